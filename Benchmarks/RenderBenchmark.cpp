@@ -0,0 +1,254 @@
+/*
+ * RenderBenchmark.cpp
+ *
+ * Measures how long each part of a GUI frame takes to render, without
+ * needing a display (uses the SDL dummy video driver unless SDL_VIDEODRIVER
+ * is already set).
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#include "../SDLWindow.hpp"
+#include "../Stats.hpp"
+#include "../StreamProcessors/CappedStorageWaveform.hpp"
+#include "TimingStats.hpp"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <utility>
+#include <vector>
+
+namespace {
+
+enum Component {
+	Clear,
+	TopText,
+	Digits,
+	AdditionalStats,
+	Waveform,
+	Flip,
+	Total,
+	NumComponents
+};
+
+const char* componentNames[NumComponents] = {
+		"clear",
+		"drawTopText",
+		"drawDigits",
+		"drawAdditionalStats",
+		"drawWaveform",
+		"flip",
+		"total"
+};
+
+/**
+ * Three periods of a noisy pulse train, as captured by the detector
+ * (1000 rpm at 44.1 kHz).
+ */
+std::vector<CappedStorageWaveform::Bin> createSyntheticWaveform(Stats& stats, size_t& triggerBin)
+{
+	const int sampleRate = 44100;
+	const int period = sampleRate * 60 / 1000;
+	CappedStorageWaveform waveform(2048, sampleRate / 200);
+
+	uint32_t lcg = 12345;
+	for (int i = 0; i < 3 * period + sampleRate / 200; i++)
+	{
+		if (i == sampleRate / 200)
+		{
+			waveform.clear();
+		}
+		lcg = lcg * 1664525u + 1013904223u;
+		int noise = int(lcg >> 24) - 128;
+		int16_t sample = ((i % period) < period / 10 ? 8000 : -1000) + noise;
+		waveform.push(sample);
+	}
+
+	triggerBin = waveform.getNumPreTriggerSamples() / waveform.getSamplesPerBin();
+
+	stats.rpm = 1000;
+	stats.filteredRpm = 999.5;
+	stats.signalMin = -1200;
+	stats.signalMax = 8200;
+	stats.thresholdInPercentage = 50;
+	stats.threshold = (stats.signalMax + stats.signalMin) / 2;
+	stats.hysteresis = (stats.signalMax - stats.signalMin) / 8;
+
+	return std::vector<CappedStorageWaveform::Bin>(waveform.getBins(), waveform.getBins() + waveform.size());
+}
+
+void runFrames(SDLWindow& win, int numFrames, const std::vector<CappedStorageWaveform::Bin>& waveform,
+		size_t triggerBin, const Stats& stats, const char* dumpPrefix)
+{
+	std::vector<TimingStats> timings;
+	for (int i = 0; i < NumComponents; i++)
+	{
+		timings.push_back(TimingStats(numFrames));
+	}
+
+	int digitScaling = 2;
+	for (int i = 8; i > 0 ; i--)
+	{
+		if (win.getHeight() > win.getDigitHeightInterdistance(i))
+		{
+			digitScaling = i;
+			break;
+		}
+	}
+
+	for (int frame = 0; frame < numFrames; frame++)
+	{
+		uint64_t t[NumComponents + 1];
+		t[0] = nowNs();
+		win.clear();
+		t[1] = nowNs();
+		win.drawTopText();
+		t[2] = nowNs();
+		win.drawDigits(1000 + frame % 9000, 4, /* showZeros */ false, /*showUnlitSegments*/ true, digitScaling);
+		t[3] = nowNs();
+		win.drawAdditionalStats(
+				stats.rpm,
+				stats.filteredRpm,
+				"mean",
+				stats.signalMax,
+				stats.signalMin,
+				stats.threshold,
+				stats.hysteresis);
+		t[4] = nowNs();
+		win.drawWaveform(
+				waveform,
+				triggerBin,
+				stats.signalMin,
+				stats.signalMax,
+				stats.threshold,
+				stats.hysteresis);
+		t[5] = nowNs();
+
+		if (dumpPrefix && frame == numFrames - 1)
+		{
+			char filename[256];
+			snprintf(filename, sizeof(filename), "%s_%dx%d.bmp", dumpPrefix, win.getWidth(), win.getHeight());
+			if (win.saveBMP(filename))
+			{
+				printf("# Saved frame to %s\n", filename);
+			}
+			else
+			{
+				fprintf(stderr, "Unable to save %s: %s\n", filename, SDL_GetError());
+			}
+			t[5] = nowNs(); // Don't count the dump
+		}
+
+		win.flip();
+		t[6] = nowNs();
+
+		for (int c = 0; c < Total; c++)
+		{
+			timings[c].add(t[c + 1] - t[c]);
+		}
+		timings[Total].add(t[6] - t[0]);
+	}
+
+	for (int c = 0; c < NumComponents; c++)
+	{
+		printf("size=%dx%d, component=%s, frames=%d, mean_us=%.2f, p99_us=%.2f\n",
+				win.getWidth(), win.getHeight(),
+				componentNames[c],
+				numFrames,
+				timings[c].mean() / 1000.0,
+				timings[c].percentile(99) / 1000.0);
+	}
+}
+
+bool parseSize(const char* str, int& w, int& h)
+{
+	return sscanf(str, "%dx%d", &w, &h) == 2 && w > 0 && h > 0;
+}
+
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+	int numFrames = 300;
+	const char* dumpPrefix = NULL;
+	std::vector<std::pair<int, int> > fullscreenSizes;
+
+	while (true)
+	{
+		static struct option long_options[] =
+		{
+				{"frames",     required_argument, 0, 'n'},
+				{"fullscreen", required_argument, 0, 's'},
+				{"dump",       required_argument, 0, 'o'},
+				{"help",       no_argument,       0, 'h'},
+				{0, 0, 0, 0}
+		};
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "n:s:o:h", long_options, &option_index);
+		if (c == -1)
+			break;
+
+		switch (c)
+		{
+		case 'n':
+			numFrames = std::max(1, atoi(optarg));
+			break;
+
+		case 's':
+		{
+			int w, h;
+			if (!parseSize(optarg, w, h))
+			{
+				fprintf(stderr, "Bad size \"%s\" (expected WIDTHxHEIGHT)\n", optarg);
+				return 1;
+			}
+			fullscreenSizes.push_back(std::make_pair(w, h));
+			break;
+		}
+
+		case 'o':
+			dumpPrefix = optarg;
+			break;
+
+		case 'h':
+		default:
+			printf(
+					"%s [options]\n"
+					"-n, --frames N         Number of frames rendered per size (default 300)\n"
+					"-s, --fullscreen WxH   Full screen size to measure (may be repeated, default 1280x720 and 1920x1080)\n"
+					"-o, --dump PREFIX      Save last frame of each size as PREFIX_WxH.bmp\n"
+					"-h, --help\n"
+					"\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (fullscreenSizes.empty())
+	{
+		fullscreenSizes.push_back(std::make_pair(1280, 720));
+		fullscreenSizes.push_back(std::make_pair(1920, 1080));
+	}
+
+	// Render offscreen unless asked otherwise
+	setenv("SDL_VIDEODRIVER", "dummy", 0);
+
+	Stats stats;
+	size_t triggerBin = 0;
+	std::vector<CappedStorageWaveform::Bin> waveform = createSyntheticWaveform(stats, triggerBin);
+
+	SDLWindow win;
+	runFrames(win, numFrames, waveform, triggerBin, stats, dumpPrefix);
+
+	for (const auto& size : fullscreenSizes)
+	{
+		win.setFullscreenResolution(size.first, size.second);
+		win.setFullscreenMode(true);
+		runFrames(win, numFrames, waveform, triggerBin, stats, dumpPrefix);
+	}
+
+	return 0;
+}
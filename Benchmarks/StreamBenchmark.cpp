@@ -0,0 +1,551 @@
+/*
+ * StreamBenchmark.cpp
+ *
+ * Throughput (ns/sample, samples/s) of the StreamProcessors and the
+ * complete detector, plus pulse latency of the detector (time from a
+ * buffer being handed to the detector, until a pulse in it is reported).
+ *
+ * Input signals come from TachometerSignalGenerator, so results are
+ * reproducible. Results can be written as JSON, for comparing commits.
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#include "../MultiRateRPMCalculatorFromAudio.hpp"
+#include "../OrderTracker.hpp"
+#include "../RPMCalculatorFromAudio.hpp"
+#include "../SignalGenerator/TachometerSignalGenerator.hpp"
+#include "../SpectralRPMEstimator.hpp"
+#include "../StreamProcessors/CappedStorageWaveform.hpp"
+#include "../StreamProcessors/MinMaxCheck.hpp"
+#include "../StreamProcessors/PreFilter.hpp"
+#include "../StreamProcessors/QuantileTracker.hpp"
+#include "../StreamProcessors/SlidingAverager.hpp"
+#include "../StreamProcessors/SlidingRpmFilter.hpp"
+#include "TimingStats.hpp"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Result {
+	std::string name;
+	std::string params;     // JSON object members, e.g. "\"rate\": 44100"
+	uint64_t numSamples;
+	double nsPerSample;
+	bool hasLatency;
+	uint64_t numPulses;
+	double latencyP50;
+	double latencyP90;
+	double latencyP99;
+	double latencyMax;
+};
+
+double g_minSeconds = 0.5;
+const char* g_filter = NULL;
+std::vector<Result> g_results;
+
+// Keeps the compiler from optimizing away the benchmarked code
+volatile int64_t g_sink;
+
+std::vector<int16_t> makeSignal(int sampleRate, double rpm, double seconds)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.sampleRate = sampleRate;
+	params.rpm = PiecewiseLinearProfile(rpm);
+	params.noise = 100;
+	params.seed = 1;
+	TachometerSignalGenerator gen(params);
+
+	std::vector<int16_t> signal(size_t(seconds * sampleRate));
+	gen.generate(signal.data(), signal.size());
+	return signal;
+}
+
+bool isSelected(const std::string& name)
+{
+	return !g_filter || name.find(g_filter) != std::string::npos;
+}
+
+/**
+ * Runs body(signal) repeatedly until at least g_minSeconds passed.
+ */
+template<class Body>
+void measureThroughput(const std::string& name, const std::string& params,
+		const std::vector<int16_t>& signal, Body body)
+{
+	Result r;
+	r.name = name;
+	r.params = params;
+	r.hasLatency = false;
+	r.numPulses = 0;
+
+	body(signal); // Warm up
+
+	uint64_t samples = 0;
+	uint64_t start = nowNs();
+	uint64_t elapsed;
+	do
+	{
+		body(signal);
+		samples += signal.size();
+		elapsed = nowNs() - start;
+	} while (elapsed < g_minSeconds * 1e9);
+
+	r.numSamples = samples;
+	r.nsPerSample = double(elapsed) / samples;
+	g_results.push_back(r);
+
+	printf("%-48s %-40s %8.2f ns/sample %10.2f Msamples/s\n",
+			name.c_str(), params.c_str(), r.nsPerSample, 1e3 / r.nsPerSample);
+}
+
+void benchMinMaxCheck()
+{
+	const std::string name = "MinMaxCheck::check";
+	if (!isSelected(name))
+	{
+		return;
+	}
+
+	const int rates[] = { 44100, 96000, 192000 };
+	for (int rate : rates)
+	{
+		std::vector<int16_t> signal = makeSignal(rate, 1000, 1);
+		MinMaxCheck minMax(rate / 5, 13);
+		char params[100];
+		snprintf(params, sizeof(params), "\"rate\": %d", rate);
+		measureThroughput(name, params, signal, [&](const std::vector<int16_t>& s) {
+			for (int16_t v : s)
+			{
+				minMax.check(v);
+			}
+			g_sink = minMax.getMax() + minMax.getMin();
+		});
+	}
+}
+
+void benchQuantileTracker()
+{
+	const std::string name = "QuantileTracker::push";
+	if (!isSelected(name))
+	{
+		return;
+	}
+
+	const int rates[] = { 44100, 96000, 192000 };
+	for (int rate : rates)
+	{
+		std::vector<int16_t> signal = makeSignal(rate, 1000, 1);
+		QuantileTracker quantiles(size_t(rate / 5) * 13, 1, 99);
+		char params[100];
+		snprintf(params, sizeof(params), "\"rate\": %d", rate);
+		measureThroughput(name, params, signal, [&](const std::vector<int16_t>& s) {
+			for (int16_t v : s)
+			{
+				quantiles.push(v);
+			}
+			g_sink = quantiles.getHigh() + quantiles.getLow();
+		});
+	}
+}
+
+void benchSlidingAverager()
+{
+	const std::string name = "SlidingAverager";
+	if (!isSelected(name))
+	{
+		return;
+	}
+
+	const int windowSizes[] = { 10, 100 };
+	for (int windowSize : windowSizes)
+	{
+		// One value per "sample", to measure cost per pushed value
+		std::vector<int16_t> signal = makeSignal(44100, 1000, 0.1);
+		SlidingAverager averager(windowSize);
+		char params[100];
+		snprintf(params, sizeof(params), "\"window\": %d", windowSize);
+		measureThroughput(name, params, signal, [&](const std::vector<int16_t>& s) {
+			double sum = 0;
+			for (int16_t v : s)
+			{
+				averager.push(v);
+				sum += averager.getAverage();
+			}
+			g_sink = int64_t(sum);
+		});
+	}
+}
+
+void benchSlidingRpmFilter()
+{
+	const std::string name = "SlidingRpmFilter";
+	if (!isSelected(name))
+	{
+		return;
+	}
+
+	const int windowSizes[] = { 10, 100 };
+	for (int windowSize : windowSizes)
+	{
+		for (int filter = MeanFilter; filter <= HampelFilter; filter++)
+		{
+			// One value per "sample", to measure cost per pushed value
+			std::vector<int16_t> signal = makeSignal(44100, 1000, 0.1);
+			SlidingRpmFilter::Parameters filterParams;
+			filterParams.filter = RpmFilter(filter);
+			filterParams.windowSize = windowSize;
+			SlidingRpmFilter rpmFilter(filterParams);
+			char params[100];
+			snprintf(params, sizeof(params), "\"window\": %d, \"filter\": \"%s\"",
+					windowSize, getRpmFilterName(RpmFilter(filter)));
+			measureThroughput(name, params, signal, [&](const std::vector<int16_t>& s) {
+				double sum = 0;
+				for (int16_t v : s)
+				{
+					rpmFilter.push(v);
+					sum += rpmFilter.getValue();
+				}
+				g_sink = int64_t(sum);
+			});
+		}
+	}
+}
+
+void benchCappedStorageWaveform()
+{
+	const std::string name = "CappedStorageWaveform::push";
+	if (!isSelected(name))
+	{
+		return;
+	}
+
+	const int numBins[] = { 1024, 2048, 4096 };
+	const double rpms[] = { 100, 3000 };
+	for (int bins : numBins)
+	{
+		for (double rpm : rpms)
+		{
+			const int rate = 44100;
+			std::vector<int16_t> signal = makeSignal(rate, rpm, 1);
+			const size_t capturedPeriod = size_t(3 * 60.0 * rate / rpm);
+			CappedStorageWaveform waveform(bins, rate / 200);
+			char params[100];
+			snprintf(params, sizeof(params), "\"bins\": %d, \"rpm\": %g", bins, rpm);
+			size_t pos = 0;
+			measureThroughput(name, params, signal, [&](const std::vector<int16_t>& s) {
+				for (int16_t v : s)
+				{
+					waveform.push(v);
+					if (++pos == capturedPeriod)
+					{
+						// Like the detector, restart capture every three periods
+						pos = 0;
+						waveform.clear();
+					}
+				}
+				g_sink = waveform.size();
+			});
+		}
+	}
+}
+
+void benchPreFilter()
+{
+	const std::string name = "PreFilter::processBlock";
+	if (!isSelected(name))
+	{
+		return;
+	}
+
+	const char* specs[] = { "dc", "lowpass:2000", "dc,bandpass:20-2000", "dc,bandpass:20-2000,sections:2" };
+	for (const char* spec : specs)
+	{
+		std::vector<int16_t> signal = makeSignal(44100, 3000, 1);
+		PreFilter::Parameters filterParams;
+		filterParams.parse(spec);
+		PreFilter filter(44100, filterParams);
+		char params[100];
+		snprintf(params, sizeof(params), "\"filter\": \"%s\"", spec);
+		measureThroughput(name, params, signal, [&](const std::vector<int16_t>& s) {
+			for (size_t pos = 0; pos < s.size(); pos += 1024)
+			{
+				filter.processBlock(&s[pos], std::min<size_t>(1024, s.size() - pos), 1,
+						[&](const int16_t* filtered, size_t count) { g_sink = filtered[count - 1]; });
+			}
+		});
+	}
+}
+
+void benchSpectralRPMEstimator()
+{
+	const std::string name = "SpectralRPMEstimator::processBlock";
+	if (!isSelected(name))
+	{
+		return;
+	}
+
+	// Real time needs less than 1e9 / rate ns/sample (5208 at 192 kHz)
+	const int rates[] = { 44100, 96000, 192000 };
+	for (int rate : rates)
+	{
+		std::vector<int16_t> signal = makeSignal(rate, 6000, 2);
+		SpectralRPMEstimator estimator(rate, 1);
+		estimator.setEstimateCallback([&](const SpectralEstimate& e) { g_sink = int64_t(e.rpm); });
+		char params[100];
+		snprintf(params, sizeof(params), "\"rate\": %d, \"frame\": %zu, \"hop\": %zu",
+				rate, estimator.getFrameSize(), estimator.getHopSize());
+		measureThroughput(name, params, signal, [&](const std::vector<int16_t>& s) {
+			for (size_t pos = 0; pos < s.size(); pos += 1024)
+			{
+				estimator.processBlock(&s[pos], std::min<size_t>(1024, s.size() - pos));
+			}
+		});
+	}
+}
+
+void benchOrderTracker()
+{
+	const std::string name = "OrderTracker::processBlock";
+	if (!isSelected(name))
+	{
+		return;
+	}
+
+	// The tachometer signal as vibration, with a pulse every revolution.
+	// Resampling costs about the same per input sample at any speed.
+	const double rpms[] = { 600, 3000, 12000 };
+	for (double rpm : rpms)
+	{
+		std::vector<int16_t> signal = makeSignal(44100, rpm, 2);
+		OrderTracker tracker(44100);
+		tracker.setSpectrumCallback([&](const OrderSpectrum& s) { g_sink = int64_t(s.orders[1]); });
+		double period = 60.0 * 44100 / rpm;
+		double nextPulse = period / 2;
+		char params[100];
+		snprintf(params, sizeof(params), "\"rpm\": %g, \"points\": %zu", rpm, tracker.getSamplesPerRevolution());
+		measureThroughput(name, params, signal, [&](const std::vector<int16_t>& s) {
+			for (size_t pos = 0; pos < s.size(); pos += 1024)
+			{
+				size_t n = std::min<size_t>(1024, s.size() - pos);
+				for (; nextPulse < tracker.getSampleIndex() + n; nextPulse += period)
+				{
+					tracker.addPulse(nextPulse);
+				}
+				tracker.processBlock(&s[pos], n);
+			}
+		});
+	}
+}
+
+void consumeWaveforms(RPMCalculatorFromAudio& detector)
+{
+	detector.setWaveformCallback([&](const CappedStorageWaveform& w, const PulseEvent&) {
+		g_sink = w.size();
+	});
+}
+
+template<class Detector>
+void consumeWaveforms(Detector&) { }
+
+/// Gives MultiRateRPMCalculatorFromAudio the constructor benchDetector() expects
+template<size_t Decimation>
+struct DecimatingDetector : public MultiRateRPMCalculatorFromAudio {
+	DecimatingDetector(int rate, int divisor) : MultiRateRPMCalculatorFromAudio(rate, divisor, Decimation) { }
+};
+
+/// The detector with the signal range from the 1st and 99th percentiles
+template<class Detector>
+struct QuantileRangeDetector : public Detector {
+	QuantileRangeDetector(int rate, int divisor) : Detector(rate, divisor) { this->setRangeQuantiles(1, 99); }
+};
+
+/// The detector with the signal range tracked over 8 periods
+template<class Detector>
+struct RangeWindowDetector : public Detector {
+	RangeWindowDetector(int rate, int divisor) : Detector(rate, divisor) { this->setRangeWindowPeriods(8); }
+};
+
+template<class Detector>
+void benchDetector(const std::string& name)
+{
+	if (!isSelected(name))
+	{
+		return;
+	}
+
+	const int rates[] = { 44100, 96000, 192000 };
+	const double rpms[] = { 600, 6000, 30000 };
+	const size_t blockSizes[] = { 64, 1024, 4096 };
+
+	for (int rate : rates)
+	{
+		for (double rpm : rpms)
+		{
+			std::vector<int16_t> signal = makeSignal(rate, rpm, 2);
+			for (size_t blockSize : blockSizes)
+			{
+				Result r;
+				r.name = name;
+				char params[100];
+				snprintf(params, sizeof(params), "\"rate\": %d, \"rpm\": %g, \"block\": %zu", rate, rpm, blockSize);
+				r.params = params;
+				r.hasLatency = true;
+
+				Detector detector(rate, 1);
+				TimingStats latency(size_t(g_minSeconds * 100 * rpm / 60) + 1000);
+				uint64_t blockStart = 0;
+				detector.setPulseCallback([&](const PulseEvent&) {
+					latency.add(nowNs() - blockStart);
+				});
+				consumeWaveforms(detector);
+
+				uint64_t samples = 0;
+				uint64_t processingNs = 0;
+				uint64_t start = nowNs();
+				do
+				{
+					for (size_t pos = 0; pos < signal.size(); pos += blockSize)
+					{
+						size_t end = std::min(signal.size(), pos + blockSize);
+						blockStart = nowNs();
+						detector.processBlock(&signal[pos], end - pos);
+						processingNs += nowNs() - blockStart;
+					}
+					samples += signal.size();
+				} while (nowNs() - start < g_minSeconds * 1e9);
+
+				r.numSamples = samples;
+				r.nsPerSample = double(processingNs) / samples;
+				r.numPulses = latency.count();
+				r.latencyP50 = latency.percentile(50);
+				r.latencyP90 = latency.percentile(90);
+				r.latencyP99 = latency.percentile(99);
+				r.latencyMax = latency.percentile(100);
+				g_results.push_back(r);
+
+				printf("%-48s %-40s %8.2f ns/sample %10.2f Msamples/s  latency p50/p99 %8.0f/%8.0f ns\n",
+						name.c_str(), params, r.nsPerSample, 1e3 / r.nsPerSample,
+						r.latencyP50, r.latencyP99);
+			}
+		}
+	}
+}
+
+bool writeJson(const char* filename)
+{
+	FILE* f = strcmp(filename, "-") == 0 ? stdout : fopen(filename, "w");
+	if (!f)
+	{
+		perror(filename);
+		return false;
+	}
+
+	fprintf(f, "{\n  \"benchmarks\": [\n");
+	for (size_t i = 0; i < g_results.size(); i++)
+	{
+		const Result& r = g_results[i];
+		fprintf(f, "    {\"name\": \"%s\", \"params\": {%s}, \"samples\": %llu, "
+				"\"ns_per_sample\": %.4f, \"samples_per_second\": %.0f",
+				r.name.c_str(), r.params.c_str(), (unsigned long long)r.numSamples,
+				r.nsPerSample, 1e9 / r.nsPerSample);
+		if (r.hasLatency)
+		{
+			fprintf(f, ", \"pulses\": %llu, \"latency_ns\": "
+					"{\"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"max\": %.0f}",
+					(unsigned long long)r.numPulses,
+					r.latencyP50, r.latencyP90, r.latencyP99, r.latencyMax);
+		}
+		fprintf(f, "}%s\n", i + 1 < g_results.size() ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+
+	if (f != stdout)
+	{
+		fclose(f);
+	}
+	return true;
+}
+
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+	const char* jsonFilename = NULL;
+
+	while (true)
+	{
+		static struct option long_options[] =
+		{
+				{"json",    required_argument, 0, 'j'},
+				{"time",    required_argument, 0, 't'},
+				{"filter",  required_argument, 0, 'f'},
+				{"help",    no_argument,       0, 'h'},
+				{0, 0, 0, 0}
+		};
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "j:t:f:h", long_options, &option_index);
+		if (c == -1)
+			break;
+
+		switch (c)
+		{
+		case 'j':
+			jsonFilename = optarg;
+			break;
+
+		case 't':
+			g_minSeconds = atof(optarg);
+			break;
+
+		case 'f':
+			g_filter = optarg;
+			break;
+
+		case 'h':
+		default:
+			printf(
+					"%s [options]\n"
+					"-j, --json FILE     Write results as JSON to FILE (- for stdout)\n"
+					"-t, --time SECONDS  Minimum time spent on each case (default 0.5)\n"
+					"-f, --filter TEXT   Only run benchmarks with TEXT in their name\n"
+					"-h, --help\n"
+					"\n", argv[0]);
+			return 1;
+		}
+	}
+
+	benchMinMaxCheck();
+	benchQuantileTracker();
+	benchSlidingAverager();
+	benchSlidingRpmFilter();
+	benchCappedStorageWaveform();
+	benchPreFilter();
+	benchDetector<RPMCalculatorFromAudio>("RPMCalculatorFromAudio::processBlock");
+	benchDetector<BasicRPMCalculatorFromAudio<false> >("BlindRPMCalculatorFromAudio::processBlock");
+	benchDetector<FixedPointRPMCalculatorFromAudio>("FixedPointRPMCalculatorFromAudio::processBlock");
+	benchDetector<QuantileRangeDetector<BasicRPMCalculatorFromAudio<false> > >("BlindRPMCalculatorFromAudio/quantiles::processBlock");
+	benchDetector<QuantileRangeDetector<FixedPointRPMCalculatorFromAudio> >("FixedPointRPMCalculatorFromAudio/quantiles::processBlock");
+	benchDetector<RangeWindowDetector<BasicRPMCalculatorFromAudio<false> > >("BlindRPMCalculatorFromAudio/window::processBlock");
+	benchDetector<RangeWindowDetector<FixedPointRPMCalculatorFromAudio> >("FixedPointRPMCalculatorFromAudio/window::processBlock");
+	benchDetector<DecimatingDetector<4> >("MultiRateRPMCalculatorFromAudio/4::processBlock");
+	benchDetector<DecimatingDetector<16> >("MultiRateRPMCalculatorFromAudio/16::processBlock");
+	benchSpectralRPMEstimator();
+	benchOrderTracker();
+
+	if (jsonFilename && !writeJson(jsonFilename))
+	{
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * TimingStats.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include "../Stopwatch.hpp"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+/**
+ * Collects durations (in ns) and reports mean and percentiles.
+ * Space for the expected number of samples should be reserved up front,
+ * so collecting does not allocate while timing.
+ */
+class TimingStats {
+public:
+	explicit TimingStats(size_t expectedNumSamples = 0)
+	{
+		_samples.reserve(expectedNumSamples);
+	}
+
+	void add(uint64_t ns) { _samples.push_back(ns); }
+
+	size_t count() const { return _samples.size(); }
+
+	double mean() const
+	{
+		if (_samples.empty())
+		{
+			return 0;
+		}
+		double sum = 0;
+		for (uint64_t s : _samples)
+		{
+			sum += s;
+		}
+		return sum / _samples.size();
+	}
+
+	/**
+	 * @param p percentile in range [0, 100]
+	 * @warning reorders the collected samples
+	 */
+	uint64_t percentile(double p)
+	{
+		if (_samples.empty())
+		{
+			return 0;
+		}
+		size_t idx = std::min(_samples.size() - 1, size_t(p / 100.0 * _samples.size()));
+		std::nth_element(_samples.begin(), _samples.begin() + idx, _samples.end());
+		return _samples[idx];
+	}
+
+	void clear() { _samples.clear(); }
+
+private:
+	std::vector<uint64_t> _samples;
+};
@@ -0,0 +1,436 @@
+/*
+ * FixedPointRPMCalculatorFromAudio.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include "SeqLock.hpp"
+#include "StreamProcessors/BlockKernels.hpp"
+#include "StreamProcessors/DetectorStages.hpp"
+#include "StreamProcessors/MinMaxCheck.hpp"
+#include "StreamProcessors/PulseEvent.hpp"
+#include "StreamProcessors/QuantileTracker.hpp"
+#include "StreamProcessors/SlidingRpmFilter.hpp"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <mutex>
+
+/**
+ * Integer only variant of the detector without waveform capture, for
+ * boards where float and double math (and especially division) is slow.
+ *
+ * - The threshold is kept in Q16 (16 fractional bits), and the levels the
+ *   samples are compared against are plain integers.
+ * - The period is counted in integer samples, plus the crossing offsets in
+ *   Q16 (linear interpolation, see CrossingInterpolatorStage). The rpm is
+ *   derived with one division per pulse, in Q8 (1/256 rpm resolution).
+ * - The filtered rpm is an integer BasicSlidingRpmFilter over the last 10
+ *   pulses, kept as a fraction until it is reported.
+ * - processBlock() skips over runs of samples that can not change anything
+ *   (inside min/max, and on the quiet side of the Schmitt trigger) using the
+ *   BlockKernels (not with setRangeQuantiles(), as every sample moves the
+ *   percentiles).
+ *
+ * Values are only converted to double when a PulseEvent is reported.
+ * Results match RPMCalculatorFromAudio, except that the Q16 threshold may
+ * round differently from the float one, moving an edge by a sample now and
+ * then (see FixedPointRPMCalculatorFromAudio_Test for the tolerances).
+ */
+class FixedPointRPMCalculatorFromAudio {
+public:
+	typedef std::function<void(const PulseEvent&)> PulseCallback;
+
+	FixedPointRPMCalculatorFromAudio(int audioSampleRate, int divisor, int requiredAmplitude = 3) :
+		_audioSampleRate(audioSampleRate),
+		_rpmNumeratorQ8((uint64_t(60) * audioSampleRate << RpmFractionBits) / divisor),
+		_requiredAmplitude(requiredAmplitude),
+		_window(audioSampleRate),
+		_minMax(_window.getSamplesPerSegment(), RangeWindowAdapter::NumSegments),
+		_control(initialControl()),
+		_controlVersion(_control.getVersion()),
+		_percentage(-1),
+		_percentageQ16(0),
+		_signalMin(0),
+		_signalMax(0),
+		_thresholdQ16(0),
+		_hysteresis(1),
+		_triggerLevel(0),
+		_riseLevel(std::numeric_limits<int32_t>::max()),
+		_fallLevel(-1),
+		_state(Uninitialized),
+		_periodCounter(0),
+		_sampleIndex(0),
+		_previousSample(0),
+		_interpolate(true),
+		_lastCrossingOffsetQ16(0)
+	{
+		assert((uint64_t(60) * audioSampleRate << RpmFractionBits) / divisor <= std::numeric_limits<uint32_t>::max());
+		setPercentage(_control.load().thresholdPercentage);
+	}
+
+	void setPulseCallback(const PulseCallback& callback) { _pulseCallback = callback; }
+
+	/**
+	 * Where the threshold is placed between min and max of the signal.
+	 * Safe to call from any thread. Takes effect at the start of the next block.
+	 */
+	void setThresholdPercentage(int percentage)
+	{
+		std::lock_guard<std::mutex> lock(_controlMutex);
+		DetectorControl control = _control.load();
+		if (control.thresholdPercentage != percentage)
+		{
+			control.thresholdPercentage = percentage;
+			_control.store(control);
+		}
+	}
+
+	int getThresholdPercentage() const { return _control.load().thresholdPercentage; }
+
+	/// See BasicRPMCalculatorFromAudio::setRpmFilter()
+	void setRpmFilter(RpmFilter filter)
+	{
+		std::lock_guard<std::mutex> lock(_controlMutex);
+		DetectorControl control = _control.load();
+		if (control.rpmFilter != filter)
+		{
+			control.rpmFilter = filter;
+			_control.store(control);
+		}
+	}
+
+	RpmFilter getRpmFilter() const { return _control.load().rpmFilter; }
+
+	int getSampleRate() const { return _audioSampleRate; }
+
+	/**
+	 * Linear by default. Cubic is not available in fixed point, and gives linear.
+	 * Must not be changed while another thread is calling check().
+	 */
+	void setCrossingInterpolation(CrossingInterpolation interpolation)
+	{
+		_interpolate = interpolation != NoInterpolation;
+	}
+
+	/// See BasicRPMCalculatorFromAudio::setRangeQuantiles()
+	void setRangeQuantiles(double lowPercent, double highPercent)
+	{
+		_quantiles = (lowPercent > 0 || highPercent < 100) ?
+				QuantileTracker(_window.getMaxWindowSize(), lowPercent, highPercent) : QuantileTracker();
+		resizeWindow();
+	}
+
+	/// See BasicRPMCalculatorFromAudio::setRangeWindowPeriods()
+	void setRangeWindowPeriods(int periods)
+	{
+		_window.setPeriodsPerWindow(periods);
+		resizeWindow();
+	}
+
+	void check(int16_t sample)
+	{
+		beginBlock();
+		checkOne(sample);
+	}
+
+	/**
+	 * Same as calling check() for samples[0], samples[stride], ... samples[(n - 1) * stride].
+	 * Other strides than 1 are copied to a scratch buffer, a chunk at a time,
+	 * so interleaved channels also get the fast path.
+	 */
+	void processBlock(const int16_t* samples, size_t n, size_t stride = 1)
+	{
+		beginBlock();
+		if (_quantiles.isEnabled())
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				checkOne(samples[i * stride]);
+			}
+			return;
+		}
+		if (stride == 1)
+		{
+			processContiguous(samples, n);
+			return;
+		}
+		for (size_t pos = 0; pos < n; pos += ScratchSize)
+		{
+			size_t m = std::min<size_t>(n - pos, ScratchSize);
+			const int16_t* src = samples + pos * stride;
+			for (size_t i = 0; i < m; i++)
+			{
+				_scratch[i] = src[i * stride];
+			}
+			processContiguous(_scratch, m);
+		}
+	}
+
+private:
+	enum { ThresholdFractionBits = 16, RpmFractionBits = 8 };
+	enum { ScratchSize = 256 };  // Samples deinterleaved at a time
+
+	enum State {
+		Uninitialized,
+		WasBelow,
+		WasAbove
+	};
+
+	int _audioSampleRate;
+	uint32_t _rpmNumeratorQ8;   // 60 * rate / divisor, so rpm = numerator / period
+	int _requiredAmplitude;
+	RangeWindowAdapter _window;     // Must be constructed before _minMax
+	MinMaxCheck _minMax;
+	QuantileTracker _quantiles;     // Used instead of _minMax when enabled
+
+	std::mutex _controlMutex;   // Serializes writers of _control
+	SeqLockValue<DetectorControl> _control;
+	uint32_t _controlVersion;
+	int _percentage;
+	int32_t _percentageQ16;
+
+	// Levels for the current min/max (see PipelineContext for what they mean)
+	int32_t _signalMin;
+	int32_t _signalMax;
+	int32_t _thresholdQ16;
+	int32_t _hysteresis;
+	int32_t _triggerLevel;
+	int32_t _riseLevel;
+	int32_t _fallLevel;
+
+	State _state;
+	uint32_t _periodCounter;
+	uint64_t _sampleIndex;
+	int32_t _previousSample;
+	bool _interpolate;
+	int32_t _lastCrossingOffsetQ16;
+
+	BasicSlidingRpmFilter<uint32_t, uint64_t> _rpmFilter;     // Of the rpm in Q8
+
+	PulseCallback _pulseCallback;
+	int16_t _scratch[ScratchSize];
+
+	static DetectorControl initialControl()
+	{
+		DetectorControl control;
+		control.thresholdPercentage = 50;
+		control.rpmFilter = MeanFilter;
+		return control;
+	}
+
+	void beginBlock()
+	{
+		uint32_t version = _control.getVersion();
+		if (version != _controlVersion)
+		{
+			_controlVersion = version;
+			DetectorControl control = _control.load();
+			setPercentage(control.thresholdPercentage);
+			_rpmFilter.setFilter(control.rpmFilter);
+		}
+	}
+
+	/// Uses the BlockKernels to skip over quiet runs
+	void processContiguous(const int16_t* samples, size_t n)
+	{
+		size_t i = 0;
+		while (i < n)
+		{
+			// Nothing but the counters change while the samples stay inside the
+			// quiet range, up to the end of the current MinMaxCheck segment (or
+			// until the window grows, which happens in checkOne())
+			size_t run = std::min(n - i, std::min(_minMax.getSamplesLeftInSegment(), _window.getSamplesBeforeGrowth()));
+			int32_t lo;
+			int32_t hi;
+			getQuietRange(lo, hi);
+			size_t numQuiet = BlockKernels::findFirstOutside(samples + i, run, lo, hi);
+			if (numQuiet)
+			{
+				_minMax.checkBlock(samples + i, numQuiet);
+				_window.advance(numQuiet);
+				_periodCounter += numQuiet;
+				_sampleIndex += numQuiet;
+				i += numQuiet;
+				_previousSample = samples[i - 1];
+				updateLevels();
+			}
+			if (numQuiet < run || run == 0)
+			{
+				checkOne(samples[i]);
+				i++;
+			}
+		}
+	}
+
+	void setPercentage(int percentage)
+	{
+		if (percentage != _percentage)
+		{
+			_percentage = percentage;
+			_percentageQ16 = ((percentage << ThresholdFractionBits) + 50) / 100;
+			// Forces the levels to be recomputed after the next sample (which is
+			// also when the float detector picks up the new percentage)
+			_signalMin = std::numeric_limits<int32_t>::max();
+		}
+	}
+
+	void resizeWindow()
+	{
+		_minMax.setSamplesPerSegment(_window.getSamplesPerSegment());
+		if (_quantiles.isEnabled())
+		{
+			_quantiles.setWindowSize(_window.getWindowSize());
+		}
+	}
+
+	int32_t getRangeMin() const { return _quantiles.isEnabled() ? _quantiles.getLow() : _minMax.getMin(); }
+	int32_t getRangeMax() const { return _quantiles.isEnabled() ? _quantiles.getHigh() : _minMax.getMax(); }
+
+	void updateLevels()
+	{
+		int32_t signalMin = getRangeMin();
+		int32_t signalMax = getRangeMax();
+		if (signalMin == _signalMin && signalMax == _signalMax)
+		{
+			return;
+		}
+		_signalMin = signalMin;
+		_signalMax = signalMax;
+
+		int32_t range = signalMax - signalMin;
+		_thresholdQ16 = int32_t(int64_t(signalMin) * (1 << ThresholdFractionBits) + int64_t(range) * _percentageQ16);
+		_hysteresis = range / 8;
+		_triggerLevel = (_thresholdQ16 + (1 << ThresholdFractionBits) - 1) >> ThresholdFractionBits;
+		_riseLevel = range > _requiredAmplitude ? _triggerLevel + _hysteresis : std::numeric_limits<int32_t>::max();
+		_fallLevel = _triggerLevel - _hysteresis;
+	}
+
+	/// Samples in [lo, hi] do not change the state or the levels
+	void getQuietRange(int32_t& lo, int32_t& hi) const
+	{
+		lo = _signalMin;
+		hi = _signalMax;
+		switch(_state)
+		{
+		case Uninitialized:
+			hi = std::min(hi, _triggerLevel - 1);
+			break;
+		case WasBelow:
+			hi = std::min<int64_t>(hi, int64_t(_riseLevel) - 1);
+			break;
+		case WasAbove:
+			lo = std::max(lo, _fallLevel);
+			break;
+		}
+	}
+
+	void checkOne(int16_t sample)
+	{
+		if (_window.isEnabled() && _window.advance(1))
+		{
+			resizeWindow();
+		}
+		if (_quantiles.isEnabled())
+		{
+			_quantiles.push(sample);
+		}
+		else
+		{
+			_minMax.check(sample);
+		}
+		_periodCounter++;
+
+		switch(_state)
+		{
+		case Uninitialized:
+			if (sample >= _triggerLevel)
+			{
+				_state = WasAbove;
+				_periodCounter = 0;
+				_lastCrossingOffsetQ16 = 0;
+			}
+			break;
+
+		case WasBelow:
+			if (sample >= _riseLevel)
+			{
+				_state = WasAbove;
+				reportPulse(sample);
+			}
+			break;
+
+		case WasAbove:
+			if (sample < _fallLevel)
+			{
+				_state = WasBelow;
+			}
+			break;
+		}
+
+		updateLevels();
+		_sampleIndex++;
+		_previousSample = sample;
+	}
+
+	/// @return where between the previous sample and this one the rise level was crossed, in Q16 (-1 .. 0)
+	int32_t getCrossingOffsetQ16(int32_t sample) const
+	{
+		if (!_interpolate || sample <= _previousSample)
+		{
+			return 0;
+		}
+		const int64_t one = 1 << ThresholdFractionBits;
+		int64_t riseLevelQ16 = _thresholdQ16 + _hysteresis * one;
+		int64_t fractionQ16 = (riseLevelQ16 - _previousSample * one) / (sample - _previousSample);
+		return int32_t(std::min(std::max<int64_t>(fractionQ16, 0), one) - one);
+	}
+
+	void reportPulse(int32_t sample)
+	{
+		const int64_t one = 1 << ThresholdFractionBits;
+		int32_t crossingOffsetQ16 = getCrossingOffsetQ16(sample);
+		int64_t periodQ16 = std::max<int64_t>(_periodCounter * one + crossingOffsetQ16 - _lastCrossingOffsetQ16, one);
+		_lastCrossingOffsetQ16 = crossingOffsetQ16;
+		uint32_t rpmQ8 = uint32_t((uint64_t(_rpmNumeratorQ8) << ThresholdFractionBits) / uint64_t(periodQ16));
+
+		_rpmFilter.push(rpmQ8);
+
+		if (_window.isEnabled())
+		{
+			uint32_t filteredPeriod = uint32_t(uint64_t(_rpmNumeratorQ8) * _rpmFilter.getDenominator() /
+					std::max<uint64_t>(_rpmFilter.getNumerator(), 1));
+			if (_window.pulse(uint32_t(periodQ16 >> ThresholdFractionBits), filteredPeriod))
+			{
+				resizeWindow();
+			}
+		}
+
+		if (_pulseCallback)
+		{
+			const double rpmScale = 1.0 / (1 << RpmFractionBits);
+			PulseEvent event;
+			event.sampleIndex = _sampleIndex;
+			event.crossingTime = _sampleIndex + crossingOffsetQ16 * (1.0 / one);
+			event.periodInSamples = periodQ16 * (1.0 / one);
+			event.rpm = rpmQ8 * rpmScale;
+			event.filteredRpm = _rpmFilter.getValue() * rpmScale;
+			event.threshold = _thresholdQ16 * (1.0 / (1 << ThresholdFractionBits));
+			event.hysteresis = _hysteresis;
+			event.signalMin = getRangeMin();
+			event.signalMax = getRangeMax();
+			event.thresholdInPercentage = _percentage;
+			_pulseCallback(event);
+		}
+
+		_periodCounter = 0;
+	}
+};
@@ -0,0 +1,368 @@
+/*
+ * gstrpmdetect.cpp
+ *
+ * GStreamer element running the detector inside a pipeline. Audio passes
+ * through untouched (in place, no copy), and each detected pulse is posted on
+ * the bus as an element message named "rpmdetect":
+ *
+ *   sample-index   guint64  Sample completing the rising edge, counted since caps were set
+ *   timestamp      guint64  Stream time of that sample (buffer PTS + offset), if buffers are timestamped
+ *   running-time   guint64  Running time of that sample (for comparing with the pipeline clock)
+ *   period         gdouble  Distance to previous rising edge, in samples
+ *   rpm            gdouble
+ *   rpm-filtered   gdouble
+ *   threshold      gdouble
+ *   hysteresis     gdouble
+ *   signal-min     gint
+ *   signal-max     gint
+ *
+ *   gst-launch-1.0 -m alsasrc ! audioconvert ! audio/x-raw,format=S16LE ! rpmdetect divisor=2 ! fakesink
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#include "../RPMCalculatorFromAudio.hpp"
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include <gst/base/gstbasetransform.h>
+
+#ifndef PACKAGE
+#define PACKAGE "rpmrevolutionmeter"
+#endif
+#ifndef VERSION
+#define VERSION "1.0"
+#endif
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_RPM_DETECT (gst_rpm_detect_get_type())
+#define GST_RPM_DETECT(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_RPM_DETECT, GstRpmDetect))
+
+typedef struct _GstRpmDetect GstRpmDetect;
+typedef struct _GstRpmDetectClass GstRpmDetectClass;
+
+struct _GstRpmDetect {
+	GstBaseTransform parent;
+
+	/* properties, protected by the object lock */
+	gint divisor;
+	gint amplitude;
+	gint thresholdPercentage;
+	gint channel;
+	gboolean postMessages;
+
+	/* streaming thread only */
+	BlindRPMCalculatorFromAudio* detector;
+	GstAudioInfo info;
+	gint activeChannel;         /* channel, when caps were set */
+	gboolean posting;           /* postMessages, when the current buffer arrived */
+	guint64 numSamples;         /* Processed since caps were set */
+	guint64 bufferFirstSample;  /* numSamples at start of current buffer */
+	GstClockTime bufferPts;
+};
+
+struct _GstRpmDetectClass {
+	GstBaseTransformClass parent_class;
+};
+
+GType gst_rpm_detect_get_type(void);
+
+G_END_DECLS
+
+GST_DEBUG_CATEGORY_STATIC(gst_rpm_detect_debug);
+#define GST_CAT_DEFAULT gst_rpm_detect_debug
+
+enum {
+	PROP_0,
+	PROP_DIVISOR,
+	PROP_AMPLITUDE,
+	PROP_THRESHOLD_PERCENTAGE,
+	PROP_CHANNEL,
+	PROP_POST_MESSAGES
+};
+
+#define DEFAULT_DIVISOR 1
+#define DEFAULT_AMPLITUDE 3
+#define DEFAULT_THRESHOLD_PERCENTAGE 50
+#define DEFAULT_CHANNEL 0
+#define DEFAULT_POST_MESSAGES TRUE
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE("sink",
+		GST_PAD_SINK,
+		GST_PAD_ALWAYS,
+		GST_STATIC_CAPS("audio/x-raw, format = (string) " GST_AUDIO_NE(S16) ", "
+				"rate = (int) [ 1000, MAX ], channels = (int) [ 1, MAX ], "
+				"layout = (string) interleaved"));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE("src",
+		GST_PAD_SRC,
+		GST_PAD_ALWAYS,
+		GST_STATIC_CAPS("audio/x-raw, format = (string) " GST_AUDIO_NE(S16) ", "
+				"rate = (int) [ 1000, MAX ], channels = (int) [ 1, MAX ], "
+				"layout = (string) interleaved"));
+
+#define gst_rpm_detect_parent_class parent_class
+G_DEFINE_TYPE(GstRpmDetect, gst_rpm_detect, GST_TYPE_BASE_TRANSFORM);
+
+
+static void gst_rpm_detect_post_pulse(GstRpmDetect* self, const PulseEvent& event)
+{
+	GstClockTime timestamp = GST_CLOCK_TIME_NONE;
+	GstClockTime runningTime = GST_CLOCK_TIME_NONE;
+	if (GST_CLOCK_TIME_IS_VALID(self->bufferPts))
+	{
+		guint64 offset = event.sampleIndex - self->bufferFirstSample;
+		timestamp = self->bufferPts + gst_util_uint64_scale_int(offset, GST_SECOND, GST_AUDIO_INFO_RATE(&self->info));
+		GstSegment* segment = &GST_BASE_TRANSFORM(self)->segment;
+		runningTime = gst_segment_to_running_time(segment, GST_FORMAT_TIME, timestamp);
+	}
+
+	GstStructure* s = gst_structure_new("rpmdetect",
+			"sample-index", G_TYPE_UINT64, (guint64)event.sampleIndex,
+			"timestamp", G_TYPE_UINT64, (guint64)timestamp,
+			"running-time", G_TYPE_UINT64, (guint64)runningTime,
+			"period", G_TYPE_DOUBLE, (gdouble)event.periodInSamples,
+			"rpm", G_TYPE_DOUBLE, event.rpm,
+			"rpm-filtered", G_TYPE_DOUBLE, event.filteredRpm,
+			"threshold", G_TYPE_DOUBLE, event.threshold,
+			"hysteresis", G_TYPE_DOUBLE, event.hysteresis,
+			"signal-min", G_TYPE_INT, event.signalMin,
+			"signal-max", G_TYPE_INT, event.signalMax,
+			NULL);
+	gst_element_post_message(GST_ELEMENT(self), gst_message_new_element(GST_OBJECT(self), s));
+}
+
+static void gst_rpm_detect_free_detector(GstRpmDetect* self)
+{
+	delete self->detector;
+	self->detector = NULL;
+}
+
+static gboolean gst_rpm_detect_set_caps(GstBaseTransform* trans, GstCaps* incaps, GstCaps* outcaps)
+{
+	GstRpmDetect* self = GST_RPM_DETECT(trans);
+	GstAudioInfo info;
+	if (!gst_audio_info_from_caps(&info, incaps))
+	{
+		GST_ERROR_OBJECT(self, "invalid caps %" GST_PTR_FORMAT, incaps);
+		return FALSE;
+	}
+
+	GST_OBJECT_LOCK(self);
+	gint divisor = self->divisor;
+	gint amplitude = self->amplitude;
+	gint thresholdPercentage = self->thresholdPercentage;
+	gint channel = self->channel;
+	GST_OBJECT_UNLOCK(self);
+
+	if (channel >= GST_AUDIO_INFO_CHANNELS(&info))
+	{
+		GST_ERROR_OBJECT(self, "channel %d requested, but stream only has %d channels",
+				channel, GST_AUDIO_INFO_CHANNELS(&info));
+		return FALSE;
+	}
+
+	// A new format restarts detection (the detector is tied to one sample rate)
+	gst_rpm_detect_free_detector(self);
+	self->info = info;
+	self->activeChannel = channel;
+	self->numSamples = 0;
+	self->detector = new BlindRPMCalculatorFromAudio(GST_AUDIO_INFO_RATE(&info), divisor, amplitude);
+	self->detector->setThresholdPercentage(thresholdPercentage);
+	self->detector->setPulseCallback([self](const PulseEvent& event) {
+		if (self->posting)
+		{
+			gst_rpm_detect_post_pulse(self, event);
+		}
+	});
+	return TRUE;
+}
+
+static GstFlowReturn gst_rpm_detect_transform_ip(GstBaseTransform* trans, GstBuffer* buf)
+{
+	GstRpmDetect* self = GST_RPM_DETECT(trans);
+	if (!self->detector)
+	{
+		return GST_FLOW_NOT_NEGOTIATED;
+	}
+
+	GstMapInfo map;
+	if (!gst_buffer_map(buf, &map, GST_MAP_READ))
+	{
+		return GST_FLOW_ERROR;
+	}
+
+	const int numChannels = GST_AUDIO_INFO_CHANNELS(&self->info);
+	const gsize numFrames = map.size / (sizeof(int16_t) * numChannels);
+	const int16_t* samples = (const int16_t*)map.data + self->activeChannel;
+
+	GST_OBJECT_LOCK(self);
+	self->detector->setThresholdPercentage(self->thresholdPercentage);
+	self->posting = self->postMessages;
+	GST_OBJECT_UNLOCK(self);
+
+	self->bufferPts = GST_BUFFER_PTS(buf);
+	self->bufferFirstSample = self->numSamples;
+	self->detector->processBlock(samples, numFrames, numChannels);
+	self->numSamples += numFrames;
+
+	gst_buffer_unmap(buf, &map);
+	return GST_FLOW_OK;
+}
+
+static gboolean gst_rpm_detect_start(GstBaseTransform* trans)
+{
+	GstRpmDetect* self = GST_RPM_DETECT(trans);
+	self->numSamples = 0;
+	return TRUE;
+}
+
+static gboolean gst_rpm_detect_stop(GstBaseTransform* trans)
+{
+	gst_rpm_detect_free_detector(GST_RPM_DETECT(trans));
+	return TRUE;
+}
+
+static void gst_rpm_detect_set_property(GObject* object, guint prop_id, const GValue* value, GParamSpec* pspec)
+{
+	GstRpmDetect* self = GST_RPM_DETECT(object);
+	GST_OBJECT_LOCK(self);
+	switch (prop_id)
+	{
+	case PROP_DIVISOR:
+		self->divisor = g_value_get_int(value);
+		break;
+	case PROP_AMPLITUDE:
+		self->amplitude = g_value_get_int(value);
+		break;
+	case PROP_THRESHOLD_PERCENTAGE:
+		self->thresholdPercentage = g_value_get_int(value);
+		break;
+	case PROP_CHANNEL:
+		self->channel = g_value_get_int(value);
+		break;
+	case PROP_POST_MESSAGES:
+		self->postMessages = g_value_get_boolean(value);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+		break;
+	}
+	GST_OBJECT_UNLOCK(self);
+}
+
+static void gst_rpm_detect_get_property(GObject* object, guint prop_id, GValue* value, GParamSpec* pspec)
+{
+	GstRpmDetect* self = GST_RPM_DETECT(object);
+	GST_OBJECT_LOCK(self);
+	switch (prop_id)
+	{
+	case PROP_DIVISOR:
+		g_value_set_int(value, self->divisor);
+		break;
+	case PROP_AMPLITUDE:
+		g_value_set_int(value, self->amplitude);
+		break;
+	case PROP_THRESHOLD_PERCENTAGE:
+		g_value_set_int(value, self->thresholdPercentage);
+		break;
+	case PROP_CHANNEL:
+		g_value_set_int(value, self->channel);
+		break;
+	case PROP_POST_MESSAGES:
+		g_value_set_boolean(value, self->postMessages);
+		break;
+	default:
+		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+		break;
+	}
+	GST_OBJECT_UNLOCK(self);
+}
+
+static void gst_rpm_detect_finalize(GObject* object)
+{
+	gst_rpm_detect_free_detector(GST_RPM_DETECT(object));
+	G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void gst_rpm_detect_class_init(GstRpmDetectClass* klass)
+{
+	GObjectClass* gobject_class = G_OBJECT_CLASS(klass);
+	GstElementClass* element_class = GST_ELEMENT_CLASS(klass);
+	GstBaseTransformClass* trans_class = GST_BASE_TRANSFORM_CLASS(klass);
+
+	gobject_class->set_property = gst_rpm_detect_set_property;
+	gobject_class->get_property = gst_rpm_detect_get_property;
+	gobject_class->finalize = gst_rpm_detect_finalize;
+
+	const GParamFlags flags = (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+	const GParamFlags mutableFlags = (GParamFlags)(flags | GST_PARAM_MUTABLE_PLAYING);
+
+	g_object_class_install_property(gobject_class, PROP_DIVISOR,
+			g_param_spec_int("divisor", "Divisor",
+					"Pulses per revolution (applied when caps are set)",
+					1, G_MAXINT, DEFAULT_DIVISOR, flags));
+	g_object_class_install_property(gobject_class, PROP_AMPLITUDE,
+			g_param_spec_int("amplitude", "Amplitude",
+					"Minimum signal amplitude (max - min) before counting revolutions (applied when caps are set)",
+					0, G_MAXINT, DEFAULT_AMPLITUDE, flags));
+	g_object_class_install_property(gobject_class, PROP_THRESHOLD_PERCENTAGE,
+			g_param_spec_int("threshold-percentage", "Threshold percentage",
+					"Trigger threshold position between signal min and max",
+					1, 99, DEFAULT_THRESHOLD_PERCENTAGE, mutableFlags));
+	g_object_class_install_property(gobject_class, PROP_CHANNEL,
+			g_param_spec_int("channel", "Channel",
+					"Channel to run the detector on (applied when caps are set)",
+					0, G_MAXINT, DEFAULT_CHANNEL, flags));
+	g_object_class_install_property(gobject_class, PROP_POST_MESSAGES,
+			g_param_spec_boolean("post-messages", "Post messages",
+					"Post an element message on the bus for each pulse",
+					DEFAULT_POST_MESSAGES, mutableFlags));
+
+	gst_element_class_set_static_metadata(element_class,
+			"RPM detector", "Filter/Analyzer/Audio",
+			"Detects rising edges from an optical tachometer, and posts rpm as element messages",
+			"Simon Gustafsson <www.optisimon.com>");
+	gst_element_class_add_static_pad_template(element_class, &sink_template);
+	gst_element_class_add_static_pad_template(element_class, &src_template);
+
+	trans_class->set_caps = GST_DEBUG_FUNCPTR(gst_rpm_detect_set_caps);
+	trans_class->transform_ip = GST_DEBUG_FUNCPTR(gst_rpm_detect_transform_ip);
+	trans_class->start = GST_DEBUG_FUNCPTR(gst_rpm_detect_start);
+	trans_class->stop = GST_DEBUG_FUNCPTR(gst_rpm_detect_stop);
+	// Never modifies the audio, so transform_ip runs on (possibly read only) passthrough buffers
+	trans_class->passthrough_on_same_caps = TRUE;
+	trans_class->transform_ip_on_passthrough = TRUE;
+}
+
+static void gst_rpm_detect_init(GstRpmDetect* self)
+{
+	self->divisor = DEFAULT_DIVISOR;
+	self->amplitude = DEFAULT_AMPLITUDE;
+	self->thresholdPercentage = DEFAULT_THRESHOLD_PERCENTAGE;
+	self->channel = DEFAULT_CHANNEL;
+	self->postMessages = DEFAULT_POST_MESSAGES;
+	self->detector = NULL;
+	gst_audio_info_init(&self->info);
+	self->activeChannel = DEFAULT_CHANNEL;
+	self->posting = DEFAULT_POST_MESSAGES;
+	self->numSamples = 0;
+	self->bufferFirstSample = 0;
+	self->bufferPts = GST_CLOCK_TIME_NONE;
+
+	gst_base_transform_set_passthrough(GST_BASE_TRANSFORM(self), TRUE);
+	gst_base_transform_set_in_place(GST_BASE_TRANSFORM(self), TRUE);
+}
+
+static gboolean plugin_init(GstPlugin* plugin)
+{
+	GST_DEBUG_CATEGORY_INIT(gst_rpm_detect_debug, "rpmdetect", 0, "RPM detector");
+	return gst_element_register(plugin, "rpmdetect", GST_RANK_NONE, GST_TYPE_RPM_DETECT);
+}
+
+GST_PLUGIN_DEFINE(GST_VERSION_MAJOR, GST_VERSION_MINOR,
+		rpmdetect,
+		"Optical tachometer rpm detection",
+		plugin_init, VERSION, "unknown", PACKAGE, "https://github.com/optisimon/RPMRevolutionMeter")
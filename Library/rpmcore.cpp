@@ -0,0 +1,274 @@
+/*
+ * rpmcore.cpp
+ *
+ * Implementation of the C API in rpmcore.h, on top of RPMCalculatorFromAudio
+ * (or MultiRateRPMCalculatorFromAudio, after rpmcore_set_decimation()).
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define RPMCORE_BUILD
+#include "rpmcore.h"
+
+#include "../MultiRateRPMCalculatorFromAudio.hpp"
+#include "../RPMCalculatorFromAudio.hpp"
+
+#include <exception>
+#include <memory>
+#include <vector>
+
+struct rpmcore {
+	explicit rpmcore(const rpmcore_config& config) :
+		config(config),
+		interpolation(LinearInterpolation),
+		queue(config.event_queue_size),
+		queueStart(0),
+		queueSize(0),
+		numLost(0),
+		numPulses(0),
+		numSamples(0),
+		callback(NULL),
+		userData(NULL)
+	{
+		createDetector(1);
+	}
+
+	/// Replaces the detector, keeping its settings (unchanged if out of memory)
+	void createDetector(int decimation)
+	{
+		std::unique_ptr<BlindRPMCalculatorFromAudio> newDetector;
+		std::unique_ptr<MultiRateRPMCalculatorFromAudio> newMultiRateDetector;
+		if (decimation > 1)
+		{
+			newMultiRateDetector.reset(new MultiRateRPMCalculatorFromAudio(config.sample_rate, config.divisor,
+					decimation, config.required_amplitude));
+			newMultiRateDetector->setPulseCallback([this](const PulseEvent& event) { onPulse(event); });
+		}
+		else
+		{
+			newDetector.reset(new BlindRPMCalculatorFromAudio(config.sample_rate, config.divisor,
+					config.required_amplitude));
+			newDetector->setPulseCallback([this](const PulseEvent& event) { onPulse(event); });
+		}
+
+		int percentage = detector ? detector->getThresholdPercentage() :
+				multiRateDetector ? multiRateDetector->getThresholdPercentage() : config.threshold_percentage;
+		detector = std::move(newDetector);
+		multiRateDetector = std::move(newMultiRateDetector);
+		setThresholdPercentage(percentage);
+		setCrossingInterpolation(interpolation);
+	}
+
+	void setThresholdPercentage(int percentage)
+	{
+		if (detector)
+		{
+			detector->setThresholdPercentage(percentage);
+		}
+		else
+		{
+			multiRateDetector->setThresholdPercentage(percentage);
+		}
+	}
+
+	void setCrossingInterpolation(CrossingInterpolation interpolation)
+	{
+		this->interpolation = interpolation;
+		if (detector)
+		{
+			detector->setCrossingInterpolation(interpolation);
+		}
+		else
+		{
+			multiRateDetector->setCrossingInterpolation(interpolation);
+		}
+	}
+
+	void process(const int16_t* samples, size_t n, size_t stride)
+	{
+		if (detector)
+		{
+			detector->processBlock(samples, n, stride);
+		}
+		else
+		{
+			multiRateDetector->processBlock(samples, n, stride);
+		}
+	}
+
+	void onPulse(const PulseEvent& event)
+	{
+		latest.sample_index = event.sampleIndex;
+		latest.period_in_samples = event.periodInSamples;
+		latest.rpm = event.rpm;
+		latest.filtered_rpm = event.filteredRpm;
+		latest.threshold = event.threshold;
+		latest.hysteresis = event.hysteresis;
+		latest.signal_min = event.signalMin;
+		latest.signal_max = event.signalMax;
+		latest.threshold_percentage = event.thresholdInPercentage;
+		numPulses++;
+
+		if (callback)
+		{
+			callback(userData, &latest);
+			return;
+		}
+
+		if (queueSize == queue.size())
+		{
+			// Full, overwrite the oldest
+			queueStart = (queueStart + 1) % queue.size();
+			queueSize--;
+			numLost++;
+		}
+		queue[(queueStart + queueSize) % queue.size()] = latest;
+		queueSize++;
+	}
+
+	rpmcore_config config;
+	CrossingInterpolation interpolation;
+	std::unique_ptr<BlindRPMCalculatorFromAudio> detector;                  // One of these
+	std::unique_ptr<MultiRateRPMCalculatorFromAudio> multiRateDetector;
+	std::vector<rpmcore_pulse> queue;
+	size_t queueStart;
+	size_t queueSize;
+	uint64_t numLost;
+	uint64_t numPulses;
+	uint64_t numSamples;
+	rpmcore_pulse latest;
+	rpmcore_pulse_callback callback;
+	void* userData;
+};
+
+
+int rpmcore_api_version(void)
+{
+	return RPMCORE_API_VERSION;
+}
+
+void rpmcore_config_init(struct rpmcore_config* config)
+{
+	config->sample_rate = 44100;
+	config->divisor = 1;
+	config->required_amplitude = 3;
+	config->threshold_percentage = 50;
+	config->event_queue_size = 256;
+}
+
+struct rpmcore* rpmcore_create(const struct rpmcore_config* config)
+{
+	if (!config || config->sample_rate < 200 || config->divisor < 1 ||
+			config->threshold_percentage < 1 || config->threshold_percentage > 99 ||
+			config->event_queue_size < 1)
+	{
+		return NULL;
+	}
+	// No exceptions may escape into C code (bad_alloc, or length_error for
+	// an absurd event_queue_size)
+	try
+	{
+		return new rpmcore(*config);
+	}
+	catch (const std::exception&)
+	{
+		return NULL;
+	}
+}
+
+void rpmcore_destroy(struct rpmcore* rpm)
+{
+	delete rpm;
+}
+
+int rpmcore_set_threshold_percentage(struct rpmcore* rpm, int percentage)
+{
+	if (percentage < 1 || percentage > 99)
+	{
+		return -1;
+	}
+	rpm->setThresholdPercentage(percentage);
+	return 0;
+}
+
+int rpmcore_set_crossing_interpolation(struct rpmcore* rpm, int interpolation)
+{
+	switch (interpolation)
+	{
+	case RPMCORE_INTERPOLATION_NONE:
+		rpm->setCrossingInterpolation(NoInterpolation);
+		return 0;
+	case RPMCORE_INTERPOLATION_LINEAR:
+		rpm->setCrossingInterpolation(LinearInterpolation);
+		return 0;
+	case RPMCORE_INTERPOLATION_CUBIC:
+		rpm->setCrossingInterpolation(CubicInterpolation);
+		return 0;
+	}
+	return -1;
+}
+
+int rpmcore_set_decimation(struct rpmcore* rpm, int decimation)
+{
+	if (decimation < 1 || rpm->numSamples)
+	{
+		return -1;
+	}
+	// No exceptions may escape into C code
+	try
+	{
+		rpm->createDetector(decimation);
+	}
+	catch (const std::exception&)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+void rpmcore_set_pulse_callback(struct rpmcore* rpm, rpmcore_pulse_callback callback, void* user_data)
+{
+	rpm->callback = callback;
+	rpm->userData = user_data;
+}
+
+size_t rpmcore_process(struct rpmcore* rpm, const int16_t* samples, size_t num_samples, size_t stride)
+{
+	uint64_t numPulsesBefore = rpm->numPulses;
+	rpm->process(samples, num_samples, stride);
+	rpm->numSamples += num_samples;
+	return rpm->numPulses - numPulsesBefore;
+}
+
+size_t rpmcore_poll(struct rpmcore* rpm, struct rpmcore_pulse* pulses, size_t max_pulses)
+{
+	size_t n = std::min(max_pulses, rpm->queueSize);
+	for (size_t i = 0; i < n; i++)
+	{
+		pulses[i] = rpm->queue[(rpm->queueStart + i) % rpm->queue.size()];
+	}
+	rpm->queueStart = (rpm->queueStart + n) % rpm->queue.size();
+	rpm->queueSize -= n;
+	return n;
+}
+
+uint64_t rpmcore_get_num_lost(const struct rpmcore* rpm)
+{
+	return rpm->numLost;
+}
+
+int rpmcore_get_latest(const struct rpmcore* rpm, struct rpmcore_pulse* pulse)
+{
+	if (rpm->numPulses == 0)
+	{
+		return 0;
+	}
+	*pulse = rpm->latest;
+	return 1;
+}
+
+uint64_t rpmcore_get_num_samples(const struct rpmcore* rpm)
+{
+	return rpm->numSamples;
+}
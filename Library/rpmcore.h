@@ -0,0 +1,147 @@
+/*
+ * rpmcore.h
+ *
+ * C API of librpmcore, the RPMRevolutionMeter detector as a library.
+ *
+ * Instances are independent (no globals), so any number can be used, from
+ * different threads. Each instance must only be fed and polled from one
+ * thread at a time; rpmcore_set_threshold_percentage() may be called from
+ * any thread.
+ *
+ *   struct rpmcore_config config;
+ *   rpmcore_config_init(&config);
+ *   config.sample_rate = 48000;
+ *   struct rpmcore* rpm = rpmcore_create(&config);
+ *
+ *   while (capturing)
+ *   {
+ *       rpmcore_process(rpm, interleaved + channel, num_frames, num_channels);
+ *
+ *       struct rpmcore_pulse pulses[16];
+ *       size_t n;
+ *       while ((n = rpmcore_poll(rpm, pulses, 16)) > 0)
+ *           ...
+ *   }
+ *   rpmcore_destroy(rpm);
+ *
+ * Instead of polling, a callback can be registered, which is then called
+ * from within rpmcore_process() for each pulse.
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(RPMCORE_BUILD) && defined(__GNUC__)
+#define RPMCORE_API __attribute__((visibility("default")))
+#else
+#define RPMCORE_API
+#endif
+
+/*
+ * Incremented when the API changes. The layout of the structs below is
+ * frozen for librpmcore.so.1, so new settings get functions instead of fields.
+ */
+#define RPMCORE_API_VERSION 3      /* 2: rpmcore_set_crossing_interpolation(), 3: rpmcore_set_decimation() */
+
+struct rpmcore;
+
+struct rpmcore_config {
+	int sample_rate;            /* Hz (default 44100) */
+	int divisor;                /* Pulses per revolution (default 1) */
+	int required_amplitude;     /* Smallest max - min of the signal to detect pulses on (default 3) */
+	int threshold_percentage;   /* Threshold position between signal min and max, 1-99 (default 50) */
+	size_t event_queue_size;    /* Pulses buffered for rpmcore_poll() (default 256) */
+};
+
+struct rpmcore_pulse {
+	uint64_t sample_index;      /* Sample completing the rising edge, counted from first sample processed */
+	double period_in_samples;   /* Distance to previous rising edge (interpolated, see below) */
+	double rpm;
+	double filtered_rpm;        /* Average of the last few periods */
+	double threshold;
+	double hysteresis;
+	int32_t signal_min;
+	int32_t signal_max;
+	int32_t threshold_percentage;
+};
+
+/* Where between two samples a rising edge is placed */
+enum rpmcore_interpolation {
+	RPMCORE_INTERPOLATION_NONE = 0,     /* At the sample completing the edge */
+	RPMCORE_INTERPOLATION_LINEAR = 1,   /* Default */
+	RPMCORE_INTERPOLATION_CUBIC = 2     /* Same as linear in a fixed point build */
+};
+
+typedef void (*rpmcore_pulse_callback)(void* user_data, const struct rpmcore_pulse* pulse);
+
+/** @return RPMCORE_API_VERSION the library was built with */
+RPMCORE_API int rpmcore_api_version(void);
+
+/** Fills in the default configuration */
+RPMCORE_API void rpmcore_config_init(struct rpmcore_config* config);
+
+/** @return NULL if the configuration is invalid (or too large to allocate) */
+RPMCORE_API struct rpmcore* rpmcore_create(const struct rpmcore_config* config);
+
+RPMCORE_API void rpmcore_destroy(struct rpmcore* rpm);
+
+/** @return 0, or -1 if percentage is outside 1-99. Safe to call from any thread. */
+RPMCORE_API int rpmcore_set_threshold_percentage(struct rpmcore* rpm, int percentage);
+
+/**
+ * @param interpolation  one of enum rpmcore_interpolation
+ * @return 0, or -1 if interpolation is not valid. Call from the thread calling rpmcore_process().
+ */
+RPMCORE_API int rpmcore_set_crossing_interpolation(struct rpmcore* rpm, int interpolation);
+
+/**
+ * Tracks the signal range at 1/decimation of the sample rate, for high rates
+ * (e.g. 8 at 192 kHz). Edge timing stays at the full rate. 1 (default) tracks
+ * it at the full rate.
+ * Call before the first rpmcore_process(), and not while another thread
+ * may call rpmcore_set_threshold_percentage().
+ * @return 0, or -1 if decimation is below 1 or samples have already been processed
+ */
+RPMCORE_API int rpmcore_set_decimation(struct rpmcore* rpm, int decimation);
+
+/**
+ * Delivers pulses by calling callback from rpmcore_process(), instead of
+ * queueing them for rpmcore_poll(). NULL goes back to queueing.
+ */
+RPMCORE_API void rpmcore_set_pulse_callback(struct rpmcore* rpm, rpmcore_pulse_callback callback, void* user_data);
+
+/**
+ * Runs the detector on num_samples samples, read from samples[0],
+ * samples[stride], samples[2 * stride], ... (so one channel of interleaved
+ * audio can be processed in place).
+ * @return number of pulses detected
+ */
+RPMCORE_API size_t rpmcore_process(struct rpmcore* rpm, const int16_t* samples, size_t num_samples, size_t stride);
+
+/**
+ * Moves up to max_pulses queued pulses (oldest first) to pulses.
+ * @return number of pulses moved
+ */
+RPMCORE_API size_t rpmcore_poll(struct rpmcore* rpm, struct rpmcore_pulse* pulses, size_t max_pulses);
+
+/** @return pulses lost since the queue was full (oldest are overwritten) */
+RPMCORE_API uint64_t rpmcore_get_num_lost(const struct rpmcore* rpm);
+
+/** @return 1 and the last pulse detected, or 0 if there has been no pulse yet */
+RPMCORE_API int rpmcore_get_latest(const struct rpmcore* rpm, struct rpmcore_pulse* pulse);
+
+/** @return number of samples processed so far */
+RPMCORE_API uint64_t rpmcore_get_num_samples(const struct rpmcore* rpm);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,214 @@
+/*
+ * Metrics.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include "Stopwatch.hpp"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <string>
+
+/**
+ * Monotonically increasing count, updated by a single thread.
+ *
+ * Since there is only one writer, add() is a relaxed load and store
+ * (no locked read-modify-write). Any thread may read the value.
+ */
+class MetricsCounter {
+public:
+	MetricsCounter() : _value(0) { }
+
+	void add(uint64_t n = 1)
+	{
+		_value.store(_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	uint64_t get() const { return _value.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<uint64_t> _value;
+};
+
+
+/**
+ * Distribution of values (typically durations in ns), updated by a single thread.
+ *
+ * Uses fixed power of two buckets: bucket i holds values in [2^(i-1), 2^i),
+ * bucket 0 holds 0. Recording is a few relaxed loads and stores.
+ */
+class MetricsHistogram {
+public:
+	enum { NumBuckets = 65 };
+
+	MetricsHistogram() : _count(0), _sum(0), _max(0)
+	{
+		for (int i = 0; i < NumBuckets; i++)
+		{
+			_buckets[i].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	void record(uint64_t value)
+	{
+		int bucket = bucketOf(value);
+		_buckets[bucket].store(_buckets[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		_count.store(_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		_sum.store(_sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		if (value > _max.load(std::memory_order_relaxed))
+		{
+			_max.store(value, std::memory_order_relaxed);
+		}
+	}
+
+	uint64_t getCount() const { return _count.load(std::memory_order_relaxed); }
+
+	uint64_t getSum() const { return _sum.load(std::memory_order_relaxed); }
+
+	uint64_t getMax() const { return _max.load(std::memory_order_relaxed); }
+
+	double getMean() const
+	{
+		uint64_t count = getCount();
+		return count ? double(getSum()) / count : 0;
+	}
+
+	/**
+	 * Upper bound of the bucket containing the given percentile (0-100).
+	 * Never reports more than the largest value recorded.
+	 */
+	uint64_t getPercentile(double p) const
+	{
+		uint64_t count = getCount();
+		if (count == 0)
+		{
+			return 0;
+		}
+		uint64_t target = uint64_t(p / 100.0 * count + 0.5);
+		if (target < 1) { target = 1; }
+		uint64_t seen = 0;
+		for (int i = 0; i < NumBuckets; i++)
+		{
+			seen += _buckets[i].load(std::memory_order_relaxed);
+			if (seen >= target)
+			{
+				uint64_t upper = i == 0 ? 0 : (i == 64 ? UINT64_MAX : (uint64_t(1) << i) - 1);
+				return std::min(upper, getMax());
+			}
+		}
+		return getMax();
+	}
+
+	static int bucketOf(uint64_t value)
+	{
+		return value == 0 ? 0 : 64 - __builtin_clzll(value);
+	}
+
+private:
+	std::atomic<uint64_t> _buckets[NumBuckets];
+	std::atomic<uint64_t> _count;
+	std::atomic<uint64_t> _sum;
+	std::atomic<uint64_t> _max;
+};
+
+
+/**
+ * Named counters and histograms, for finding out what the process is doing
+ * without attaching a profiler.
+ *
+ * Metrics are created up front (which allocates), and are then updated
+ * without locks or allocation. Each metric should only be updated by one
+ * thread. References returned stay valid for the lifetime of the registry.
+ */
+class MetricsRegistry {
+public:
+	MetricsRegistry() : _startNs(nowNs()) { }
+
+	MetricsCounter& addCounter(const char* name)
+	{
+		_counters.emplace_back(name);
+		return _counters.back().counter;
+	}
+
+	MetricsHistogram& addHistogram(const char* name, const char* unit = "ns")
+	{
+		_histograms.emplace_back(name, unit);
+		return _histograms.back().histogram;
+	}
+
+	template<class F>
+	void forEachCounter(F f) const
+	{
+		for (const NamedCounter& c : _counters)
+		{
+			f(c.name, c.counter);
+		}
+	}
+
+	template<class F>
+	void forEachHistogram(F f) const
+	{
+		for (const NamedHistogram& h : _histograms)
+		{
+			f(h.name, h.unit, h.histogram);
+		}
+	}
+
+	double getUptimeSeconds() const { return (nowNs() - _startNs) * 1e-9; }
+
+	/**
+	 * Writes all metrics as text, one per line, each prefixed with "# ".
+	 * (Not safe to call from a signal handler).
+	 */
+	void dump(FILE* f) const
+	{
+		double uptime = getUptimeSeconds();
+		fprintf(f, "# metrics uptime_s=%.3f\n", uptime);
+		for (const NamedCounter& c : _counters)
+		{
+			uint64_t value = c.counter.get();
+			fprintf(f, "# %s=%llu (%.1f/s)\n", c.name.c_str(), (unsigned long long)value,
+					uptime > 0 ? value / uptime : 0.0);
+		}
+		for (const NamedHistogram& h : _histograms)
+		{
+			const MetricsHistogram& hist = h.histogram;
+			fprintf(f, "# %s count=%llu mean_%s=%.0f p50_%s<=%llu p99_%s<=%llu max_%s=%llu\n",
+					h.name.c_str(),
+					(unsigned long long)hist.getCount(),
+					h.unit.c_str(), hist.getMean(),
+					h.unit.c_str(), (unsigned long long)hist.getPercentile(50),
+					h.unit.c_str(), (unsigned long long)hist.getPercentile(99),
+					h.unit.c_str(), (unsigned long long)hist.getMax());
+		}
+		fflush(f);
+	}
+
+private:
+	struct NamedCounter {
+		explicit NamedCounter(const char* name) : name(name) { }
+		std::string name;
+		MetricsCounter counter;
+	};
+
+	struct NamedHistogram {
+		NamedHistogram(const char* name, const char* unit) : name(name), unit(unit) { }
+		std::string name;
+		std::string unit;
+		MetricsHistogram histogram;
+	};
+
+	const uint64_t _startNs;
+	// deque: elements never move when more metrics are added
+	std::deque<NamedCounter> _counters;
+	std::deque<NamedHistogram> _histograms;
+};
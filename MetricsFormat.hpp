@@ -0,0 +1,128 @@
+/*
+ * MetricsFormat.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include "Metrics.hpp"
+#include "Stats.hpp"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+
+namespace MetricsFormat {
+
+/**
+ * "detector.pulses" -> "rpmmeter_detector_pulses"
+ */
+inline std::string prometheusName(const std::string& name)
+{
+	std::string result = "rpmmeter_";
+	for (char c : name)
+	{
+		bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+		result += valid ? c : '_';
+	}
+	return result;
+}
+
+inline void appendf(std::string& out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+inline void appendf(std::string& out, const char* format, ...)
+{
+	char buff[512];
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(buff, sizeof(buff), format, args);
+	va_end(args);
+	if (n > 0)
+	{
+		out.append(buff, std::min<size_t>(n, sizeof(buff) - 1));
+	}
+}
+
+/**
+ * Prometheus text exposition format (version 0.0.4).
+ */
+inline std::string prometheus(const Stats& stats, const MetricsRegistry& registry)
+{
+	std::string out;
+	out.reserve(4096);
+
+	const struct { const char* name; const char* help; double value; } gauges[] = {
+			{ "rpmmeter_rpm",                      "RPM from the last period",          stats.rpm },
+			{ "rpmmeter_rpm_filtered",             "Average RPM of the last periods",   stats.filteredRpm },
+			{ "rpmmeter_rpm_tracked",              "RPM from the speed tracker",        stats.trackedRpm },
+			{ "rpmmeter_rpm_source",               "Source of the RPM: 0 none, 1 edge, 2 spectral", double(stats.rpmSource) },
+			{ "rpmmeter_signal_max",               "Tracked maximum of input signal",   double(stats.signalMax) },
+			{ "rpmmeter_signal_min",               "Tracked minimum of input signal",   double(stats.signalMin) },
+			{ "rpmmeter_threshold",                "Trigger threshold",                 double(stats.threshold) },
+			{ "rpmmeter_threshold_percentage",     "Threshold position between min and max", double(stats.thresholdInPercentage) },
+			{ "rpmmeter_hysteresis",               "Trigger hysteresis",                double(stats.hysteresis) },
+	};
+	for (const auto& g : gauges)
+	{
+		appendf(out, "# HELP %s %s\n# TYPE %s gauge\n%s %.9g\n", g.name, g.help, g.name, g.name, g.value);
+	}
+
+	appendf(out, "# TYPE rpmmeter_uptime_seconds gauge\nrpmmeter_uptime_seconds %.3f\n", registry.getUptimeSeconds());
+
+	registry.forEachCounter([&](const std::string& name, const MetricsCounter& c) {
+		std::string n = prometheusName(name) + "_total";
+		appendf(out, "# TYPE %s counter\n%s %llu\n", n.c_str(), n.c_str(), (unsigned long long)c.get());
+	});
+
+	registry.forEachHistogram([&](const std::string& name, const std::string& unit, const MetricsHistogram& h) {
+		std::string n = prometheusName(name + "_" + unit);
+		appendf(out, "# TYPE %s summary\n", n.c_str());
+		appendf(out, "%s{quantile=\"0.5\"} %llu\n", n.c_str(), (unsigned long long)h.getPercentile(50));
+		appendf(out, "%s{quantile=\"0.99\"} %llu\n", n.c_str(), (unsigned long long)h.getPercentile(99));
+		appendf(out, "%s{quantile=\"1\"} %llu\n", n.c_str(), (unsigned long long)h.getMax());
+		appendf(out, "%s_sum %llu\n", n.c_str(), (unsigned long long)h.getSum());
+		appendf(out, "%s_count %llu\n", n.c_str(), (unsigned long long)h.getCount());
+	});
+
+	return out;
+}
+
+inline std::string json(const Stats& stats, const MetricsRegistry& registry)
+{
+	std::string out;
+	out.reserve(2048);
+
+	appendf(out, "{\"rpm\": %.9g, \"rpm_filtered\": %.9g, \"rpm_tracked\": %.9g, \"rpm_source\": %d, "
+			"\"signal_max\": %d, \"signal_min\": %d, "
+			"\"threshold\": %d, \"threshold_percentage\": %d, \"hysteresis\": %d, \"uptime_s\": %.3f",
+			stats.rpm, stats.filteredRpm, stats.trackedRpm, stats.rpmSource, stats.signalMax, stats.signalMin,
+			stats.threshold, stats.thresholdInPercentage, stats.hysteresis,
+			registry.getUptimeSeconds());
+
+	out += ", \"counters\": {";
+	bool first = true;
+	registry.forEachCounter([&](const std::string& name, const MetricsCounter& c) {
+		appendf(out, "%s\"%s\": %llu", first ? "" : ", ", name.c_str(), (unsigned long long)c.get());
+		first = false;
+	});
+	out += "}, \"histograms\": {";
+	first = true;
+	registry.forEachHistogram([&](const std::string& name, const std::string& unit, const MetricsHistogram& h) {
+		appendf(out, "%s\"%s\": {\"unit\": \"%s\", \"count\": %llu, \"mean\": %.1f, \"p50\": %llu, \"p99\": %llu, \"max\": %llu}",
+				first ? "" : ", ", name.c_str(), unit.c_str(),
+				(unsigned long long)h.getCount(), h.getMean(),
+				(unsigned long long)h.getPercentile(50),
+				(unsigned long long)h.getPercentile(99),
+				(unsigned long long)h.getMax());
+		first = false;
+	});
+	out += "}}\n";
+
+	return out;
+}
+
+} // namespace MetricsFormat
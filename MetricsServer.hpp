@@ -0,0 +1,321 @@
+/*
+ * MetricsServer.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include "Metrics.hpp"
+#include "MetricsFormat.hpp"
+#include "SeqLock.hpp"
+#include "Stats.hpp"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Minimal HTTP/1.0 server exposing the latest Stats and all metrics, so the
+ * meter can be scraped by Prometheus or polled by scripts:
+ *
+ *   GET /metrics       Prometheus text format
+ *   GET /metrics.json  JSON
+ *
+ * Listens either on a TCP port on 127.0.0.1, or on a Unix domain socket
+ * (curl --unix-socket PATH http://localhost/metrics). Runs in its own thread,
+ * and only reads the lock-free Stats snapshot and metrics, so it never
+ * blocks the audio thread. All connections are polled together, so a slow
+ * client does not hold up the others, and each one is closed if its request
+ * has not been answered within RequestTimeoutMs.
+ */
+class MetricsServer {
+public:
+	enum {
+		MaxConnections = 16,     // More are left waiting in the listen backlog
+		RequestTimeoutMs = 1000  // From accept to the last byte of the reply
+	};
+
+	MetricsServer(const SeqLockValue<Stats>& stats, const MetricsRegistry& registry) :
+		_stats(stats),
+		_registry(registry),
+		_listenFd(-1),
+		_quit(false)
+	{
+	}
+
+	~MetricsServer()
+	{
+		stop();
+	}
+
+	/// @return false (with errno set) if unable to listen
+	bool listenTcp(int port)
+	{
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+		{
+			return false;
+		}
+		int yes = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		return finishListen(fd, (struct sockaddr*)&addr, sizeof(addr));
+	}
+
+	/// @return false (with errno set) if unable to listen
+	bool listenUnix(const char* path)
+	{
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (strlen(path) >= sizeof(addr.sun_path))
+		{
+			errno = ENAMETOOLONG;
+			return false;
+		}
+		strcpy(addr.sun_path, path);
+
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+		{
+			return false;
+		}
+		unlink(path); // Left behind if we were killed last time
+		_unixPath = path;
+		return finishListen(fd, (struct sockaddr*)&addr, sizeof(addr));
+	}
+
+	void start()
+	{
+		_thread = std::thread(&MetricsServer::run, this);
+	}
+
+	void stop()
+	{
+		_quit = true;
+		if (_thread.joinable())
+		{
+			_thread.join();
+		}
+		for (Connection& c : _connections)
+		{
+			close(c.fd);
+		}
+		_connections.clear();
+		if (_listenFd >= 0)
+		{
+			close(_listenFd);
+			_listenFd = -1;
+		}
+		if (!_unixPath.empty())
+		{
+			unlink(_unixPath.c_str());
+			_unixPath.clear();
+		}
+	}
+
+	/**
+	 * @return complete HTTP response for the request line (e.g. "GET /metrics HTTP/1.1")
+	 */
+	std::string respond(const std::string& requestLine) const
+	{
+		size_t methodEnd = requestLine.find(' ');
+		size_t pathEnd = methodEnd == std::string::npos ? methodEnd : requestLine.find_first_of(" ?", methodEnd + 1);
+		std::string method = requestLine.substr(0, methodEnd);
+		std::string path = methodEnd == std::string::npos ? "" : requestLine.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+
+		if (method != "GET")
+		{
+			return response("405 Method Not Allowed", "text/plain", "Only GET is supported\n");
+		}
+		if (path == "/metrics")
+		{
+			return response("200 OK", "text/plain; version=0.0.4",
+					MetricsFormat::prometheus(_stats.load(), _registry));
+		}
+		if (path == "/metrics.json")
+		{
+			return response("200 OK", "application/json",
+					MetricsFormat::json(_stats.load(), _registry));
+		}
+		return response("404 Not Found", "text/plain", "Try /metrics or /metrics.json\n");
+	}
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Connection {
+		int fd;
+		Clock::time_point deadline;
+		std::string request;
+		std::string reply;   // Empty until the request line is complete
+		size_t sent;
+	};
+
+	const SeqLockValue<Stats>& _stats;
+	const MetricsRegistry& _registry;
+	int _listenFd;
+	std::string _unixPath;
+	std::atomic<bool> _quit;
+	std::thread _thread;
+	std::vector<Connection> _connections;  // Only used by the server thread
+
+	bool finishListen(int fd, const struct sockaddr* addr, socklen_t addrLen)
+	{
+		if (bind(fd, addr, addrLen) < 0 || listen(fd, 4) < 0)
+		{
+			int err = errno;
+			close(fd);
+			errno = err;
+			return false;
+		}
+		_listenFd = fd;
+		return true;
+	}
+
+	static std::string response(const char* status, const char* contentType, const std::string& body)
+	{
+		char header[256];
+		snprintf(header, sizeof(header),
+				"HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+				status, contentType, body.size());
+		return header + body;
+	}
+
+	void run()
+	{
+		std::vector<struct pollfd> pfds;
+		while (!_quit)
+		{
+			// Never wait longer than 200 ms, so stop() is noticed without needing to wake us up
+			Clock::time_point now = Clock::now();
+			Clock::time_point wakeup = now + std::chrono::milliseconds(200);
+			pfds.clear();
+			for (const Connection& c : _connections)
+			{
+				pfds.push_back({ c.fd, short(c.reply.empty() ? POLLIN : POLLOUT), 0 });
+				wakeup = std::min(wakeup, c.deadline);
+			}
+			if (_connections.size() < MaxConnections)
+			{
+				pfds.push_back({ _listenFd, POLLIN, 0 });
+			}
+			int timeoutMs = std::chrono::duration_cast<std::chrono::milliseconds>(wakeup - now).count();
+			if (poll(pfds.data(), pfds.size(), std::max(timeoutMs, 0) + 1) < 0)
+			{
+				continue;
+			}
+
+			now = Clock::now();
+			size_t numConnections = _connections.size();
+			if (numConnections < pfds.size() && (pfds.back().revents & POLLIN))
+			{
+				acceptConnection(now);
+			}
+
+			// Keep the ones still in progress, in place
+			size_t kept = 0;
+			for (size_t i = 0; i < numConnections; i++)
+			{
+				Connection& c = _connections[i];
+				bool open = now < c.deadline;
+				if (open && pfds[i].revents)
+				{
+					open = serve(c);
+				}
+				if (open)
+				{
+					std::swap(_connections[kept++], c);
+				}
+				else
+				{
+					close(c.fd);
+				}
+			}
+			// Newly accepted ones are after the polled ones
+			for (size_t i = numConnections; i < _connections.size(); i++)
+			{
+				std::swap(_connections[kept++], _connections[i]);
+			}
+			_connections.resize(kept);
+		}
+	}
+
+	void acceptConnection(Clock::time_point now)
+	{
+		int fd = ::accept(_listenFd, NULL, NULL);
+		if (fd < 0)
+		{
+			return;
+		}
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		Connection c;
+		c.fd = fd;
+		c.deadline = now + std::chrono::milliseconds(RequestTimeoutMs);
+		c.sent = 0;
+		_connections.push_back(c);
+	}
+
+	/**
+	 * Reads what has arrived of the request, and sends what fits of the reply.
+	 * @return false when the connection is done with, or failed
+	 */
+	bool serve(Connection& c)
+	{
+		if (c.reply.empty())
+		{
+			// Only the request line matters, read until it is complete
+			char buff[512];
+			ssize_t n = recv(c.fd, buff, sizeof(buff), 0);
+			if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+			{
+				return false;
+			}
+			if (n > 0)
+			{
+				c.request.append(buff, n);
+			}
+			if (c.request.find('\n') == std::string::npos)
+			{
+				return c.request.size() < 4096;
+			}
+			c.reply = respond(c.request.substr(0, c.request.find_first_of("\r\n")));
+		}
+
+		while (c.sent < c.reply.size())
+		{
+			ssize_t n = send(c.fd, c.reply.data() + c.sent, c.reply.size() - c.sent, MSG_NOSIGNAL);
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			{
+				return true; // Wait for POLLOUT
+			}
+			if (n <= 0)
+			{
+				return false;
+			}
+			c.sent += n;
+		}
+		return false;
+	}
+};
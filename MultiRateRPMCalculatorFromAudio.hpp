@@ -0,0 +1,262 @@
+/*
+ * MultiRateRPMCalculatorFromAudio.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include "SeqLock.hpp"
+#include "StreamProcessors/BlockKernels.hpp"
+#include "StreamProcessors/CappedStorageWaveform.hpp"
+#include "StreamProcessors/CicDecimator.hpp"
+#include "StreamProcessors/DetectorStages.hpp"
+#include "StreamProcessors/MinMaxCheck.hpp"
+#include "StreamProcessors/Pipeline.hpp"
+#include "StreamProcessors/PulseEvent.hpp"
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+/**
+ * Edge detector for high sample rates (192 or 384 kHz, captured for the
+ * timing precision), where tracking the signal range and the threshold at
+ * the full rate is wasted work.
+ *
+ * The samples are taken in groups of decimation samples:
+ *
+ * - Min and max of each group (BlockKernels::accumulateMinMax, vectorized)
+ *   feed the range tracking and the ThresholdStage, so those run at 1 /
+ *   decimation of the rate. Min/max decimation instead of filtering keeps
+ *   the full height of narrow pulses, so the threshold is where the full
+ *   rate detector would put it.
+ * - Only groups whose min/max reach a level that can change the Schmitt
+ *   trigger state are run through SchmittTriggerStage,
+ *   CrossingInterpolatorStage and PeriodEstimatorStage sample by sample.
+ *   Edges are therefore found and interpolated at the full rate, and pulse
+ *   timing is the same as for BasicRPMCalculatorFromAudio.
+ * - With a waveform callback, the waveform is captured after a CIC
+ *   decimator (order 2), at 1 / decimation of the rate.
+ *
+ * The levels are updated at the end of each group instead of after each
+ * sample, which delays them by at most decimation samples.
+ */
+class MultiRateRPMCalculatorFromAudio {
+public:
+	typedef PeriodEstimatorStage::PulseCallback PulseCallback;
+	typedef WaveformCaptureStage::WaveformCallback WaveformCallback;
+
+	/// @param decimation  samples per group, 1 or more (8 is a good choice at 192 kHz)
+	MultiRateRPMCalculatorFromAudio(int audioSampleRate, int divisor, size_t decimation, int requiredAmplitude = 3) :
+		_audioSampleRate(audioSampleRate),
+		_decimation(decimation),
+		_control(initialControl()),
+		_minMax(std::max<size_t>(2 * (audioSampleRate / 5) / decimation, 2), 13),
+		_period(audioSampleRate, divisor, &_control),
+		_threshold(requiredAmplitude, _control),
+		_groupMin(std::numeric_limits<int16_t>::max()),
+		_groupMax(std::numeric_limits<int16_t>::min()),
+		_samplesInGroup(0),
+		_cic(decimation, 2),
+		_waveform(2048, std::max<int>(audioSampleRate / 200 / decimation, 1)),
+		_pulsesInWaveform(0),
+		_buffer(ChunkSize)
+	{
+		assert(decimation >= 1);
+	}
+
+	void setPulseCallback(const PulseCallback& callback) { _period.setPulseCallback(callback); }
+
+	/// The waveform at the decimated rate, every 3 pulses
+	void setWaveformCallback(const WaveformCallback& callback) { _waveformCallback = callback; }
+
+	/**
+	 * Where the threshold is placed between min and max of the signal.
+	 * Safe to call from any thread. Takes effect at the start of the next block.
+	 */
+	void setThresholdPercentage(int percentage)
+	{
+		std::lock_guard<std::mutex> lock(_controlMutex);
+		DetectorControl control = _control.load();
+		if (control.thresholdPercentage != percentage)
+		{
+			control.thresholdPercentage = percentage;
+			_control.store(control);
+		}
+	}
+
+	int getThresholdPercentage() const { return _control.load().thresholdPercentage; }
+
+	/**
+	 * Filter for PulseEvent::filteredRpm, see BasicSlidingRpmFilter. Safe to
+	 * call from any thread. Takes effect at the start of the next block.
+	 */
+	void setRpmFilter(RpmFilter filter)
+	{
+		std::lock_guard<std::mutex> lock(_controlMutex);
+		DetectorControl control = _control.load();
+		if (control.rpmFilter != filter)
+		{
+			control.rpmFilter = filter;
+			_control.store(control);
+		}
+	}
+
+	RpmFilter getRpmFilter() const { return _control.load().rpmFilter; }
+
+	int getSampleRate() const { return _audioSampleRate; }
+
+	size_t getDecimation() const { return _decimation; }
+
+	/// Linear by default. Must not be changed while another thread is calling check().
+	void setCrossingInterpolation(CrossingInterpolation interpolation)
+	{
+		_interpolator.setInterpolation(interpolation);
+	}
+
+	void check(int16_t sample)
+	{
+		processBlock(&sample, 1);
+	}
+
+	/**
+	 * Same as calling check() for samples[0], samples[stride], ... samples[(n - 1) * stride].
+	 */
+	void processBlock(const int16_t* samples, size_t n, size_t stride = 1)
+	{
+		_period.beginBlock(_ctx);
+		_threshold.beginBlock(_ctx);
+		if (stride == 1)
+		{
+			processContiguous(samples, n);
+			return;
+		}
+		// The group kernels want contiguous samples
+		while (n)
+		{
+			size_t count = std::min<size_t>(n, ChunkSize);
+			for (size_t i = 0; i < count; i++)
+			{
+				_buffer[i] = samples[i * stride];
+			}
+			processContiguous(_buffer.data(), count);
+			samples += count * stride;
+			n -= count;
+		}
+	}
+
+private:
+	enum { ChunkSize = 1024 };
+
+	int _audioSampleRate;
+	size_t _decimation;
+	std::mutex _controlMutex;                   // Serializes writers of _control
+	SeqLockValue<DetectorControl> _control;     // Must be constructed before _period and _threshold
+
+	PipelineContext _ctx;
+	MinMaxCheck _minMax;                        // Fed with the min and max of each group
+	SchmittTriggerStage _trigger;
+	CrossingInterpolatorStage _interpolator;
+	PeriodEstimatorStage _period;
+	ThresholdStage _threshold;
+
+	int16_t _groupMin;                          // Of the current group so far
+	int16_t _groupMax;
+	size_t _samplesInGroup;
+
+	CicDecimator _cic;
+	CappedStorageWaveform _waveform;
+	int _pulsesInWaveform;
+	WaveformCallback _waveformCallback;
+
+	std::vector<int16_t> _buffer;               // One channel of strided input
+
+	static DetectorControl initialControl()
+	{
+		DetectorControl control;
+		control.thresholdPercentage = 50;
+		control.rpmFilter = MeanFilter;
+		return control;
+	}
+
+	void processContiguous(const int16_t* samples, size_t n)
+	{
+		size_t i = 0;
+		while (i < n)
+		{
+			size_t count = std::min(n - i, _decimation - _samplesInGroup);
+			int16_t lo = std::numeric_limits<int16_t>::max();
+			int16_t hi = std::numeric_limits<int16_t>::min();
+			BlockKernels::accumulateMinMax(samples + i, count, lo, hi);
+
+			if (_trigger.isQuiet(lo, hi, _ctx))
+			{
+				_interpolator.skip(samples + i, count);
+				_period.skip(count);
+				_ctx.sampleIndex += count;
+			}
+			else
+			{
+				scan(samples + i, count);
+			}
+
+			if (_waveformCallback)
+			{
+				int16_t decimated;
+				if (_cic.process(samples + i, count, 1, &decimated))   // At most one per group
+				{
+					_waveform.push(decimated);
+				}
+			}
+
+			_groupMin = std::min(_groupMin, lo);
+			_groupMax = std::max(_groupMax, hi);
+			_samplesInGroup += count;
+			if (_samplesInGroup == _decimation)
+			{
+				endGroup();
+			}
+			i += count;
+		}
+	}
+
+	/// Full rate, for samples that may contain edges
+	void scan(const int16_t* samples, size_t n)
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			_ctx.sample = samples[i];
+			_ctx.edge = PipelineContext::NoEdge;
+			_trigger.process(_ctx);
+			_interpolator.process(_ctx);
+			_period.process(_ctx);
+			if (_ctx.edge == PipelineContext::RisingEdge && _waveformCallback && ++_pulsesInWaveform >= 3)
+			{
+				_waveformCallback(_waveform, _ctx.pulse);
+				_waveform.clear();
+				_pulsesInWaveform = 0;
+			}
+			_ctx.sampleIndex++;
+		}
+	}
+
+	void endGroup()
+	{
+		_minMax.check(_groupMin);
+		_minMax.check(_groupMax);
+		_ctx.signalMin = _minMax.getMin();
+		_ctx.signalMax = _minMax.getMax();
+		_threshold.process(_ctx);
+
+		_groupMin = std::numeric_limits<int16_t>::max();
+		_groupMax = std::numeric_limits<int16_t>::min();
+		_samplesInGroup = 0;
+	}
+};
@@ -0,0 +1,610 @@
+/*
+ * OrderTracker.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include "SpscRing.hpp"
+#include "StreamProcessors/RealFFT.hpp"
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/**
+ * Result of analysing one revolution. The arrays belong to the OrderTracker,
+ * and are only valid during the callback.
+ */
+struct OrderSpectrum {
+	uint64_t revolution;    // Counted from 0, over the revolutions analysed
+	double startTime;       // Crossing time of the pulse starting the revolution, in samples
+	double endTime;         // Crossing time of the pulse ending it
+	double rpm;             // Average over the revolution
+	size_t numOrders;       // Orders 0 .. numOrders - 1 (samplesPerRevolution / 2 + 1)
+	const float* orders;    // Amplitude of each order over this revolution, in sample units
+	const float* averaged;  // Amplitude of each order, power averaged over the last revolutions
+	const float* samples;   // The revolution resampled, samplesPerRevolution of them
+};
+
+
+/**
+ * Order analysis of a second signal (an accelerometer or a microphone next
+ * to the machine), using the pulses of the rpm measurement as angle
+ * reference. Vibration that follows the shaft (unbalance, gear meshing,
+ * blade pass) stays at the same order (cycles per revolution) whatever the
+ * speed, while in a plain spectrum it smears over all frequencies the speed
+ * passes through.
+ *
+ * - Every pulsesPerRevolution:th pulse ends a revolution. The marks in
+ *   between are not used, so they need not be evenly spaced.
+ * - The angle between the pulses is a quadratic through the last three
+ *   revolution pulses (constant acceleration), or linear over the revolution
+ *   when there is no previous one (or its length differs by more than
+ *   maxSpeedChange).
+ * - Each revolution is resampled to samplesPerRevolution points at equal
+ *   angles, with a Blackman windowed sinc of kernelHalfWidth zero crossings
+ *   (from a table, interpolated). When a revolution is longer than that,
+ *   the sinc is widened to a low pass at cutoff times the new Nyquist, so
+ *   higher frequencies do not alias into the orders. Orders up to about a
+ *   third of samplesPerRevolution come out within 0.1%; above that the low
+ *   pass takes off (order 90 of 256 points is 2.5% low).
+ * - The revolution is analysed by a real FFT, without a window: it holds a
+ *   whole number of cycles of every order. Each new revolution is averaged
+ *   into the power of each order with weight 1 / averageRevolutions.
+ *
+ * Each revolution is analysed as soon as the samples the kernel needs after
+ * its end have arrived. Pulses may be added before the samples they are in
+ * (the detector runs first), in any block size. Revolutions slower than
+ * minRpm, and those whose kernel reaches before the first sample (or into
+ * samples lost, see skip()), are skipped. minRpm also sizes the history of
+ * samples.
+ *
+ * All buffers, the kernel and the FFT tables are allocated by the
+ * constructor. Runs on whatever thread calls processBlock(); see
+ * AsyncOrderTracker for running it on a worker thread.
+ */
+class OrderTracker {
+public:
+	struct Parameters {
+		Parameters() :
+			samplesPerRevolution(256),
+			pulsesPerRevolution(1),
+			minRpm(60),
+			kernelHalfWidth(8),
+			cutoff(0.9),
+			averageRevolutions(8),
+			maxSpeedChange(0.3)
+		{ }
+		size_t samplesPerRevolution;    // Power of two, at least 8
+		int pulsesPerRevolution;
+		double minRpm;
+		int kernelHalfWidth;            // Zero crossings on each side
+		double cutoff;                  // Of the new Nyquist, when the revolution is longer
+		double averageRevolutions;      // At least 1 (no averaging)
+		double maxSpeedChange;          // Relative, between revolutions, for the quadratic angle
+	};
+
+	typedef std::function<void(const OrderSpectrum&)> SpectrumCallback;
+
+	OrderTracker(int audioSampleRate, const Parameters& params = Parameters()) :
+		_audioSampleRate(audioSampleRate),
+		_params(params),
+		_maxRevolution(60.0 * audioSampleRate / params.minRpm),
+		_fft(params.samplesPerRevolution),
+		_kernel(params.kernelHalfWidth * KernelOversampling + 2),
+		_history(historySizeFor(_maxRevolution, params)),
+		_historyMask(_history.size() - 1),
+		_sampleIndex(0),
+		_firstValidSample(0),
+		_boundaries(MaxBoundaries),
+		_resampled(params.samplesPerRevolution),
+		_spectrum(_fft.getNumBins()),
+		_orders(_fft.getNumBins()),
+		_power(_fft.getNumBins()),
+		_averaged(_fft.getNumBins()),
+		_numRevolutions(0)
+	{
+		assert(params.pulsesPerRevolution >= 1);
+		assert(params.samplesPerRevolution >= 8);
+		assert(params.minRpm > 0);
+		assert(params.kernelHalfWidth >= 1);
+		assert(params.cutoff > 0 && params.cutoff <= 1);
+		assert(params.averageRevolutions >= 1);
+
+		// Blackman windowed sinc, from 0 to kernelHalfWidth zero crossings
+		const double halfWidth = params.kernelHalfWidth;
+		for (size_t i = 0; i + 1 < _kernel.size(); i++)
+		{
+			double x = double(i) / KernelOversampling;
+			double sinc = i ? sin(M_PI * x) / (M_PI * x) : 1;
+			double window = 0.42 + 0.5 * cos(M_PI * x / halfWidth) + 0.08 * cos(2 * M_PI * x / halfWidth);
+			_kernel[i] = float(sinc * window);
+		}
+		_kernel.back() = 0;
+		restart();
+	}
+
+	void setSpectrumCallback(const SpectrumCallback& callback) { _spectrumCallback = callback; }
+
+	size_t getSamplesPerRevolution() const { return _params.samplesPerRevolution; }
+
+	size_t getNumOrders() const { return _spectrum.size(); }
+
+	/// Samples received (and skipped) so far
+	uint64_t getSampleIndex() const { return _sampleIndex; }
+
+	uint64_t getNumRevolutions() const { return _numRevolutions; }
+
+	/**
+	 * @param crossingTime  in samples (PulseEvent::crossingTime), counted like
+	 *                      processBlock() counts them. Must not decrease.
+	 */
+	void addPulse(double crossingTime)
+	{
+		if (_numPulses++ % _params.pulsesPerRevolution)
+		{
+			return;
+		}
+		if (_numBoundaries == MaxBoundaries)
+		{
+			// The samples are far behind the pulses; start over from this one
+			restart();
+			_numPulses = 1;
+		}
+		_boundaries[(_firstBoundary + _numBoundaries) % MaxBoundaries] = crossingTime;
+		_numBoundaries++;
+		analyseRevolutions();
+	}
+
+	/**
+	 * The angle reference was lost after the last pulse added (e.g. the
+	 * RevolutionTracker started over), so no revolution is analysed from it
+	 * to the next one. Revolutions already ended are still analysed, and
+	 * pulses are counted for pulsesPerRevolution from the next one.
+	 */
+	void resetBoundary()
+	{
+		_numPulses = 0;
+		if (_numBoundaries == 0 || std::isnan(_boundaries[(_firstBoundary + _numBoundaries - 1) % MaxBoundaries]))
+		{
+			return;
+		}
+		if (_numBoundaries == MaxBoundaries)
+		{
+			restart();
+			return;
+		}
+		// A NaN boundary: neither revolution next to it has a length
+		_boundaries[(_firstBoundary + _numBoundaries) % MaxBoundaries] = NAN;
+		_numBoundaries++;
+		analyseRevolutions();
+	}
+
+	/**
+	 * Feeds samples[0], samples[stride], ... samples[(n - 1) * stride].
+	 * Revolutions are reported from within this call.
+	 */
+	void processBlock(const int16_t* samples, size_t n, size_t stride = 1)
+	{
+		while (n)
+		{
+			size_t count = std::min<size_t>(n, MaxBlockSize);
+			for (size_t i = 0; i < count; i++)
+			{
+				_history[(_sampleIndex + i) & _historyMask] = samples[i * stride];
+			}
+			_sampleIndex += count;
+			samples += count * stride;
+			n -= count;
+			analyseRevolutions();
+		}
+	}
+
+	/**
+	 * numSamples were lost. The angle starts over, and no revolution is
+	 * resampled from the samples before them.
+	 */
+	void skip(uint64_t numSamples)
+	{
+		_sampleIndex += numSamples;
+		_firstValidSample = _sampleIndex;
+		restart();
+	}
+
+	/// Forgets the pulses (not the averaged spectrum)
+	void restart()
+	{
+		_numPulses = 0;
+		_firstBoundary = 0;
+		_numBoundaries = 0;
+		_hasPrevious = false;
+		_previousStart = 0;
+	}
+
+private:
+	// The worker of AsyncOrderTracker may add a ring of pulses ahead of their samples
+	enum { KernelOversampling = 512, MaxBlockSize = 1024, MaxBoundaries = 1024 };
+
+	int _audioSampleRate;
+	Parameters _params;
+	double _maxRevolution;              // In samples, at minRpm
+	RealFFT _fft;
+	std::vector<float> _kernel;         // KernelOversampling points per zero crossing, then a 0
+
+	std::vector<float> _history;        // Circular, by sample index
+	size_t _historyMask;
+	uint64_t _sampleIndex;
+	uint64_t _firstValidSample;         // After the last skip()
+
+	uint64_t _numPulses;                // Since restart
+	std::vector<double> _boundaries;    // Revolution pulses not analysed yet (circular), NaN at a resetBoundary()
+	int _firstBoundary;
+	int _numBoundaries;
+	bool _hasPrevious;                  // _previousStart starts the revolution before _boundaries[0]
+	double _previousStart;
+
+	std::vector<float> _resampled;
+	std::vector<RealFFT::Complex> _spectrum;
+	std::vector<float> _orders;
+	std::vector<float> _power;
+	std::vector<float> _averaged;
+	uint64_t _numRevolutions;
+	SpectrumCallback _spectrumCallback;
+
+	/// Scale of the sinc (1 for no low pass) for a revolution of the given length
+	double cutoffFor(double revolution) const
+	{
+		return std::min(1.0, _params.cutoff * _params.samplesPerRevolution / revolution);
+	}
+
+	/// A revolution at minRpm, the kernel on both sides of it, and a block
+	static size_t historySizeFor(double maxRevolution, const Parameters& params)
+	{
+		double halfWidth = params.kernelHalfWidth * std::max(1.0, maxRevolution / (params.cutoff * params.samplesPerRevolution));
+		size_t size = 1024;
+		while (size < maxRevolution + 2 * halfWidth + MaxBlockSize + 4)
+		{
+			size *= 2;
+		}
+		return size;
+	}
+
+	void analyseRevolutions()
+	{
+		while (_numBoundaries >= 2)
+		{
+			double start = _boundaries[_firstBoundary];
+			double end = _boundaries[(_firstBoundary + 1) % MaxBoundaries];
+			double length = end - start;    // NaN next to a resetBoundary()
+			if (length > 0 && length <= _maxRevolution)
+			{
+				double halfWidth = _params.kernelHalfWidth / cutoffFor(length);
+				if (end + halfWidth + 1 >= double(_sampleIndex))
+				{
+					return;     // Waiting for the samples after the end
+				}
+				double oldest = std::max(double(_firstValidSample), double(_sampleIndex) - double(_history.size()));
+				if (start - halfWidth >= oldest)
+				{
+					resample(start, end);
+					analyse(start, end);
+				}
+			}
+
+			_hasPrevious = length > 0 && length <= _maxRevolution;
+			_previousStart = start;
+			_firstBoundary = (_firstBoundary + 1) % MaxBoundaries;
+			_numBoundaries--;
+		}
+	}
+
+	/**
+	 * Angle (in revolutions) a * u^2 + b * u at time u after start: 0 at
+	 * start, 1 at end, and -1 at the previous start when it is known (and
+	 * close enough to a revolution before).
+	 */
+	void resample(double start, double end)
+	{
+		double length = end - start;
+		double a = 0;
+		double b = 1 / length;
+		double before = start - _previousStart;
+		if (_hasPrevious && fabs(before - length) <= _params.maxSpeedChange * length)
+		{
+			a = (before - length) / (before * length * (before + length));
+			b = (1 - a * length * length) / length;
+		}
+
+		const double scale = cutoffFor(length);
+		const double halfWidth = _params.kernelHalfWidth / scale;
+		const double kernelLimit = double(_params.kernelHalfWidth) * KernelOversampling;
+		const size_t n = _params.samplesPerRevolution;
+		for (size_t k = 0; k < n; k++)
+		{
+			// Inverse of the angle, in the form that is stable also for a == 0
+			double angle = double(k) / n;
+			double t = start + 2 * angle / (b + sqrt(std::max(0.0, b * b + 4 * a * angle)));
+
+			int64_t first = int64_t(ceil(t - halfWidth));
+			int64_t last = int64_t(floor(t + halfWidth));
+			float sum = 0;
+			float weightSum = 0;
+			for (int64_t i = first; i <= last; i++)
+			{
+				double x = fabs(t - i) * scale * KernelOversampling;
+				if (x >= kernelLimit)
+				{
+					continue;
+				}
+				size_t index = size_t(x);
+				float fraction = float(x - index);
+				float weight = _kernel[index] + fraction * (_kernel[index + 1] - _kernel[index]);
+				sum += weight * _history[uint64_t(i) & _historyMask];
+				weightSum += weight;
+			}
+			_resampled[k] = weightSum != 0 ? sum / weightSum : 0;
+		}
+	}
+
+	void analyse(double start, double end)
+	{
+		_fft.forward(_resampled.data(), _spectrum.data());
+
+		const size_t n = _params.samplesPerRevolution;
+		const float rate = float(1 / _params.averageRevolutions);
+		for (size_t k = 0; k < _spectrum.size(); k++)
+		{
+			// Amplitude of a cosine at order k (the 0 and n / 2 bins are not doubled)
+			float amplitude = std::abs(_spectrum[k]) * (k == 0 || 2 * k == n ? 1.0f : 2.0f) / n;
+			float power = amplitude * amplitude;
+			_orders[k] = amplitude;
+			_power[k] = _numRevolutions ? _power[k] + rate * (power - _power[k]) : power;
+			_averaged[k] = sqrtf(_power[k]);
+		}
+
+		OrderSpectrum spectrum;
+		spectrum.revolution = _numRevolutions++;
+		spectrum.startTime = start;
+		spectrum.endTime = end;
+		spectrum.rpm = 60.0 * _audioSampleRate / (end - start);
+		spectrum.numOrders = _spectrum.size();
+		spectrum.orders = _orders.data();
+		spectrum.averaged = _averaged.data();
+		spectrum.samples = _resampled.data();
+		if (_spectrumCallback)
+		{
+			_spectrumCallback(spectrum);
+		}
+	}
+};
+
+
+/**
+ * Runs an OrderTracker on its own thread.
+ *
+ * addPulse() and processBlock() are called from the audio thread, and only
+ * copy into two rings, one for the samples and one for the pulses. The
+ * worker thread drains them in order and does the resampling and the FFTs,
+ * calling the spectrum callback from the worker thread.
+ *
+ * If the worker falls behind, whole blocks are dropped (counted in
+ * getNumDropped()). Where they were is passed on through the pulse ring, so
+ * the worker counts them as silence and starts the angle over, and the
+ * pulses keep lining up with the samples. A pulse that does not fit in its
+ * ring drops the block it is in.
+ */
+class AsyncOrderTracker {
+public:
+	typedef OrderTracker::SpectrumCallback SpectrumCallback;
+
+	AsyncOrderTracker(int audioSampleRate, const OrderTracker::Parameters& params = OrderTracker::Parameters()) :
+		_tracker(audioSampleRate, params),
+		_samples(ringSizeFor(audioSampleRate)),
+		_marks(1024),
+		_chunk(4096),
+		_samplesOffered(0),
+		_gapStart(0),
+		_gapLength(0),
+		_dropBlock(false),
+		_hasMark(false),
+		_numDropped(0),
+		_quit(false)
+	{ }
+
+	~AsyncOrderTracker()
+	{
+		stop();
+	}
+
+	/// Must be set before start(). Called from the worker thread.
+	void setSpectrumCallback(const SpectrumCallback& callback) { _tracker.setSpectrumCallback(callback); }
+
+	void start()
+	{
+		_thread = std::thread(&AsyncOrderTracker::run, this);
+	}
+
+	/// Analyses what is left in the rings, and stops the worker thread
+	void stop()
+	{
+		_quit = true;
+		if (_thread.joinable())
+		{
+			_thread.join();
+		}
+	}
+
+	/// Audio thread only, before the block the pulse is in
+	void addPulse(double crossingTime)
+	{
+		Mark mark;
+		mark.time = crossingTime;
+		mark.gapLength = 0;
+		if (_gapLength || !_marks.tryPush(mark))
+		{
+			_dropBlock = true;
+		}
+	}
+
+	/// Audio thread only, like addPulse(). See OrderTracker::resetBoundary()
+	void resetBoundary()
+	{
+		Mark mark;
+		mark.time = NAN;
+		mark.gapLength = 0;
+		if (_gapLength || !_marks.tryPush(mark))
+		{
+			_dropBlock = true;  // The gap starts the angle over too
+		}
+	}
+
+	/// Audio thread only. The whole block is queued, or dropped.
+	void processBlock(const int16_t* samples, size_t n, size_t stride = 1)
+	{
+		flushGap();
+		if (!_gapLength && !_dropBlock && _samples.capacity() - _samples.size() >= n)
+		{
+			_samples.tryPushBlock(samples, n, stride);
+		}
+		else
+		{
+			if (!_gapLength)
+			{
+				_gapStart = _samplesOffered;
+			}
+			_gapLength += n;
+			_numDropped.store(_numDropped.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+			flushGap();
+		}
+		_dropBlock = false;
+		_samplesOffered += n;
+	}
+
+	uint64_t getNumDropped() const { return _numDropped.load(std::memory_order_relaxed); }
+
+	size_t getSamplesPerRevolution() const { return _tracker.getSamplesPerRevolution(); }
+
+private:
+	/// A pulse, a resetBoundary() (time NaN), or (gapLength > 0) where samples were dropped
+	struct Mark {
+		double time;            // Crossing time, or the first sample dropped
+		uint64_t gapLength;
+	};
+
+	OrderTracker _tracker;
+	SpscRing<int16_t> _samples;
+	SpscRing<Mark> _marks;
+	std::vector<int16_t> _chunk;
+
+	// Audio thread
+	uint64_t _samplesOffered;
+	uint64_t _gapStart;
+	uint64_t _gapLength;        // Dropped, not yet passed on
+	bool _dropBlock;
+
+	// Worker thread
+	Mark _mark;
+	bool _hasMark;              // _mark is popped, but not applied yet
+
+	std::atomic<uint64_t> _numDropped;
+	std::atomic<bool> _quit;
+	std::thread _thread;
+
+	/// About half a second
+	static size_t ringSizeFor(int audioSampleRate)
+	{
+		size_t size = 4096;
+		while (size < size_t(audioSampleRate) / 2)
+		{
+			size *= 2;
+		}
+		return size;
+	}
+
+	void flushGap()
+	{
+		if (_gapLength)
+		{
+			Mark mark;
+			mark.time = double(_gapStart);
+			mark.gapLength = _gapLength;
+			if (_marks.tryPush(mark))
+			{
+				_gapLength = 0;
+			}
+		}
+	}
+
+	void run()
+	{
+		while (true)
+		{
+			bool quitting = _quit;  // Read before draining, so nothing pushed before stop() is lost
+			// Marks pushed before these samples are visible too
+			size_t available = _samples.size();
+			bool busy = false;
+			while (true)
+			{
+				if (!_hasMark)
+				{
+					_hasMark = _marks.tryPop(_mark);
+				}
+				if (_hasMark && _mark.gapLength == 0)
+				{
+					if (std::isnan(_mark.time))
+					{
+						_tracker.resetBoundary();
+					}
+					else
+					{
+						_tracker.addPulse(_mark.time);
+					}
+					_hasMark = false;
+					busy = true;
+					continue;
+				}
+
+				size_t count = std::min(available, _chunk.size());
+				if (_hasMark)
+				{
+					uint64_t untilGap = uint64_t(_mark.time) - _tracker.getSampleIndex();
+					if (untilGap == 0)
+					{
+						_tracker.skip(_mark.gapLength);
+						_hasMark = false;
+						busy = true;
+						continue;
+					}
+					count = std::min<uint64_t>(count, untilGap);
+				}
+				if (count == 0)
+				{
+					break;
+				}
+				count = _samples.tryPopBlock(_chunk.data(), count);
+				available -= count;
+				_tracker.processBlock(_chunk.data(), count);
+				busy = true;
+			}
+			if (quitting)
+			{
+				break;
+			}
+			if (!busy)
+			{
+				usleep(2000);
+			}
+		}
+	}
+};
@@ -0,0 +1,189 @@
+/*
+ * RPMCalculatorFromAudio.hpp
+ *
+ *  Created on: Jun 19, 2016
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include "FixedPointRPMCalculatorFromAudio.hpp"
+#include "StreamProcessors/DetectorStages.hpp"
+#include "StreamProcessors/Pipeline.hpp"
+#include "StreamProcessors/PulseEvent.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>
+
+/// The stage lists of the two detector variants
+template<bool CaptureWaveform> struct RPMDetectorPipeline;
+
+template<> struct RPMDetectorPipeline<true> {
+	typedef Pipeline<MinMaxStage, SchmittTriggerStage, CrossingInterpolatorStage, PeriodEstimatorStage,
+			WaveformCaptureStage, ThresholdStage> Type;
+
+	static Type create(int sampleRate, int divisor, int requiredAmplitude, const SeqLockValue<DetectorControl>& control)
+	{
+		return Type(MinMaxStage(sampleRate), SchmittTriggerStage(), CrossingInterpolatorStage(),
+				PeriodEstimatorStage(sampleRate, divisor, &control),
+				WaveformCaptureStage(sampleRate), ThresholdStage(requiredAmplitude, control));
+	}
+};
+
+template<> struct RPMDetectorPipeline<false> {
+	typedef Pipeline<MinMaxStage, SchmittTriggerStage, CrossingInterpolatorStage, PeriodEstimatorStage,
+			ThresholdStage> Type;
+
+	static Type create(int sampleRate, int divisor, int requiredAmplitude, const SeqLockValue<DetectorControl>& control)
+	{
+		return Type(MinMaxStage(sampleRate), SchmittTriggerStage(), CrossingInterpolatorStage(),
+				PeriodEstimatorStage(sampleRate, divisor, &control),
+				ThresholdStage(requiredAmplitude, control));
+	}
+};
+
+
+// TODO: Consider updating waveform even when not triggering on anything. (roll mode)
+/**
+ * Detects rising edges in an audio stream using a threshold (with hysteresis)
+ * placed at a percentage between the tracked min and max of the signal.
+ *
+ * Results are delivered through callbacks, called from the thread calling check():
+ * - the pulse callback is called for each detected pulse
+ * - the waveform callback is called every few pulses with the waveform
+ *   captured since the last delivery (only when CaptureWaveform is true)
+ *
+ * The work is done by a Pipeline of the stages in DetectorStages.hpp.
+ * Without waveform capture, the samples are never copied anywhere, which is
+ * what headless users (--blind, librpmcore, the GStreamer element) want.
+ */
+template<bool CaptureWaveform>
+class BasicRPMCalculatorFromAudio {
+public:
+	typedef PeriodEstimatorStage::PulseCallback PulseCallback;
+	typedef WaveformCaptureStage::WaveformCallback WaveformCallback;
+
+	BasicRPMCalculatorFromAudio(int audioSampleRate, int divisor, int requiredAmplitude = 3) :
+		_audioSampleRate(audioSampleRate),
+		_control(initialControl()),
+		_pipeline(RPMDetectorPipeline<CaptureWaveform>::create(audioSampleRate, divisor, requiredAmplitude,
+				_control))
+	{
+
+	}
+
+	void setPulseCallback(const PulseCallback& callback)
+	{
+		_pipeline.template stage<PeriodEstimatorStage>().setPulseCallback(callback);
+	}
+
+	/// Only available when CaptureWaveform is true
+	void setWaveformCallback(const WaveformCallback& callback)
+	{
+		_pipeline.template stage<WaveformCaptureStage>().setWaveformCallback(callback);
+	}
+
+	/**
+	 * Where the threshold is placed between min and max of the signal.
+	 * Safe to call from any thread. Takes effect at the start of the next block.
+	 */
+	void setThresholdPercentage(int percentage)
+	{
+		std::lock_guard<std::mutex> lock(_controlMutex);
+		DetectorControl control = _control.load();
+		if (control.thresholdPercentage != percentage)
+		{
+			control.thresholdPercentage = percentage;
+			_control.store(control);
+		}
+	}
+
+	int getThresholdPercentage() const { return _control.load().thresholdPercentage; }
+
+	/**
+	 * Filter for PulseEvent::filteredRpm, see BasicSlidingRpmFilter. Safe to
+	 * call from any thread. Takes effect at the start of the next block.
+	 */
+	void setRpmFilter(RpmFilter filter)
+	{
+		std::lock_guard<std::mutex> lock(_controlMutex);
+		DetectorControl control = _control.load();
+		if (control.rpmFilter != filter)
+		{
+			control.rpmFilter = filter;
+			_control.store(control);
+		}
+	}
+
+	RpmFilter getRpmFilter() const { return _control.load().rpmFilter; }
+
+	int getSampleRate() const { return _audioSampleRate; }
+
+	/// Linear by default. Must not be changed while another thread is calling check().
+	void setCrossingInterpolation(CrossingInterpolation interpolation)
+	{
+		_pipeline.template stage<CrossingInterpolatorStage>().setInterpolation(interpolation);
+	}
+
+	/**
+	 * Signal range (which the threshold is placed in) from percentiles instead of
+	 * min and max, see MinMaxStage::setQuantiles(). Must not be changed while
+	 * another thread is calling check().
+	 */
+	void setRangeQuantiles(double lowPercent, double highPercent)
+	{
+		_pipeline.template stage<MinMaxStage>().setQuantiles(lowPercent, highPercent);
+	}
+
+	/**
+	 * Track the signal range over periods periods (e.g. 8) instead of about
+	 * 2.6 seconds, see RangeWindowAdapter; 0 for the fixed window. Must not be
+	 * changed while another thread is calling check().
+	 */
+	void setRangeWindowPeriods(int periods)
+	{
+		_pipeline.template stage<MinMaxStage>().setWindowPeriods(periods);
+	}
+
+	void check(int16_t sample)
+	{
+		_pipeline.push(sample);
+	}
+
+	/**
+	 * Same as calling check() for samples[0], samples[stride], ... samples[(n - 1) * stride],
+	 * e.g. stride 2 to use one channel of interleaved stereo directly.
+	 */
+	void processBlock(const int16_t* samples, size_t n, size_t stride = 1)
+	{
+		_pipeline.processBlock(samples, n, stride);
+	}
+
+private:
+	int _audioSampleRate;
+	std::mutex _controlMutex;                   // Serializes writers of _control
+	SeqLockValue<DetectorControl> _control;     // Must be constructed before _pipeline
+	typename RPMDetectorPipeline<CaptureWaveform>::Type _pipeline;
+
+	static DetectorControl initialControl()
+	{
+		DetectorControl control;
+		control.thresholdPercentage = 50;
+		control.rpmFilter = MeanFilter;
+		return control;
+	}
+};
+
+typedef BasicRPMCalculatorFromAudio<true> RPMCalculatorFromAudio;
+
+// The detector used when nothing displays the waveform. Building with
+// -DRPMMETER_FIXED_POINT (make FIXED_POINT=1) selects the integer only one.
+#ifdef RPMMETER_FIXED_POINT
+typedef FixedPointRPMCalculatorFromAudio BlindRPMCalculatorFromAudio;
+#else
+typedef BasicRPMCalculatorFromAudio<false> BlindRPMCalculatorFromAudio;
+#endif
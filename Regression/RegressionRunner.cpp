@@ -0,0 +1,413 @@
+/*
+ * RegressionRunner.cpp
+ *
+ * Runs the detectors over a corpus of WAV files, and compares the detected
+ * pulses with stored golden files. Also checks that each file is processed
+ * at least a given factor faster than realtime.
+ *
+ * Each case is run through every detector: the float one (float), the fixed
+ * point one (fixed) and the multi-rate one (multirate, 4 samples per group).
+ *
+ * Corpus file format (one case per line, # starts a comment):
+ *   name  wav_file  min_realtime_factor  [rpm_divisor]
+ *
+ * Golden files are stored as <golden_dir>/<name>.txt for the float detector,
+ * and <golden_dir>/<name>.<detector>.txt for the others, one pulse per line:
+ *   sample_index  period_in_samples  rpm  rpm_filtered
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#include "../Benchmarks/TimingStats.hpp"
+#include "../FixedPointRPMCalculatorFromAudio.hpp"
+#include "../MultiRateRPMCalculatorFromAudio.hpp"
+#include "../RPMCalculatorFromAudio.hpp"
+#include "../SignalGenerator/WavFile.hpp"
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Case {
+	std::string name;
+	std::string wavFile;
+	double minRealtimeFactor;
+	int rpmDivisor;
+};
+
+struct Pulse {
+	double sampleIndex;
+	double period;
+	double rpm;
+	double filteredRpm;
+};
+
+enum Detector {
+	FloatDetector,
+	FixedPointDetector,
+	MultiRateDetector,
+	NumDetectors
+};
+
+const char* const g_detectorNames[NumDetectors] = { "float", "fixed", "multirate" };
+
+const size_t MultiRateDecimation = 4;
+const size_t BlockSize = 512;   // Samples per processBlock(), like a GStreamer buffer
+
+double g_timeTolerance = 0.01; // In samples
+double g_rpmTolerance = 1e-6;  // Relative
+bool g_update = false;
+std::string g_goldenDir = "Regression/golden";
+bool g_enabled[NumDetectors] = { true, true, true };
+
+bool readCorpus(const char* filename, std::vector<Case>& cases)
+{
+	std::ifstream in(filename);
+	if (!in)
+	{
+		std::cerr << "Unable to open corpus file " << filename << "\n";
+		return false;
+	}
+
+	std::string line;
+	int lineNo = 0;
+	while (std::getline(in, line))
+	{
+		lineNo++;
+		size_t hash = line.find('#');
+		if (hash != std::string::npos)
+		{
+			line.resize(hash);
+		}
+		std::istringstream iss(line);
+		Case c;
+		if (!(iss >> c.name))
+		{
+			continue; // Empty line
+		}
+		if (!(iss >> c.wavFile >> c.minRealtimeFactor))
+		{
+			std::cerr << filename << ":" << lineNo << ": expected name, wav file and realtime factor\n";
+			return false;
+		}
+		if (!(iss >> c.rpmDivisor))
+		{
+			c.rpmDivisor = 1;
+		}
+		cases.push_back(c);
+	}
+	return true;
+}
+
+bool readGolden(const std::string& filename, std::vector<Pulse>& pulses)
+{
+	std::ifstream in(filename.c_str());
+	if (!in)
+	{
+		return false;
+	}
+	std::string line;
+	while (std::getline(in, line))
+	{
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+		std::istringstream iss(line);
+		Pulse p;
+		if (iss >> p.sampleIndex >> p.period >> p.rpm >> p.filteredRpm)
+		{
+			pulses.push_back(p);
+		}
+	}
+	return true;
+}
+
+bool writeGolden(const std::string& filename, const std::vector<Pulse>& pulses)
+{
+	FILE* f = fopen(filename.c_str(), "w");
+	if (!f)
+	{
+		perror(filename.c_str());
+		return false;
+	}
+	fprintf(f, "# sample_index period rpm rpm_filtered\n");
+	for (const Pulse& p : pulses)
+	{
+		fprintf(f, "%.3f %.3f %.9g %.9g\n", p.sampleIndex, p.period, p.rpm, p.filteredRpm);
+	}
+	return fclose(f) == 0;
+}
+
+bool isClose(double expected, double actual, double relativeTolerance)
+{
+	return fabs(expected - actual) <= relativeTolerance * std::max(fabs(expected), 1.0);
+}
+
+/**
+ * @return number of mismatching pulses (a different pulse count counts as one)
+ */
+int compare(const std::string& name, const std::vector<Pulse>& golden, const std::vector<Pulse>& actual)
+{
+	int numMismatches = 0;
+	if (golden.size() != actual.size())
+	{
+		std::cout << "  " << name << ": expected " << golden.size()
+				<< " pulses, got " << actual.size() << "\n";
+		numMismatches++;
+	}
+
+	const int maxReported = 10;
+	for (size_t i = 0; i < std::min(golden.size(), actual.size()); i++)
+	{
+		const Pulse& g = golden[i];
+		const Pulse& a = actual[i];
+		bool ok = fabs(g.sampleIndex - a.sampleIndex) <= g_timeTolerance &&
+				fabs(g.period - a.period) <= 2 * g_timeTolerance &&
+				isClose(g.rpm, a.rpm, g_rpmTolerance) &&
+				isClose(g.filteredRpm, a.filteredRpm, g_rpmTolerance);
+		if (!ok)
+		{
+			if (numMismatches < maxReported)
+			{
+				std::cout << "  " << name << ": pulse " << i
+						<< " expected (sample=" << g.sampleIndex << ", period=" << g.period
+						<< ", rpm=" << g.rpm << ", rpm_filtered=" << g.filteredRpm
+						<< ") got (sample=" << a.sampleIndex << ", period=" << a.period
+						<< ", rpm=" << a.rpm << ", rpm_filtered=" << a.filteredRpm << ")\n";
+			}
+			numMismatches++;
+		}
+	}
+	return numMismatches;
+}
+
+/**
+ * Runs all samples through the detector, in blocks like main does.
+ * @return elapsed time in ns
+ */
+template<class RPMDetector>
+uint64_t detect(RPMDetector& detector, const std::vector<int16_t>& samples, std::vector<Pulse>& actual)
+{
+	detector.setPulseCallback([&](const PulseEvent& event) {
+		Pulse p;
+		p.sampleIndex = event.sampleIndex;
+		p.period = event.periodInSamples;
+		p.rpm = event.rpm;
+		p.filteredRpm = event.filteredRpm;
+		actual.push_back(p);
+	});
+
+	uint64_t start = nowNs();
+	for (size_t pos = 0; pos < samples.size(); pos += BlockSize)
+	{
+		detector.processBlock(&samples[pos], std::min(BlockSize, samples.size() - pos));
+	}
+	return std::max<uint64_t>(nowNs() - start, 1);
+}
+
+bool runDetector(const Case& c, Detector d, const std::vector<int16_t>& samples, int sampleRate)
+{
+	std::vector<Pulse> actual;
+	actual.reserve(samples.size() / 8);
+	uint64_t elapsedNs = 0;
+	switch (d)
+	{
+	case FixedPointDetector:
+	{
+		FixedPointRPMCalculatorFromAudio detector(sampleRate, c.rpmDivisor);
+		elapsedNs = detect(detector, samples, actual);
+		break;
+	}
+	case MultiRateDetector:
+	{
+		MultiRateRPMCalculatorFromAudio detector(sampleRate, c.rpmDivisor, MultiRateDecimation);
+		elapsedNs = detect(detector, samples, actual);
+		break;
+	}
+	default:
+	{
+		RPMCalculatorFromAudio detector(sampleRate, c.rpmDivisor);
+		elapsedNs = detect(detector, samples, actual);
+		break;
+	}
+	}
+
+	double audioSeconds = double(samples.size()) / sampleRate;
+	double realtimeFactor = audioSeconds / (elapsedNs * 1e-9);
+
+	const std::string name = c.name + " (" + g_detectorNames[d] + ")";
+	const std::string goldenFile = g_goldenDir + "/" + c.name +
+			(d == FloatDetector ? "" : std::string(".") + g_detectorNames[d]) + ".txt";
+	if (g_update)
+	{
+		if (!writeGolden(goldenFile, actual))
+		{
+			std::cout << "FAIL " << name << ": unable to write " << goldenFile << "\n";
+			return false;
+		}
+		std::cout << "UPDATED " << name << " (" << actual.size() << " pulses)\n";
+		return true;
+	}
+
+	std::vector<Pulse> golden;
+	if (!readGolden(goldenFile, golden))
+	{
+		std::cout << "FAIL " << name << ": missing golden file " << goldenFile
+				<< " (run with --update to create it)\n";
+		return false;
+	}
+
+	bool ok = true;
+	int numMismatches = compare(name, golden, actual);
+	if (numMismatches)
+	{
+		std::cout << "FAIL " << name << ": " << numMismatches << " pulse(s) differ from " << goldenFile << "\n";
+		ok = false;
+	}
+	if (realtimeFactor < c.minRealtimeFactor)
+	{
+		std::cout << "FAIL " << name << ": too slow, " << realtimeFactor
+				<< "x realtime (budget " << c.minRealtimeFactor << "x)\n";
+		ok = false;
+	}
+	if (ok)
+	{
+		std::cout << "PASS " << name << ": " << actual.size() << " pulses, "
+				<< int(realtimeFactor) << "x realtime (budget " << c.minRealtimeFactor << "x)\n";
+	}
+	return ok;
+}
+
+/**
+ * @return number of failed detectors
+ */
+int runCase(const Case& c)
+{
+	std::vector<int16_t> samples;
+	int sampleRate = 0;
+	const char* error = "";
+	if (!readWavChannel(c.wavFile.c_str(), 0, samples, sampleRate, error))
+	{
+		std::cout << "FAIL " << c.name << ": " << c.wavFile << ": " << error << "\n";
+		return 1;
+	}
+
+	int numFailed = 0;
+	for (int d = 0; d < NumDetectors; d++)
+	{
+		if (g_enabled[d] && !runDetector(c, Detector(d), samples, sampleRate))
+		{
+			numFailed++;
+		}
+	}
+	return numFailed;
+}
+
+bool parseDetectors(const char* list)
+{
+	std::fill(g_enabled, g_enabled + NumDetectors, false);
+	std::istringstream iss(list);
+	std::string name;
+	while (std::getline(iss, name, ','))
+	{
+		const char* const* found = std::find(g_detectorNames, g_detectorNames + NumDetectors, name);
+		if (found == g_detectorNames + NumDetectors)
+		{
+			fprintf(stderr, "Unknown detector '%s'\n", name.c_str());
+			return false;
+		}
+		g_enabled[found - g_detectorNames] = true;
+	}
+	return true;
+}
+
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+	while (true)
+	{
+		static struct option long_options[] =
+		{
+				{"update",         no_argument,       0, 'u'},
+				{"golden_dir",     required_argument, 0, 'g'},
+				{"time_tolerance", required_argument, 0, 't'},
+				{"rpm_tolerance",  required_argument, 0, 'r'},
+				{"detectors",      required_argument, 0, 'd'},
+				{"help",           no_argument,       0, 'h'},
+				{0, 0, 0, 0}
+		};
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "ug:t:r:d:h", long_options, &option_index);
+		if (c == -1)
+			break;
+
+		switch (c)
+		{
+		case 'u': g_update = true; break;
+		case 'g': g_goldenDir = optarg; break;
+		case 't': g_timeTolerance = atof(optarg); break;
+		case 'r': g_rpmTolerance = atof(optarg); break;
+		case 'd':
+			if (!parseDetectors(optarg))
+			{
+				return 1;
+			}
+			break;
+		case 'h':
+		default:
+			printf(
+					"%s [options] CORPUS_FILE\n"
+					"-u, --update                Write golden files from current results instead of comparing\n"
+					"-g, --golden_dir DIR        Where golden files are stored (default Regression/golden)\n"
+					"-t, --time_tolerance N      Allowed difference in pulse position, in samples (default 0.01)\n"
+					"-r, --rpm_tolerance N       Allowed relative difference in rpm (default 1e-6)\n"
+					"-d, --detectors LIST        Comma separated detectors to run (default float,fixed,multirate)\n"
+					"-h, --help\n"
+					"\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind != argc - 1)
+	{
+		fprintf(stderr, "Expected exactly one corpus file (see --help)\n");
+		return 1;
+	}
+
+	std::vector<Case> cases;
+	if (!readCorpus(argv[optind], cases))
+	{
+		return 1;
+	}
+
+	int numDetectors = std::count(g_enabled, g_enabled + NumDetectors, true);
+	int numFailed = 0;
+	for (const Case& c : cases)
+	{
+		numFailed += runCase(c);
+	}
+
+	int numRuns = cases.size() * numDetectors;
+	if (numFailed)
+	{
+		std::cout << "\n*** " << numFailed << " of " << numRuns << " regression runs FAILED ***\n";
+		return 1;
+	}
+	std::cout << "\nAll " << numRuns << " regression runs (" << cases.size() << " cases, "
+			<< numDetectors << " detectors) passed\n";
+	return 0;
+}
@@ -0,0 +1,20 @@
+#!/bin/sh
+#
+# Creates the generated part of the regression corpus. The generator is
+# deterministic, so the files are identical on every run and platform.
+#
+# Usage: Regression/generate_corpus.sh [path to generate_signal]
+
+set -e
+
+GEN=${1:-./generate_signal}
+OUT=Regression/generated
+
+mkdir -p $OUT
+
+$GEN -o $OUT/constant_1500.wav  -t 5 --rpm 1500 --noise 100
+$GEN -o $OUT/ramp_600_6000.wav  --rpm "0:600,5:6000" --noise 200 --jitter 0.002 --seed 2
+$GEN -o $OUT/steps.wav          --rpm "0:1000,2:1000,2:3000,4:3000,4:500,6:500" --noise 50 --seed 3
+$GEN -o $OUT/fade_and_drift.wav --rpm 2000 --amplitude "0:10000,3:300,6:10000" --dc_drift 2000 --dc_drift_period 3 --noise 30 --seed 4
+$GEN -o $OUT/high_rpm_30000.wav -t 3 --rpm 30000 --noise 100 --seed 5
+$GEN -o $OUT/four_pulses_per_rev.wav -t 4 --rpm 1200 --pulses_per_rev 4 --jitter 0.005 --noise 100 --seed 6
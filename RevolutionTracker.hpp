@@ -0,0 +1,257 @@
+/*
+ * RevolutionTracker.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+/**
+ * Output of the RevolutionTracker, for each pulse.
+ */
+struct RevolutionEvent {
+	double crossingTime;    // Of the pulse ending the segment, in samples
+	int segment;            // 0 .. pulsesPerRevolution - 1, 0 starting at the index pulse
+	double segmentRpm;      // Angular velocity over the segment, in rpm
+	double rpm;             // Over the last whole revolution, 0 until there is one
+	bool indexLocked;       // The index pulse is known, so segment numbers are absolute
+	bool revolution;        // The pulse is the index pulse (once per revolution)
+};
+
+
+/**
+ * Speed from a target with pulsesPerRevolution marks that need not be
+ * evenly spaced (tape marks, fan blades, a toothed wheel with a gap).
+ * Dividing the pulse rate by the number of marks, as --rpm_divisor does,
+ * gives a ripple repeating every revolution, as each period covers a
+ * different angle.
+ *
+ * - The rpm is taken over the last pulsesPerRevolution periods, always
+ *   exactly one revolution, so the spacing of the marks cancels out. It
+ *   still follows every pulse.
+ * - The angle covered by each segment (as a fraction of a revolution) is
+ *   learned from the periods at the end of each revolution, averaging
+ *   learningRate of each revolution in. Each period is compared to the
+ *   revolution time at its own time, interpolated between the last two
+ *   revolutions, so the angles are also right while the speed changes.
+ *   The segment rpm is the angle over the period, which is smooth once the
+ *   angles are learned (after two revolutions).
+ * - The index pulse is the one ending the longest segment, e.g. the gap of
+ *   a wheel with a missing tooth. It is locked once that segment is at
+ *   least minGapRatio times as long as any other. Without such a gap the
+ *   segments are numbered from an arbitrary pulse.
+ *
+ * A period more than maxSegmentChange off from the learned one (a missed
+ * or an extra pulse) shifts every later pulse to the wrong segment, so the
+ * tracker starts over from that pulse and learns the angles again.
+ *
+ * The periods of the last revolution are kept in a ring of floats, and the
+ * learned angles in another; everything else is per pulse work.
+ */
+class RevolutionTracker {
+public:
+	struct Parameters {
+		Parameters() :
+			pulsesPerRevolution(1),
+			learningRate(0.1),
+			minGapRatio(1.3),
+			maxSegmentChange(0.4)
+		{ }
+		int pulsesPerRevolution;
+		double learningRate;        // 0 .. 1, per revolution
+		double minGapRatio;
+		double maxSegmentChange;    // Relative to the expected period of the segment
+	};
+
+	typedef std::function<void(const RevolutionEvent&)> RevolutionCallback;
+
+	RevolutionTracker(int audioSampleRate, const Parameters& params = Parameters()) :
+		_audioSampleRate(audioSampleRate),
+		_params(params),
+		_periods(params.pulsesPerRevolution),
+		_fractions(params.pulsesPerRevolution),
+		_rpm(0),
+		_indexLocked(false),
+		_indexPosition(0)
+	{
+		assert(params.pulsesPerRevolution >= 1);
+		assert(params.learningRate > 0 && params.learningRate <= 1);
+		restart();
+	}
+
+	void setRevolutionCallback(const RevolutionCallback& callback) { _revolutionCallback = callback; }
+
+	int getPulsesPerRevolution() const { return _params.pulsesPerRevolution; }
+
+	/// Over the last whole revolution, 0 until there is one
+	double getRpm() const { return _rpm; }
+
+	bool isIndexLocked() const { return _indexLocked; }
+
+	/**
+	 * @param crossingTime  in samples (PulseEvent::crossingTime). Must not
+	 *                      decrease from one call to the next.
+	 * @return true if a RevolutionEvent was reported for this pulse; false
+	 *         for the first pulse, and for the one starting over
+	 */
+	bool addPulse(double crossingTime)
+	{
+		const int n = _params.pulsesPerRevolution;
+		if (!_hasPulse)
+		{
+			_hasPulse = true;
+			_lastPulse = crossingTime;
+			return false;
+		}
+		double period = std::max(crossingTime - _lastPulse, 1e-3);
+		_lastPulse = crossingTime;
+
+		if (_numLearned && isOutlier(period))
+		{
+			restart();
+			_hasPulse = true;
+			_lastPulse = crossingTime;
+			return false;
+		}
+
+		_revolutionTime += period - _periods[_position];
+		_periods[_position] = float(period);
+		_numPeriods++;
+
+		if (_numPeriods >= n)
+		{
+			_rpm = 60.0 * _audioSampleRate / _revolutionTime;
+		}
+
+		RevolutionEvent event;
+		event.crossingTime = crossingTime;
+		event.segmentRpm = 60.0 * _audioSampleRate * _fractions[_position] / period;
+		event.rpm = _rpm;
+
+		int position = _position;
+		_position = (_position + 1) % n;
+		if (_position == 0)
+		{
+			endRevolution();
+		}
+
+		event.indexLocked = _indexLocked;
+		int start = _indexLocked ? (_indexPosition + 1) % n : 0;
+		event.segment = (position - start + n) % n;
+		event.revolution = event.segment == n - 1;
+		if (_revolutionCallback)
+		{
+			_revolutionCallback(event);
+		}
+		return true;
+	}
+
+	/// Forgets the pulses and the learned angles
+	void restart()
+	{
+		std::fill(_periods.begin(), _periods.end(), 0.0f);
+		std::fill(_fractions.begin(), _fractions.end(), 1.0f / _params.pulsesPerRevolution);
+		_hasPulse = false;
+		_lastPulse = 0;
+		_position = 0;
+		_numPeriods = 0;
+		_revolutionTime = 0;
+		_previousRevolutionTime = 0;
+		_numLearned = 0;
+		_rpm = 0;
+		_indexLocked = false;
+		_indexPosition = 0;
+	}
+
+private:
+	int _audioSampleRate;
+	Parameters _params;
+	std::vector<float> _periods;    // Of the last revolution, by position
+	std::vector<float> _fractions;  // Learned angle of each position, in revolutions
+
+	bool _hasPulse;
+	double _lastPulse;
+	int _position;                  // Of the next period in the ring
+	int _numPeriods;                // Since (re)start
+	double _revolutionTime;         // Sum of _periods
+	double _previousRevolutionTime; // At the end of the previous revolution, 0 if none
+	int _numLearned;                // Revolutions _fractions are learned from
+	double _rpm;
+	bool _indexLocked;
+	int _indexPosition;             // Position of the segment ending at the index pulse
+	RevolutionCallback _revolutionCallback;
+
+	bool isOutlier(double period) const
+	{
+		double expected = _fractions[_position] * _revolutionTime;
+		return period > expected * (1 + _params.maxSegmentChange) ||
+				period < expected * (1 - _params.maxSegmentChange);
+	}
+
+	/// After the last position of the ring
+	void endRevolution()
+	{
+		const int n = _params.pulsesPerRevolution;
+		if (_numPeriods < n)
+		{
+			return;
+		}
+
+		// Sums drift as periods come and go; start each revolution exact
+		_revolutionTime = 0;
+		for (int k = 0; k < n; k++)
+		{
+			_revolutionTime += _periods[k];
+		}
+
+		// Revolution time at the middle of each segment, changing linearly
+		// from the last revolution to this one (both centered on their middle)
+		double change = _previousRevolutionTime > 0 ? (_revolutionTime - _previousRevolutionTime) / _revolutionTime : 0;
+		double rate = _numLearned < 2 ? 1 : _params.learningRate;   // The first two are replaced
+		double start = 0;
+		double sum = 0;
+		for (int k = 0; k < n; k++)
+		{
+			double middle = (start + 0.5 * _periods[k]) / _revolutionTime;
+			start += _periods[k];
+			double fraction = _periods[k] / (_revolutionTime * (1 + change * (middle - 0.5)));
+			_fractions[k] += float(rate * (fraction - _fractions[k]));
+			sum += _fractions[k];
+		}
+		for (int k = 0; k < n; k++)
+		{
+			_fractions[k] = float(_fractions[k] / sum);
+		}
+		_previousRevolutionTime = _revolutionTime;
+		_numLearned++;
+
+		// The longest segment, and how much longer it is than the next one
+		int longest = 0;
+		for (int k = 1; k < n; k++)
+		{
+			if (_fractions[k] > _fractions[longest])
+			{
+				longest = k;
+			}
+		}
+		float second = 0;
+		for (int k = 0; k < n; k++)
+		{
+			if (k != longest)
+			{
+				second = std::max(second, _fractions[k]);
+			}
+		}
+		_indexLocked = n > 1 && _fractions[longest] >= _params.minGapRatio * second;
+		_indexPosition = _indexLocked ? longest : 0;
+	}
+};
@@ -0,0 +1,98 @@
+/*
+ * RpmFusion.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include "SpectralRPMEstimator.hpp"
+#include "StreamProcessors/PulseEvent.hpp"
+
+#include <math.h>
+#include <stdint.h>
+
+/**
+ * Combines the edge detector (precise, low latency, but fails on weak or
+ * noisy signals) with the SpectralRPMEstimator (slow, but robust):
+ *
+ * - Both available and agreeing: the (filtered) edge rpm.
+ * - Both available but disagreeing (e.g. noise causing double triggers, or
+ *   pulses missed): the spectral rpm.
+ * - Only one available: that one.
+ *
+ * The edge detector counts as available when its last pulse is at most
+ * maxEdgeAgeInPeriods of its own periods older than the spectral estimate,
+ * and the spectral estimate when its confidence is at least minConfidence.
+ */
+class RpmFusion {
+public:
+	struct Parameters {
+		Parameters() :
+			minConfidence(0.5),
+			maxDisagreement(0.05),
+			maxEdgeAgeInPeriods(4)
+		{ }
+		double minConfidence;
+		double maxDisagreement;      // Relative difference still counted as agreeing
+		double maxEdgeAgeInPeriods;
+	};
+
+	enum Source {
+		None,
+		Edge,
+		Spectral
+	};
+
+	struct Result {
+		double rpm;
+		Source source;
+	};
+
+	explicit RpmFusion(const Parameters& params = Parameters()) : _params(params) { }
+
+	/**
+	 * @param lastPulse  latest pulse from the edge detector, or NULL if none yet
+	 * @param estimate   latest spectral estimate
+	 */
+	Result fuse(const PulseEvent* lastPulse, const SpectralEstimate& estimate) const
+	{
+		bool edgeOk = lastPulse && isRecent(*lastPulse, estimate.sampleIndex);
+		bool spectralOk = estimate.confidence >= _params.minConfidence && estimate.rpm > 0;
+
+		Result result;
+		result.rpm = 0;
+		result.source = None;
+		if (edgeOk && (!spectralOk || fabs(lastPulse->filteredRpm - estimate.rpm) <= _params.maxDisagreement * estimate.rpm))
+		{
+			result.rpm = lastPulse->filteredRpm;
+			result.source = Edge;
+		}
+		else if (spectralOk)
+		{
+			result.rpm = estimate.rpm;
+			result.source = Spectral;
+		}
+		return result;
+	}
+
+	static const char* getSourceName(Source source)
+	{
+		switch(source)
+		{
+		case Edge: return "edge";
+		case Spectral: return "spectral";
+		default: return "none";
+		}
+	}
+
+private:
+	Parameters _params;
+
+	bool isRecent(const PulseEvent& pulse, uint64_t sampleIndex) const
+	{
+		return pulse.sampleIndex >= sampleIndex ||
+				sampleIndex - pulse.sampleIndex <= _params.maxEdgeAgeInPeriods * pulse.periodInSamples;
+	}
+};
@@ -9,6 +9,8 @@
 
 #pragma once
 
+#include "StreamProcessors/SlidingRpmFilter.hpp"
+
 #include <SDL/SDL.h>
 
 
@@ -18,6 +20,8 @@ public:
 		_should_quit(false),
 		_should_go_fullscreen(false),
 		_should_display_filtered_rpm(false),
+		_rpmFilter(MeanFilter),
+		_firstRpmFilter(MeanFilter),
 		_digitScaling(2),
 		_thresholdPercentage(50)
 	{
@@ -74,7 +78,17 @@ public:
 					break;
 
 				case SDLK_f:
-					_should_display_filtered_rpm ^= 1;
+					// raw -> the configured filter -> the next ones (mean, median,
+					// trimmed, hampel, wrapping around) -> raw
+					if (!_should_display_filtered_rpm)
+					{
+						_should_display_filtered_rpm = true;
+					}
+					else
+					{
+						_rpmFilter = RpmFilter((_rpmFilter + 1) % (HampelFilter + 1));
+						_should_display_filtered_rpm = _rpmFilter != _firstRpmFilter;
+					}
 					break;
 
 				case SDLK_SPACE:
@@ -101,6 +115,15 @@ public:
 
 	bool shouldDisplayFilteredRPM() const { return _should_display_filtered_rpm; }
 
+	RpmFilter getRpmFilter() const { return _rpmFilter; }
+
+	/// The configured filter, which f cycles from and back to
+	void setRpmFilter(RpmFilter filter)
+	{
+		_rpmFilter = filter;
+		_firstRpmFilter = filter;
+	}
+
 	int getDigitScaling() const { return _digitScaling; }
 
 	void setDigitScaling(int scaling) { _digitScaling = scaling; }
@@ -118,6 +141,8 @@ private:
 	bool _should_quit;
 	bool _should_go_fullscreen;
 	bool _should_display_filtered_rpm;
+	RpmFilter _rpmFilter;
+	RpmFilter _firstRpmFilter;
 
 	int _digitScaling;
 	int _thresholdPercentage;
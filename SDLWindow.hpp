@@ -9,11 +9,14 @@
 
 #pragma once
 
+#include "StreamProcessors/CappedStorageWaveform.hpp"
+
 #include <SDL/SDL.h>
 #include <SDL/SDL_gfxPrimitives.h>
 #include <SDL/SDL_gfxPrimitives_font.h>
 
 #include <iostream>
+#include <vector>
 
 #include <assert.h>
 
@@ -112,13 +115,14 @@ public:
 				_screen,
 				0,
 				0,
-				"ESC = quit, F11 = toggle fullscreen, +/- = change digit size, f = toggle rpm averaging",
+				"ESC = quit, F11 = toggle fullscreen, +/- = change digit size, f = cycle rpm filter",
 				255, 255, 255, 255);
 	}
 
 	void drawAdditionalStats(
 			float rpm,
 			float filteredRpm,
+			const char* filterName,
 			int signalMax,
 			int signalMin,
 			int threshold,
@@ -133,7 +137,7 @@ public:
 		snprintf(buff, sizeof(buff), "          RPM: %5.1f", rpm);
 		stringRGBA(	_screen, x, y, buff, 255, 255, 255, 255);
 		y += dy;
-		snprintf(buff, sizeof(buff), " filtered RPM: %5.1f", filteredRpm);
+		snprintf(buff, sizeof(buff), "%9s RPM: %5.1f", filterName, filteredRpm);
 		stringRGBA(	_screen, x, y, buff, 255, 255, 255, 255);
 		y += dy;
 		snprintf(buff, sizeof(buff), "sensor maxval: %5d", signalMax);
@@ -151,6 +155,77 @@ public:
 	}
 
 
+	/**
+	 * Draws a captured waveform scaled to the full width of the window,
+	 * along with the threshold +/- hysteresis levels.
+	 * Each bin is drawn as a vertical line covering its min/max range.
+	 */
+	void drawWaveform(
+			const std::vector<CappedStorageWaveform::Bin>& waveform,
+			size_t triggerBin,
+			int signalMin,
+			int signalMax,
+			int threshold,
+			int hysteresis)
+	{
+		double xScaling = _w * 1.0 / waveform.size();
+
+		const auto & convertY = [&](int sample) {
+			int tmp = (sample - signalMin) * 255.0 / (signalMax - signalMin);
+			return _h - 1 - tmp;
+		};
+
+		// Draw the vertical extent of each bin, and connect neighbouring bins.
+		for (int i = 0; i < int(waveform.size()); i++)
+		{
+			const CappedStorageWaveform::Bin& bin = waveform[i];
+			drawLine(
+					i * xScaling,
+					convertY(bin.min),
+					i * xScaling,
+					convertY(bin.max),
+					255, 255, 255, 255
+			);
+			if (i + 1 < int(waveform.size()))
+			{
+				const CappedStorageWaveform::Bin& next = waveform[i+1];
+				drawLine(
+						i * xScaling,
+						convertY(next.max < bin.min ? bin.min : bin.max),
+						(i+1) * xScaling,
+						convertY(next.max < bin.min ? next.max : next.min),
+						255, 255, 255, 255
+				);
+			}
+		}
+
+		// Mark the trigger point (end of the pre-trigger region)
+		if (triggerBin > 0)
+		{
+			drawLine(
+					triggerBin * xScaling,
+					_h - 1 - 255,
+					triggerBin * xScaling,
+					_h - 1,
+					255, 255, 0, 255);
+		}
+
+		// Draw the thresholds used during signal processing
+		// TODO: draw a nice symbol for the hysteresis region as well?
+		drawLine(
+				0,
+				convertY(threshold + hysteresis),
+				_w-1,
+				convertY(threshold + hysteresis),
+				0, 0, 255, 255);
+		drawLine(
+				0,
+				convertY(threshold - hysteresis),
+				_w-1,
+				convertY(threshold - hysteresis),
+				0, 0, 255, 255);
+	}
+
 	void drawLine(Sint16 x1, Sint16 y1,
 			Sint16 x2, Sint16 y2,
 			Uint8 r, Uint8 g, Uint8 b, Uint8 a)
@@ -317,6 +392,25 @@ public:
 		SDL_Flip(_screen);
 	}
 
+	/**
+	 * Overrides the resolution used by setFullscreenMode(). Mostly useful
+	 * with the dummy video driver, which reports no native resolution.
+	 */
+	void setFullscreenResolution(int w, int h)
+	{
+		_fullscreenWidth = w;
+		_fullscreenHeight = h;
+	}
+
+	/**
+	 * Saves the current (not yet flipped) frame as a BMP file.
+	 * @return true on success
+	 */
+	bool saveBMP(const char* filename)
+	{
+		return SDL_SaveBMP(_screen, filename) == 0;
+	}
+
 private:
 	bool _should_call_sdl_quit;
 	bool _isFullscreen;
@@ -0,0 +1,89 @@
+/*
+ * SeqLock.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <type_traits>
+
+/**
+ * Latest value of T, written by one thread and read by any number of threads.
+ *
+ * The writer never waits for readers (it only bumps a sequence number around
+ * the copy), so it is safe to publish from the audio thread. Readers retry if
+ * the value changed while they copied it.
+ */
+template<class T>
+class SeqLockValue {
+public:
+	explicit SeqLockValue(const T& initial = T()) : _seq(0)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "SeqLockValue needs a trivially copyable type");
+		copyIn(initial);
+	}
+
+	/// Must only be called from one thread
+	void store(const T& value)
+	{
+		uint32_t seq = _seq.load(std::memory_order_relaxed);
+		_seq.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		copyIn(value);
+		_seq.store(seq + 2, std::memory_order_release);
+	}
+
+	T load() const
+	{
+		T value;
+		uint32_t before;
+		uint32_t after;
+		do
+		{
+			before = _seq.load(std::memory_order_acquire);
+			copyOut(value);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = _seq.load(std::memory_order_relaxed);
+		} while ((before & 1) || before != after);
+		return value;
+	}
+
+	/// Number of stores done so far
+	uint32_t getVersion() const { return _seq.load(std::memory_order_acquire) / 2; }
+
+private:
+	std::atomic<uint32_t> _seq;
+	// Copied word by word through relaxed atomics, so the concurrent
+	// reads and writes are well defined.
+	enum { NumWords = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t) };
+	std::atomic<uint32_t> _words[NumWords];
+
+	void copyIn(const T& value)
+	{
+		unsigned char tmp[NumWords * sizeof(uint32_t)] = { 0 };
+		memcpy(tmp, &value, sizeof(T));
+		for (int i = 0; i < NumWords; i++)
+		{
+			uint32_t w;
+			memcpy(&w, tmp + i * sizeof(uint32_t), sizeof(uint32_t));
+			_words[i].store(w, std::memory_order_relaxed);
+		}
+	}
+
+	void copyOut(T& value) const
+	{
+		unsigned char tmp[NumWords * sizeof(uint32_t)];
+		for (int i = 0; i < NumWords; i++)
+		{
+			uint32_t w = _words[i].load(std::memory_order_relaxed);
+			memcpy(tmp + i * sizeof(uint32_t), &w, sizeof(uint32_t));
+		}
+		memcpy(&value, tmp, sizeof(T));
+	}
+};
@@ -0,0 +1,233 @@
+/*
+ * ShmPublisher.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include "RPMCalculatorFromAudio.hpp"
+#include "RpmFusion.hpp"
+#include "SpeedTracker.hpp"
+#include "StallDetector.hpp"
+#include "Stopwatch.hpp"
+#include "rpm_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <string>
+
+/**
+ * Publishes detected pulses in a POSIX shared memory segment (layout in
+ * rpm_shm.h), so other processes on the same host can read the latest rpm
+ * and recent pulses without any system calls.
+ *
+ * publish() never blocks and does not allocate. It only makes a system call
+ * (FUTEX_WAKE) when some reader is sleeping in rpm_shm_wait().
+ */
+class ShmPublisher {
+public:
+	ShmPublisher() : _shm(NULL), _sampleRate(0) { }
+
+	~ShmPublisher()
+	{
+		close();
+	}
+
+	/**
+	 * Creates (or takes over) the segment /name.
+	 * @return false (with errno set) on failure
+	 */
+	bool open(const char* name, int sampleRate)
+	{
+		close();
+		std::string path = std::string("/") + name;
+		int fd = shm_open(path.c_str(), O_CREAT | O_RDWR, 0666);
+		if (fd < 0)
+		{
+			return false;
+		}
+		if (ftruncate(fd, sizeof(struct rpm_shm)) < 0)
+		{
+			int err = errno;
+			::close(fd);
+			errno = err;
+			return false;
+		}
+		void* p = mmap(NULL, sizeof(struct rpm_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		int err = errno;
+		::close(fd);
+		if (p == MAP_FAILED)
+		{
+			errno = err;
+			return false;
+		}
+
+		_shm = (struct rpm_shm*)p;
+		_path = path;
+		_sampleRate = sampleRate;
+
+		// Invalidate first, so readers of a stale segment with the same name
+		// do not accept a half initialized one.
+		__atomic_store_n(&_shm->magic, 0, __ATOMIC_RELEASE);
+		memset((char*)_shm + sizeof(_shm->magic), 0, sizeof(struct rpm_shm) - sizeof(_shm->magic));
+		_shm->version = RPM_SHM_VERSION;
+		_shm->size = sizeof(struct rpm_shm);
+		_shm->ring_size = RPM_SHM_RING_SIZE;
+		_shm->latest.sample_rate = sampleRate;
+		__atomic_store_n(&_shm->magic, RPM_SHM_MAGIC, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	/// Unmaps and removes the segment. Readers that have it mapped keep their mapping.
+	void close()
+	{
+		if (_shm)
+		{
+			munmap(_shm, sizeof(struct rpm_shm));
+			shm_unlink(_path.c_str());
+			_shm = NULL;
+		}
+	}
+
+	bool isOpen() const { return _shm != NULL; }
+
+	/**
+	 * Must only be called from one thread at a time (the one running the
+	 * detector, or one holding the same lock as it)
+	 */
+	void publish(const PulseEvent& event)
+	{
+		if (!_shm)
+		{
+			return;
+		}
+		uint64_t timestampNs = nowNs();
+		uint64_t writeCount = _shm->write_count;
+
+		// The slot still holds pulse writeCount - RING_SIZE. Readers detect that
+		// it is being overwritten by checking write_count after copying it, so
+		// write_count must be visible before the slot is modified.
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		struct rpm_shm_pulse& pulse = _shm->ring[writeCount % RPM_SHM_RING_SIZE];
+		pulse.sample_index = event.sampleIndex;
+		pulse.timestamp_ns = timestampNs;
+		pulse.period_in_samples = event.periodInSamples;
+		pulse.rpm = event.rpm;
+		pulse.filtered_rpm = event.filteredRpm;
+
+		uint32_t seq = _shm->latest_seq;
+		__atomic_store_n(&_shm->latest_seq, seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		struct rpm_shm_latest& latest = _shm->latest;
+		latest.num_pulses = writeCount + 1;
+		latest.sample_index = event.sampleIndex;
+		latest.timestamp_ns = timestampNs;
+		latest.period_in_samples = event.periodInSamples;
+		latest.rpm = event.rpm;
+		latest.filtered_rpm = event.filteredRpm;
+		latest.threshold = event.threshold;
+		latest.hysteresis = event.hysteresis;
+		latest.signal_min = event.signalMin;
+		latest.signal_max = event.signalMax;
+		latest.threshold_percentage = event.thresholdInPercentage;
+		latest.sample_rate = _sampleRate;
+		latest.stall_state = RPM_SHM_RUNNING;
+		latest.rpm_source = RPM_SHM_SOURCE_EDGE;
+		__atomic_store_n(&_shm->latest_seq, seq + 2, __ATOMIC_RELEASE);
+
+		__atomic_store_n(&_shm->write_count, writeCount + 1, __ATOMIC_RELEASE);
+
+		// Pairs with rpm_shm_wait(): either the reader sees the new futex
+		// value, or we see it as a waiter and wake it.
+		__atomic_add_fetch(&_shm->futex, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&_shm->num_waiters, __ATOMIC_SEQ_CST))
+		{
+			syscall(SYS_futex, &_shm->futex, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+		}
+	}
+
+	/**
+	 * Updates the rpm of latest from the spectral estimator or RpmFusion, in
+	 * place of publish() (--estimator spectral or fused). Same thread as
+	 * publish(), or one holding the same lock as it.
+	 */
+	void publishEstimate(const SpectralEstimate& estimate, const RpmFusion::Result& result)
+	{
+		if (!_shm)
+		{
+			return;
+		}
+
+		uint64_t timestampNs = nowNs();
+		uint32_t seq = _shm->latest_seq;
+		__atomic_store_n(&_shm->latest_seq, seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+
+		struct rpm_shm_latest& latest = _shm->latest;
+		latest.sample_index = estimate.sampleIndex;
+		latest.timestamp_ns = timestampNs;
+		latest.rpm = result.rpm;
+		latest.filtered_rpm = result.rpm;
+		latest.sample_rate = _sampleRate;
+		latest.rpm_source = getSource(result.source);
+
+		__atomic_store_n(&_shm->latest_seq, seq + 2, __ATOMIC_RELEASE);
+	}
+
+	/// Updates the tracked_* values of latest. Same thread as publish()
+	void publishTracked(const SpeedEstimate& estimate)
+	{
+		if (!_shm)
+		{
+			return;
+		}
+		uint32_t seq = _shm->latest_seq;
+		__atomic_store_n(&_shm->latest_seq, seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		struct rpm_shm_latest& latest = _shm->latest;
+		latest.tracked_sample_index = estimate.sampleIndex;
+		latest.tracked_rpm = estimate.rpm;
+		latest.tracked_locked = estimate.locked;
+		__atomic_store_n(&_shm->latest_seq, seq + 2, __ATOMIC_RELEASE);
+	}
+
+	/// Updates the stall_* values of latest, until the next publish(). Same thread as publish()
+	void publishStall(const StallEvent& event)
+	{
+		if (!_shm)
+		{
+			return;
+		}
+		uint32_t seq = _shm->latest_seq;
+		__atomic_store_n(&_shm->latest_seq, seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		struct rpm_shm_latest& latest = _shm->latest;
+		latest.stall_state = event.stopped ? RPM_SHM_STOPPED : RPM_SHM_STALLED;
+		latest.stall_sample_index = event.sampleIndex;
+		latest.stall_rpm = event.rpm;
+		__atomic_store_n(&_shm->latest_seq, seq + 2, __ATOMIC_RELEASE);
+	}
+
+private:
+	struct rpm_shm* _shm;
+	std::string _path;
+	int _sampleRate;
+
+	static int32_t getSource(RpmFusion::Source source)
+	{
+		switch (source)
+		{
+		case RpmFusion::Edge: return RPM_SHM_SOURCE_EDGE;
+		case RpmFusion::Spectral: return RPM_SHM_SOURCE_SPECTRAL;
+		default: return RPM_SHM_SOURCE_NONE;
+		}
+	}
+};
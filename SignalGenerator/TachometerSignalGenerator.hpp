@@ -0,0 +1,364 @@
+/*
+ * TachometerSignalGenerator.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+
+/**
+ * Piecewise linear function of time, given as (time, value) breakpoints.
+ * Two breakpoints at the same time give a step. Before the first and after
+ * the last breakpoint the value is held constant.
+ */
+class PiecewiseLinearProfile {
+public:
+	PiecewiseLinearProfile() { }
+
+	explicit PiecewiseLinearProfile(double constantValue)
+	{
+		addPoint(0, constantValue);
+	}
+
+	void addPoint(double t, double value)
+	{
+		assert(_points.empty() || t >= _points.back().first);
+		_points.push_back(std::make_pair(t, value));
+	}
+
+	bool empty() const { return _points.empty(); }
+
+	double getEndTime() const { return _points.empty() ? 0 : _points.back().first; }
+
+	double valueAt(double t) const
+	{
+		assert(!_points.empty());
+		if (t <= _points.front().first)
+		{
+			return _points.front().second;
+		}
+
+		for (size_t i = 1; i < _points.size(); i++)
+		{
+			const std::pair<double, double>& a = _points[i-1];
+			const std::pair<double, double>& b = _points[i];
+			if (t < b.first)
+			{
+				double fraction = (t - a.first) / (b.first - a.first);
+				return a.second + fraction * (b.second - a.second);
+			}
+		}
+		return _points.back().second;
+	}
+
+	/**
+	 * Parses "t0:v0,t1:v1,..." (time in seconds).
+	 * @return false on syntax error
+	 */
+	bool parse(const char* str)
+	{
+		_points.clear();
+		const char* p = str;
+		while (*p)
+		{
+			char* end;
+			double t = strtod(p, &end);
+			if (end == p || *end != ':')
+			{
+				return false;
+			}
+			p = end + 1;
+			double value = strtod(p, &end);
+			if (end == p || (*end != ',' && *end != '\0'))
+			{
+				return false;
+			}
+			if (!_points.empty() && t < _points.back().first)
+			{
+				return false;
+			}
+			addPoint(t, value);
+			p = *end ? end + 1 : end;
+		}
+		return !_points.empty();
+	}
+
+private:
+	std::vector<std::pair<double, double> > _points;
+};
+
+
+/**
+ * Synthesizes what a reflex detector connected to an (AC coupled) mic input
+ * would deliver, so the detector can be tested and benchmarked offline.
+ *
+ * The model is a pulse train (pulsesPerRevolution pulses per revolution,
+ * each high for dutyCycle of the pulse period), band limited by a first order
+ * sensor response, AC coupled by a first order high pass filter, scaled by an
+ * amplitude profile, plus DC drift and gaussian noise.
+ *
+ * Output is a pure function of the parameters and the seed. Only the exactly
+ * specified std::mt19937 is used from <random> (the distributions are
+ * implementation defined), so a given seed gives the same signal everywhere.
+ */
+class TachometerSignalGenerator {
+public:
+	struct Parameters {
+		Parameters() :
+			sampleRate(44100),
+			rpm(1000),
+			amplitude(10000),
+			pulsesPerRevolution(1),
+			dutyCycle(0.1),
+			jitter(0),
+			noise(0),
+			dcOffset(0),
+			dcDrift(0),
+			dcDriftPeriod(10),
+			sensorTimeConstant(20e-6),
+			acCouplingCutoff(10),
+			seed(1)
+		{ }
+
+		int sampleRate;
+		PiecewiseLinearProfile rpm;
+		PiecewiseLinearProfile amplitude;   // Peak to peak before AC coupling
+		int pulsesPerRevolution;
+		double dutyCycle;          // Fraction of each pulse period the sensor sees the reflector
+		double jitter;             // Std dev of pulse timing error, as fraction of the pulse period
+		double noise;              // Std dev of additive gaussian noise
+		double dcOffset;
+		double dcDrift;            // Amplitude of a slow sinusoidal drift of the DC level
+		double dcDriftPeriod;      // In seconds
+		double sensorTimeConstant; // In seconds, 0 = ideal edges
+		double acCouplingCutoff;   // In Hz, 0 = DC coupled
+		uint32_t seed;
+	};
+
+	explicit TachometerSignalGenerator(const Parameters& params) :
+		_params(params),
+		_rng(params.seed),
+		_sampleIndex(0),
+		_pulsePhase(-0.5), // First rising edge half a pulse period in
+		_pulseIndex(0),
+		_currentJitter(0),
+		_sensorState(0),
+		_hpState(0),
+		_hpPrevInput(0),
+		_hasSpareGaussian(false),
+		_spareGaussian(0),
+		_recordPulseTimes(false)
+	{
+		assert(_params.sampleRate > 0);
+		assert(_params.pulsesPerRevolution > 0);
+		assert(!_params.rpm.empty());
+		assert(!_params.amplitude.empty());
+		assert(_params.dutyCycle > 0 && _params.dutyCycle < 1);
+
+		double dt = 1.0 / _params.sampleRate;
+		_sensorAlpha = _params.sensorTimeConstant > 0 ?
+				1 - exp(-dt / _params.sensorTimeConstant) : 1;
+		_hpAlpha = _params.acCouplingCutoff > 0 ?
+				1 / (1 + 2 * M_PI * _params.acCouplingCutoff * dt) : 1;
+
+		// Keeps each pulse inside its own period
+		_jitterLimit = std::min(0.25, (1 - _params.dutyCycle) / 4);
+
+		_currentJitter = drawJitter();
+	}
+
+	/**
+	 * When enabled, the (fractional) sample position of each generated rising
+	 * edge is stored, and available through getPulseTimes().
+	 */
+	void setRecordPulseTimes(bool enable) { _recordPulseTimes = enable; }
+
+	const std::vector<double>& getPulseTimes() const { return _pulseTimes; }
+
+	/**
+	 * Number of samples covering the rpm and amplitude profiles.
+	 */
+	size_t getProfileLengthInSamples() const
+	{
+		double t = std::max(_params.rpm.getEndTime(), _params.amplitude.getEndTime());
+		return size_t(t * _params.sampleRate + 0.5);
+	}
+
+	uint64_t getSampleIndex() const { return _sampleIndex; }
+
+	int16_t next()
+	{
+		const double t = double(_sampleIndex) / _params.sampleRate;
+		const double pulsesPerSample = _params.rpm.valueAt(t) / 60.0 * _params.pulsesPerRevolution / _params.sampleRate;
+
+		// Move on to the next pulse when the current one is guaranteed
+		// to have ended, and the next one can not yet have started.
+		double prevPhase = _pulsePhase;
+		_pulsePhase += pulsesPerSample;
+		if (_pulsePhase - _pulseIndex >= 1 - _jitterLimit)
+		{
+			_pulseIndex++;
+			_currentJitter = drawJitter();
+		}
+		// Position within the current pulse period, shifted by its jitter
+		double local = _pulsePhase - _pulseIndex - _currentJitter;
+
+		if (_recordPulseTimes && pulsesPerSample > 0)
+		{
+			double edge = _pulseIndex + _currentJitter;
+			if (prevPhase < edge && _pulsePhase >= edge)
+			{
+				double fraction = (edge - prevPhase) / pulsesPerSample;
+				_pulseTimes.push_back(_sampleIndex - 1 + fraction);
+			}
+		}
+
+		// Sensor response
+		if (_params.sensorTimeConstant > 0)
+		{
+			double localStart = local - pulsesPerSample;
+			respondDuringSample(localStart, local);
+		}
+		else
+		{
+			_sensorState = isReflectorSeen(local) ? 1 : 0;
+		}
+
+		// AC coupling
+		double ac = _sensorState;
+		if (_params.acCouplingCutoff > 0)
+		{
+			_hpState = _hpAlpha * (_hpState + _sensorState - _hpPrevInput);
+			_hpPrevInput = _sensorState;
+			ac = _hpState;
+		}
+
+		double value = _params.amplitude.valueAt(t) * ac + _params.dcOffset;
+		if (_params.dcDrift != 0)
+		{
+			value += _params.dcDrift * sin(2 * M_PI * t / _params.dcDriftPeriod);
+		}
+		if (_params.noise > 0)
+		{
+			value += _params.noise * gaussian();
+		}
+
+		_sampleIndex++;
+
+		value = floor(value + 0.5);
+		if (value > 32767) { value = 32767; }
+		if (value < -32768) { value = -32768; }
+		return int16_t(value);
+	}
+
+	void generate(int16_t* out, size_t numSamples)
+	{
+		for (size_t i = 0; i < numSamples; i++)
+		{
+			out[i] = next();
+		}
+	}
+
+private:
+	const Parameters _params;
+	std::mt19937 _rng;
+	uint64_t _sampleIndex;
+
+	double _pulsePhase;  // Number of (nominal) pulse periods passed
+	int64_t _pulseIndex;
+	double _currentJitter;
+	double _jitterLimit;
+
+	double _sensorAlpha;
+	double _sensorState;
+	double _hpAlpha;
+	double _hpState;
+	double _hpPrevInput;
+
+	bool _hasSpareGaussian;
+	double _spareGaussian;
+
+	bool _recordPulseTimes;
+	std::vector<double> _pulseTimes;
+
+	bool isReflectorSeen(double local) const
+	{
+		return local >= 0 && local < _params.dutyCycle;
+	}
+
+	/**
+	 * Exact response of the (first order) sensor during one sample period,
+	 * in which the position within the pulse goes from localStart to
+	 * localEnd. Edges inside the period are handled at their exact time, so
+	 * the samples around an edge carry its sub-sample position (like with a
+	 * real sensor), instead of edges snapping to whole samples.
+	 */
+	void respondDuringSample(double localStart, double localEnd)
+	{
+		const double edges[] = { 0, _params.dutyCycle };
+		const double length = localEnd - localStart;
+		double pos = localStart;
+		double remaining = 1;   // Of the sample period
+		for (double edge : edges)
+		{
+			if (edge > pos && edge <= localEnd && length > 0)
+			{
+				double fraction = (edge - pos) / length;
+				settle(isReflectorSeen(pos) ? 1 : 0, fraction);
+				remaining -= fraction;
+				pos = edge;
+			}
+		}
+		settle(isReflectorSeen(localEnd) ? 1 : 0, remaining);
+	}
+
+	/// Moves the sensor towards level during the given fraction of a sample period
+	void settle(double level, double fraction)
+	{
+		double decay = fraction >= 1 ? 1 - _sensorAlpha : pow(1 - _sensorAlpha, fraction);
+		_sensorState = level + (_sensorState - level) * decay;
+	}
+
+	double uniform()
+	{
+		return (_rng() + 0.5) / 4294967296.0; // (0, 1)
+	}
+
+	/// Box-Muller transform
+	double gaussian()
+	{
+		if (_hasSpareGaussian)
+		{
+			_hasSpareGaussian = false;
+			return _spareGaussian;
+		}
+		double r = sqrt(-2 * log(uniform()));
+		double theta = 2 * M_PI * uniform();
+		_spareGaussian = r * sin(theta);
+		_hasSpareGaussian = true;
+		return r * cos(theta);
+	}
+
+	double drawJitter()
+	{
+		if (_params.jitter <= 0)
+		{
+			return 0;
+		}
+		double j = _params.jitter * gaussian();
+		if (j > _jitterLimit) { j = _jitterLimit; }
+		if (j < -_jitterLimit) { j = -_jitterLimit; }
+		return j;
+	}
+};
@@ -0,0 +1,202 @@
+/*
+ * WavFile.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+/**
+ * Reads one channel of a 16 bit PCM WAV file into memory.
+ * @return false (with a description in error) if the file can't be read
+ */
+inline bool readWavChannel(const char* filename, int channel,
+		std::vector<int16_t>& samples, int& sampleRate, const char*& error)
+{
+	FILE* f = fopen(filename, "rb");
+	if (!f)
+	{
+		error = "unable to open file";
+		return false;
+	}
+
+	const auto& get16 = [&]() -> uint32_t {
+		int lo = fgetc(f);
+		int hi = fgetc(f);
+		return uint32_t(lo & 0xff) | (uint32_t(hi & 0xff) << 8);
+	};
+	const auto& get32 = [&]() -> uint32_t {
+		uint32_t lo = get16();
+		return lo | (get16() << 16);
+	};
+
+	char id[4];
+	bool ok = fread(id, 1, 4, f) == 4 && memcmp(id, "RIFF", 4) == 0;
+	get32();
+	ok = ok && fread(id, 1, 4, f) == 4 && memcmp(id, "WAVE", 4) == 0;
+	if (!ok)
+	{
+		error = "not a WAV file";
+		fclose(f);
+		return false;
+	}
+
+	int numChannels = 0;
+	int bitsPerSample = 0;
+	int format = 0;
+	while (fread(id, 1, 4, f) == 4)
+	{
+		uint32_t size = get32();
+		if (memcmp(id, "fmt ", 4) == 0)
+		{
+			format = get16();
+			numChannels = get16();
+			sampleRate = get32();
+			get32(); // Byte rate
+			get16(); // Block align
+			bitsPerSample = get16();
+			fseek(f, size - 16 + (size & 1), SEEK_CUR);
+		}
+		else if (memcmp(id, "data", 4) == 0)
+		{
+			if (format != 1 || bitsPerSample != 16)
+			{
+				error = "only 16 bit PCM supported";
+				fclose(f);
+				return false;
+			}
+			if (channel >= numChannels)
+			{
+				error = "no such channel";
+				fclose(f);
+				return false;
+			}
+			std::vector<int16_t> interleaved(size / 2);
+			size_t numRead = fread(interleaved.data(), 2, interleaved.size(), f);
+			fclose(f);
+
+			samples.resize(numRead / numChannels);
+			for (size_t i = 0; i < samples.size(); i++)
+			{
+				const uint8_t* p = (const uint8_t*)&interleaved[i * numChannels + channel];
+				samples[i] = int16_t(p[0] | (p[1] << 8));
+			}
+			return true;
+		}
+		else
+		{
+			fseek(f, size + (size & 1), SEEK_CUR);
+		}
+	}
+
+	error = "no data chunk";
+	fclose(f);
+	return false;
+}
+
+
+/**
+ * Writes 16 bit PCM WAV files. The header is completed when the
+ * writer is destroyed (or close() is called).
+ */
+class WavWriter {
+public:
+	WavWriter(const char* filename, int sampleRate, int numChannels) :
+		_file(fopen(filename, "wb")),
+		_sampleRate(sampleRate),
+		_numChannels(numChannels),
+		_numFrames(0)
+	{
+		if (_file)
+		{
+			writeHeader();
+		}
+	}
+
+	~WavWriter()
+	{
+		close();
+	}
+
+	bool isOpen() const { return _file != NULL; }
+
+	/**
+	 * @param interleaved numFrames * numChannels samples
+	 */
+	bool write(const int16_t* interleaved, size_t numFrames)
+	{
+		if (!_file)
+		{
+			return false;
+		}
+		for (size_t i = 0; i < numFrames * _numChannels; i++)
+		{
+			put16(interleaved[i]);
+		}
+		_numFrames += numFrames;
+		return !ferror(_file);
+	}
+
+	/**
+	 * @return false if anything failed while writing the file
+	 */
+	bool close()
+	{
+		if (!_file)
+		{
+			return false;
+		}
+		fseek(_file, 0, SEEK_SET);
+		writeHeader();
+		bool ok = !ferror(_file);
+		ok = (fclose(_file) == 0) && ok;
+		_file = NULL;
+		return ok;
+	}
+
+private:
+	FILE* _file;
+	int _sampleRate;
+	int _numChannels;
+	uint32_t _numFrames;
+
+	void put16(uint16_t v)
+	{
+		fputc(v & 0xff, _file);
+		fputc(v >> 8, _file);
+	}
+
+	void put32(uint32_t v)
+	{
+		put16(v & 0xffff);
+		put16(v >> 16);
+	}
+
+	void writeHeader()
+	{
+		const uint32_t dataSize = _numFrames * _numChannels * 2;
+		fwrite("RIFF", 1, 4, _file);
+		put32(36 + dataSize);
+		fwrite("WAVE", 1, 4, _file);
+		fwrite("fmt ", 1, 4, _file);
+		put32(16);
+		put16(1); // PCM
+		put16(_numChannels);
+		put32(_sampleRate);
+		put32(_sampleRate * _numChannels * 2);
+		put16(_numChannels * 2);
+		put16(16);
+		fwrite("data", 1, 4, _file);
+		put32(dataSize);
+	}
+
+	WavWriter(const WavWriter&);
+	WavWriter& operator=(const WavWriter&);
+};
@@ -0,0 +1,414 @@
+/*
+ * SpectralRPMEstimator.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include "SeqLock.hpp"
+#include "SpscRing.hpp"
+#include "StreamProcessors/RealFFT.hpp"
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/**
+ * Result of analysing one frame.
+ */
+struct SpectralEstimate {
+	uint64_t sampleIndex;   // Index of the sample after the last one in the frame
+	double frequency;       // Pulse frequency in Hz
+	double rpm;
+	double confidence;      // 0 (noise) .. 1 (clean pulse train), see SpectralRPMEstimator
+};
+
+
+/**
+ * Estimates the rpm from the spectrum of the signal, instead of from
+ * individual edges. It does not need a minimum amplitude, and is not fooled by
+ * noise causing extra triggers, but reacts slower than RPMCalculatorFromAudio
+ * (a result every hopSize samples, describing the last frameSize samples).
+ *
+ * For each frame (Hann window, real FFT, magnitude spectrum):
+ * - Harmonic sum: each candidate pulse frequency f (between minRpm and maxRpm,
+ *   on a grid fine enough for the highest harmonic to stay within half a bin)
+ *   scores the magnitudes at f, 2f, ... numHarmonics * f, minus the
+ *   magnitudes half way between them. Subtracting the in-between magnitudes
+ *   keeps 2f from winning over f for narrow pulses (where all harmonics are
+ *   about as strong).
+ * - Parabolic interpolation of the log magnitude around each harmonic of the
+ *   best candidate gives its position to a fraction of a bin. The estimate is
+ *   the average of position / k, weighted by (magnitude * k)^2, as higher and
+ *   stronger harmonics give better precision.
+ * - The confidence comes from how far the harmonics of the best candidate
+ *   stand out: r = score / numHarmonics / median magnitude (the noise floor),
+ *   confidence = (r - 1) / (r + 1). Noise alone stays below about 0.15, and
+ *   above 0.5 (harmonics 3 times the noise floor) the estimate is reliable.
+ *
+ * All buffers and the FFT tables are allocated by the constructor. Runs on
+ * whatever thread calls processBlock(); see AsyncSpectralRPMEstimator for
+ * running it on a worker thread.
+ */
+class SpectralRPMEstimator {
+public:
+	struct Parameters {
+		Parameters() :
+			frameSize(0),
+			hopSize(0),
+			minRpm(600),
+			maxRpm(60000),
+			numHarmonics(8)
+		{ }
+		size_t frameSize;   // Power of two. 0 = at least 0.35 s of audio (3.5 periods at 600 rpm)
+		size_t hopSize;     // Samples between estimates. 0 = frameSize / 4
+		double minRpm;
+		double maxRpm;
+		int numHarmonics;
+	};
+
+	typedef std::function<void(const SpectralEstimate&)> EstimateCallback;
+
+	SpectralRPMEstimator(int audioSampleRate, int divisor, const Parameters& params = Parameters()) :
+		_audioSampleRate(audioSampleRate),
+		_divisor(divisor),
+		_params(params),
+		_frameSize(params.frameSize ? params.frameSize : defaultFrameSize(audioSampleRate)),
+		_hopSize(params.hopSize ? params.hopSize : _frameSize / 4),
+		_fft(_frameSize),
+		_history(_frameSize),
+		_historyPos(0),
+		_numSamples(0),
+		_samplesUntilNextFrame(_frameSize),
+		_window(_frameSize),
+		_frame(_frameSize),
+		_spectrum(_fft.getNumBins()),
+		_magnitudes(_fft.getNumBins())
+	{
+		_scratch.reserve(_magnitudes.size());
+		assert(_hopSize > 0 && _hopSize <= _frameSize);
+		assert(_params.numHarmonics > 0);
+		for (size_t i = 0; i < _frameSize; i++)
+		{
+			_window[i] = 0.5f - 0.5f * cos(2 * M_PI * i / _frameSize);
+		}
+		_latest.sampleIndex = 0;
+		_latest.frequency = 0;
+		_latest.rpm = 0;
+		_latest.confidence = 0;
+	}
+
+	void setEstimateCallback(const EstimateCallback& callback) { _estimateCallback = callback; }
+
+	size_t getFrameSize() const { return _frameSize; }
+
+	size_t getHopSize() const { return _hopSize; }
+
+	int getSampleRate() const { return _audioSampleRate; }
+
+	/// Most recent estimate (all zero before the first frame is complete)
+	const SpectralEstimate& getLatest() const { return _latest; }
+
+	/**
+	 * Feeds samples[0], samples[stride], ... samples[(n - 1) * stride].
+	 * Estimates are reported (from within this call) every hopSize samples,
+	 * once the first frameSize samples have arrived.
+	 */
+	void processBlock(const int16_t* samples, size_t n, size_t stride = 1)
+	{
+		while (n)
+		{
+			size_t count = std::min(n, std::min(_samplesUntilNextFrame, _frameSize - _historyPos));
+			for (size_t i = 0; i < count; i++)
+			{
+				_history[_historyPos + i] = samples[i * stride];
+			}
+			_historyPos = (_historyPos + count) % _frameSize;
+			_numSamples += count;
+			_samplesUntilNextFrame -= count;
+			samples += count * stride;
+			n -= count;
+
+			if (_samplesUntilNextFrame == 0)
+			{
+				_samplesUntilNextFrame = _hopSize;
+				analyseFrame();
+			}
+		}
+	}
+
+	static size_t defaultFrameSize(int audioSampleRate)
+	{
+		size_t size = 1024;
+		while (size < 0.35 * audioSampleRate)
+		{
+			size *= 2;
+		}
+		return size;
+	}
+
+private:
+	int _audioSampleRate;
+	int _divisor;
+	Parameters _params;
+	size_t _frameSize;
+	size_t _hopSize;
+	RealFFT _fft;
+
+	std::vector<int16_t> _history;      // Circular, the last frameSize samples
+	size_t _historyPos;
+	uint64_t _numSamples;
+	size_t _samplesUntilNextFrame;
+
+	std::vector<float> _window;
+	std::vector<float> _frame;
+	std::vector<RealFFT::Complex> _spectrum;
+	std::vector<float> _magnitudes;
+	std::vector<float> _scratch;
+
+	SpectralEstimate _latest;
+	EstimateCallback _estimateCallback;
+
+	void analyseFrame()
+	{
+		double sum = 0;
+		for (size_t i = 0; i < _frameSize; i++)
+		{
+			sum += _history[i];
+		}
+		float mean = sum / _frameSize;
+		for (size_t i = 0; i < _frameSize; i++)
+		{
+			float sample = _history[(_historyPos + i) % _frameSize];
+			_frame[i] = (sample - mean) * _window[i];
+		}
+
+		_fft.forward(_frame.data(), _spectrum.data());
+		for (size_t k = 0; k < _spectrum.size(); k++)
+		{
+			_magnitudes[k] = std::abs(_spectrum[k]);
+		}
+
+		double binInHz = double(_audioSampleRate) / _frameSize;
+		double lowest = std::max(_params.minRpm * _divisor / 60 / binInHz, 1.0);
+		double highest = std::min(_params.maxRpm * _divisor / 60 / binInHz, double(_magnitudes.size() - 2));
+		double step = 0.5 / _params.numHarmonics;
+
+		double bestBin = 0;
+		double bestScore = 0;
+		for (double bin = lowest; bin <= highest; bin += step)
+		{
+			double score = getHarmonicScore(bin);
+			if (score > bestScore)
+			{
+				bestScore = score;
+				bestBin = bin;
+			}
+		}
+
+		SpectralEstimate estimate;
+		estimate.sampleIndex = _numSamples;
+		estimate.frequency = 0;
+		estimate.rpm = 0;
+		estimate.confidence = 0;
+		if (bestScore > 0)
+		{
+			estimate.frequency = refine(bestBin) * binInHz;
+			estimate.rpm = 60 * estimate.frequency / _divisor;
+			double r = bestScore / _params.numHarmonics / getNoiseFloor(size_t(lowest), size_t(highest * _params.numHarmonics));
+			estimate.confidence = std::max(0.0, (r - 1) / (r + 1));
+		}
+		_latest = estimate;
+		if (_estimateCallback)
+		{
+			_estimateCallback(estimate);
+		}
+	}
+
+	float magnitudeAt(double bin) const
+	{
+		size_t k = size_t(bin + 0.5);
+		return k < _magnitudes.size() ? _magnitudes[k] : 0;
+	}
+
+	/// @return harmonic minus in-between magnitudes, for a fundamental at bin
+	double getHarmonicScore(double bin) const
+	{
+		double harmonicSum = 0;
+		double betweenSum = 0;
+		for (int k = 1; k <= _params.numHarmonics; k++)
+		{
+			harmonicSum += magnitudeAt(k * bin);
+			betweenSum += magnitudeAt((k - 0.5) * bin);
+		}
+		return harmonicSum - betweenSum;
+	}
+
+	/// @return median magnitude of bins [first, last)
+	float getNoiseFloor(size_t first, size_t last)
+	{
+		last = std::min(last, _magnitudes.size());
+		first = std::min(first, last - 1);
+		_scratch.assign(_magnitudes.begin() + first, _magnitudes.begin() + last);
+		std::nth_element(_scratch.begin(), _scratch.begin() + _scratch.size() / 2, _scratch.end());
+		return std::max(_scratch[_scratch.size() / 2], 1e-6f);
+	}
+
+	/// @return the fundamental, in bins, from interpolated harmonic peaks near bin, 2 * bin, ...
+	double refine(double bin) const
+	{
+		double weightedSum = 0;
+		double weightSum = 0;
+		for (int k = 1; k <= _params.numHarmonics; k++)
+		{
+			size_t center = size_t(k * bin + 0.5);
+			if (center + 2 >= _magnitudes.size())
+			{
+				break;
+			}
+			size_t peak = center;
+			if (_magnitudes[center - 1] > _magnitudes[peak]) { peak = center - 1; }
+			if (_magnitudes[center + 1] > _magnitudes[peak]) { peak = center + 1; }
+			if (peak == 0 || _magnitudes[peak] <= 0)
+			{
+				continue;
+			}
+
+			const float tiny = 1e-20f;
+			double left = log(_magnitudes[peak - 1] + tiny);
+			double middle = log(_magnitudes[peak] + tiny);
+			double right = log(_magnitudes[peak + 1] + tiny);
+			double curvature = left - 2 * middle + right;
+			double offset = curvature < 0 ? 0.5 * (left - right) / curvature : 0;
+			offset = std::max(-0.5, std::min(0.5, offset));
+
+			double weight = double(_magnitudes[peak]) * k;
+			weight *= weight;
+			weightedSum += weight * (peak + offset) / k;
+			weightSum += weight;
+		}
+		return weightSum > 0 ? weightedSum / weightSum : bin;
+	}
+};
+
+
+/**
+ * Runs a SpectralRPMEstimator on its own thread.
+ *
+ * processBlock() is called from the audio thread, and only copies the
+ * samples into a ring. The worker thread drains the ring and runs the
+ * analysis, calling the estimate callback from the worker thread. If the
+ * worker falls behind and the ring fills up, samples are dropped (counted in
+ * getNumDropped()), which shortens the period seen by the estimator.
+ */
+class AsyncSpectralRPMEstimator {
+public:
+	typedef SpectralRPMEstimator::EstimateCallback EstimateCallback;
+
+	AsyncSpectralRPMEstimator(int audioSampleRate, int divisor,
+			const SpectralRPMEstimator::Parameters& params = SpectralRPMEstimator::Parameters()) :
+		_estimator(audioSampleRate, divisor, params),
+		_ring(ringSizeFor(_estimator.getFrameSize())),
+		_chunk(4096),
+		_numDropped(0),
+		_quit(false)
+	{
+		_estimator.setEstimateCallback([this](const SpectralEstimate& estimate) {
+			_latest.store(estimate);
+			if (_estimateCallback)
+			{
+				_estimateCallback(estimate);
+			}
+		});
+		_latest.store(_estimator.getLatest());
+	}
+
+	~AsyncSpectralRPMEstimator()
+	{
+		stop();
+	}
+
+	/// Must be set before start(). Called from the worker thread.
+	void setEstimateCallback(const EstimateCallback& callback) { _estimateCallback = callback; }
+
+	void start()
+	{
+		_thread = std::thread(&AsyncSpectralRPMEstimator::run, this);
+	}
+
+	/// Analyses what is left in the ring, and stops the worker thread
+	void stop()
+	{
+		_quit = true;
+		if (_thread.joinable())
+		{
+			_thread.join();
+		}
+	}
+
+	/// Must only be called from one thread (the one receiving audio)
+	void processBlock(const int16_t* samples, size_t n, size_t stride = 1)
+	{
+		size_t pushed = _ring.tryPushBlock(samples, n, stride);
+		if (pushed < n)
+		{
+			_numDropped.store(_numDropped.load(std::memory_order_relaxed) + n - pushed, std::memory_order_relaxed);
+		}
+	}
+
+	/// Safe to call from any thread
+	SpectralEstimate getLatest() const { return _latest.load(); }
+
+	uint64_t getNumDropped() const { return _numDropped.load(std::memory_order_relaxed); }
+
+	size_t getFrameSize() const { return _estimator.getFrameSize(); }
+
+private:
+	SpectralRPMEstimator _estimator;
+	SpscRing<int16_t> _ring;
+	std::vector<int16_t> _chunk;
+	SeqLockValue<SpectralEstimate> _latest;
+	EstimateCallback _estimateCallback;
+	std::atomic<uint64_t> _numDropped;
+	std::atomic<bool> _quit;
+	std::thread _thread;
+
+	/// Room for two frames, so a slow analysis does not drop samples
+	static size_t ringSizeFor(size_t frameSize)
+	{
+		return 2 * frameSize;
+	}
+
+	void run()
+	{
+		while (true)
+		{
+			bool quitting = _quit;  // Read before draining, so nothing pushed before stop() is lost
+			bool gotSamples = false;
+			size_t n;
+			while ((n = _ring.tryPopBlock(_chunk.data(), _chunk.size())) > 0)
+			{
+				gotSamples = true;
+				_estimator.processBlock(_chunk.data(), n);
+			}
+			if (quitting)
+			{
+				break;
+			}
+			if (!gotSamples)
+			{
+				usleep(2000);
+			}
+		}
+	}
+};
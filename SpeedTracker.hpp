@@ -0,0 +1,265 @@
+/*
+ * SpeedTracker.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+/**
+ * Output of the SpeedTracker.
+ */
+struct SpeedEstimate {
+	uint64_t sampleIndex;   // Time of the estimate (samples counted from the first one)
+	double frequency;       // Pulse frequency in Hz
+	double rpm;
+	bool locked;
+};
+
+
+/**
+ * Digital PLL locked to the pulse train, giving a speed estimate every
+ * outputInterval samples, independent of the pulse rate.
+ *
+ * The oscillator is a phase (in pulses), its rate and the rate of change of
+ * the rate. Between pulses it runs freely, so the estimate keeps following a
+ * speed ramp instead of holding the last period until the next pulse. At
+ * each pulse the phase error against the nearest whole pulse corrects all
+ * three with a critically damped alpha-beta-gamma update, which tracks
+ * constant acceleration without lag. smoothing (0 .. 1) trades noise for
+ * responsiveness; the loop remembers about 1 / (1 - smoothing) pulses.
+ *
+ * Pulses whose phase error is above maxPhaseError (a quarter of a pulse by
+ * default, e.g. noise triggering the edge detector twice) are ignored, and a
+ * single missed pulse does not disturb it. A decaying count of the ignored
+ * pulses unlocks it after two in a row, and starts it over from the next
+ * pulses after four in a row, or when about every other pulse is ignored (as
+ * when locked to half the rate).
+ *
+ * The crossing times come from the edge detector (PulseEvent::crossingTime).
+ * Since a block is typically run through the detector before the tracker,
+ * pulses are queued, and applied when advance() reaches their time. Work per
+ * sample is constant (per pulse and per estimate, actually).
+ */
+class SpeedTracker {
+public:
+	struct Parameters {
+		Parameters() :
+			outputInterval(44),
+			smoothing(0.5),
+			maxPhaseError(0.25)
+		{ }
+		size_t outputInterval;  // Samples between estimates (44 = 1 ms at 44.1 kHz)
+		double smoothing;
+		double maxPhaseError;   // In pulses
+	};
+
+	typedef std::function<void(const SpeedEstimate&)> EstimateCallback;
+
+	SpeedTracker(int audioSampleRate, int divisor, const Parameters& params = Parameters()) :
+		_audioSampleRate(audioSampleRate),
+		_divisor(divisor),
+		_params(params),
+		_numPulses(0),
+		_outlierScore(0),
+		_missedLast(false),
+		_stateTime(0),
+		_phase(0),
+		_rate(0),
+		_acceleration(0),
+		_queue(64),
+		_queueHead(0),
+		_queueSize(0),
+		_sampleIndex(0),
+		_samplesUntilOutput(params.outputInterval)
+	{
+		assert(_params.outputInterval > 0);
+		assert(_params.smoothing >= 0 && _params.smoothing < 1);
+		double s = _params.smoothing;
+		_alpha = 1 - s * s * s;
+		_beta = 1.5 * (1 - s) * (1 - s) * (1 + s);
+		_gamma = 0.5 * (1 - s) * (1 - s) * (1 - s);
+	}
+
+	void setEstimateCallback(const EstimateCallback& callback) { _estimateCallback = callback; }
+
+	int getSampleRate() const { return _audioSampleRate; }
+
+	/// Locked once a few consecutive pulses fit, and until pulses are missing or do not fit
+	bool isLockedAt(double time) const
+	{
+		return _numPulses >= 3 && _outlierScore < UnlockScore && (time - _stateTime) * _rate <= MaxGapInPulses;
+	}
+
+	/**
+	 * @param crossingTime  in samples, counted like advance() counts them.
+	 *                      Must not decrease from one call to the next.
+	 */
+	void addPulse(double crossingTime)
+	{
+		if (_queueSize == _queue.size())
+		{
+			applyPulse(_queue[_queueHead]);
+			_queueHead = (_queueHead + 1) % _queue.size();
+			_queueSize--;
+		}
+		_queue[(_queueHead + _queueSize) % _queue.size()] = crossingTime;
+		_queueSize++;
+	}
+
+	/**
+	 * Moves time forward by numSamples, reporting estimates (from within this
+	 * call) every outputInterval samples.
+	 */
+	void advance(size_t numSamples)
+	{
+		while (numSamples)
+		{
+			size_t n = std::min(numSamples, _samplesUntilOutput);
+			_sampleIndex += n;
+			_samplesUntilOutput -= n;
+			numSamples -= n;
+			if (_samplesUntilOutput == 0)
+			{
+				_samplesUntilOutput = _params.outputInterval;
+				applyPulsesUntil(_sampleIndex);
+				report();
+			}
+		}
+	}
+
+	/**
+	 * In Hz, extrapolated to time (in samples). The acceleration is applied
+	 * for at most MaxGapInPulses, so it does not run away when pulses stop.
+	 */
+	double getFrequencyAt(double time) const
+	{
+		if (_numPulses < 2)
+		{
+			return 0;
+		}
+		double dt = std::min(time - _stateTime, MaxGapInPulses / _rate);
+		double rate = std::max(_rate + _acceleration * dt, 0.0);
+		return rate * _audioSampleRate;
+	}
+
+private:
+	enum { MaxGapInPulses = 3 };
+
+	// Outlier score: multiplied by OutlierDecay for each pulse, plus 1 for an outlier
+	static constexpr double OutlierDecay = 0.8;
+	static constexpr double UnlockScore = 1.5;     // Two in a row
+	static constexpr double RestartScore = 2.5;    // Four in a row, or every other one
+
+	int _audioSampleRate;
+	int _divisor;
+	Parameters _params;
+	double _alpha;
+	double _beta;
+	double _gamma;
+
+	int _numPulses;         // Accepted since (re)start
+	double _outlierScore;
+	bool _missedLast;       // Last accepted pulse came after a missed one
+	double _stateTime;      // When phase, rate and acceleration were last updated (samples)
+	double _phase;          // Pulses
+	double _rate;           // Pulses per sample
+	double _acceleration;   // Pulses per sample^2
+
+	std::vector<double> _queue;    // Crossing times not applied yet
+	size_t _queueHead;
+	size_t _queueSize;
+
+	uint64_t _sampleIndex;
+	size_t _samplesUntilOutput;
+	EstimateCallback _estimateCallback;
+
+	void applyPulsesUntil(double time)
+	{
+		while (_queueSize && _queue[_queueHead] <= time)
+		{
+			applyPulse(_queue[_queueHead]);
+			_queueHead = (_queueHead + 1) % _queue.size();
+			_queueSize--;
+		}
+	}
+
+	void applyPulse(double time)
+	{
+		double dt = time - _stateTime;
+		if (_numPulses == 0 || dt <= 0)
+		{
+			restart(time);
+			return;
+		}
+		if (_numPulses == 1)
+		{
+			_rate = 1 / dt;
+			_acceleration = 0;
+			_phase = 0;
+			_stateTime = time;
+			_numPulses++;
+			return;
+		}
+
+		double predictedPhase = _phase + _rate * dt + 0.5 * _acceleration * dt * dt;
+		double predictedRate = _rate + _acceleration * dt;
+		double pulses = floor(predictedPhase + 0.5);
+		double error = pulses - predictedPhase;
+		// One pulse since the last one, or two when the previous one was not
+		// missed (locking to a multiple of the rate gives a miss each time)
+		bool missed = pulses == 2 && !_missedLast;
+		_outlierScore *= OutlierDecay;
+		if (fabs(error) > _params.maxPhaseError || (pulses != 1 && !missed))
+		{
+			_outlierScore += 1;
+			if (_outlierScore > RestartScore)
+			{
+				restart(time);
+			}
+			return;
+		}
+		_missedLast = missed;
+
+		// Only the fraction of the phase is needed; keeps it small
+		_phase = _alpha * error - error;
+		_rate = predictedRate + _beta * error / dt;
+		_acceleration += 2 * _gamma * error / (dt * dt);
+		_stateTime = time;
+		_numPulses++;
+	}
+
+	void restart(double time)
+	{
+		_numPulses = 1;
+		_outlierScore = 0;
+		_missedLast = false;
+		_phase = 0;
+		_rate = 0;
+		_acceleration = 0;
+		_stateTime = time;
+	}
+
+	void report()
+	{
+		if (_estimateCallback)
+		{
+			SpeedEstimate estimate;
+			estimate.sampleIndex = _sampleIndex;
+			estimate.frequency = getFrequencyAt(_sampleIndex);
+			estimate.rpm = 60 * estimate.frequency / _divisor;
+			estimate.locked = isLockedAt(_sampleIndex);
+			_estimateCallback(estimate);
+		}
+	}
+};
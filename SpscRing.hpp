@@ -0,0 +1,109 @@
+/*
+ * SpscRing.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+/**
+ * Fixed size queue between exactly one producer thread and one consumer
+ * thread. Neither side ever blocks or allocates after construction, so it
+ * can be fed from the audio thread.
+ */
+template<class T>
+class SpscRing {
+public:
+	/// @param capacity  must be a power of two
+	explicit SpscRing(size_t capacity) :
+		_buffer(capacity),
+		_mask(capacity - 1),
+		_head(0),
+		_tail(0)
+	{
+		assert(capacity > 0 && (capacity & (capacity - 1)) == 0 && "capacity must be a power of two");
+	}
+
+	/// Producer only. @return false if full (value is dropped)
+	bool tryPush(const T& value)
+	{
+		size_t head = _head.load(std::memory_order_relaxed);
+		if (head - _tail.load(std::memory_order_acquire) == _buffer.size())
+		{
+			return false;
+		}
+		_buffer[head & _mask] = value;
+		_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/// Consumer only. @return false if empty
+	bool tryPop(T& value)
+	{
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		if (tail == _head.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		value = _buffer[tail & _mask];
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * Producer only. Pushes values[0], values[stride], ... until n values are
+	 * pushed or the ring is full.
+	 * @return number of values pushed
+	 */
+	size_t tryPushBlock(const T* values, size_t n, size_t stride = 1)
+	{
+		size_t head = _head.load(std::memory_order_relaxed);
+		size_t space = _buffer.size() - (head - _tail.load(std::memory_order_acquire));
+		n = std::min(n, space);
+		for (size_t i = 0; i < n; i++)
+		{
+			_buffer[(head + i) & _mask] = values[i * stride];
+		}
+		_head.store(head + n, std::memory_order_release);
+		return n;
+	}
+
+	/// Consumer only. @return number of values popped into values (at most maxCount)
+	size_t tryPopBlock(T* values, size_t maxCount)
+	{
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		size_t n = std::min(maxCount, _head.load(std::memory_order_acquire) - tail);
+		for (size_t i = 0; i < n; i++)
+		{
+			values[i] = _buffer[(tail + i) & _mask];
+		}
+		_tail.store(tail + n, std::memory_order_release);
+		return n;
+	}
+
+	/// Approximate when called while the other thread is active
+	size_t size() const
+	{
+		return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+	}
+
+	size_t capacity() const { return _buffer.size(); }
+
+private:
+	std::vector<T> _buffer;
+	const size_t _mask;
+	// Padded onto separate cache lines, so producer and consumer do not slow
+	// each other down (padding rather than alignas, so it can be new:ed in C++11)
+	char _padding0[64];
+	std::atomic<size_t> _head;
+	char _padding1[64 - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> _tail;
+};
@@ -0,0 +1,177 @@
+/*
+ * StallDetector.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+
+/**
+ * Output of the StallDetector.
+ */
+struct StallEvent {
+	uint64_t sampleIndex;   // Time of the event (samples counted from the first one)
+	double rpm;             // Highest rpm still possible, 0 when stopped
+	bool stopped;
+};
+
+
+/**
+ * Notices when the pulses stop coming. The edge detector only reports at
+ * pulses, so without this the last rpm is shown forever after the shaft
+ * stops.
+ *
+ * Each pulse sets a deadline, deadlineFactor times the last period after
+ * it (but at most maxPeriod). When it passes without a new pulse, the speed
+ * must have dropped: had it been rpm, a pulse would have come within
+ * 60 * rate / (divisor * rpm) samples. That rpm, for the time since the last
+ * pulse, is reported as an upper bound every updateInterval, decaying as
+ * 1 / time. When maxPeriod passes without a pulse, a stop (rpm 0) is
+ * reported, once; so a stop is reported at most maxPeriod after the last
+ * pulse, which also makes maxPeriod the longest period (lowest rpm) that is
+ * measured without a stop in between.
+ *
+ * Time only moves with advance(), by sample count, like for the
+ * SpeedTracker. When the samples stop coming too (a stalled capture device),
+ * a timer can call checkAt() with the samples that should have arrived by
+ * now, so the stop is still reported in time.
+ */
+class StallDetector {
+public:
+	struct Parameters {
+		Parameters() :
+			deadlineFactor(2.5),
+			maxPeriod(3),
+			updateInterval(0.1)
+		{ }
+		double deadlineFactor;  // Periods without a pulse before reporting, > 2 to allow a missed pulse
+		double maxPeriod;       // In seconds, without a pulse before reporting a stop
+		double updateInterval;  // In seconds, between reports of the upper bound
+	};
+
+	typedef std::function<void(const StallEvent&)> StallCallback;
+
+	StallDetector(int audioSampleRate, int divisor, const Parameters& params = Parameters()) :
+		_audioSampleRate(audioSampleRate),
+		_divisor(divisor),
+		_maxPeriod(params.maxPeriod * audioSampleRate),
+		_deadlineFactor(params.deadlineFactor),
+		_updateInterval(std::max(params.updateInterval * audioSampleRate, 1.0)),
+		_state(Idle),
+		_lastPulse(0),
+		_period(0),
+		_deadline(0),
+		_nextReport(0),
+		_sampleIndex(0)
+	{
+		assert(params.maxPeriod > 0);
+		assert(params.deadlineFactor >= 1);
+	}
+
+	void setStallCallback(const StallCallback& callback) { _stallCallback = callback; }
+
+	/// Time advance() has reached, in samples
+	uint64_t getSampleIndex() const { return _sampleIndex; }
+
+	/// True after a stop has been reported, until the next pulse
+	bool isStopped() const { return _state == Stopped; }
+
+	/**
+	 * @param crossingTime  in samples, counted like advance() counts them
+	 *                      (may be ahead of it, as the detector runs first).
+	 */
+	void addPulse(double crossingTime)
+	{
+		bool hasPeriod = _state == Running || _state == Stalling;
+		_period = hasPeriod ? crossingTime - _lastPulse : 0;
+		_lastPulse = crossingTime;
+		_state = Running;
+		_deadline = crossingTime + (_period > 0 ? std::min(_deadlineFactor * _period, _maxPeriod) : _maxPeriod);
+	}
+
+	/// Moves time forward by numSamples, reporting from within this call
+	void advance(size_t numSamples)
+	{
+		_sampleIndex += numSamples;
+		checkAt(_sampleIndex);
+	}
+
+	/**
+	 * Reports what is due at sampleIndex, without moving time. For a timer,
+	 * with the samples that should have arrived by now: samples lost while
+	 * the capture was stalled are never counted by advance(), so time must
+	 * keep following the samples the detector saw. At most one upper bound
+	 * is reported per call, for the latest update due.
+	 */
+	void checkAt(uint64_t sampleIndex)
+	{
+		double now = double(sampleIndex);
+
+		if (_state == Running && now >= _deadline)
+		{
+			_state = Stalling;
+			_nextReport = 0;
+		}
+		if (_state != Stalling)
+		{
+			return;
+		}
+
+		double stopTime = _lastPulse + _maxPeriod;
+		if (now >= stopTime)
+		{
+			_state = Stopped;
+			report(stopTime, 0, true);
+		}
+		else if (now >= _deadline + _nextReport * _updateInterval)
+		{
+			// On the grid from the deadline, whatever the block size
+			uint64_t k = std::max(_nextReport, uint64_t((now - _deadline) / _updateInterval));
+			double due = _deadline + k * _updateInterval;
+			_nextReport = k + 1;
+			report(due, 60.0 * _audioSampleRate / (due - _lastPulse) / _divisor, false);
+		}
+	}
+
+private:
+	enum State {
+		Idle,       // No pulse yet
+		Running,    // Before the deadline
+		Stalling,   // Reporting the upper bound
+		Stopped
+	};
+
+	int _audioSampleRate;
+	int _divisor;
+	double _maxPeriod;          // In samples
+	double _deadlineFactor;
+	double _updateInterval;     // In samples
+	State _state;
+	double _lastPulse;          // Crossing time of the last pulse
+	double _period;             // Before the last pulse, 0 if not known
+	double _deadline;
+	uint64_t _nextReport;       // Update intervals after the deadline
+	uint64_t _sampleIndex;
+	StallCallback _stallCallback;
+
+	void report(double time, double rpm, bool stopped)
+	{
+		if (_stallCallback)
+		{
+			StallEvent event;
+			event.sampleIndex = uint64_t(ceil(time));
+			event.rpm = rpm;
+			event.stopped = stopped;
+			_stallCallback(event);
+		}
+	}
+};
@@ -0,0 +1,37 @@
+/*
+ * Stats.hpp
+ *
+ *  Created on: Jun 19, 2016
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+/**
+ * Values shown by the GUI, updated by the detector each time a new
+ * waveform is delivered.
+ */
+struct Stats {
+	Stats() :
+		rpm(0),
+		filteredRpm(0),
+		trackedRpm(0),
+		rpmSource(0),
+		signalMax(0),
+		signalMin(0),
+		threshold(0),
+		thresholdInPercentage(0),
+		hysteresis(0)
+	{ }
+	float rpm;
+	float filteredRpm;
+	float trackedRpm;       // From the SpeedTracker (0 unless --tracker is given)
+	int rpmSource;          // Of rpm and filteredRpm, a RpmFusion::Source (0 none, 1 edge, 2 spectral)
+	int signalMax;
+	int signalMin;
+	int threshold;
+	int thresholdInPercentage;
+	int hysteresis;
+};
@@ -10,8 +10,19 @@
 #pragma once
 
 #include <assert.h>
+#include <stdint.h>
 #include <time.h>
 
+/**
+ * Monotonic time in nanoseconds.
+ */
+inline uint64_t nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
 class Stopwatch {
 public:
 	Stopwatch()
@@ -0,0 +1,107 @@
+/*
+ * BlockKernels.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <limits>
+
+/**
+ * Loops over contiguous 16 bit samples, written without data dependent
+ * branches in the inner loops so that gcc vectorizes them (NEON on ARM,
+ * SSE2 on x86) at -O3.
+ */
+namespace BlockKernels {
+
+/**
+ * @return index of the first sample outside [lo, hi], or n if all are inside
+ */
+inline size_t findFirstOutside(const int16_t* samples, size_t n, int32_t lo, int32_t hi)
+{
+	if (lo > hi)
+	{
+		return 0;
+	}
+	// Clamped, so the compares can be done on 16 bit lanes
+	const int16_t lo16 = std::max<int32_t>(lo, std::numeric_limits<int16_t>::min());
+	const int16_t hi16 = std::min<int32_t>(hi, std::numeric_limits<int16_t>::max());
+
+	const size_t ChunkSize = 16;
+	size_t i = 0;
+	for (; i + ChunkSize <= n; i += ChunkSize)
+	{
+		int outside = 0;
+		for (size_t j = 0; j < ChunkSize; j++)
+		{
+			outside |= (samples[i + j] < lo16) | (samples[i + j] > hi16);
+		}
+		if (outside)
+		{
+			break;
+		}
+	}
+	for (; i < n; i++)
+	{
+		if (samples[i] < lo16 || samples[i] > hi16)
+		{
+			return i;
+		}
+	}
+	return n;
+}
+
+/**
+ * Widens [minValue, maxValue] to include samples[0 .. n-1].
+ */
+inline void accumulateMinMax(const int16_t* samples, size_t n, int16_t& minValue, int16_t& maxValue)
+{
+	int16_t lo = minValue;
+	int16_t hi = maxValue;
+	for (size_t i = 0; i < n; i++)
+	{
+		lo = std::min(lo, samples[i]);
+		hi = std::max(hi, samples[i]);
+	}
+	minValue = lo;
+	maxValue = hi;
+}
+
+/**
+ * out[i] = samples[i * stride], as float.
+ */
+inline void convertToFloat(const int16_t* samples, size_t n, size_t stride, float* out)
+{
+	if (stride == 1)
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			out[i] = samples[i];
+		}
+		return;
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		out[i] = samples[i * stride];
+	}
+}
+
+/**
+ * out[i] = values[i], rounded to nearest and saturated to the 16 bit range.
+ */
+inline void convertToInt16(const float* values, size_t n, int16_t* out)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		float v = std::min(std::max(values[i], -32768.0f), 32767.0f);
+		out[i] = int16_t(v + (v >= 0 ? 0.5f : -0.5f));
+	}
+}
+
+} // namespace BlockKernels
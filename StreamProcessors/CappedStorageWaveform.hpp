@@ -10,66 +10,168 @@
 #pragma once
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <vector>
 
-
+/**
+ * Stores a waveform of arbitrary length in a bounded number of bins.
+ *
+ * Each bin holds the minimum and maximum of samplesPerBin consecutive samples.
+ * When all bins are used, pairs of neighbouring bins are merged, which halves
+ * the number of used bins and doubles samplesPerBin (always a power of two).
+ * Unlike plain decimation, narrow pulses are never lost, since every sample
+ * contributes to the min/max of some bin.
+ *
+ * All storage is allocated in the constructor. A merge is O(maxNumBins), but it
+ * only happens after maxNumBins * samplesPerBin / 2 new samples, so push() is
+ * amortized O(1) regardless of how long the captured period is.
+ *
+ * Optionally the last preTriggerSamples samples are remembered, and used
+ * as the start of the waveform after each clear(). That way the region just
+ * before the trigger (typically the rising edge of the pulse) is visible.
+ */
 class CappedStorageWaveform {
 public:
-	CappedStorageWaveform(int maxWaveformSize = 4096) :
-	_maxWaveformSize(maxWaveformSize),
-	_waveformNumSamplesSkip(0), // 0 = everysample, 1 = every other sample
-	_skipCounter(0)
+	struct Bin {
+		int16_t min;
+		int16_t max;
+	};
+
+	CappedStorageWaveform(int maxNumBins = 4096, int preTriggerSamples = 0) :
+		_maxNumBins(maxNumBins),
+		_bins(maxNumBins),
+		_numBins(0),
+		_samplesPerBin(1),
+		_samplesInCurrentBin(0),
+		_preTrigger(preTriggerSamples),
+		_preTriggerPos(0),
+		_preTriggerFilled(0),
+		_numPreTriggerSamples(0)
 	{
-		assert((_maxWaveformSize & 1) == 0); // Needs to be even
+		assert(_maxNumBins >= 2);
+		assert((_maxNumBins & 1) == 0); // Needs to be even
 	}
 
 	void push(int16_t val)
 	{
-		if (_skipCounter == _waveformNumSamplesSkip)
+		if (!_preTrigger.empty())
 		{
-			if (_waveform.size() < _maxWaveformSize)
+			_preTrigger[_preTriggerPos] = val;
+			_preTriggerPos++;
+			if (_preTriggerPos == _preTrigger.size())
 			{
-				_waveform.push_back(val);
-				_skipCounter = 0;
-				return;
+				_preTriggerPos = 0;
 			}
-			else
+			if (_preTriggerFilled < _preTrigger.size())
 			{
-				// Compact the vector to only use every second sample.
-				// double _waveformNumSamplesSkip,
-				for (size_t i = 0; 2*i < _maxWaveformSize; i++)
-				{
-					_waveform[i] = _waveform[2*i];
-				}
-				_waveform.resize(_maxWaveformSize/2);
-				_waveformNumSamplesSkip = (_waveformNumSamplesSkip + 1) * 2 - 1;
-
-				// Don't forget the current sample as well
-				_waveform.push_back(val);
-				_skipCounter = 0;
-				return;
+				_preTriggerFilled++;
 			}
 		}
 
-		_skipCounter++;
+		store(val);
 	}
 
-	const std::vector<int16_t>& getWaveform() const {
-		return _waveform;
+	/**
+	 * Number of bins in use, including a partially filled last bin.
+	 */
+	size_t size() const
+	{
+		return _numBins + (_samplesInCurrentBin ? 1 : 0);
+	}
+
+	const Bin& operator[](size_t i) const
+	{
+		assert(i < size());
+		return _bins[i];
 	}
 
+	const Bin* getBins() const { return _bins.data(); }
+
+	size_t getMaxNumBins() const { return _maxNumBins; }
+
+	size_t getSamplesPerBin() const { return _samplesPerBin; }
+
+	/**
+	 * Number of samples at the start of the waveform which were pushed
+	 * before the last clear(). (The trigger point is located right after those).
+	 */
+	size_t getNumPreTriggerSamples() const { return _numPreTriggerSamples; }
+
+	/**
+	 * Restarts the capture. The last preTriggerSamples samples pushed
+	 * (if any) are kept at the start of the new waveform.
+	 */
 	void clear()
 	{
-		_waveform.clear();
-		_waveformNumSamplesSkip = 0;
-		_skipCounter = 0;
+		_numBins = 0;
+		_samplesPerBin = 1;
+		_samplesInCurrentBin = 0;
+		_numPreTriggerSamples = _preTriggerFilled;
+
+		size_t pos = (_preTriggerPos + _preTrigger.size() - _preTriggerFilled) % std::max<size_t>(_preTrigger.size(), 1);
+		for (size_t i = 0; i < _preTriggerFilled; i++)
+		{
+			store(_preTrigger[pos]);
+			pos++;
+			if (pos == _preTrigger.size())
+			{
+				pos = 0;
+			}
+		}
 	}
 
 private:
-	size_t _maxWaveformSize;
-	size_t _waveformNumSamplesSkip;
-	size_t _skipCounter;
-	std::vector<int16_t> _waveform;
+	const size_t _maxNumBins;
+	std::vector<Bin> _bins;
+	size_t _numBins;  // Completely filled bins
+	size_t _samplesPerBin;
+	size_t _samplesInCurrentBin;
+
+	std::vector<int16_t> _preTrigger;
+	size_t _preTriggerPos;
+	size_t _preTriggerFilled;
+	size_t _numPreTriggerSamples;
+
+	void store(int16_t val)
+	{
+		Bin& bin = _bins[_numBins];
+		if (_samplesInCurrentBin == 0)
+		{
+			bin.min = bin.max = val;
+		}
+		else
+		{
+			if (val < bin.min) { bin.min = val; }
+			if (val > bin.max) { bin.max = val; }
+		}
+
+		_samplesInCurrentBin++;
+		if (_samplesInCurrentBin == _samplesPerBin)
+		{
+			_samplesInCurrentBin = 0;
+			_numBins++;
+			if (_numBins == _maxNumBins)
+			{
+				mergeBinPairs();
+			}
+		}
+	}
+
+	void mergeBinPairs()
+	{
+		for (size_t i = 0; 2*i < _maxNumBins; i++)
+		{
+			const Bin& a = _bins[2*i];
+			const Bin& b = _bins[2*i + 1];
+			Bin merged;
+			merged.min = std::min(a.min, b.min);
+			merged.max = std::max(a.max, b.max);
+			_bins[i] = merged;
+		}
+		_numBins = _maxNumBins / 2;
+		_samplesPerBin *= 2;
+	}
 };
@@ -0,0 +1,89 @@
+/*
+ * CicDecimator.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Cascaded integrator-comb decimator: order integrators at the input rate,
+ * then order combs (differences) at 1 / ratio of the rate. The response is
+ * that of order moving averages of ratio samples in series, with no
+ * multiplications at all.
+ *
+ * The integrators are allowed to wrap around; as long as the output fits
+ * (order * log2(ratio) + 16 bits <= 32) the combs undo the wrap exactly, so
+ * unsigned 32 bit arithmetic is enough. The gain ratio^order is divided out,
+ * so the output has the same scale as the input.
+ */
+class CicDecimator {
+public:
+	enum { MaxOrder = 4 };
+
+	CicDecimator(size_t ratio, int order) :
+		_ratio(ratio),
+		_order(order),
+		_gain(1),
+		_phase(0)
+	{
+		assert(ratio >= 1 && order >= 1 && order <= MaxOrder);
+		for (int k = 0; k < order; k++)
+		{
+			_gain *= ratio;
+		}
+		assert(_gain <= (1u << 16) && "order * log2(ratio) must be at most 16");
+		for (int k = 0; k < MaxOrder; k++)
+		{
+			_integrators[k] = 0;
+			_delays[k] = 0;
+		}
+	}
+
+	size_t getRatio() const { return _ratio; }
+
+	/**
+	 * Decimates samples[0], samples[stride], ... samples[(n - 1) * stride].
+	 * @param out  room for n / ratio + 1 samples
+	 * @return number of samples written to out
+	 */
+	size_t process(const int16_t* samples, size_t n, size_t stride, int16_t* out)
+	{
+		size_t numOut = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			uint32_t value = uint32_t(int32_t(samples[i * stride]));
+			for (int k = 0; k < _order; k++)
+			{
+				_integrators[k] += value;
+				value = _integrators[k];
+			}
+
+			if (++_phase == _ratio)
+			{
+				_phase = 0;
+				for (int k = 0; k < _order; k++)
+				{
+					uint32_t difference = value - _delays[k];
+					_delays[k] = value;
+					value = difference;
+				}
+				out[numOut++] = int16_t(int32_t(value) / int32_t(_gain));
+			}
+		}
+		return numOut;
+	}
+
+private:
+	size_t _ratio;
+	int _order;
+	uint32_t _gain;
+	size_t _phase;                          // Input samples since the last output
+	uint32_t _integrators[MaxOrder];
+	uint32_t _delays[MaxOrder];             // Comb inputs at the previous output
+};
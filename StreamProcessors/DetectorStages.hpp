@@ -0,0 +1,643 @@
+/*
+ * DetectorStages.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include "../SeqLock.hpp"
+#include "CappedStorageWaveform.hpp"
+#include "MinMaxCheck.hpp"
+#include "Pipeline.hpp"
+#include "PulseEvent.hpp"
+#include "QuantileTracker.hpp"
+#include "SlidingRpmFilter.hpp"
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+/*
+ * The stages of the edge detector (see RPMCalculatorFromAudio), in the order
+ * they are normally used:
+ *
+ *   MinMaxStage           tracks the signal range (min/max, or percentiles)
+ *   SchmittTriggerStage   finds rising edges, using the threshold from the previous sample
+ *   CrossingInterpolatorStage  finds where between two samples the edge crossed its level
+ *   PeriodEstimatorStage  measures the period between edges, and reports pulses
+ *   WaveformCaptureStage  captures the waveform between pulses (left out when nothing displays it)
+ *   ThresholdStage        places threshold and hysteresis in the tracked range
+ */
+
+
+/**
+ * Length of the window the signal range is tracked over: 13 segments of
+ * rate / 5 samples (about 2.6 seconds) by default, which is too short to hold
+ * a revolution at very low speeds, and follows amplitude changes slowly at
+ * high speeds.
+ *
+ * With setPeriodsPerWindow(), the window is instead sized to that many
+ * periods, from the larger of the last and the filtered period (so it grows
+ * right away when the speed drops), but at most MaxWindowFactor times the
+ * default (about 10 seconds). It keeps the default size until
+ * StartupPulses pulses have been seen. Each time no pulse arrives for a
+ * whole window (the speed dropped a lot, the amplitude dropped below the
+ * threshold, or the signal stopped), the window is doubled, up to the
+ * default. That keeps the last pulse in the range a while longer, while
+ * older samples still leave it a segment at a time.
+ *
+ * Changes of less than 1/8 of the window are ignored, so the window does not
+ * change with each pulse (and two detectors estimating the period a little
+ * differently end up with the same window).
+ *
+ * pulse() and advance() tell when the window size changed, for the caller to
+ * resize its MinMaxCheck (and QuantileTracker).
+ */
+class RangeWindowAdapter {
+public:
+	enum { NumSegments = 13, StartupPulses = 10, MinSamplesPerSegment = 4, MaxWindowFactor = 4 };
+
+	explicit RangeWindowAdapter(int sampleRate) :
+		_defaultSamplesPerSegment(std::max(sampleRate / 5, int(MinSamplesPerSegment))),
+		_maxSamplesPerSegment(_defaultSamplesPerSegment * MaxWindowFactor),
+		_periodsPerWindow(0),
+		_samplesPerSegment(_defaultSamplesPerSegment),
+		_numPulses(0),
+		_samplesSincePulse(0)
+	{ }
+
+	/// 0 for the default window, otherwise at least 2
+	void setPeriodsPerWindow(int periods)
+	{
+		assert(periods == 0 || periods >= 2);
+		_periodsPerWindow = periods;
+		restart();
+	}
+
+	int getPeriodsPerWindow() const { return _periodsPerWindow; }
+
+	bool isEnabled() const { return _periodsPerWindow != 0; }
+
+	size_t getSamplesPerSegment() const { return _samplesPerSegment; }
+	size_t getWindowSize() const { return _samplesPerSegment * NumSegments; }
+	size_t getMaxWindowSize() const { return _maxSamplesPerSegment * NumSegments; }
+
+	/// advance() by at most this many samples does not change the window
+	size_t getSamplesBeforeGrowth() const
+	{
+		if (_samplesPerSegment >= _defaultSamplesPerSegment)
+		{
+			return std::numeric_limits<size_t>::max();
+		}
+		return getWindowSize() - std::min(_samplesSincePulse, getWindowSize());
+	}
+
+	/// @return true if the window size changed
+	bool advance(size_t numSamples)
+	{
+		_samplesSincePulse += numSamples;
+		if (_samplesSincePulse <= getWindowSize() || _samplesPerSegment >= _defaultSamplesPerSegment)
+		{
+			return false;
+		}
+		_samplesPerSegment = std::min(2 * _samplesPerSegment, _defaultSamplesPerSegment);
+		return true;
+	}
+
+	/**
+	 * @param period          of the pulse, in samples
+	 * @param filteredPeriod  of the filtered rpm, in samples
+	 * @return true if the window size changed
+	 */
+	bool pulse(size_t period, size_t filteredPeriod)
+	{
+		_samplesSincePulse = 0;
+		if (_numPulses < StartupPulses && ++_numPulses < StartupPulses)
+		{
+			return false;
+		}
+		size_t window = _periodsPerWindow * std::max(period, filteredPeriod);
+		size_t samplesPerSegment = std::min(std::max(window / NumSegments + 1, size_t(MinSamplesPerSegment)),
+				_maxSamplesPerSegment);
+		size_t change = std::max(samplesPerSegment, _samplesPerSegment) - std::min(samplesPerSegment, _samplesPerSegment);
+		if (change * 8 <= _samplesPerSegment)
+		{
+			return false;
+		}
+		_samplesPerSegment = samplesPerSegment;
+		return true;
+	}
+
+private:
+	size_t _defaultSamplesPerSegment;
+	size_t _maxSamplesPerSegment;
+	int _periodsPerWindow;
+	size_t _samplesPerSegment;
+	int _numPulses;
+	size_t _samplesSincePulse;
+
+	void restart()
+	{
+		_samplesPerSegment = _defaultSamplesPerSegment;
+		_numPulses = 0;
+		_samplesSincePulse = 0;
+	}
+};
+
+
+/**
+ * Tracks min and max of the signal over roughly the last 2.6 seconds, or a
+ * number of periods (see RangeWindowAdapter).
+ *
+ * A single glitch sample sets min or max for the whole window, though. With
+ * setQuantiles(), the range is instead taken from a low and a high
+ * percentile over the same time (QuantileTracker), which a few samples can
+ * not move.
+ */
+class MinMaxStage : public PipelineStage {
+public:
+	explicit MinMaxStage(int sampleRate) :
+		_window(sampleRate),
+		_minMax(_window.getSamplesPerSegment(), RangeWindowAdapter::NumSegments),
+		_lastPulseIndex(0)
+	{ }
+
+	/**
+	 * Window of periods periods instead of about 2.6 seconds, e.g. 8; 0 for
+	 * the fixed window. Must not be called while another thread is calling process().
+	 */
+	void setWindowPeriods(int periods)
+	{
+		_window.setPeriodsPerWindow(periods);
+		resizeWindow();
+	}
+
+	size_t getWindowSize() const { return _window.getWindowSize(); }
+
+	/**
+	 * Range from the lowPercent and highPercent percentiles, e.g. 1 and 99
+	 * (must be outside the duty cycle of the pulses). 0 and 100 go back to min
+	 * and max. Allocates; must not be called while another thread is calling process().
+	 */
+	void setQuantiles(double lowPercent, double highPercent)
+	{
+		_quantiles = (lowPercent > 0 || highPercent < 100) ?
+				QuantileTracker(_window.getMaxWindowSize(), lowPercent, highPercent) : QuantileTracker();
+		resizeWindow();
+	}
+
+	bool usesQuantiles() const { return _quantiles.isEnabled(); }
+
+	void process(PipelineContext& ctx)
+	{
+		if (_window.isEnabled())
+		{
+			adaptWindow(ctx.pulse);
+		}
+		if (_quantiles.isEnabled())
+		{
+			_quantiles.push(ctx.sample);
+			ctx.signalMin = _quantiles.getLow();
+			ctx.signalMax = _quantiles.getHigh();
+			return;
+		}
+		_minMax.check(ctx.sample);
+		ctx.signalMin = _minMax.getMin();
+		ctx.signalMax = _minMax.getMax();
+	}
+
+private:
+	RangeWindowAdapter _window;
+	MinMaxCheck _minMax;
+	QuantileTracker _quantiles;
+	uint64_t _lastPulseIndex;
+
+	/// The pulse is the last one reported by the PeriodEstimatorStage (at the previous sample or before)
+	void adaptWindow(const PulseEvent& pulse)
+	{
+		bool changed = false;
+		if (pulse.sampleIndex != _lastPulseIndex)
+		{
+			_lastPulseIndex = pulse.sampleIndex;
+			changed = _window.pulse(size_t(pulse.periodInSamples),
+					size_t(pulse.periodInSamples * pulse.rpm / pulse.filteredRpm));
+		}
+		changed |= _window.advance(1);
+		if (changed)
+		{
+			resizeWindow();
+		}
+	}
+
+	void resizeWindow()
+	{
+		_minMax.setSamplesPerSegment(_window.getSamplesPerSegment());
+		if (_quantiles.isEnabled())
+		{
+			_quantiles.setWindowSize(_window.getWindowSize());
+		}
+	}
+};
+
+
+/**
+ * Comparator with hysteresis. Marks the sample where the signal rises above
+ * threshold + hysteresis (after having been below threshold - hysteresis).
+ */
+class SchmittTriggerStage : public PipelineStage {
+public:
+	SchmittTriggerStage() : _state(Uninitialized) { }
+
+	/// True when no sample in [lo, hi] can change the state (with the current levels)
+	bool isQuiet(int32_t lo, int32_t hi, const PipelineContext& ctx) const
+	{
+		switch(_state)
+		{
+		case Uninitialized:
+			return hi < ctx.triggerLevel;
+		case WasBelow:
+			return hi < ctx.riseLevel;
+		case WasAbove:
+			return lo >= ctx.fallLevel;
+		}
+		return false;
+	}
+
+	void process(PipelineContext& ctx)
+	{
+		switch(_state)
+		{
+		case Uninitialized:
+			if (ctx.sample >= ctx.triggerLevel)
+			{
+				_state = WasAbove;
+				ctx.edge = PipelineContext::FirstEdge;
+			}
+			break;
+
+		case WasBelow:
+			if (ctx.sample >= ctx.riseLevel)
+			{
+				_state = WasAbove;
+				ctx.edge = PipelineContext::RisingEdge;
+			}
+			break;
+
+		case WasAbove:
+			if (ctx.sample < ctx.fallLevel)
+			{
+				_state = WasBelow;
+			}
+			break;
+		}
+	}
+
+private:
+	enum State {
+		Uninitialized,
+		WasBelow,
+		WasAbove
+	};
+
+	State _state;
+};
+
+
+enum CrossingInterpolation {
+	NoInterpolation,        // Edges at whole samples
+	LinearInterpolation,    // Straight line between the samples around the crossing
+	CubicInterpolation      // Cubic through the crossing samples and the two before
+};
+
+
+/**
+ * Estimates where between the previous and the current sample a rising edge
+ * crossed the rise level (threshold + hysteresis), so periods are not
+ * quantized to whole samples. At 44.1 kHz and 30000 rpm a period is only 88
+ * samples, so whole samples would mean more than 1% error per pulse.
+ *
+ * Only does any math on edges; for the other samples it just remembers the
+ * last few samples.
+ */
+class CrossingInterpolatorStage : public PipelineStage {
+public:
+	explicit CrossingInterpolatorStage(CrossingInterpolation interpolation = LinearInterpolation) :
+		_interpolation(interpolation)
+	{
+		std::fill(_history, _history + HistorySize, 0);
+	}
+
+	void setInterpolation(CrossingInterpolation interpolation) { _interpolation = interpolation; }
+
+	CrossingInterpolation getInterpolation() const { return _interpolation; }
+
+	void process(PipelineContext& ctx)
+	{
+		if (ctx.edge == PipelineContext::RisingEdge)
+		{
+			ctx.crossingOffset = findCrossing(ctx.threshold + ctx.hysteresis, ctx.sample);
+		}
+		_history[0] = _history[1];
+		_history[1] = _history[2];
+		_history[2] = ctx.sample;
+	}
+
+	/// Instead of process() for samples without edges
+	void skip(const int16_t* samples, size_t n)
+	{
+		for (size_t i = n > HistorySize ? n - HistorySize : 0; i < n; i++)
+		{
+			_history[0] = _history[1];
+			_history[1] = _history[2];
+			_history[2] = samples[i];
+		}
+	}
+
+private:
+	enum { HistorySize = 3 };
+
+	CrossingInterpolation _interpolation;
+	int32_t _history[HistorySize];    // The samples before the current one, oldest first
+
+	/// @return crossing time relative to the current sample (-1 .. 0)
+	double findCrossing(double level, int32_t sample) const
+	{
+		const double previous = _history[2];
+		const double rise = sample - previous;
+		if (_interpolation == NoInterpolation || rise <= 0)
+		{
+			return 0;
+		}
+
+		double t = std::min(std::max((level - previous) / rise, 0.0), 1.0);
+		if (_interpolation == CubicInterpolation)
+		{
+			t = refineCubic(level, sample, t);
+		}
+		return t - 1;
+	}
+
+	/**
+	 * Solves p(t) = level for the cubic p through the last three samples
+	 * (t = -2, -1, 0) and the current one (t = 1), with Newton's method
+	 * starting at the linear estimate. Falls back to the linear estimate if
+	 * the cubic does not rise through the interval.
+	 */
+	double refineCubic(double level, int32_t sample, double linearT) const
+	{
+		const double y0 = _history[0];
+		const double y1 = _history[1];
+		const double y2 = _history[2];
+		const double y3 = sample;
+		// p(t) = a + b t + c t^2 + d t^3
+		const double a = y2;
+		const double b = y0 / 6 - y1 + y2 / 2 + y3 / 3;
+		const double c = y1 / 2 - y2 + y3 / 2;
+		const double d = -y0 / 6 + y1 / 2 - y2 / 2 + y3 / 6;
+
+		double t = linearT;
+		for (int i = 0; i < 4; i++)
+		{
+			double value = a + t * (b + t * (c + t * d));
+			double slope = b + t * (2 * c + t * 3 * d);
+			if (slope <= 0)
+			{
+				return linearT;
+			}
+			t -= (value - level) / slope;
+		}
+		return (t >= 0 && t <= 1) ? t : linearT;
+	}
+};
+
+
+/**
+ * Settings changed from outside the audio thread. Delivered to the stages
+ * through a SeqLockValue, whose version tells them when to look again.
+ */
+struct DetectorControl {
+	int thresholdPercentage;
+	RpmFilter rpmFilter;        // For PulseEvent::filteredRpm
+};
+
+
+/**
+ * Counts samples between rising edges, and turns each edge into a PulseEvent
+ * (stored in the context, and passed to the pulse callback). The period
+ * includes the crossing offsets, when a CrossingInterpolatorStage is used.
+ *
+ * The filtered rpm is over the last 10 pulses, with the filter from the
+ * DetectorControl (checked once per block), or the mean without one.
+ */
+class PeriodEstimatorStage : public PipelineStage {
+public:
+	enum { PerSample = 1, PerBlock = 1 };
+
+	typedef std::function<void(const PulseEvent&)> PulseCallback;
+
+	PeriodEstimatorStage(int sampleRate, int divisor, const SeqLockValue<DetectorControl>* control = NULL) :
+		_sampleRate(sampleRate),
+		_divisor(divisor),
+		_periodCounter(0),
+		_lastCrossingOffset(0),
+		_control(control),
+		_controlVersion(control ? control->getVersion() : 0)
+	{
+		if (control)
+		{
+			_rpmFilter.setFilter(control->load().rpmFilter);
+		}
+	}
+
+	void setPulseCallback(const PulseCallback& callback) { _pulseCallback = callback; }
+
+	void beginBlock(PipelineContext&)
+	{
+		if (!_control)
+		{
+			return;
+		}
+		uint32_t version = _control->getVersion();
+		if (version != _controlVersion)
+		{
+			_controlVersion = version;
+			_rpmFilter.setFilter(_control->load().rpmFilter);
+		}
+	}
+
+	/// Instead of process() for samples without edges
+	void skip(size_t n) { _periodCounter += n; }
+
+	void process(PipelineContext& ctx)
+	{
+		_periodCounter++;
+		if (ctx.edge == PipelineContext::FirstEdge)
+		{
+			_periodCounter = 0;
+			_lastCrossingOffset = 0;
+		}
+		else if (ctx.edge == PipelineContext::RisingEdge)
+		{
+			double period = std::max(_periodCounter + ctx.crossingOffset - _lastCrossingOffset, 1.0);
+			_lastCrossingOffset = ctx.crossingOffset;
+
+			double rpm = ((60.0 * _sampleRate) / period ) / _divisor;
+
+			_rpmFilter.push(rpm);
+
+			PulseEvent& event = ctx.pulse;
+			event.sampleIndex = ctx.sampleIndex;
+			event.crossingTime = ctx.sampleIndex + ctx.crossingOffset;
+			event.periodInSamples = period;
+			event.rpm = rpm;
+			event.filteredRpm = _rpmFilter.getValue();
+			event.threshold = ctx.threshold;
+			event.hysteresis = ctx.hysteresis;
+			event.signalMin = ctx.signalMin;
+			event.signalMax = ctx.signalMax;
+			event.thresholdInPercentage = ctx.thresholdInPercentage;
+
+			if (_pulseCallback)
+			{
+				_pulseCallback(event);
+			}
+
+			_periodCounter = 0;
+		}
+	}
+
+private:
+	int _sampleRate;
+	int _divisor;
+	long _periodCounter;
+	double _lastCrossingOffset;
+	const SeqLockValue<DetectorControl>* _control;
+	uint32_t _controlVersion;
+	SlidingRpmFilter _rpmFilter;
+	PulseCallback _pulseCallback;
+};
+
+
+/**
+ * Captures the waveform, and hands it to the waveform callback every few
+ * pulses (together with the pulse completing it).
+ */
+class WaveformCaptureStage : public PipelineStage {
+public:
+	typedef std::function<void(const CappedStorageWaveform&, const PulseEvent&)> WaveformCallback;
+
+	explicit WaveformCaptureStage(int sampleRate, int pulsesPerDelivery = 3) :
+		_numStoredWaveforms(0),
+		_numWaveformsBeforeDelivery(pulsesPerDelivery),
+		_waveform(2048, sampleRate / 200)
+	{ }
+
+	void setWaveformCallback(const WaveformCallback& callback) { _waveformCallback = callback; }
+
+	void process(PipelineContext& ctx)
+	{
+		_waveform.push(ctx.sample);
+
+		if (ctx.edge == PipelineContext::RisingEdge)
+		{
+			_numStoredWaveforms++;
+
+			if (_numStoredWaveforms >= _numWaveformsBeforeDelivery)
+			{
+				if (_waveformCallback)
+				{
+					_waveformCallback(_waveform, ctx.pulse);
+				}
+
+				_waveform.clear();
+				_numStoredWaveforms = 0;
+			}
+		}
+	}
+
+private:
+	int _numStoredWaveforms;
+	int _numWaveformsBeforeDelivery;
+	CappedStorageWaveform _waveform;
+	WaveformCallback _waveformCallback;
+};
+
+
+/**
+ * Places the threshold at a percentage between the tracked min and max, with
+ * a hysteresis of 1/8 of the range.
+ *
+ * The levels only change when min or max changes (at the end of a MinMaxCheck
+ * segment, or on a new extreme) or when a new percentage arrives, so they are
+ * only recomputed then. The control version is checked once per block.
+ */
+class ThresholdStage : public PipelineStage {
+public:
+	enum { PerSample = 1, PerBlock = 1 };
+
+	ThresholdStage(int requiredAmplitude, const SeqLockValue<DetectorControl>& control) :
+		_requiredAmplitude(requiredAmplitude),
+		_control(&control),
+		_controlVersion(control.getVersion()),
+		_percentage(control.load().thresholdPercentage),
+		_signalMin(0),
+		_signalMax(0),
+		_dirty(true)
+	{ }
+
+	void beginBlock(PipelineContext&)
+	{
+		uint32_t version = _control->getVersion();
+		if (version != _controlVersion)
+		{
+			_controlVersion = version;
+			int percentage = _control->load().thresholdPercentage;
+			_dirty |= (percentage != _percentage);
+			_percentage = percentage;
+		}
+	}
+
+	void process(PipelineContext& ctx)
+	{
+		if (_dirty || ctx.signalMin != _signalMin || ctx.signalMax != _signalMax)
+		{
+			update(ctx);
+		}
+	}
+
+private:
+	int _requiredAmplitude;
+	const SeqLockValue<DetectorControl>* _control;
+	uint32_t _controlVersion;
+	int _percentage;
+	int _signalMin;
+	int _signalMax;
+	bool _dirty;
+
+	void update(PipelineContext& ctx)
+	{
+		_signalMin = ctx.signalMin;
+		_signalMax = ctx.signalMax;
+		_dirty = false;
+
+		ctx.thresholdInPercentage = _percentage;
+		float weight = _percentage * 0.01;
+		ctx.threshold = _signalMax * weight + _signalMin * (1 - weight);
+		ctx.hysteresis = (_signalMax - _signalMin) / 8;
+		int amplitude = _signalMax - _signalMin;
+		ctx.amplitudeIsHighEnough = amplitude > _requiredAmplitude;
+
+		// Samples are integers, so comparing against the rounded up level is exact
+		ctx.triggerLevel = ceil(ctx.threshold);
+		ctx.riseLevel = ctx.amplitudeIsHighEnough ?
+				int32_t(ceil(ctx.threshold + ctx.hysteresis)) : std::numeric_limits<int32_t>::max();
+		ctx.fallLevel = ceil(ctx.threshold - ctx.hysteresis);
+	}
+};
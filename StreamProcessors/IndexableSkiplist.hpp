@@ -0,0 +1,251 @@
+/*
+ * IndexableSkiplist.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * Sorted multiset of at most capacity values, with O(log n) insert, erase,
+ * access by rank, and sum of the smallest k values (the order statistics the
+ * sliding rpm filters need).
+ *
+ * Each link of the skiplist stores how many positions it skips (its width)
+ * and the sum of the values it skips, so rank and sum queries add up the
+ * links on the way down instead of walking the nodes. The nodes come from a
+ * pool allocated by the constructor; nothing is allocated afterwards.
+ *
+ * Node levels are drawn from a small xorshift generator with a fixed seed,
+ * so the structure (and the rounding of the sums of a floating point Sum) is
+ * the same from run to run.
+ */
+template<class T, class Sum>
+class IndexableSkiplist {
+public:
+	explicit IndexableSkiplist(size_t capacity) :
+		_capacity(capacity),
+		_numLevels(1),
+		_size(0),
+		_random(2463534242u)
+	{
+		assert(capacity >= 1 && capacity < Nil - 1);
+		while (_numLevels < MaxLevels && (size_t(1) << _numLevels) < capacity)
+		{
+			_numLevels++;
+		}
+		size_t numNodes = capacity + 1;     // Plus the head
+		_values.resize(numNodes);
+		_nodeLevels.resize(numNodes);
+		_next.resize(numNodes * _numLevels);
+		_width.resize(numNodes * _numLevels);
+		_sum.resize(numNodes * _numLevels);
+		clear();
+	}
+
+	size_t size() const { return _size; }
+	size_t capacity() const { return _capacity; }
+
+	void clear()
+	{
+		_size = 0;
+		for (int level = 0; level < _numLevels; level++)
+		{
+			link(Head, level) = Nil;
+			width(Head, level) = 1;
+			sum(Head, level) = 0;
+		}
+		// Free nodes are chained through their level 0 links
+		_free = Nil;
+		for (size_t node = _capacity; node >= 1; node--)
+		{
+			link(uint32_t(node), 0) = _free;
+			_free = uint32_t(node);
+		}
+	}
+
+	void insert(T value)
+	{
+		assert(_size < _capacity);
+		uint32_t chain[MaxLevels];
+		size_t stepsAtLevel[MaxLevels];
+		Sum sumAtLevel[MaxLevels];
+		uint32_t node = Head;
+		for (int level = _numLevels - 1; level >= 0; level--)
+		{
+			stepsAtLevel[level] = 0;
+			sumAtLevel[level] = 0;
+			while (link(node, level) != Nil && _values[link(node, level)] <= value)
+			{
+				stepsAtLevel[level] += width(node, level);
+				sumAtLevel[level] += sum(node, level);
+				node = link(node, level);
+			}
+			chain[level] = node;
+		}
+
+		uint32_t newNode = _free;
+		_free = link(newNode, 0);
+		int d = randomLevel();
+		_values[newNode] = value;
+		_nodeLevels[newNode] = d;
+
+		// Nodes (and their sum) between chain[level] and the new node
+		size_t steps = 0;
+		Sum stepSum = 0;
+		for (int level = 0; level < d; level++)
+		{
+			uint32_t previous = chain[level];
+			link(newNode, level) = link(previous, level);
+			link(previous, level) = newNode;
+			width(newNode, level) = width(previous, level) - steps;
+			sum(newNode, level) = sum(previous, level) - stepSum;
+			width(previous, level) = steps + 1;
+			sum(previous, level) = stepSum + value;
+			steps += stepsAtLevel[level];
+			stepSum += sumAtLevel[level];
+		}
+		for (int level = d; level < _numLevels; level++)
+		{
+			width(chain[level], level)++;
+			sum(chain[level], level) += value;
+		}
+		_size++;
+	}
+
+	/// Removes one value equal to value, which must be in the list
+	void erase(T value)
+	{
+		uint32_t chain[MaxLevels];
+		uint32_t node = Head;
+		for (int level = _numLevels - 1; level >= 0; level--)
+		{
+			while (link(node, level) != Nil && _values[link(node, level)] < value)
+			{
+				node = link(node, level);
+			}
+			chain[level] = node;
+		}
+		uint32_t removed = link(chain[0], 0);
+		assert(removed != Nil && _values[removed] == value);
+
+		int d = _nodeLevels[removed];
+		for (int level = 0; level < d; level++)
+		{
+			uint32_t previous = chain[level];
+			width(previous, level) += width(removed, level) - 1;
+			sum(previous, level) += sum(removed, level) - value;
+			link(previous, level) = link(removed, level);
+		}
+		for (int level = d; level < _numLevels; level++)
+		{
+			width(chain[level], level)--;
+			sum(chain[level], level) -= value;
+		}
+		link(removed, 0) = _free;
+		_free = removed;
+		_size--;
+	}
+
+	/// The value of the given rank, 0 for the smallest
+	T at(size_t rank) const
+	{
+		assert(rank < _size);
+		size_t position = rank + 1;
+		uint32_t node = Head;
+		for (int level = _numLevels - 1; level >= 0; level--)
+		{
+			while (width(node, level) <= position)
+			{
+				position -= width(node, level);
+				node = link(node, level);
+			}
+		}
+		return _values[node];
+	}
+
+	/// Sum of the count smallest values
+	Sum sumOfSmallest(size_t count) const
+	{
+		assert(count <= _size);
+		Sum total = 0;
+		size_t position = count;
+		uint32_t node = Head;
+		for (int level = _numLevels - 1; level >= 0; level--)
+		{
+			while (width(node, level) <= position)
+			{
+				position -= width(node, level);
+				total += sum(node, level);
+				node = link(node, level);
+			}
+		}
+		return total;
+	}
+
+	/// Number of values below value (or, with inclusive, at most value)
+	size_t countBelow(T value, bool inclusive = false) const
+	{
+		size_t count = 0;
+		uint32_t node = Head;
+		for (int level = _numLevels - 1; level >= 0; level--)
+		{
+			for (uint32_t next = link(node, level);
+					next != Nil && (_values[next] < value || (inclusive && _values[next] == value));
+					next = link(node, level))
+			{
+				count += width(node, level);
+				node = next;
+			}
+		}
+		return count;
+	}
+
+private:
+	enum { MaxLevels = 24 };
+	static const uint32_t Head = 0;
+	static const uint32_t Nil = 0xffffffffu;
+
+	size_t _capacity;
+	int _numLevels;
+	size_t _size;
+	uint32_t _random;
+	uint32_t _free;
+
+	std::vector<T> _values;
+	std::vector<int> _nodeLevels;
+	// Per node and level: the next node, and the positions and sum of the
+	// values from (not including) this node to (including) the next one.
+	// Links to Nil count one position for Nil itself.
+	std::vector<uint32_t> _next;
+	std::vector<size_t> _width;
+	std::vector<Sum> _sum;
+
+	uint32_t& link(uint32_t node, int level) { return _next[node * _numLevels + level]; }
+	uint32_t link(uint32_t node, int level) const { return _next[node * _numLevels + level]; }
+	size_t& width(uint32_t node, int level) { return _width[node * _numLevels + level]; }
+	size_t width(uint32_t node, int level) const { return _width[node * _numLevels + level]; }
+	Sum& sum(uint32_t node, int level) { return _sum[node * _numLevels + level]; }
+	Sum sum(uint32_t node, int level) const { return _sum[node * _numLevels + level]; }
+
+	/// 1 + number of coin flips coming up heads, so level k+1 is half as likely as level k
+	int randomLevel()
+	{
+		_random ^= _random << 13;
+		_random ^= _random >> 17;
+		_random ^= _random << 5;
+		int level = 1;
+		for (uint32_t bits = _random; (bits & 1) && level < _numLevels; bits >>= 1)
+		{
+			level++;
+		}
+		return level;
+	}
+};
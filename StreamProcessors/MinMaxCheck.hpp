@@ -9,17 +9,21 @@
 
 #pragma once
 
+#include "BlockKernels.hpp"
+
+#include <assert.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <limits>
-#include <deque>
+#include <vector>
 
 /**
  * Determines minimum and maximum value that has been passed during
  * the at most the last samplesPerSegment * (numSegments + 1) - 1  samples.
  * Actual number will gitter with a number of samples of samplesPerSegment
  *
- * Works by having a deque of min/max values for each previously checked segment.
+ * Works by having a ring of min/max values for each previously checked segment.
  * In addition to those segments, the current samples (on the way to form a segment)
  * will also contribute  to the reported min / max value.
  *
@@ -27,6 +31,10 @@
  * min/max values for a longer time span without having to store every single value,
  * or having to resort to leaky bucket filtering.
  *
+ * The segment length can be changed at any time (setSamplesPerSegment()), e.g.
+ * to follow the speed. Segments already checked keep their length, so the
+ * window reaches its new size once numSegments new segments have been checked.
+ * Nothing is allocated after construction.
  * */
 class MinMaxCheck {
 public:
@@ -37,8 +45,13 @@ public:
 		_currentMax(std::numeric_limits<int16_t>::min()),
 		_sampleInSegmentCntr(0),
 		_samplesPerSegment(samplesPerSegment),
-		_numSegments(numSegments)
-	{ }
+		_numSegments(numSegments),
+		_minMax(numSegments, MinMax(0, 0)),
+		_oldestSegment(0),
+		_numStoredSegments(0)
+	{
+		assert(samplesPerSegment >= 1 && numSegments >= 1);
+	}
 
 	void check(int16_t sample)
 	{
@@ -61,6 +74,54 @@ public:
 		}
 	}
 
+	/**
+	 * Same as calling check() for each of the samples, but n must not go past
+	 * the end of the current segment (see getSamplesLeftInSegment()).
+	 */
+	void checkBlock(const int16_t* samples, size_t n)
+	{
+		assert(n <= getSamplesLeftInSegment());
+		if (n == 0)
+		{
+			return;
+		}
+		if (_sampleInSegmentCntr == 0)
+		{
+			startNewSegment(samples[0]);
+		}
+
+		BlockKernels::accumulateMinMax(samples, n, _currentMin, _currentMax);
+		_minValueInSegments = std::min(_minValueInSegments, _currentMin);
+		_maxValueInSegments = std::max(_maxValueInSegments, _currentMax);
+		_sampleInSegmentCntr += n;
+
+		if (_sampleInSegmentCntr >= _samplesPerSegment)
+		{
+			endNewSegment();
+			_sampleInSegmentCntr = 0;
+		}
+	}
+
+	size_t getSamplesLeftInSegment() const { return _samplesPerSegment - _sampleInSegmentCntr; }
+
+	size_t getSamplesPerSegment() const { return _samplesPerSegment; }
+	size_t getNumSegments() const { return _numSegments; }
+
+	/**
+	 * Length of the current segment and the ones after it. If the current
+	 * segment already has samplesPerSegment samples, it is ended now.
+	 */
+	void setSamplesPerSegment(size_t samplesPerSegment)
+	{
+		assert(samplesPerSegment >= 1);
+		_samplesPerSegment = samplesPerSegment;
+		if (_sampleInSegmentCntr >= _samplesPerSegment)
+		{
+			endNewSegment();
+			_sampleInSegmentCntr = 0;
+		}
+	}
+
 	int16_t getMin() const { return _minValueInSegments; }
 	int16_t getMax() const { return _maxValueInSegments; }
 
@@ -93,7 +154,7 @@ private:
 	int16_t _currentMin;
 	int16_t _currentMax;
 	size_t _sampleInSegmentCntr;
-	const size_t _samplesPerSegment;
+	size_t _samplesPerSegment;
 	const size_t _numSegments;
 	struct MinMax {
 		int16_t min;
@@ -101,20 +162,27 @@ private:
 		MinMax(int min, int max) : min(min), max(max)
 		{}
 	};
-	std::deque<MinMax> _minMax;
+	std::vector<MinMax> _minMax;    // Ring of the last _numStoredSegments segments
+	size_t _oldestSegment;
+	size_t _numStoredSegments;
 
 	void endNewSegment()
 	{
-		_minMax.emplace_back(_currentMin, _currentMax);
-		if (_minMax.size() > _numSegments)
+		if (_numStoredSegments < _numSegments)
+		{
+			_minMax[_numStoredSegments++] = MinMax(_currentMin, _currentMax);
+		}
+		else
 		{
-			_minMax.pop_front();
+			_minMax[_oldestSegment] = MinMax(_currentMin, _currentMax);
+			_oldestSegment = (_oldestSegment + 1) % _numSegments;
 		}
 
 		_minValueInSegments = std::numeric_limits<int16_t>::max();
 		_maxValueInSegments = std::numeric_limits<int16_t>::min();
-		for (const auto& minmax : _minMax)
+		for (size_t i = 0; i < _numStoredSegments; i++)
 		{
+			const MinMax& minmax = _minMax[i];
 			if (minmax.max > _maxValueInSegments)
 			{
 				_maxValueInSegments = minmax.max;
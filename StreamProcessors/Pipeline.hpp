@@ -0,0 +1,180 @@
+/*
+ * Pipeline.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include "PulseEvent.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <limits>
+
+#include <tuple>
+#include <type_traits>
+
+/**
+ * State shared by the stages of a Pipeline. Each field is written by one
+ * kind of stage, and read by the stages after it (or, for the threshold,
+ * by the stages before it when the next sample arrives).
+ */
+struct PipelineContext {
+	enum Edge {
+		NoEdge,
+		FirstEdge,      // First time the signal is above threshold (period not known yet)
+		RisingEdge      // A pulse
+	};
+
+	PipelineContext() :
+		sample(0),
+		sampleIndex(0),
+		signalMin(0),
+		signalMax(0),
+		threshold(0),
+		hysteresis(1),
+		thresholdInPercentage(0),
+		amplitudeIsHighEnough(false),
+		triggerLevel(0),
+		riseLevel(std::numeric_limits<int32_t>::max()),
+		fallLevel(-1),
+		edge(NoEdge),
+		crossingOffset(0),
+		pulse()
+	{ }
+
+	int32_t sample;             // Current sample, as modified by the stages so far
+	uint64_t sampleIndex;       // Counted from the first sample pushed
+
+	int signalMin;              // Tracked signal range
+	int signalMax;
+
+	double threshold;           // Trigger level and hysteresis
+	double hysteresis;
+	int thresholdInPercentage;
+	bool amplitudeIsHighEnough;
+
+	// The same levels as integers, for comparing samples against:
+	//   sample >= threshold                                   <=> sample >= triggerLevel
+	//   sample >= threshold + hysteresis (and amplitude ok)   <=> sample >= riseLevel
+	//   sample <  threshold - hysteresis                      <=> sample <  fallLevel
+	int32_t triggerLevel;
+	int32_t riseLevel;
+	int32_t fallLevel;
+
+	Edge edge;                  // Edge detected at the current sample
+	double crossingOffset;      // Where the edge crossed its level, relative to the current sample (-1 .. 0)
+	PulseEvent pulse;           // Filled in when edge == RisingEdge
+};
+
+
+/**
+ * Base for pipeline stages, declaring which hooks the stage uses:
+ *
+ *   void process(PipelineContext& ctx)     for each sample, if PerSample
+ *   void beginBlock(PipelineContext& ctx)  once per block, before its samples, if PerBlock
+ *
+ * A stage only has to implement the hooks it declares.
+ */
+struct PipelineStage {
+	enum { PerSample = 1, PerBlock = 0 };
+};
+
+
+/**
+ * A chain of stages, called in order for each sample.
+ *
+ * The stages are template parameters, so all calls are resolved (and
+ * typically inlined) at compile time; there are no virtual calls, and a
+ * stage that is left out costs nothing. Different detectors are assembled by
+ * listing different stages, e.g.
+ *
+ *   Pipeline<MinMaxStage, SchmittTriggerStage, PeriodEstimatorStage, ThresholdStage>
+ */
+template<class... Stages>
+class Pipeline {
+public:
+	enum { NumStages = sizeof...(Stages) };
+
+	Pipeline() { }
+
+	explicit Pipeline(const Stages&... stages) : _stages(stages...) { }
+
+	void push(int16_t sample)
+	{
+		beginBlock(Index<0>());
+		processSample(sample);
+	}
+
+	/**
+	 * Processes samples[0], samples[stride], ... samples[(n - 1) * stride].
+	 * Per block stages run once, before the first sample.
+	 */
+	void processBlock(const int16_t* samples, size_t n, size_t stride = 1)
+	{
+		beginBlock(Index<0>());
+		for (size_t i = 0; i < n; i++)
+		{
+			processSample(samples[i * stride]);
+		}
+	}
+
+	template<size_t I>
+	typename std::tuple_element<I, std::tuple<Stages...> >::type& get() { return std::get<I>(_stages); }
+
+	/// First stage of type S
+	template<class S>
+	S& stage() { return std::get<IndexOf<S, Stages...>::value>(_stages); }
+
+	template<class S>
+	const S& stage() const { return std::get<IndexOf<S, Stages...>::value>(_stages); }
+
+	const PipelineContext& context() const { return _ctx; }
+
+private:
+	std::tuple<Stages...> _stages;
+	PipelineContext _ctx;
+
+	template<size_t I> struct Index { };
+
+	template<class S, class... List> struct IndexOf;
+	template<class S, class... Rest> struct IndexOf<S, S, Rest...> : std::integral_constant<size_t, 0> { };
+	template<class S, class First, class... Rest> struct IndexOf<S, First, Rest...> :
+		std::integral_constant<size_t, 1 + IndexOf<S, Rest...>::value> { };
+
+	void processSample(int16_t sample)
+	{
+		_ctx.sample = sample;
+		_ctx.edge = PipelineContext::NoEdge;
+		processSample(Index<0>());
+		_ctx.sampleIndex++;
+	}
+
+	template<size_t I>
+	void processSample(Index<I>)
+	{
+		typedef typename std::tuple_element<I, std::tuple<Stages...> >::type Stage;
+		callProcess(std::get<I>(_stages), std::integral_constant<bool, Stage::PerSample>());
+		processSample(Index<I + 1>());
+	}
+
+	void processSample(Index<NumStages>) { }
+
+	template<size_t I>
+	void beginBlock(Index<I>)
+	{
+		typedef typename std::tuple_element<I, std::tuple<Stages...> >::type Stage;
+		callBeginBlock(std::get<I>(_stages), std::integral_constant<bool, Stage::PerBlock>());
+		beginBlock(Index<I + 1>());
+	}
+
+	void beginBlock(Index<NumStages>) { }
+
+	template<class S> void callProcess(S& s, std::true_type) { s.process(_ctx); }
+	template<class S> void callProcess(S&, std::false_type) { }
+	template<class S> void callBeginBlock(S& s, std::true_type) { s.beginBlock(_ctx); }
+	template<class S> void callBeginBlock(S&, std::false_type) { }
+};
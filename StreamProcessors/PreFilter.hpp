@@ -0,0 +1,382 @@
+/*
+ * PreFilter.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include "BlockKernels.hpp"
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/**
+ * Coefficients of one second order section, normalized so a0 == 1:
+ *
+ *   y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] - a1 y[n-1] - a2 y[n-2]
+ *
+ * Designs are the bilinear transform ones from the "Audio EQ Cookbook".
+ */
+struct BiquadCoefficients {
+	float b0, b1, b2;
+	float a1, a2;
+
+	static BiquadCoefficients lowPass(double sampleRate, double cutoff, double q)
+	{
+		double w = 2 * M_PI * cutoff / sampleRate;
+		double alpha = sin(w) / (2 * q);
+		double c = cos(w);
+		return normalize((1 - c) / 2, 1 - c, (1 - c) / 2, 1 + alpha, -2 * c, 1 - alpha);
+	}
+
+	static BiquadCoefficients highPass(double sampleRate, double cutoff, double q)
+	{
+		double w = 2 * M_PI * cutoff / sampleRate;
+		double alpha = sin(w) / (2 * q);
+		double c = cos(w);
+		return normalize((1 + c) / 2, -(1 + c), (1 + c) / 2, 1 + alpha, -2 * c, 1 - alpha);
+	}
+
+	/// Q of section k (0 .. numSections-1) of a Butterworth filter of order 2 * numSections
+	static double butterworthQ(int k, int numSections)
+	{
+		return 1 / (2 * cos(M_PI * (2 * k + 1) / (4 * numSections)));
+	}
+
+private:
+	static BiquadCoefficients normalize(double b0, double b1, double b2, double a0, double a1, double a2)
+	{
+		BiquadCoefficients c;
+		c.b0 = b0 / a0;
+		c.b1 = b1 / a0;
+		c.b2 = b2 / a0;
+		c.a1 = a1 / a0;
+		c.a2 = a2 / a0;
+		return c;
+	}
+};
+
+
+/**
+ * Second order sections in series, each in transposed direct form II (two
+ * state variables, and the best float behavior of the direct forms).
+ *
+ * process() works on a whole block, two sections at a time, so the
+ * coefficients and the state stay in registers for the entire block. The
+ * recursion prevents running consecutive samples of a section in parallel
+ * (as SIMD lanes), but the loops are short and free of branches.
+ */
+class BiquadCascade {
+public:
+	void addSection(const BiquadCoefficients& coefficients)
+	{
+		Section s;
+		s.c = coefficients;
+		s.z1 = 0;
+		s.z2 = 0;
+		_sections.push_back(s);
+	}
+
+	size_t getNumSections() const { return _sections.size(); }
+
+	void reset()
+	{
+		for (Section& s : _sections)
+		{
+			s.z1 = 0;
+			s.z2 = 0;
+		}
+	}
+
+	/// Filters values[0 .. n-1] in place
+	void process(float* values, size_t n)
+	{
+		size_t k = 0;
+		for (; k + 1 < _sections.size(); k += 2)
+		{
+			processPair(_sections[k], _sections[k + 1], values, n);
+		}
+		if (k < _sections.size())
+		{
+			processOne(_sections[k], values, n);
+		}
+	}
+
+private:
+	struct Section {
+		BiquadCoefficients c;
+		float z1;
+		float z2;
+	};
+	std::vector<Section> _sections;
+
+	static void processOne(Section& s, float* values, size_t n)
+	{
+		const float b0 = s.c.b0, b1 = s.c.b1, b2 = s.c.b2, a1 = s.c.a1, a2 = s.c.a2;
+		float z1 = s.z1;
+		float z2 = s.z2;
+		for (size_t i = 0; i < n; i++)
+		{
+			float x = values[i];
+			float y = b0 * x + z1;
+			z1 = b1 * x - a1 * y + z2;
+			z2 = b2 * x - a2 * y;
+			values[i] = y;
+		}
+		s.z1 = flushDenormal(z1);
+		s.z2 = flushDenormal(z2);
+	}
+
+	/**
+	 * Same as processOne(s, ...) followed by processOne(t, ...), but the two
+	 * recursions (each limited by the latency of its multiply-adds) are
+	 * independent of each other within an iteration, so they overlap.
+	 */
+	static void processPair(Section& s, Section& t, float* values, size_t n)
+	{
+		const float sb0 = s.c.b0, sb1 = s.c.b1, sb2 = s.c.b2, sa1 = s.c.a1, sa2 = s.c.a2;
+		const float tb0 = t.c.b0, tb1 = t.c.b1, tb2 = t.c.b2, ta1 = t.c.a1, ta2 = t.c.a2;
+		float sz1 = s.z1;
+		float sz2 = s.z2;
+		float tz1 = t.z1;
+		float tz2 = t.z2;
+		for (size_t i = 0; i < n; i++)
+		{
+			float x = values[i];
+			float y = sb0 * x + sz1;
+			sz1 = sb1 * x - sa1 * y + sz2;
+			sz2 = sb2 * x - sa2 * y;
+			float u = tb0 * y + tz1;
+			tz1 = tb1 * y - ta1 * u + tz2;
+			tz2 = tb2 * y - ta2 * u;
+			values[i] = u;
+		}
+		s.z1 = flushDenormal(sz1);
+		s.z2 = flushDenormal(sz2);
+		t.z1 = flushDenormal(tz1);
+		t.z2 = flushDenormal(tz2);
+	}
+
+	/// At block ends, so silence does not leave the state decaying through denormals
+	static float flushDenormal(float value)
+	{
+		return fabsf(value) < 1e-15f ? 0 : value;
+	}
+};
+
+
+/**
+ * Removes the DC offset: y[n] = x[n] - x[n-1] + r y[n-1], a zero at DC and
+ * a pole just inside it (r = 1 - 2 pi cutoff / rate).
+ */
+class DCBlocker {
+public:
+	DCBlocker(double sampleRate, double cutoff) :
+		_r(float(1 - 2 * M_PI * cutoff / sampleRate)),
+		_x1(0),
+		_y1(0)
+	{ }
+
+	void reset()
+	{
+		_x1 = 0;
+		_y1 = 0;
+	}
+
+	/// Filters values[0 .. n-1] in place
+	void process(float* values, size_t n)
+	{
+		const float r = _r;
+		float x1 = _x1;
+		float y1 = _y1;
+		for (size_t i = 0; i < n; i++)
+		{
+			float x = values[i];
+			y1 = x - x1 + r * y1;
+			x1 = x;
+			values[i] = y1;
+		}
+		_x1 = x1;
+		_y1 = fabsf(y1) < 1e-15f ? 0 : y1;   // See BiquadCascade
+	}
+
+private:
+	float _r;
+	float _x1;
+	float _y1;
+};
+
+
+/**
+ * Optional filtering of the samples before the edge detector: a DC blocker,
+ * followed by a Butterworth high pass and/or low pass (together a band pass).
+ *
+ * Samples are converted to float once per block, run through each filter
+ * over the whole block, and converted back to (saturated) 16 bit samples,
+ * which are handed to the sink without further copies, e.g.
+ *
+ *   preFilter.processBlock(samples, n, 2, [&](const int16_t* filtered, size_t count) {
+ *       detector.processBlock(filtered, count);
+ *   });
+ *
+ * Blocks longer than MaxBlockSize are handed over in several parts. The
+ * buffers are allocated by the constructor, so processBlock() never
+ * allocates.
+ */
+class PreFilter {
+public:
+	enum { MaxBlockSize = 1024 };
+
+	struct Parameters {
+		Parameters() :
+			dcBlockerCutoff(0),
+			highPassCutoff(0),
+			lowPassCutoff(0),
+			numSections(1)
+		{ }
+		double dcBlockerCutoff;     // Hz, 0 for no DC blocker
+		double highPassCutoff;      // Hz, 0 for no high pass
+		double lowPassCutoff;       // Hz, 0 for no low pass
+		int numSections;            // Per cutoff, the slope is 12 dB/octave per section
+
+		bool isEnabled() const { return dcBlockerCutoff > 0 || highPassCutoff > 0 || lowPassCutoff > 0; }
+
+		/**
+		 * Parses a comma separated list of
+		 *   dc[:HZ]            DC blocker (default 2 Hz)
+		 *   highpass:HZ
+		 *   lowpass:HZ
+		 *   bandpass:LOW-HIGH
+		 *   sections:N
+		 * e.g. "dc,bandpass:5-2000". Returns false for anything else.
+		 */
+		bool parse(const char* str)
+		{
+			*this = Parameters();
+			const char* p = str;
+			while (*p)
+			{
+				const char* end = p + strcspn(p, ",");
+				std::string item(p, end);
+				std::string name = item.substr(0, item.find(':'));
+				const char* value = item.size() > name.size() ? item.c_str() + name.size() + 1 : NULL;
+				bool ok;
+				if (name == "dc")
+				{
+					dcBlockerCutoff = 2;
+					ok = !value || parseNumber(value, '\0', dcBlockerCutoff);
+				}
+				else if (name == "highpass")
+				{
+					ok = value && parseNumber(value, '\0', highPassCutoff);
+				}
+				else if (name == "lowpass")
+				{
+					ok = value && parseNumber(value, '\0', lowPassCutoff);
+				}
+				else if (name == "bandpass")
+				{
+					const char* high = value ? strchr(value, '-') : NULL;
+					ok = high && parseNumber(value, '-', highPassCutoff) && parseNumber(high + 1, '\0', lowPassCutoff) &&
+							highPassCutoff < lowPassCutoff;
+				}
+				else if (name == "sections")
+				{
+					double n = 0;
+					ok = value && parseNumber(value, '\0', n) && n >= 1 && n <= 4 && n == int(n);
+					numSections = int(n);
+				}
+				else
+				{
+					ok = false;
+				}
+				if (!ok)
+				{
+					return false;
+				}
+				p = *end ? end + 1 : end;
+			}
+			return isEnabled();
+		}
+
+	private:
+		static bool parseNumber(const char* str, char terminator, double& value)
+		{
+			char* end;
+			value = strtod(str, &end);
+			return end != str && *end == terminator && value > 0;
+		}
+	};
+
+	PreFilter(int sampleRate, const Parameters& params) :
+		_params(params),
+		_dcBlocker(sampleRate, params.dcBlockerCutoff),
+		_values(MaxBlockSize),
+		_filtered(MaxBlockSize)
+	{
+		assert(params.numSections >= 1);
+		assert(params.highPassCutoff < sampleRate / 2.0 && params.lowPassCutoff < sampleRate / 2.0);
+		for (int k = 0; k < params.numSections; k++)
+		{
+			double q = BiquadCoefficients::butterworthQ(k, params.numSections);
+			if (params.highPassCutoff > 0)
+			{
+				_biquads.addSection(BiquadCoefficients::highPass(sampleRate, params.highPassCutoff, q));
+			}
+			if (params.lowPassCutoff > 0)
+			{
+				_biquads.addSection(BiquadCoefficients::lowPass(sampleRate, params.lowPassCutoff, q));
+			}
+		}
+	}
+
+	const Parameters& getParameters() const { return _params; }
+
+	void reset()
+	{
+		_dcBlocker.reset();
+		_biquads.reset();
+	}
+
+	/**
+	 * Filters samples[0], samples[stride], ... samples[(n - 1) * stride],
+	 * calling sink(const int16_t* filtered, size_t count) for each part of
+	 * at most MaxBlockSize samples. The filtered samples are only valid
+	 * during the call.
+	 */
+	template<class Sink>
+	void processBlock(const int16_t* samples, size_t n, size_t stride, Sink sink)
+	{
+		while (n)
+		{
+			size_t count = std::min<size_t>(n, MaxBlockSize);
+			BlockKernels::convertToFloat(samples, count, stride, _values.data());
+			if (_params.dcBlockerCutoff > 0)
+			{
+				_dcBlocker.process(_values.data(), count);
+			}
+			_biquads.process(_values.data(), count);
+			BlockKernels::convertToInt16(_values.data(), count, _filtered.data());
+			sink(static_cast<const int16_t*>(_filtered.data()), count);
+			samples += count * stride;
+			n -= count;
+		}
+	}
+
+private:
+	Parameters _params;
+	DCBlocker _dcBlocker;
+	BiquadCascade _biquads;
+	std::vector<float> _values;
+	std::vector<int16_t> _filtered;
+};
@@ -0,0 +1,26 @@
+/*
+ * PulseEvent.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Everything known about a detected pulse (rising edge) at the time it is detected.
+ */
+struct PulseEvent {
+	uint64_t sampleIndex;   // Index of the sample completing the rising edge (counted from first sample checked)
+	double crossingTime;    // Where the signal crossed the trigger level, in samples (sampleIndex - 1 .. sampleIndex)
+	double periodInSamples; // Distance to previous crossing (fractional unless interpolation is off)
+	double rpm;
+	double filteredRpm;
+	double threshold;
+	double hysteresis;
+	int signalMin;
+	int signalMax;
+	int thresholdInPercentage;
+};
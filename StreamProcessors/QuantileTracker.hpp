@@ -0,0 +1,171 @@
+/*
+ * QuantileTracker.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * Tracks a low and a high percentile (e.g. 1 and 99) of the last windowSize
+ * samples. Unlike min and max, a few glitch samples can not move them.
+ *
+ * The window is kept in a ring (to know which sample leaves it), and a
+ * histogram over all 65536 sample values is updated as samples enter and
+ * leave. Each percentile is a cursor into the histogram, together with the
+ * number of samples below the cursor bin. A new sample only moves a cursor
+ * by a bin or so; walks over long empty stretches (e.g. between the low and
+ * the high level of the pulses) skip empty blocks of 256 bins using a
+ * second, coarse histogram. So push() is O(1), with at most a few hundred
+ * steps in the worst case.
+ *
+ * The window can be made shorter (and longer again, up to the size given to
+ * the constructor) with setWindowSize(). A shorter window is reached by
+ * dropping two of the oldest samples per push, so there are no long loops.
+ *
+ * Default constructed, it holds no storage and must not be used; this lets
+ * the stages carry one at no cost when it is not enabled.
+ */
+class QuantileTracker {
+public:
+	QuantileTracker() :
+		_windowSize(0),
+		_windowPos(0),
+		_count(0),
+		_lowFraction(0),
+		_highFraction(0)
+	{
+		_low.bin = _high.bin = 0;
+		_low.below = _high.below = 0;
+	}
+
+	/**
+	 * @param lowPercent   e.g. 1
+	 * @param highPercent  e.g. 99
+	 */
+	QuantileTracker(size_t windowSize, double lowPercent, double highPercent) :
+		_windowSize(windowSize),
+		_window(windowSize),
+		_windowPos(0),
+		_count(0),
+		_lowFraction(lowPercent / 100),
+		_highFraction(highPercent / 100),
+		_fine(NumValues, 0),
+		_coarse(NumValues / BlockSize, 0)
+	{
+		assert(windowSize > 0);
+		assert(lowPercent >= 0 && lowPercent <= highPercent && highPercent <= 100);
+		_low.bin = _high.bin = 0;
+		_low.below = _high.below = 0;
+	}
+
+	bool isEnabled() const { return _windowSize != 0; }
+
+	size_t getWindowSize() const { return _windowSize; }
+
+	/// Largest window size, the one given to the constructor
+	size_t getCapacity() const { return _window.size(); }
+
+	/// @param windowSize  1 .. getCapacity()
+	void setWindowSize(size_t windowSize)
+	{
+		assert(windowSize >= 1 && windowSize <= _window.size());
+		_windowSize = windowSize;
+	}
+
+	void push(int16_t sample)
+	{
+		for (int k = 0; k < 2 && _count >= _windowSize; k++)
+		{
+			removeOldest();
+		}
+		uint32_t value = toBin(sample);
+		_window[_windowPos] = value;
+		_windowPos = _windowPos + 1 == _window.size() ? 0 : _windowPos + 1;
+		_count++;
+		add(value);
+
+		seek(_low, uint32_t((_count - 1) * _lowFraction));
+		seek(_high, uint32_t((_count - 1) * _highFraction));
+	}
+
+	/// Only valid after the first push()
+	int16_t getLow() const { return fromBin(_low.bin); }
+	int16_t getHigh() const { return fromBin(_high.bin); }
+
+private:
+	enum { NumValues = 65536, BlockSize = 256 };
+
+	struct Cursor {
+		uint32_t bin;       // Holds the sample of the wanted rank
+		uint32_t below;     // Samples in the bins before bin
+	};
+
+	size_t _windowSize;
+	std::vector<uint16_t> _window;   // Ring of the last _count samples, as bins
+	size_t _windowPos;
+	size_t _count;
+	double _lowFraction;
+	double _highFraction;
+	std::vector<uint32_t> _fine;     // Samples per value
+	std::vector<uint32_t> _coarse;   // Samples per BlockSize values
+	Cursor _low;
+	Cursor _high;
+
+	static uint32_t toBin(int16_t sample) { return uint32_t(sample + 32768); }
+	static int16_t fromBin(uint32_t bin) { return int16_t(int32_t(bin) - 32768); }
+
+	void add(uint32_t value)
+	{
+		_fine[value]++;
+		_coarse[value / BlockSize]++;
+		_low.below += value < _low.bin;
+		_high.below += value < _high.bin;
+	}
+
+	void removeOldest()
+	{
+		size_t oldest = _windowPos >= _count ? _windowPos - _count : _windowPos + _window.size() - _count;
+		remove(_window[oldest]);
+		_count--;
+	}
+
+	void remove(uint32_t value)
+	{
+		_fine[value]--;
+		_coarse[value / BlockSize]--;
+		_low.below -= value < _low.bin;
+		_high.below -= value < _high.bin;
+	}
+
+	/// Moves the cursor to the bin holding the sample of the given rank (0 = smallest)
+	void seek(Cursor& c, uint32_t rank)
+	{
+		while (rank < c.below)
+		{
+			if (c.bin % BlockSize == 0 && _coarse[c.bin / BlockSize - 1] == 0)
+			{
+				c.bin -= BlockSize;
+				continue;
+			}
+			c.bin--;
+			c.below -= _fine[c.bin];
+		}
+		while (rank >= c.below + _fine[c.bin])
+		{
+			c.below += _fine[c.bin];
+			c.bin++;
+			while (c.bin % BlockSize == 0 && _coarse[c.bin / BlockSize] == 0)
+			{
+				c.bin += BlockSize;
+			}
+		}
+	}
+};
@@ -0,0 +1,133 @@
+/*
+ * RealFFT.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <complex>
+#include <vector>
+
+/**
+ * Forward FFT of real input, for a fixed power of two size.
+ *
+ * All tables and buffers are allocated by the constructor (the "plan"), so
+ * forward() never allocates and can be called repeatedly on a worker thread.
+ * The size/2 point complex FFT of the even/odd samples packed as complex
+ * values is computed in place (iterative radix 2), and then split into the
+ * size/2 + 1 bins of the real input.
+ */
+class RealFFT {
+public:
+	typedef std::complex<float> Complex;
+
+	/// @param size  power of two, at least 4
+	explicit RealFFT(size_t size) :
+		_size(size),
+		_half(size / 2),
+		_work(size / 2),
+		_twiddles(size / 4),
+		_splitTwiddles(size / 2 + 1),
+		_bitReverse(size / 2)
+	{
+		assert(size >= 4 && (size & (size - 1)) == 0 && "size must be a power of two");
+
+		for (size_t i = 0; i < _twiddles.size(); i++)
+		{
+			double phase = -2 * M_PI * i / _half;
+			_twiddles[i] = Complex(cos(phase), sin(phase));
+		}
+		for (size_t k = 0; k < _splitTwiddles.size(); k++)
+		{
+			double phase = -2 * M_PI * k / _size;
+			_splitTwiddles[k] = Complex(cos(phase), sin(phase));
+		}
+
+		int bits = 0;
+		while ((size_t(1) << bits) < _half)
+		{
+			bits++;
+		}
+		for (size_t i = 0; i < _half; i++)
+		{
+			uint32_t r = 0;
+			for (int b = 0; b < bits; b++)
+			{
+				r |= ((i >> b) & 1) << (bits - 1 - b);
+			}
+			_bitReverse[i] = r;
+		}
+	}
+
+	size_t size() const { return _size; }
+
+	size_t getNumBins() const { return _half + 1; }
+
+	/**
+	 * @param in   size() samples
+	 * @param out  getNumBins() bins, bin k at k / size() of the sample rate
+	 */
+	void forward(const float* in, Complex* out)
+	{
+		for (size_t i = 0; i < _half; i++)
+		{
+			_work[_bitReverse[i]] = Complex(in[2 * i], in[2 * i + 1]);
+		}
+		transformHalf();
+
+		// X[k] = (Z[k] + conj(Z[N/2-k])) / 2 - i/2 * w^k * (Z[k] - conj(Z[N/2-k]))
+		for (size_t k = 0; k <= _half; k++)
+		{
+			const Complex& a = _work[k == _half ? 0 : k];
+			const Complex& b = _work[k == 0 ? 0 : _half - k];
+			float evenRe = 0.5f * (a.real() + b.real());
+			float evenIm = 0.5f * (a.imag() - b.imag());
+			float oddRe = 0.5f * (a.imag() + b.imag());
+			float oddIm = -0.5f * (a.real() - b.real());
+			const Complex& w = _splitTwiddles[k];
+			out[k] = Complex(
+					evenRe + oddRe * w.real() - oddIm * w.imag(),
+					evenIm + oddRe * w.imag() + oddIm * w.real());
+		}
+	}
+
+private:
+	size_t _size;
+	size_t _half;
+	std::vector<Complex> _work;
+	std::vector<Complex> _twiddles;        // exp(-2 pi i j / (size/2)), j < size/4
+	std::vector<Complex> _splitTwiddles;   // exp(-2 pi i k / size), k <= size/2
+	std::vector<uint32_t> _bitReverse;
+
+	void transformHalf()
+	{
+		// Products are written out, since std::complex multiplication is
+		// slowed down by its inf/nan handling unless compiled with -ffast-math
+		Complex* a = _work.data();
+		for (size_t len = 2; len <= _half; len <<= 1)
+		{
+			size_t halfLen = len / 2;
+			size_t step = _half / len;
+			for (size_t i = 0; i < _half; i += len)
+			{
+				for (size_t j = 0; j < halfLen; j++)
+				{
+					const Complex& w = _twiddles[j * step];
+					Complex& u = a[i + j];
+					Complex& v = a[i + j + halfLen];
+					float re = v.real() * w.real() - v.imag() * w.imag();
+					float im = v.real() * w.imag() + v.imag() * w.real();
+					v = Complex(u.real() - re, u.imag() - im);
+					u = Complex(u.real() + re, u.imag() + im);
+				}
+			}
+		}
+	}
+};
@@ -0,0 +1,238 @@
+/*
+ * SlidingRpmFilter.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include "IndexableSkiplist.hpp"
+
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+enum RpmFilter {
+	MeanFilter,             // Average of the window
+	MedianFilter,           // Middle value (average of the two middle ones for an even count)
+	TrimmedMeanFilter,      // Average without the lowest and highest trimFraction of the window
+	HampelFilter            // Average, with values far from the median replaced by the median
+};
+
+/// Parses "mean", "median", "trimmed" or "hampel". Returns false for anything else.
+inline bool parseRpmFilter(const char* str, RpmFilter& filter)
+{
+	static const char* const names[] = { "mean", "median", "trimmed", "hampel" };
+	for (int i = 0; i < 4; i++)
+	{
+		if (strcmp(str, names[i]) == 0)
+		{
+			filter = RpmFilter(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+inline const char* getRpmFilterName(RpmFilter filter)
+{
+	static const char* const names[] = { "mean", "median", "trimmed", "hampel" };
+	return names[filter];
+}
+
+
+/**
+ * Filtered rpm over the last windowSize pulses. The mean follows every
+ * pulse, so a single missed pulse (half the rpm) or doubled one (twice the
+ * rpm) moves it by a tenth of the rpm for 10 pulses. The other filters
+ * ignore such outliers:
+ *
+ * - median: the middle value. Ignores up to half the window.
+ * - trimmed mean: the mean of the middle values, without the lowest and the
+ *   highest trimFraction. Less noisy than the median.
+ * - Hampel: the mean, with values further than hampelThreshold scaled
+ *   median absolute deviations (1.4826 MAD, the standard deviation for
+ *   gaussian noise) from the median replaced by the median. The mean while
+ *   there are no outliers.
+ *
+ * The window is kept both in a ring (to know which value leaves it) and in
+ * an IndexableSkiplist, so push() is O(log n) (the MAD needs O(log^2 n)), and
+ * the result is computed once per push. Nothing is allocated after
+ * construction.
+ *
+ * T and Sum may be integers (the fixed point detector filters rpm in Q8), so
+ * the result is kept as a fraction, getNumerator() / getDenominator().
+ */
+template<class T, class Sum>
+class BasicSlidingRpmFilter {
+public:
+	struct Parameters {
+		Parameters() :
+			filter(MeanFilter),
+			windowSize(10),
+			trimFraction(0.2),
+			hampelThreshold(3)
+		{ }
+		RpmFilter filter;
+		size_t windowSize;
+		double trimFraction;        // Of each end, 0 .. 0.5 (exclusive)
+		double hampelThreshold;     // In scaled MADs
+	};
+
+	explicit BasicSlidingRpmFilter(const Parameters& params = Parameters()) :
+		_params(params),
+		_window(params.windowSize),
+		_ring(params.windowSize),
+		_ringPos(0),
+		_hampelScalePermille(Sum(params.hampelThreshold * 1482.6 + 0.5)),
+		_numerator(0),
+		_denominator(1)
+	{
+		assert(params.windowSize >= 1);
+		assert(params.trimFraction >= 0 && params.trimFraction < 0.5);
+	}
+
+	const Parameters& getParameters() const { return _params; }
+
+	/// Takes effect right away, for the values already in the window
+	void setFilter(RpmFilter filter)
+	{
+		_params.filter = filter;
+		if (_window.size())
+		{
+			update();
+		}
+	}
+
+	size_t size() const { return _window.size(); }
+
+	void push(T value)
+	{
+		if (_window.size() == _ring.size())
+		{
+			_window.erase(_ring[_ringPos]);
+		}
+		_ring[_ringPos] = value;
+		_ringPos = (_ringPos + 1) % _ring.size();
+		_window.insert(value);
+		update();
+	}
+
+	/// 0 / 1 before the first push()
+	Sum getNumerator() const { return _numerator; }
+	Sum getDenominator() const { return _denominator; }
+
+	double getValue() const { return double(_numerator) / double(_denominator); }
+
+private:
+	Parameters _params;
+	IndexableSkiplist<T, Sum> _window;
+	std::vector<T> _ring;
+	size_t _ringPos;
+	Sum _hampelScalePermille;   // hampelThreshold * 1.4826, in 1/1000
+	Sum _numerator;
+	Sum _denominator;
+
+	void update()
+	{
+		size_t n = _window.size();
+		switch(_params.filter)
+		{
+		case MeanFilter:
+			_numerator = _window.sumOfSmallest(n);
+			_denominator = Sum(n);
+			break;
+
+		case MedianFilter:
+			if (n % 2)
+			{
+				_numerator = _window.at(n / 2);
+				_denominator = 1;
+			}
+			else
+			{
+				_numerator = Sum(_window.at(n / 2 - 1)) + Sum(_window.at(n / 2));
+				_denominator = 2;
+			}
+			break;
+
+		case TrimmedMeanFilter:
+		{
+			size_t trim = size_t(n * _params.trimFraction);
+			_numerator = _window.sumOfSmallest(n - trim) - _window.sumOfSmallest(trim);
+			_denominator = Sum(n - 2 * trim);
+			break;
+		}
+
+		case HampelFilter:
+			updateHampel(n);
+			break;
+		}
+	}
+
+	/**
+	 * The median (the lower one for an even count) as center, and the lower
+	 * median of the distances to it as MAD.
+	 */
+	void updateHampel(size_t n)
+	{
+		size_t middle = (n - 1) / 2;
+		T median = _window.at(middle);
+		Sum band = Sum(madAround(median, middle)) * _hampelScalePermille / 1000;
+
+		// Values outside [median - band, median + band] count as the median
+		T lowest = Sum(median) - Sum(std::numeric_limits<T>::lowest()) > band ? T(Sum(median) - band) : std::numeric_limits<T>::lowest();
+		T highest = Sum(std::numeric_limits<T>::max()) - Sum(median) > band ? T(Sum(median) + band) : std::numeric_limits<T>::max();
+		size_t numBelow = _window.countBelow(lowest);
+		size_t numAbove = n - _window.countBelow(highest, true);
+		_numerator = _window.sumOfSmallest(n - numAbove) - _window.sumOfSmallest(numBelow) +
+				Sum(numBelow + numAbove) * Sum(median);
+		_denominator = Sum(n);
+	}
+
+	/**
+	 * The k:th smallest distance |value - center|. The distances of the
+	 * values below center (ranks numLower-1 down to 0) and of the rest (ranks
+	 * numLower and up) are two sorted sequences, so it is a selection from two
+	 * sorted sequences: binary search for how many come from the lower one.
+	 */
+	T madAround(T center, size_t k) const
+	{
+		size_t numLower = _window.countBelow(center);
+		size_t numUpper = _window.size() - numLower;
+		size_t lo = k + 1 > numUpper ? k + 1 - numUpper : 0;
+		size_t hi = std::min(k + 1, numLower);
+		while (true)
+		{
+			size_t i = lo + (hi - lo) / 2;     // Taken from the lower sequence
+			size_t j = k + 1 - i;              // Taken from the upper sequence
+			if (i < numLower && j > 0 && upperDistance(numLower, j - 1, center) > lowerDistance(numLower, i, center))
+			{
+				lo = i + 1;
+			}
+			else if (i > 0 && j < numUpper && lowerDistance(numLower, i - 1, center) > upperDistance(numLower, j, center))
+			{
+				hi = i - 1;
+			}
+			else
+			{
+				T a = i > 0 ? lowerDistance(numLower, i - 1, center) : T(0);
+				T b = j > 0 ? upperDistance(numLower, j - 1, center) : T(0);
+				return std::max(a, b);
+			}
+		}
+	}
+
+	/// The i:th smallest distance of the values below center
+	T lowerDistance(size_t numLower, size_t i, T center) const { return center - _window.at(numLower - 1 - i); }
+
+	/// The j:th smallest distance of the values at or above center
+	T upperDistance(size_t numLower, size_t j, T center) const { return _window.at(numLower + j) - center; }
+};
+
+typedef BasicSlidingRpmFilter<double, double> SlidingRpmFilter;
@@ -0,0 +1,245 @@
+/*
+ * GenerateSignal.cpp
+ *
+ * Command line front end for TachometerSignalGenerator. Writes a WAV file,
+ * and/or runs the detector directly on the generated samples.
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#include "../RPMCalculatorFromAudio.hpp"
+#include "../SignalGenerator/TachometerSignalGenerator.hpp"
+#include "../SignalGenerator/WavFile.hpp"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <memory>
+#include <vector>
+
+static void printUsage(const char* name)
+{
+	printf(
+			"%s [options]\n"
+			"-o, --output FILE.WAV       Write generated signal to a WAV file\n"
+			"-x, --detect                Run the detector on the generated signal and print pulses\n"
+			"-T, --truth FILE            Write true rising edge positions (in samples) to FILE\n"
+			"-t, --duration SECONDS      Length of signal (default: end of profiles, or 10 s)\n"
+			"-r, --rate HZ               Sample rate (default 44100)\n"
+			"-c, --channels N            Channels in WAV file, signal is duplicated (default 2)\n"
+			"-p, --rpm PROFILE           RPM, either constant or \"t0:rpm0,t1:rpm1,...\" (default 1000)\n"
+			"-a, --amplitude PROFILE     Amplitude, either constant or \"t0:a0,t1:a1,...\" (default 10000)\n"
+			"-n, --pulses_per_rev N      Pulses per revolution (default 1)\n"
+			"-u, --duty FRACTION         Fraction of pulse period the reflector is seen (default 0.1)\n"
+			"-j, --jitter FRACTION       Std dev of pulse timing, as fraction of pulse period (default 0)\n"
+			"-N, --noise STDDEV          Additive gaussian noise (default 0)\n"
+			"-O, --dc_offset VALUE       DC offset (default 0)\n"
+			"-D, --dc_drift AMPLITUDE    Slow sinusoidal DC drift (default 0)\n"
+			"-P, --dc_drift_period SECS  Period of DC drift (default 10)\n"
+			"-e, --sensor_tau SECONDS    Time constant of sensor response (default 20e-6)\n"
+			"-C, --ac_cutoff HZ          Cut off of AC coupling, 0 = DC coupled (default 10)\n"
+			"-s, --seed N                Random seed (default 1)\n"
+			"-d, --rpm_divisor N         Divisor used by the detector (default 1)\n"
+			"-h, --help\n"
+			"\n", name);
+}
+
+static bool parseProfile(const char* str, PiecewiseLinearProfile& profile)
+{
+	char* end;
+	double constant = strtod(str, &end);
+	if (end != str && *end == '\0')
+	{
+		profile = PiecewiseLinearProfile(constant);
+		return true;
+	}
+	return profile.parse(str);
+}
+
+int main(int argc, char *argv[])
+{
+	TachometerSignalGenerator::Parameters params;
+	const char* outputFilename = NULL;
+	const char* truthFilename = NULL;
+	double duration = -1;
+	int numChannels = 2;
+	int detect = 0;
+	int rpmDivisor = 1;
+
+	while (true)
+	{
+		static struct option long_options[] =
+		{
+				{"output",          required_argument, 0, 'o'},
+				{"detect",          no_argument,       0, 'x'},
+				{"truth",           required_argument, 0, 'T'},
+				{"duration",        required_argument, 0, 't'},
+				{"rate",            required_argument, 0, 'r'},
+				{"channels",        required_argument, 0, 'c'},
+				{"rpm",             required_argument, 0, 'p'},
+				{"amplitude",       required_argument, 0, 'a'},
+				{"pulses_per_rev",  required_argument, 0, 'n'},
+				{"duty",            required_argument, 0, 'u'},
+				{"jitter",          required_argument, 0, 'j'},
+				{"noise",           required_argument, 0, 'N'},
+				{"dc_offset",       required_argument, 0, 'O'},
+				{"dc_drift",        required_argument, 0, 'D'},
+				{"dc_drift_period", required_argument, 0, 'P'},
+				{"sensor_tau",      required_argument, 0, 'e'},
+				{"ac_cutoff",       required_argument, 0, 'C'},
+				{"seed",            required_argument, 0, 's'},
+				{"rpm_divisor",     required_argument, 0, 'd'},
+				{"help",            no_argument,       0, 'h'},
+				{0, 0, 0, 0}
+		};
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "o:xT:t:r:c:p:a:n:u:j:N:O:D:P:e:C:s:d:h",
+				long_options, &option_index);
+		if (c == -1)
+			break;
+
+		switch (c)
+		{
+		case 'o': outputFilename = optarg; break;
+		case 'x': detect = 1; break;
+		case 'T': truthFilename = optarg; break;
+		case 't': duration = atof(optarg); break;
+		case 'r': params.sampleRate = atoi(optarg); break;
+		case 'c': numChannels = atoi(optarg); break;
+		case 'p':
+			if (!parseProfile(optarg, params.rpm))
+			{
+				fprintf(stderr, "Bad rpm profile \"%s\"\n", optarg);
+				return 1;
+			}
+			break;
+		case 'a':
+			if (!parseProfile(optarg, params.amplitude))
+			{
+				fprintf(stderr, "Bad amplitude profile \"%s\"\n", optarg);
+				return 1;
+			}
+			break;
+		case 'n': params.pulsesPerRevolution = atoi(optarg); break;
+		case 'u': params.dutyCycle = atof(optarg); break;
+		case 'j': params.jitter = atof(optarg); break;
+		case 'N': params.noise = atof(optarg); break;
+		case 'O': params.dcOffset = atof(optarg); break;
+		case 'D': params.dcDrift = atof(optarg); break;
+		case 'P': params.dcDriftPeriod = atof(optarg); break;
+		case 'e': params.sensorTimeConstant = atof(optarg); break;
+		case 'C': params.acCouplingCutoff = atof(optarg); break;
+		case 's': params.seed = strtoul(optarg, NULL, 0); break;
+		case 'd': rpmDivisor = atoi(optarg); break;
+		case 'h':
+		default:
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (params.sampleRate <= 0 || numChannels <= 0 || params.pulsesPerRevolution <= 0 ||
+			params.dutyCycle <= 0 || params.dutyCycle >= 1 || rpmDivisor <= 0)
+	{
+		fprintf(stderr, "Invalid parameters\n");
+		return 1;
+	}
+
+	if (!outputFilename && !detect && !truthFilename)
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	TachometerSignalGenerator generator(params);
+	generator.setRecordPulseTimes(truthFilename != NULL);
+
+	size_t numSamples;
+	if (duration >= 0)
+	{
+		numSamples = size_t(duration * params.sampleRate + 0.5);
+	}
+	else
+	{
+		numSamples = generator.getProfileLengthInSamples();
+		if (numSamples == 0)
+		{
+			numSamples = 10 * params.sampleRate;
+		}
+	}
+
+	std::unique_ptr<WavWriter> wav;
+	if (outputFilename)
+	{
+		wav.reset(new WavWriter(outputFilename, params.sampleRate, numChannels));
+		if (!wav->isOpen())
+		{
+			perror(outputFilename);
+			return 1;
+		}
+	}
+
+	RPMCalculatorFromAudio detector(params.sampleRate, rpmDivisor);
+	detector.setPulseCallback([&](const PulseEvent& event) {
+		printf("sample=%llu, period=%.3f, rpm=%g, rpm_filtered=%g\n",
+				(unsigned long long)event.sampleIndex,
+				event.periodInSamples,
+				event.rpm,
+				event.filteredRpm);
+	});
+
+	const size_t blockSize = 4096;
+	std::vector<int16_t> block(blockSize);
+	std::vector<int16_t> interleaved(blockSize * numChannels);
+
+	for (size_t pos = 0; pos < numSamples; pos += blockSize)
+	{
+		size_t n = std::min(blockSize, numSamples - pos);
+		generator.generate(block.data(), n);
+
+		if (detect)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				detector.check(block[i]);
+			}
+		}
+
+		if (wav)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				for (int ch = 0; ch < numChannels; ch++)
+				{
+					interleaved[i * numChannels + ch] = block[i];
+				}
+			}
+			wav->write(interleaved.data(), n);
+		}
+	}
+
+	if (wav && !wav->close())
+	{
+		fprintf(stderr, "Failed writing %s\n", outputFilename);
+		return 1;
+	}
+
+	if (truthFilename)
+	{
+		FILE* f = fopen(truthFilename, "w");
+		if (!f)
+		{
+			perror(truthFilename);
+			return 1;
+		}
+		for (double t : generator.getPulseTimes())
+		{
+			fprintf(f, "%.3f\n", t);
+		}
+		fclose(f);
+	}
+
+	return 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * RpmcoreExample.c
+ *
+ * Minimal example of embedding the detector through the librpmcore C API:
+ * feeds one channel of a synthetic stereo signal, block by block, and prints
+ * the detected pulses (polled, or through a callback with -c).
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#include "../Library/rpmcore.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static void onPulse(void* user_data, const struct rpmcore_pulse* pulse)
+{
+	int* numPulses = (int*)user_data;
+	(*numPulses)++;
+	printf("callback: sample=%llu, period=%g, rpm=%g, rpm_filtered=%g\n",
+			(unsigned long long)pulse->sample_index, pulse->period_in_samples,
+			pulse->rpm, pulse->filtered_rpm);
+}
+
+int main(int argc, char *argv[])
+{
+	int useCallback = argc > 1 && strcmp(argv[1], "-c") == 0;
+
+	struct rpmcore_config config;
+	rpmcore_config_init(&config);
+	config.sample_rate = 48000;
+	struct rpmcore* rpm = rpmcore_create(&config);
+	if (!rpm)
+	{
+		fprintf(stderr, "rpmcore_create failed\n");
+		return 1;
+	}
+
+	int numCallbackPulses = 0;
+	if (useCallback)
+	{
+		rpmcore_set_pulse_callback(rpm, onPulse, &numCallbackPulses);
+	}
+
+	/* 1200 rpm (20 Hz) reflector on the right channel, 2 seconds */
+	enum { NumChannels = 2, BlockFrames = 512 };
+	int16_t block[BlockFrames * NumChannels];
+	const double pulseHz = 1200 / 60.0;
+	long frame = 0;
+	for (int b = 0; b < 2 * config.sample_rate / BlockFrames; b++)
+	{
+		for (int i = 0; i < BlockFrames; i++, frame++)
+		{
+			double phase = fmod(frame * pulseHz / config.sample_rate, 1.0);
+			block[i * NumChannels + 0] = 0;
+			block[i * NumChannels + 1] = phase < 0.1 ? 10000 : -10000;
+		}
+		rpmcore_process(rpm, block + 1, BlockFrames, NumChannels);
+
+		struct rpmcore_pulse pulses[16];
+		size_t n;
+		while ((n = rpmcore_poll(rpm, pulses, 16)) > 0)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				printf("poll: sample=%llu, period=%g, rpm=%g, rpm_filtered=%g\n",
+						(unsigned long long)pulses[i].sample_index, pulses[i].period_in_samples,
+						pulses[i].rpm, pulses[i].filtered_rpm);
+			}
+		}
+	}
+
+	struct rpmcore_pulse latest;
+	if (rpmcore_get_latest(rpm, &latest))
+	{
+		printf("latest: rpm=%g after %llu samples\n", latest.rpm,
+				(unsigned long long)rpmcore_get_num_samples(rpm));
+	}
+	rpmcore_destroy(rpm);
+	return 0;
+}
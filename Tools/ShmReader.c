@@ -0,0 +1,121 @@
+/*
+ * ShmReader.c
+ *
+ * Example consumer of the shared memory segment published by
+ * RPMRevolutionMeter --shm NAME. Written in plain C, to show that rpm_shm.h
+ * can be used without anything else from this project.
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#include "../rpm_shm.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void printUsage(const char* name)
+{
+	printf(
+			"%s [-f] NAME\n"
+			"Prints the latest rpm published in shared memory segment NAME.\n"
+			"-f   Follow: print every pulse as it arrives (blocks on a futex)\n"
+			"\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	int follow = 0;
+	const char* name = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-f") == 0)
+		{
+			follow = 1;
+		}
+		else if (argv[i][0] != '-' && !name)
+		{
+			name = argv[i];
+		}
+		else
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (!name)
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	struct rpm_shm* shm = rpm_shm_open_reader(name);
+	if (!shm)
+	{
+		perror(name);
+		return 1;
+	}
+
+	if (!follow)
+	{
+		struct rpm_shm_latest latest;
+		rpm_shm_read_latest(shm, &latest);
+		printf("pulses=%" PRIu64 ", sample=%" PRIu64 ", period=%.3f, rpm=%g, rpm_filtered=%g, "
+				"threshold=%g, hysteresis=%g, min=%d, max=%d",
+				latest.num_pulses, latest.sample_index, latest.period_in_samples,
+				latest.rpm, latest.filtered_rpm, latest.threshold, latest.hysteresis,
+				latest.signal_min, latest.signal_max);
+		if (latest.rpm_source == RPM_SHM_SOURCE_SPECTRAL)
+		{
+			printf(", source=spectral");
+		}
+		else if (latest.rpm_source == RPM_SHM_SOURCE_NONE)
+		{
+			printf(", source=none");
+		}
+		if (latest.tracked_sample_index)
+		{
+			printf(", rpm_tracked=%g, locked=%d", latest.tracked_rpm, latest.tracked_locked);
+		}
+		if (latest.stall_state == RPM_SHM_STALLED)
+		{
+			printf(", stalled=1, rpm_max=%g", latest.stall_rpm);
+		}
+		else if (latest.stall_state == RPM_SHM_STOPPED)
+		{
+			printf(", stopped=1");
+		}
+		printf("\n");
+		rpm_shm_close_reader(shm);
+		return 0;
+	}
+
+	uint64_t next = rpm_shm_get_write_count(shm);
+	struct rpm_shm_pulse pulses[64];
+	while (1)
+	{
+		if (!rpm_shm_wait(shm, next, 1000))
+		{
+			continue;
+		}
+		uint64_t numLost = 0;
+		size_t n = rpm_shm_read_pulses(shm, &next, pulses, 64, &numLost);
+		if (numLost)
+		{
+			printf("# lost %" PRIu64 " pulses\n", numLost);
+		}
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		uint64_t nowNs = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+		for (size_t i = 0; i < n; i++)
+		{
+			printf("sample=%" PRIu64 ", period=%.3f, rpm=%g, rpm_filtered=%g, age_us=%.1f\n",
+					pulses[i].sample_index, pulses[i].period_in_samples,
+					pulses[i].rpm, pulses[i].filtered_rpm,
+					(nowNs - pulses[i].timestamp_ns) * 1e-3);
+		}
+		fflush(stdout);
+	}
+}
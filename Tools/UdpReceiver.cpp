@@ -0,0 +1,278 @@
+/*
+ * UdpReceiver.cpp
+ *
+ * Receives pulse, estimate, tracked speed and stall datagrams sent by RPMRevolutionMeter
+ * --udp HOST:PORT (format in rpm_udp.h), prints them, and reports lost
+ * datagrams and records per rig and channel.
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#include "../Stopwatch.hpp"
+#include "../rpm_udp.h"
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <map>
+#include <utility>
+
+namespace {
+
+struct SourceStats {
+	SourceStats() :
+		nextSequence(0),
+		numDatagrams(0),
+		numLostDatagrams(0)
+	{
+		for (unsigned type = 0; type < RPM_UDP_NUM_TYPES; type++)
+		{
+			nextRecord[type] = 0;
+			numRecords[type] = 0;
+			numLostRecords[type] = 0;
+		}
+	}
+	uint64_t nextSequence;
+	uint64_t numDatagrams;
+	uint64_t numLostDatagrams;
+	// For each RPM_UDP_TYPE_
+	uint64_t nextRecord[RPM_UDP_NUM_TYPES];
+	uint64_t numRecords[RPM_UDP_NUM_TYPES];
+	uint64_t numLostRecords[RPM_UDP_NUM_TYPES];
+};
+
+volatile sig_atomic_t g_quit = 0;
+
+void onSignal(int)
+{
+	g_quit = 1;
+}
+
+void printUsage(const char* name)
+{
+	printf(
+			"%s [options]\n"
+			"-p, --port PORT       UDP port to listen on (default 5005)\n"
+			"-g, --group ADDRESS   Join multicast group ADDRESS\n"
+			"-q, --quiet           Do not print each record, only loss statistics at exit\n"
+			"-h, --help\n"
+			"\n", name);
+}
+
+} // namespace
+
+
+int main(int argc, char *argv[])
+{
+	int port = 5005;
+	const char* group = NULL;
+	int quiet = 0;
+
+	while (true)
+	{
+		static struct option long_options[] =
+		{
+				{"port",   required_argument, 0, 'p'},
+				{"group",  required_argument, 0, 'g'},
+				{"quiet",  no_argument,       0, 'q'},
+				{"help",   no_argument,       0, 'h'},
+				{0, 0, 0, 0}
+		};
+		int option_index = 0;
+		int c = getopt_long(argc, argv, "p:g:qh", long_options, &option_index);
+		if (c == -1)
+			break;
+
+		switch (c)
+		{
+		case 'p': port = atoi(optarg); break;
+		case 'g': group = optarg; break;
+		case 'q': quiet = 1; break;
+		case 'h':
+		default:
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+	{
+		perror("socket");
+		return 1;
+	}
+	int yes = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		perror("bind");
+		return 1;
+	}
+
+	if (group)
+	{
+		struct ip_mreq mreq;
+		memset(&mreq, 0, sizeof(mreq));
+		if (inet_pton(AF_INET, group, &mreq.imr_multiaddr) != 1)
+		{
+			fprintf(stderr, "Bad multicast group \"%s\"\n", group);
+			return 1;
+		}
+		mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+		if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+		{
+			perror("IP_ADD_MEMBERSHIP");
+			return 1;
+		}
+	}
+
+	// No SA_RESTART, so recv() returns on ctrl-c
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = onSignal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	std::map<std::pair<uint32_t, uint16_t>, SourceStats> sources;
+	uint64_t numInvalid = 0;
+	uint8_t buffer[65536];
+	struct rpm_udp_header header;
+	struct rpm_udp_pulse pulses[RPM_UDP_MAX_RECORDS];
+	struct rpm_udp_tracked tracked[RPM_UDP_MAX_RECORDS];
+	struct rpm_udp_stall stall[RPM_UDP_MAX_RECORDS];
+	struct rpm_udp_estimate estimates[RPM_UDP_MAX_RECORDS];
+
+	while (!g_quit)
+	{
+		ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+		if (n < 0)
+		{
+			continue;
+		}
+		uint64_t receivedNs = nowNs();
+		if (rpm_udp_decode_header(buffer, n, &header) != 0)
+		{
+			numInvalid++;
+			continue;
+		}
+
+		SourceStats& s = sources[std::make_pair(header.rig_id, header.channel)];
+		if (s.numDatagrams && header.sequence != s.nextSequence)
+		{
+			uint64_t lost = header.sequence > s.nextSequence ? header.sequence - s.nextSequence : 0;
+			s.numLostDatagrams += lost;
+			printf("# rig=%u channel=%u: sequence %llu, expected %llu (%s)\n",
+					header.rig_id, header.channel,
+					(unsigned long long)header.sequence, (unsigned long long)s.nextSequence,
+					lost ? "lost datagrams" : "reordered or restarted sender");
+		}
+		if (s.numRecords[header.type] && header.first_record > s.nextRecord[header.type])
+		{
+			s.numLostRecords[header.type] += header.first_record - s.nextRecord[header.type];
+		}
+		s.nextSequence = header.sequence + 1;
+		s.nextRecord[header.type] = header.first_record + header.num_records;
+		s.numDatagrams++;
+		s.numRecords[header.type] += header.num_records;
+
+		if (quiet)
+		{
+			continue;
+		}
+		// Ages are only meaningful when sender and receiver share a clock (same host)
+		if (header.type == RPM_UDP_TYPE_PULSES)
+		{
+			rpm_udp_decode_pulses(buffer, &header, pulses);
+			for (unsigned i = 0; i < header.num_records; i++)
+			{
+				double ageUs = (int64_t)(receivedNs - pulses[i].timestamp_ns) * 1e-3;
+				printf("rig=%u, channel=%u, pulse=%llu, sample=%llu, period=%g, rpm=%g, age_us=%.1f\n",
+						header.rig_id, header.channel,
+						(unsigned long long)(header.first_record + i),
+						(unsigned long long)pulses[i].sample_index,
+						pulses[i].period_in_samples, pulses[i].rpm, ageUs);
+			}
+		}
+		else if (header.type == RPM_UDP_TYPE_TRACKED)
+		{
+			rpm_udp_decode_tracked(buffer, &header, tracked);
+			for (unsigned i = 0; i < header.num_records; i++)
+			{
+				double ageUs = (int64_t)(receivedNs - tracked[i].timestamp_ns) * 1e-3;
+				printf("rig=%u, channel=%u, tracked=%llu, sample=%llu, rpm_tracked=%g, locked=%d, age_us=%.1f\n",
+						header.rig_id, header.channel,
+						(unsigned long long)(header.first_record + i),
+						(unsigned long long)tracked[i].sample_index,
+						tracked[i].rpm, (tracked[i].flags & RPM_UDP_TRACKED_LOCKED) ? 1 : 0, ageUs);
+			}
+		}
+		else if (header.type == RPM_UDP_TYPE_STALL)
+		{
+			rpm_udp_decode_stall(buffer, &header, stall);
+			for (unsigned i = 0; i < header.num_records; i++)
+			{
+				double ageUs = (int64_t)(receivedNs - stall[i].timestamp_ns) * 1e-3;
+				printf("rig=%u, channel=%u, stall=%llu, sample=%llu, rpm_max=%g, stopped=%d, age_us=%.1f\n",
+						header.rig_id, header.channel,
+						(unsigned long long)(header.first_record + i),
+						(unsigned long long)stall[i].sample_index,
+						stall[i].rpm, (stall[i].flags & RPM_UDP_STALL_STOPPED) ? 1 : 0, ageUs);
+			}
+		}
+		else
+		{
+			static const char* sourceNames[] = { "none", "edge", "spectral" };
+			rpm_udp_decode_estimate(buffer, &header, estimates);
+			for (unsigned i = 0; i < header.num_records; i++)
+			{
+				double ageUs = (int64_t)(receivedNs - estimates[i].timestamp_ns) * 1e-3;
+				printf("rig=%u, channel=%u, estimate=%llu, sample=%llu, rpm=%g, source=%s, age_us=%.1f\n",
+						header.rig_id, header.channel,
+						(unsigned long long)(header.first_record + i),
+						(unsigned long long)estimates[i].sample_index,
+						estimates[i].rpm,
+						estimates[i].source <= RPM_UDP_SOURCE_SPECTRAL ? sourceNames[estimates[i].source] : "?",
+						ageUs);
+			}
+		}
+		fflush(stdout);
+	}
+
+	for (const auto& source : sources)
+	{
+		const SourceStats& s = source.second;
+		printf("# rig=%u channel=%u: datagrams=%llu pulses=%llu estimates=%llu tracked=%llu stalls=%llu "
+				"lost_datagrams=%llu lost_pulses=%llu lost_estimates=%llu lost_tracked=%llu lost_stalls=%llu\n",
+				source.first.first, source.first.second,
+				(unsigned long long)s.numDatagrams,
+				(unsigned long long)s.numRecords[RPM_UDP_TYPE_PULSES],
+				(unsigned long long)s.numRecords[RPM_UDP_TYPE_ESTIMATE],
+				(unsigned long long)s.numRecords[RPM_UDP_TYPE_TRACKED],
+				(unsigned long long)s.numRecords[RPM_UDP_TYPE_STALL],
+				(unsigned long long)s.numLostDatagrams,
+				(unsigned long long)s.numLostRecords[RPM_UDP_TYPE_PULSES],
+				(unsigned long long)s.numLostRecords[RPM_UDP_TYPE_ESTIMATE],
+				(unsigned long long)s.numLostRecords[RPM_UDP_TYPE_TRACKED],
+				(unsigned long long)s.numLostRecords[RPM_UDP_TYPE_STALL]);
+	}
+	if (numInvalid)
+	{
+		printf("# invalid datagrams=%llu\n", (unsigned long long)numInvalid);
+	}
+	close(fd);
+	return 0;
+}
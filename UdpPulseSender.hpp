@@ -0,0 +1,360 @@
+/*
+ * UdpPulseSender.hpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include "RPMCalculatorFromAudio.hpp"
+#include "RpmFusion.hpp"
+#include "SpeedTracker.hpp"
+#include "SpscRing.hpp"
+#include "StallDetector.hpp"
+#include "Stopwatch.hpp"
+#include "rpm_udp.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+
+/**
+ * Streams detected pulses (or spectral estimates), tracked speed estimates
+ * and stall reports as batched UDP datagrams (format in rpm_udp.h), to a
+ * unicast or multicast destination.
+ *
+ * push(), pushEstimate(), pushTracked() and pushStall() are called from the
+ * audio thread (or one holding the same lock), and only copy the record into a ring; a separate thread builds and sends the datagrams.
+ * Each type of record has its own datagrams. A datagram is sent when it
+ * holds maxPulsesPerDatagram records, or when its first record is maxDelayMs
+ * old. If the sender thread falls behind and the ring fills up, records are
+ * dropped (and show up as gaps in first_record at the receiver).
+ */
+class UdpPulseSender {
+public:
+	struct Parameters {
+		Parameters() :
+			rigId(0),
+			channel(0),
+			maxPulsesPerDatagram(16),
+			maxDelayMs(50),
+			ringSize(4096),
+			multicastTtl(1)
+		{ }
+		uint32_t rigId;
+		uint16_t channel;
+		int maxPulsesPerDatagram;   // 1 - RPM_UDP_MAX_RECORDS, for tracked speeds too
+		int maxDelayMs;
+		size_t ringSize;            // Power of two
+		int multicastTtl;
+	};
+
+	explicit UdpPulseSender(const Parameters& params = Parameters()) :
+		_params(params),
+		_ring(params.ringSize),
+		_fd(-1),
+		_destinationLength(0),
+		_nextPulseNumber(0),
+		_nextTrackedNumber(0),
+		_nextStallNumber(0),
+		_nextEstimateNumber(0),
+		_numDropped(0),
+		_numDatagrams(0),
+		_quit(false)
+	{
+		_params.maxPulsesPerDatagram = std::max(1, std::min<int>(_params.maxPulsesPerDatagram, RPM_UDP_MAX_RECORDS));
+		memset(&_destination, 0, sizeof(_destination));
+	}
+
+	~UdpPulseSender()
+	{
+		stop();
+	}
+
+	/**
+	 * @param destination  "host:port", e.g. "127.0.0.1:5005" or "239.1.2.3:5005"
+	 * @return false (with a description in error) on failure
+	 */
+	bool open(const char* destination, std::string& error)
+	{
+		std::string dest(destination);
+		size_t colon = dest.rfind(':');
+		if (colon == std::string::npos || colon == 0 || colon + 1 == dest.size())
+		{
+			error = "expected HOST:PORT";
+			return false;
+		}
+		std::string host = dest.substr(0, colon);
+		std::string port = dest.substr(colon + 1);
+
+		struct addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_DGRAM;
+		struct addrinfo* result = NULL;
+		int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+		if (rc != 0)
+		{
+			error = gai_strerror(rc);
+			return false;
+		}
+		memcpy(&_destination, result->ai_addr, result->ai_addrlen);
+		_destinationLength = result->ai_addrlen;
+		freeaddrinfo(result);
+
+		_fd = socket(AF_INET, SOCK_DGRAM, 0);
+		if (_fd < 0)
+		{
+			error = strerror(errno);
+			return false;
+		}
+
+		const struct sockaddr_in* sin = (const struct sockaddr_in*)&_destination;
+		if (IN_MULTICAST(ntohl(sin->sin_addr.s_addr)))
+		{
+			unsigned char ttl = _params.multicastTtl;
+			setsockopt(_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+		}
+		return true;
+	}
+
+	void start()
+	{
+		_thread = std::thread(&UdpPulseSender::run, this);
+	}
+
+	/// Sends what is left in the ring, and stops the sender thread
+	void stop()
+	{
+		_quit = true;
+		if (_thread.joinable())
+		{
+			_thread.join();
+		}
+		if (_fd >= 0)
+		{
+			close(_fd);
+			_fd = -1;
+		}
+	}
+
+	/**
+	 * Must only be called from one thread at a time (the one running the
+	 * detector, or one holding the same lock as it)
+	 */
+	void push(const PulseEvent& event)
+	{
+		Item item;
+		item.type = RPM_UDP_TYPE_PULSES;
+		item.number = _nextPulseNumber++;
+		item.pulse.sample_index = event.sampleIndex;
+		item.pulse.timestamp_ns = nowNs();
+		item.pulse.period_in_samples = event.periodInSamples;
+		item.pulse.rpm = event.rpm;
+		pushItem(item);
+	}
+
+	/// Must only be called from the thread calling push()
+	void pushTracked(const SpeedEstimate& estimate)
+	{
+		Item item;
+		item.type = RPM_UDP_TYPE_TRACKED;
+		item.number = _nextTrackedNumber++;
+		item.tracked.sample_index = estimate.sampleIndex;
+		item.tracked.timestamp_ns = nowNs();
+		item.tracked.rpm = estimate.rpm;
+		item.tracked.flags = estimate.locked ? RPM_UDP_TRACKED_LOCKED : 0;
+		pushItem(item);
+	}
+
+	/// Must only be called from the thread calling push()
+	void pushStall(const StallEvent& event)
+	{
+		Item item;
+		item.type = RPM_UDP_TYPE_STALL;
+		item.number = _nextStallNumber++;
+		item.stall.sample_index = event.sampleIndex;
+		item.stall.timestamp_ns = nowNs();
+		item.stall.rpm = event.rpm;
+		item.stall.flags = event.stopped ? RPM_UDP_STALL_STOPPED : 0;
+		pushItem(item);
+	}
+
+	/// In place of push(), with --estimator spectral or fused. Same thread as push()
+	void pushEstimate(const SpectralEstimate& estimate, const RpmFusion::Result& result)
+	{
+		Item item;
+		item.type = RPM_UDP_TYPE_ESTIMATE;
+		item.number = _nextEstimateNumber++;
+		item.estimate.sample_index = estimate.sampleIndex;
+		item.estimate.timestamp_ns = nowNs();
+		item.estimate.rpm = result.rpm;
+		item.estimate.source = result.source == RpmFusion::Edge ? RPM_UDP_SOURCE_EDGE :
+				result.source == RpmFusion::Spectral ? RPM_UDP_SOURCE_SPECTRAL : RPM_UDP_SOURCE_NONE;
+		pushItem(item);
+	}
+
+	/// Records of all types
+	uint64_t getNumDropped() const { return _numDropped.load(std::memory_order_relaxed); }
+
+	uint64_t getNumDatagrams() const { return _numDatagrams.load(std::memory_order_relaxed); }
+
+private:
+	struct Item {
+		uint16_t type;
+		uint64_t number;    // Counted separately for each type
+		union {
+			struct rpm_udp_pulse pulse;
+			struct rpm_udp_tracked tracked;
+			struct rpm_udp_stall stall;
+			struct rpm_udp_estimate estimate;
+		};
+
+		uint64_t timestampNs() const
+		{
+			switch (type)
+			{
+			case RPM_UDP_TYPE_PULSES: return pulse.timestamp_ns;
+			case RPM_UDP_TYPE_TRACKED: return tracked.timestamp_ns;
+			case RPM_UDP_TYPE_STALL: return stall.timestamp_ns;
+			default: return estimate.timestamp_ns;
+			}
+		}
+	};
+
+	/// The datagram being filled with one type of records
+	struct Batch {
+		struct rpm_udp_header header;
+		uint64_t startNs;
+		uint64_t expectedNumber;
+		union {
+			struct rpm_udp_pulse pulses[RPM_UDP_MAX_RECORDS];
+			struct rpm_udp_tracked tracked[RPM_UDP_MAX_RECORDS];
+			struct rpm_udp_stall stall[RPM_UDP_MAX_RECORDS];
+			struct rpm_udp_estimate estimates[RPM_UDP_MAX_RECORDS];
+		};
+	};
+
+	Parameters _params;
+	SpscRing<Item> _ring;
+	int _fd;
+	struct sockaddr_storage _destination;
+	socklen_t _destinationLength;
+	uint64_t _nextPulseNumber;
+	uint64_t _nextTrackedNumber;
+	uint64_t _nextStallNumber;
+	uint64_t _nextEstimateNumber;
+	std::atomic<uint64_t> _numDropped;
+	std::atomic<uint64_t> _numDatagrams;
+	std::atomic<bool> _quit;
+	std::thread _thread;
+
+	void pushItem(const Item& item)
+	{
+		if (!_ring.tryPush(item))
+		{
+			_numDropped.store(_numDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+	}
+
+	void run()
+	{
+		Batch batches[RPM_UDP_NUM_TYPES];
+		for (unsigned type = 0; type < RPM_UDP_NUM_TYPES; type++)
+		{
+			Batch& b = batches[type];
+			memset(&b.header, 0, sizeof(b.header));
+			b.header.rig_id = _params.rigId;
+			b.header.channel = _params.channel;
+			b.header.type = type;
+			b.startNs = 0;
+			b.expectedNumber = 0;
+		}
+		uint64_t sequence = 0;
+		const uint64_t maxDelayNs = uint64_t(_params.maxDelayMs) * 1000000;
+
+		while (true)
+		{
+			bool quitting = _quit;  // Read before draining, so nothing pushed before stop() is lost
+			Item item;
+			bool gotItem = false;
+			while (_ring.tryPop(item))
+			{
+				gotItem = true;
+				Batch& b = batches[item.type];
+				// A record dropped in push() ends the batch, since first_record
+				// only describes consecutive records.
+				if (b.header.num_records && item.number != b.expectedNumber)
+				{
+					send(b, sequence);
+				}
+				if (b.header.num_records == 0)
+				{
+					b.header.first_record = item.number;
+					b.startNs = item.timestampNs();
+				}
+				switch (item.type)
+				{
+				case RPM_UDP_TYPE_PULSES: b.pulses[b.header.num_records++] = item.pulse; break;
+				case RPM_UDP_TYPE_TRACKED: b.tracked[b.header.num_records++] = item.tracked; break;
+				case RPM_UDP_TYPE_STALL: b.stall[b.header.num_records++] = item.stall; break;
+				default: b.estimates[b.header.num_records++] = item.estimate; break;
+				}
+				b.expectedNumber = item.number + 1;
+				if (b.header.num_records == _params.maxPulsesPerDatagram)
+				{
+					send(b, sequence);
+				}
+			}
+
+			uint64_t now = nowNs();
+			for (Batch& b : batches)
+			{
+				if (b.header.num_records && (quitting || now - b.startNs >= maxDelayNs))
+				{
+					send(b, sequence);
+				}
+			}
+			if (quitting)
+			{
+				break;
+			}
+			if (!gotItem)
+			{
+				usleep(std::min(1000, std::max(_params.maxDelayMs, 1) * 1000 / 4));
+			}
+		}
+	}
+
+	/// Sends and empties the batch, numbering the datagram from sequence
+	void send(Batch& b, uint64_t& sequence)
+	{
+		uint8_t buffer[RPM_UDP_MAX_DATAGRAM_SIZE];
+		b.header.sequence = sequence++;
+		size_t size;
+		switch (b.header.type)
+		{
+		case RPM_UDP_TYPE_PULSES: size = rpm_udp_encode(buffer, &b.header, b.pulses); break;
+		case RPM_UDP_TYPE_TRACKED: size = rpm_udp_encode_tracked(buffer, &b.header, b.tracked); break;
+		case RPM_UDP_TYPE_STALL: size = rpm_udp_encode_stall(buffer, &b.header, b.stall); break;
+		default: size = rpm_udp_encode_estimate(buffer, &b.header, b.estimates); break;
+		}
+		// Errors (e.g. no route, or nobody listening on loopback) are ignored:
+		// the receivers see the gap in sequence numbers.
+		ssize_t rc = sendto(_fd, buffer, size, 0, (const struct sockaddr*)&_destination, _destinationLength);
+		(void)rc;
+		_numDatagrams.store(_numDatagrams.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		b.header.num_records = 0;
+	}
+};
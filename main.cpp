@@ -7,19 +7,32 @@
  *  Do whatever you like with this code, but please refer to me as the original author.
  */
 
-#include "StreamProcessors/CappedStorageWaveform.hpp"
-#include "StreamProcessors/MinMaxCheck.hpp"
-#include "StreamProcessors/SlidingAverager.hpp"
+#include "RPMCalculatorFromAudio.hpp"
+#include "RevolutionTracker.hpp"
+#include "RpmFusion.hpp"
 #include "SDLWindow.hpp"
+#include "Metrics.hpp"
+#include "MetricsServer.hpp"
+#include "OrderTracker.hpp"
 #include "SDLEventHandler.hpp"
+#include "SeqLock.hpp"
+#include "ShmPublisher.hpp"
+#include "SpectralRPMEstimator.hpp"
+#include "SpeedTracker.hpp"
+#include "StallDetector.hpp"
+#include "Stats.hpp"
 #include "Stopwatch.hpp"
+#include "StreamProcessors/PreFilter.hpp"
+#include "UdpPulseSender.hpp"
 
 #include <gst/gst.h>
 #include <gst/app/gstappsrc.h>
 #include <gst/app/gstappsink.h>
+#include <glib-unix.h>
 
 #include <getopt.h>
 #include <inttypes.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,7 +42,9 @@
 #include <atomic>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <sstream>
 #include <thread>
 #include <vector>
 
@@ -39,42 +54,131 @@ int rpmDivisor = 1;
 int requiredAmplitude = 3;
 int verboseFlag = 0;
 const char* inputAlsaDevice = "hw:0,0";
+int httpPort = 0;
+const char* unixSocketPath = NULL;
+const char* shmName = NULL;
+const char* udpDestination = NULL;
+UdpPulseSender::Parameters udpParams;
+CrossingInterpolation interpolation = LinearInterpolation;
+
+enum Estimator {
+	EdgeEstimator,      // RPMCalculatorFromAudio only
+	SpectralEstimator,  // SpectralRPMEstimator only
+	FusedEstimator      // Both, combined by RpmFusion
+};
+Estimator estimator = EdgeEstimator;
+double trackerIntervalMs = 0;
+PreFilter::Parameters preFilterParams;
+double rangeLowPercent = 0;     // 0 and 100 for min and max
+double rangeHighPercent = 100;
+int rangeWindowPeriods = 0;     // 0 for the fixed window
+RpmFilter rpmFilter = MeanFilter;
+StallDetector::Parameters stallParams;   // maxPeriod 0 (the default) to disable
+int numMarks = 0;                        // 0 unless --marks is given
+int orderPoints = 0;                     // Points per revolution, 0 unless --orders is given
 gchar* inputAudioFilename = NULL;
 
 /* these are the caps we are going to pass through the appsink and appsrc */
 const gchar *audio_caps =
 		"audio/x-raw,format=S16LE,channels=2,rate=44100, layout=interleaved";
 
-struct Stats {
-	Stats() :
-		rpm(0),
-		filteredRpm(0),
-		signalMax(0),
-		signalMin(0),
-		threshold(0),
-		thresholdInPercentage(0),
-		hysteresis(0)
-	{ }
-	float rpm;
-	float filteredRpm;
-	int signalMax;
-	int signalMin;
-	int threshold;
-	int thresholdInPercentage;
-	int hysteresis;
-};
-
-static std::atomic<int> gs_threshold_percentage(50);
 static std::atomic<double> gs_rpm(0);
 static std::atomic<bool> quit(false);
 
 
-static std::vector<int16_t> g_period_waveform;
+static std::vector<CappedStorageWaveform::Bin> g_period_waveform;
+static size_t g_period_waveform_trigger_bin = 0;
 static bool g_period_waveform_updated = false;
-Stats stats;
+Stats stats;                            // Shown by the GUI, under g_period_waveform_mutex
 static std::mutex g_period_waveform_mutex;
 
 
+/**
+ * Internal metrics. Each metric is only updated from one thread:
+ * capture.* and detector.* from the GStreamer streaming thread,
+ * gui.* from the display thread.
+ */
+struct AppMetrics {
+	explicit AppMetrics(MetricsRegistry& r) :
+		captureBuffers(r.addCounter("capture.buffers")),
+		captureSamples(r.addCounter("capture.samples")),
+		captureBufferSamples(r.addHistogram("capture.buffer_size", "samples")),
+		captureBufferInterval(r.addHistogram("capture.buffer_interval")),
+		captureBufferProcessing(r.addHistogram("capture.buffer_processing")),
+		detectorPulses(r.addCounter("detector.pulses")),
+		detectorWaveformDeliveries(r.addCounter("detector.waveform_deliveries")),
+		detectorWaveformLockWait(r.addHistogram("detector.waveform_lock_wait")),
+		guiFrames(r.addCounter("gui.frames")),
+		guiFrameRender(r.addHistogram("gui.frame_render")),
+		guiLockWait(r.addHistogram("gui.lock_wait"))
+	{ }
+
+	MetricsCounter& captureBuffers;
+	MetricsCounter& captureSamples;
+	MetricsHistogram& captureBufferSamples;
+	MetricsHistogram& captureBufferInterval;
+	MetricsHistogram& captureBufferProcessing;
+	MetricsCounter& detectorPulses;
+	MetricsCounter& detectorWaveformDeliveries;
+	MetricsHistogram& detectorWaveformLockWait;
+	MetricsCounter& guiFrames;
+	MetricsHistogram& guiFrameRender;
+	MetricsHistogram& guiLockWait;
+};
+
+static MetricsRegistry g_metricsRegistry;
+static AppMetrics g_metrics(g_metricsRegistry);
+
+/* latest values, for readers that must not take g_period_waveform_mutex (MetricsServer) */
+static SeqLockValue<Stats> g_statsSnapshot;
+
+/* latest values and recent pulses, for other processes (see rpm_shm.h) */
+static ShmPublisher g_shmPublisher;
+
+/* pulses streamed to a collector, if --udp is given */
+static std::unique_ptr<UdpPulseSender> g_udpSender;
+
+/* runs on its own thread, with --estimator spectral or fused */
+static std::unique_ptr<AsyncSpectralRPMEstimator> g_spectral;
+
+/* latest pulse from the edge detector, for fusing with the spectral estimates */
+static SeqLockValue<PulseEvent> g_lastPulse;
+static std::atomic<bool> g_hasPulse(false);
+
+/* speed estimates between pulses, with --tracker */
+static std::unique_ptr<SpeedTracker> g_tracker;
+
+/* rpm over whole revolutions and per segment, with --marks (same thread as onPulse) */
+static std::unique_ptr<RevolutionTracker> g_revolutions;
+static RevolutionEvent g_revolution;     // Latest
+static bool g_hasRevolution = false;     // g_revolution is for the current pulse
+
+/* order spectra of the right channel, on its own thread, with --orders */
+static std::unique_ptr<AsyncOrderTracker> g_orders;
+
+/* filters the samples before the edge detector, with --prefilter */
+static std::unique_ptr<PreFilter> g_preFilter;
+
+/*
+ * reports falling and zero rpm when the pulses stop, with --max_period.
+ * Advanced by the streaming thread, and checked by a timer on the main loop
+ * when reading from the mic and the buffers stop coming.
+ */
+static std::unique_ptr<StallDetector> g_stall;
+static uint64_t g_lastBufferNs = 0;          // Arrival of the last buffer, under g_outputMutex
+static int g_bufferSampleRate = 44100;       // From the caps of the last buffer, under g_outputMutex
+
+/*
+ * held by the streaming thread while it runs the detectors on a buffer, by
+ * the stall timer, and by the spectral estimator thread while it publishes,
+ * so the results (g_statsSnapshot, g_shmPublisher, g_udpSender and the lines
+ * printed) have one writer at a time.
+ */
+static std::mutex g_outputMutex;
+static const guint StallTimerIntervalMs = 50;
+static const uint64_t StallTimerSlackNs = 100000000;   // Buffers later than this count as stalled
+
+
 void printTimeInformation()
 {
 	time_t t = time(NULL);
@@ -97,179 +201,347 @@ void printTimeInformation()
 }
 
 
-// TODO: Consider updating waveform even when not triggering on anything. (roll mode)
-class RPMCalculatorFromAudio {
-public:
-	RPMCalculatorFromAudio(int audioSampleRate, int divisor) :
-		_audioSampleRate(audioSampleRate),
-		_divisor(divisor),
-		_periodCounter(0),
-		_minMax(audioSampleRate / 5, 13),
-		_slidingAverageRpmCalculator(10),
-		_thresholdInPercentage(0),
-		_threshold(0),
-		_hysteresis(1),
-		_amplitudeIsHighEnough(false),
-		_isFirstTimestamp(true),
-		_state(Uninitialized),
-		_numStoredWaveforms(0),
-		_numWaveformsBeforeDelivery(3)
-{
+static Stopwatch g_stopwatch;
+static std::once_flag g_firstTimestamp;
 
+/*
+ * time since the first printed result. Called from the streaming thread and
+ * the estimator threads, so the stopwatch is only restarted once, by whoever
+ * comes first, and only read after that (call_once orders the two).
+ */
+static void getTimestamp(uint64_t* secs, uint64_t* nsecs)
+{
+	*secs = 0;
+	*nsecs = 0;
+
+	bool isFirst = false;
+	std::call_once(g_firstTimestamp, [&isFirst]() {
+		isFirst = true;
+		g_stopwatch.restart();
+		printTimeInformation();
+	});
+	if (!isFirst)
+	{
+		g_stopwatch.getElapsed(secs, nsecs);
+	}
 }
 
-	void check(int16_t sample)
-	{
-		_minMax.check(sample);
-		_waveform.push(sample);
+/* called by the detector for each detected pulse */
+static void onPulse(const PulseEvent& detected)
+{
+	g_metrics.detectorPulses.add();
 
-		_periodCounter++;
-		switch(_state)
+	// With --marks, the rpm over the last whole revolution replaces the one
+	// from the last period
+	PulseEvent event = detected;
+	if (g_revolutions)
+	{
+		// No segment for the first pulse, or one that starts it over
+		g_hasRevolution = g_revolutions->addPulse(event.crossingTime);
+		if (g_revolutions->getRpm() > 0)
 		{
-		case Uninitialized:
-			if (sample >= _threshold)
-			{
-				_state = WasAbove;
-				_threshold = sample;
-				_periodCounter = 0;
-			}
-			break;
+			event.rpm = g_revolutions->getRpm();
+		}
+	}
 
-		case WasBelow:
-			if ((sample >= _threshold + _hysteresis) && _amplitudeIsHighEnough)
-			{
-				_state = WasAbove;
-				_periodCounter = std::max<long>(_periodCounter, 1);
+	// With --marks, revolutions start at the index pulse, and none spans a
+	// restart of the revolution tracker (a lost index)
+	if (g_orders && (!g_revolutions || (g_hasRevolution && g_revolution.revolution)))
+	{
+		g_orders->addPulse(event.crossingTime);
+	}
+	else if (g_orders && !g_hasRevolution)
+	{
+		g_orders->resetBoundary();
+	}
 
-				double rpm = ((60.0 * _audioSampleRate) / _periodCounter ) / _divisor;
+	if (g_tracker)
+	{
+		g_tracker->addPulse(event.crossingTime);
+	}
 
-				gs_rpm = rpm;
-				stats.rpm = rpm;
-				_slidingAverageRpmCalculator.push(rpm);
-				double filteredRpm = _slidingAverageRpmCalculator.getAverage();
+	if (g_stall)
+	{
+		g_stall->addPulse(event.crossingTime);
+	}
 
-				//
-				// Time stamp the data
-				//
-				uint64_t nsecs = 0;
-				uint64_t secs = 0;
+	Stats snapshot = g_statsSnapshot.load();
+	snapshot.signalMax = event.signalMax;
+	snapshot.signalMin = event.signalMin;
+	snapshot.threshold = event.threshold;
+	snapshot.thresholdInPercentage = event.thresholdInPercentage;
+	snapshot.hysteresis = event.hysteresis;
 
-				if (_isFirstTimestamp)
-				{
-					_isFirstTimestamp = 0;
-					_stopwatch.restart();
-					printTimeInformation();
-				}
-				else
-				{
-					_stopwatch.getElapsed(&secs, &nsecs);
-				}
+	if (estimator != EdgeEstimator)
+	{
+		// The rpm is published, and printed, by onSpectralEstimate()
+		g_statsSnapshot.store(snapshot);
+		g_lastPulse.store(event);
+		g_hasPulse = true;
+		return;
+	}
 
+	gs_rpm = event.rpm;
+	{
+		std::lock_guard<std::mutex> guard(g_period_waveform_mutex);
+		stats.rpm = event.rpm;
+	}
 
-				if (verboseFlag)
-				{
-					std::cout
-					<< "ts=" << secs << "." << nsecs/1000000
-					<< ", PeriodCounter=" << _periodCounter
-					<< ", rpm=" << rpm
-					<< ", rpm_filtered=" << filteredRpm
-					<< ", threshold=" << int(_threshold)
-					<< ", hysteresis=" << int(_hysteresis)
-					<< ", minMax.min=" << _minMax.getMin()
-					<< ", minMax.max=" << _minMax.getMax()
-					<< "\n";
-				}
-				else
-				{
-					std::cout
-					<< "ts=" << secs << "." << nsecs/1000000
-					<< ", rpm=" << rpm
-					<< ", rpm_filtered=" << filteredRpm
-					<< "\n";
-				}
+	snapshot.rpm = event.rpm;
+	snapshot.filteredRpm = event.filteredRpm;
+	snapshot.rpmSource = RpmFusion::Edge;
+	g_statsSnapshot.store(snapshot);
+	g_shmPublisher.publish(event);
+	if (g_udpSender)
+	{
+		g_udpSender->push(event);
+	}
 
-				_periodCounter = 0;
-				_numStoredWaveforms++;
+	//
+	// Time stamp the data
+	//
+	uint64_t nsecs = 0;
+	uint64_t secs = 0;
+	getTimestamp(&secs, &nsecs);
 
-				if (_numStoredWaveforms >= _numWaveformsBeforeDelivery)
-				{
-					std::lock_guard<std::mutex> guard(g_period_waveform_mutex);
-
-					const std::vector<int16_t>& waveform = _waveform.getWaveform();
-					g_period_waveform.resize(waveform.size());
-
-					int min = _minMax.getMin();
-					int max = _minMax.getMax();
-
-					for (size_t i = 0; i < waveform.size(); i++)
-					{
-						g_period_waveform[i] = waveform[i];
-					}
-					stats.signalMax = max;
-					stats.signalMin = min;
-					stats.threshold = _threshold;
-					stats.thresholdInPercentage = _thresholdInPercentage;
-					stats.hysteresis = _hysteresis;
-					stats.filteredRpm = _slidingAverageRpmCalculator.getAverage();
-
-					g_period_waveform_updated = true;
-					_waveform.clear();
-					_numStoredWaveforms = 0;
-				}
-			}
-			break;
+	// One write, as the order tracker thread prints too
+	std::ostringstream line;
+	if (verboseFlag)
+	{
+		line
+		<< "ts=" << secs << "." << nsecs/1000000
+		<< ", PeriodCounter=" << event.periodInSamples
+		<< ", rpm=" << event.rpm
+		<< ", rpm_filtered=" << event.filteredRpm
+		<< ", threshold=" << int(event.threshold)
+		<< ", hysteresis=" << int(event.hysteresis)
+		<< ", minMax.min=" << event.signalMin
+		<< ", minMax.max=" << event.signalMax
+		<< "\n";
+	}
+	else if (g_hasRevolution)
+	{
+		line
+		<< "ts=" << secs << "." << nsecs/1000000
+		<< ", rpm=" << event.rpm
+		<< ", rpm_filtered=" << event.filteredRpm
+		<< ", segment=" << g_revolution.segment
+		<< ", rpm_segment=" << g_revolution.segmentRpm
+		<< ", index=" << g_revolution.indexLocked
+		<< "\n";
+	}
+	else
+	{
+		line
+		<< "ts=" << secs << "." << nsecs/1000000
+		<< ", rpm=" << event.rpm
+		<< ", rpm_filtered=" << event.filteredRpm
+		<< "\n";
+	}
+	std::cout << line.str();
+}
 
-		case WasAbove:
-			if (sample < _threshold - _hysteresis)
-			{
-				_state = WasBelow;
-			}
-			break;
+/* called by the revolution tracker for each pulse, with --marks (from within onPulse) */
+static void onRevolution(const RevolutionEvent& event)
+{
+	g_revolution = event;
+}
+
+/* called by the speed tracker every --tracker milliseconds (same thread as onPulse) */
+static void onTrackedSpeed(const SpeedEstimate& estimate)
+{
+	{
+		std::lock_guard<std::mutex> guard(g_period_waveform_mutex);
+		stats.trackedRpm = estimate.rpm;
+	}
+
+	Stats snapshot = g_statsSnapshot.load();
+	snapshot.trackedRpm = estimate.rpm;
+	g_statsSnapshot.store(snapshot);
+	g_shmPublisher.publishTracked(estimate);
+	if (g_udpSender)
+	{
+		g_udpSender->pushTracked(estimate);
+	}
+
+	uint64_t nsecs = 0;
+	uint64_t secs = 0;
+	getTimestamp(&secs, &nsecs);
+
+	// One write, as the estimator threads print too
+	std::ostringstream line;
+	line
+	<< "ts=" << secs << "." << nsecs/1000000
+	<< ", rpm_tracked=" << estimate.rpm
+	<< ", locked=" << estimate.locked
+	<< "\n";
+	std::cout << line.str();
+}
+
+/*
+ * called by the stall detector when the pulses stop (same thread as onPulse,
+ * or the main loop when the buffers stop too, always under g_outputMutex)
+ */
+static void onStall(const StallEvent& event)
+{
+	if (estimator == EdgeEstimator)
+	{
+		gs_rpm = event.rpm;
+	}
+	{
+		// Also from the stall timer, while the GUI thread copies stats
+		std::lock_guard<std::mutex> guard(g_period_waveform_mutex);
+		if (estimator == EdgeEstimator)
+		{
+			stats.rpm = event.rpm;
+		}
+		stats.filteredRpm = event.rpm;
+	}
+
+	// With the other estimators, the published rpm is from onSpectralEstimate()
+	if (estimator == EdgeEstimator)
+	{
+		Stats snapshot = g_statsSnapshot.load();
+		snapshot.rpm = event.rpm;
+		snapshot.filteredRpm = event.rpm;
+		g_statsSnapshot.store(snapshot);
+		g_shmPublisher.publishStall(event);
+		if (g_udpSender)
+		{
+			g_udpSender->pushStall(event);
 		}
+	}
+
+	uint64_t nsecs = 0;
+	uint64_t secs = 0;
+	getTimestamp(&secs, &nsecs);
+
+	// One write, as the estimator threads print too
+	std::ostringstream line;
+	line
+	<< "ts=" << secs << "." << nsecs/1000000
+	<< ", rpm=" << event.rpm
+	<< (event.stopped ? ", stopped=1" : ", stalled=1")
+	<< "\n";
+	std::cout << line.str();
+}
+
+/* called from the spectral estimator thread for each analysed frame */
+static void onSpectralEstimate(const SpectralEstimate& estimate)
+{
+	static RpmFusion fusion;
+
+	PulseEvent lastPulse;
+	bool hasPulse = estimator == FusedEstimator && g_hasPulse;
+	if (hasPulse)
+	{
+		lastPulse = g_lastPulse.load();
+	}
+	RpmFusion::Result result = fusion.fuse(hasPulse ? &lastPulse : NULL, estimate);
+
+	gs_rpm = result.rpm;
+	{
+		std::lock_guard<std::mutex> guard(g_period_waveform_mutex);
+		stats.rpm = result.rpm;
+	}
 
-		_thresholdInPercentage = gs_threshold_percentage;
-		float weight = _thresholdInPercentage * 0.01;
-		_threshold = _minMax.getMax() * weight + _minMax.getMin() * (1 - weight);
-		_hysteresis = (_minMax.getMax() - _minMax.getMin()) / 8;
-		int amplitude = _minMax.getMax() - _minMax.getMin();
-		_amplitudeIsHighEnough = amplitude > requiredAmplitude;
+	// In place of the pulses, which onPulse() does not publish with this estimator
+	std::unique_lock<std::mutex> outputLock(g_outputMutex);
+	Stats snapshot = g_statsSnapshot.load();
+	snapshot.rpm = result.rpm;
+	snapshot.filteredRpm = result.rpm;
+	snapshot.rpmSource = result.source;
+	g_statsSnapshot.store(snapshot);
+	g_shmPublisher.publishEstimate(estimate, result);
+	if (g_udpSender)
+	{
+		g_udpSender->pushEstimate(estimate, result);
 	}
+	outputLock.unlock();
+
+	uint64_t nsecs = 0;
+	uint64_t secs = 0;
+	getTimestamp(&secs, &nsecs);
+
+	// One write, as the streaming thread prints too
+	std::ostringstream line;
+	line
+	<< "ts=" << secs << "." << nsecs/1000000
+	<< ", rpm=" << result.rpm
+	<< ", source=" << RpmFusion::getSourceName(result.source)
+	<< ", spectral_rpm=" << estimate.rpm
+	<< ", confidence=" << estimate.confidence
+	<< "\n";
+	std::cout << line.str();
+}
 
-private:
-	int _audioSampleRate;
-	int _divisor;
-	long _periodCounter;
+/* called from the order tracker thread for each revolution, with --orders */
+static void onOrderSpectrum(const OrderSpectrum& spectrum)
+{
+	// The strongest orders (not 0, the offset), averaged over the last revolutions
+	const int NumPrinted = 4;
+	size_t strongest[NumPrinted] = { 0 };
+	for (size_t k = 1; k < spectrum.numOrders; k++)
+	{
+		for (int i = 0; i < NumPrinted; i++)
+		{
+			if (!strongest[i] || spectrum.averaged[k] > spectrum.averaged[strongest[i]])
+			{
+				std::copy_backward(strongest + i, strongest + NumPrinted - 1, strongest + NumPrinted);
+				strongest[i] = k;
+				break;
+			}
+		}
+	}
 
-	MinMaxCheck _minMax;
-	SlidingAverager _slidingAverageRpmCalculator;
-	int _thresholdInPercentage;
-	double _threshold;
-	double _hysteresis;
-	bool _amplitudeIsHighEnough;
+	uint64_t nsecs = 0;
+	uint64_t secs = 0;
+	getTimestamp(&secs, &nsecs);
+
+	// One write, as the streaming thread prints too
+	std::ostringstream line;
+	line
+	<< "ts=" << secs << "." << nsecs/1000000
+	<< ", revolution=" << spectrum.revolution
+	<< ", rpm_revolution=" << spectrum.rpm
+	<< ", orders=";
+	for (int i = 0; i < NumPrinted && strongest[i]; i++)
+	{
+		line << (i ? ";" : "") << strongest[i] << ":" << spectrum.averaged[strongest[i]];
+	}
+	line << "\n";
+	std::cout << line.str();
+}
 
-	bool _isFirstTimestamp;
-	Stopwatch _stopwatch;
+/* called by the detector every few pulses, with the waveform captured since last time */
+static void onWaveform(const CappedStorageWaveform& waveform, const PulseEvent& event)
+{
+	g_metrics.detectorWaveformDeliveries.add();
 
-	enum State {
-		Uninitialized,
-		WasBelow,
-		WasAbove
-	};
+	uint64_t lockStart = nowNs();
+	std::lock_guard<std::mutex> guard(g_period_waveform_mutex);
+	g_metrics.detectorWaveformLockWait.record(nowNs() - lockStart);
 
-	State _state;
+	g_period_waveform.assign(waveform.getBins(), waveform.getBins() + waveform.size());
+	g_period_waveform_trigger_bin = waveform.getNumPreTriggerSamples() / waveform.getSamplesPerBin();
 
-	int _numStoredWaveforms;
-	const int _numWaveformsBeforeDelivery;
+	stats.signalMax = event.signalMax;
+	stats.signalMin = event.signalMin;
+	stats.threshold = event.threshold;
+	stats.thresholdInPercentage = event.thresholdInPercentage;
+	stats.hysteresis = event.hysteresis;
+	stats.filteredRpm = event.filteredRpm;
 
-	CappedStorageWaveform _waveform;
-};
+	g_period_waveform_updated = true;
+}
 
 
 typedef struct
 {
 	GMainLoop *loop;
 	GstElement *source;
-	RPMCalculatorFromAudio *check;
+	RPMCalculatorFromAudio *check;              // With the gui
+	BlindRPMCalculatorFromAudio *blindCheck;    // With --blind (no waveform capture)
 } ProgramData;
 
 /* called when the appsink notifies us that there is a new buffer ready for
@@ -280,6 +552,14 @@ on_new_sample_from_sink (GstElement * elt, ProgramData * data)
 	GstSample *sample;
 	GstBuffer *buffer;
 
+	static uint64_t lastBufferNs = 0;
+	const uint64_t startNs = nowNs();
+	if (lastBufferNs)
+	{
+		g_metrics.captureBufferInterval.record(startNs - lastBufferNs);
+	}
+	lastBufferNs = startNs;
+
 	// get the sample from appsink
 	sample = gst_app_sink_pull_sample (GST_APP_SINK (elt));
 	buffer = gst_sample_get_buffer (sample);
@@ -289,22 +569,70 @@ on_new_sample_from_sink (GstElement * elt, ProgramData * data)
 	gboolean isMapped = gst_buffer_map (buffer, &info, GST_MAP_READ);
 	if (isMapped)
 	{
-		// Get the interesting bytes:
-		int16_t buff[info.size/4];
-		for (unsigned i = 0; i < info.size / 4; i++)
+		// Everything reporting results from here on, until the estimator threads
+		std::unique_lock<std::mutex> outputLock(g_outputMutex);
+
+		// Left channel of the interleaved stereo samples
+		const int channel = 0;
+		const int16_t* samples = (const int16_t*)(info.data) + channel;
+		auto detect = [data](const int16_t* s, size_t n, size_t stride) {
+			if (data->blindCheck)
+			{
+				data->blindCheck->processBlock(s, n, stride);
+			}
+			else
+			{
+				data->check->processBlock(s, n, stride);
+			}
+		};
+		if (g_preFilter)
 		{
-			const int channel = 0;
-			buff[i] = ((int16_t*)(info.data))[i*2 + channel];
-
-			data->check->check(buff[i]);
+			g_preFilter->processBlock(samples, info.size / 4, 2, [&](const int16_t* filtered, size_t count) {
+				detect(filtered, count, 1);
+			});
+		}
+		else
+		{
+			detect(samples, info.size / 4, 2);
+		}
+		if (g_tracker)
+		{
+			g_tracker->advance(info.size / 4);
+		}
+		if (g_stall)
+		{
+			GstCaps* caps = gst_sample_get_caps(sample);
+			gint rate = 0;
+			if (caps && gst_structure_get_int(gst_caps_get_structure(caps, 0), "rate", &rate) && rate > 0)
+			{
+				g_bufferSampleRate = rate;
+			}
+			g_stall->advance(info.size / 4);
+			g_lastBufferNs = startNs;
+		}
+		outputLock.unlock();
+		if (g_spectral)
+		{
+			g_spectral->processBlock(samples, info.size / 4, 2);
+		}
+		if (g_orders)
+		{
+			// Right channel: the vibration signal
+			g_orders->processBlock((const int16_t*)(info.data) + 1, info.size / 4, 2);
 		}
 
 		gst_buffer_unmap(buffer, &info);
+
+		g_metrics.captureBuffers.add();
+		g_metrics.captureSamples.add(info.size / 4);
+		g_metrics.captureBufferSamples.record(info.size / 4);
 	}
 
 	// we don't need the appsink sample anymore
 	gst_sample_unref (sample);
 
+	g_metrics.captureBufferProcessing.record(nowNs() - startNs);
+
 	if (quit)
 	{
 		return GST_FLOW_EOS;
@@ -313,6 +641,28 @@ on_new_sample_from_sink (GstElement * elt, ProgramData * data)
 	return GST_FLOW_OK;
 }
 
+/* called (from the main loop) every StallTimerIntervalMs, when reading from the mic */
+static gboolean
+on_stall_timer (gpointer)
+{
+	std::lock_guard<std::mutex> guard(g_outputMutex);
+	uint64_t late = g_lastBufferNs ? nowNs() - g_lastBufferNs : 0;
+	if (late > StallTimerSlackNs)
+	{
+		// The samples that should have arrived by now
+		g_stall->checkAt(g_stall->getSampleIndex() + late * g_bufferSampleRate / 1000000000);
+	}
+	return TRUE;
+}
+
+/* called (from the main loop) when receiving SIGUSR1 */
+static gboolean
+on_sigusr1 (gpointer)
+{
+	g_metricsRegistry.dump(stderr);
+	return TRUE;
+}
+
 /* called when we get a GstMessage from the source pipeline when we get EOS, we
  * notify the appsrc of it. */
 static gboolean
@@ -334,7 +684,7 @@ on_source_message (GstBus * bus, GstMessage * message, ProgramData * data)
 }
 
 
-void sdlDisplayThread()
+void sdlDisplayThread(RPMCalculatorFromAudio* detector)
 {
 	if (noGUI)
 	{
@@ -343,82 +693,63 @@ void sdlDisplayThread()
 
 	SDLWindow win;
 	SDLEventHandler eventHandler;
-	eventHandler.setThresholdPercentage(gs_threshold_percentage);
+	std::vector<CappedStorageWaveform::Bin> period_waveform;
+	period_waveform.reserve(4096);
+	eventHandler.setThresholdPercentage(detector->getThresholdPercentage());
+	eventHandler.setRpmFilter(detector->getRpmFilter());
 
 	while(!quit)
 	{
+		const uint64_t frameStartNs = nowNs();
 		win.drawTopText();
 
 		{
-			std::vector<int16_t> period_waveform;
 			Stats statsCopy;
+			size_t triggerBin;
 			{
+				uint64_t lockStart = nowNs();
 				std::lock_guard<std::mutex> guard(g_period_waveform_mutex);
-				period_waveform.resize(g_period_waveform.size());
-				for (size_t i = 0; i < g_period_waveform.size(); i++)
-				{
-					period_waveform[i] = g_period_waveform[i];
-				}
+				g_metrics.guiLockWait.record(nowNs() - lockStart);
+				period_waveform.assign(g_period_waveform.begin(), g_period_waveform.end());
+				triggerBin = g_period_waveform_trigger_bin;
 
 				statsCopy = stats;
 			}
 
-			float rpm = eventHandler.shouldDisplayFilteredRPM() ? stats.filteredRpm : stats.rpm;
+			float rpm = eventHandler.shouldDisplayFilteredRPM() ? statsCopy.filteredRpm :
+					trackerIntervalMs > 0 ? statsCopy.trackedRpm : statsCopy.rpm;
 			win.drawDigits(rpm, 4, /* showZeros */ false, /*showUnlitSegments*/ true,
 					eventHandler.getDigitScaling());
 
 			win.drawAdditionalStats(
 					statsCopy.rpm,
 					statsCopy.filteredRpm,
+					getRpmFilterName(detector->getRpmFilter()),
 					statsCopy.signalMax,
 					statsCopy.signalMin,
 					statsCopy.threshold,
 					statsCopy.hysteresis);
 
-			int width = win.getWidth();
-			int height = win.getHeight();
-			double xScaling = width * 1.0 / period_waveform.size();
-
-			const auto & convertY = [&](int sample) {
-				int tmp = (sample - statsCopy.signalMin) * 255.0 / (statsCopy.signalMax - statsCopy.signalMin);
-				return height - 1 - tmp;
-			};
-
-			for (int i = 0; i < int(period_waveform.size())-1; i++)
-			{
-				win.drawLine(
-						i * xScaling,
-						convertY(period_waveform[i]),
-						(i+1) * xScaling,
-						convertY(period_waveform[i+1]),
-						255, 255, 255, 255
-				);
-			}
-
-			// Draw the thresholds used during signal processing
-			// TODO: draw a nice symbol for the hysteresis region as well?
-			win.drawLine(
-					0,
-					convertY(statsCopy.threshold + statsCopy.hysteresis),
-					width-1,
-					convertY(statsCopy.threshold + statsCopy.hysteresis),
-					0, 0, 255, 255);
-			win.drawLine(
-					0,
-					convertY(statsCopy.threshold - statsCopy.hysteresis),
-					width-1,
-					convertY(statsCopy.threshold - statsCopy.hysteresis),
-					0, 0, 255, 255);
+			win.drawWaveform(
+					period_waveform,
+					triggerBin,
+					statsCopy.signalMin,
+					statsCopy.signalMax,
+					statsCopy.threshold,
+					statsCopy.hysteresis);
 
 		}
 
 		win.flip();
 		win.clear();
+		g_metrics.guiFrames.add();
+		g_metrics.guiFrameRender.record(nowNs() - frameStartNs);
 		usleep(20000);
 
 		eventHandler.refresh();
 
-		gs_threshold_percentage = eventHandler.getThresholdPercentage();
+		detector->setThresholdPercentage(eventHandler.getThresholdPercentage());
+		detector->setRpmFilter(eventHandler.getRpmFilter());
 		if (eventHandler.shouldQuit())
 		{
 			quit = true;
@@ -453,6 +784,9 @@ int main (int argc, char *argv[])
 	GstBus *bus = NULL;
 	GstElement *testsink = NULL;
 
+	// Off unless --max_period is given, so the output is unchanged by default
+	stallParams.maxPeriod = 0;
+
 	while(true)
 	{
 		int c;
@@ -468,11 +802,28 @@ int main (int argc, char *argv[])
 				{"help",    no_argument,   &showHelp_flag, 1},
 				/* These options don’t set a flag. We distinguish them by their indices. */
 				{"file",    required_argument, 0, 'f'},
+				{"http_port",   required_argument, 0, 'H'},
+				{"unix_socket", required_argument, 0, 'U'},
+				{"shm",         required_argument, 0, 'S'},
+				{"udp",         required_argument, 0, 'u'},
+				{"rig_id",      required_argument, 0, 'R'},
+				{"udp_batch",   required_argument, 0, 'B'},
+				{"udp_max_delay_ms", required_argument, 0, 'M'},
+				{"interpolation", required_argument, 0, 'I'},
+				{"estimator",   required_argument, 0, 'E'},
+				{"tracker",     required_argument, 0, 'T'},
+				{"prefilter",   required_argument, 0, 'P'},
+				{"range",       required_argument, 0, 'r'},
+				{"window",      required_argument, 0, 'W'},
+				{"rpm_filter",  required_argument, 0, 'F'},
+				{"max_period",  required_argument, 0, 's'},
+				{"marks",       required_argument, 0, 'n'},
+				{"orders",      required_argument, 0, 'O'},
 				{0, 0, 0, 0}
 		};
 		/* getopt_long stores the option index here. */
 		int option_index = 0;
-		c = getopt_long (argc, argv, "a:vbmd:D:hf:",
+		c = getopt_long (argc, argv, "a:vbmd:D:hf:H:U:S:u:R:B:M:I:E:T:P:r:W:F:s:n:O:",
 				long_options, &option_index);
 
 		/* Detect the end of the options. */
@@ -526,6 +877,145 @@ int main (int argc, char *argv[])
 			inputAudioFilename = g_strdup (optarg);
 			break;
 
+		case 'H':
+			httpPort = std::stoi(optarg);
+			break;
+
+		case 'U':
+			unixSocketPath = optarg;
+			break;
+
+		case 'S':
+			shmName = optarg;
+			break;
+
+		case 'u':
+			udpDestination = optarg;
+			break;
+
+		case 'R':
+			udpParams.rigId = std::stoul(optarg);
+			break;
+
+		case 'B':
+			udpParams.maxPulsesPerDatagram = std::stoi(optarg);
+			break;
+
+		case 'M':
+			udpParams.maxDelayMs = std::stoi(optarg);
+			break;
+
+		case 'I':
+			if (strcmp(optarg, "none") == 0)
+			{
+				interpolation = NoInterpolation;
+			}
+			else if (strcmp(optarg, "linear") == 0)
+			{
+				interpolation = LinearInterpolation;
+			}
+			else if (strcmp(optarg, "cubic") == 0)
+			{
+				interpolation = CubicInterpolation;
+			}
+			else
+			{
+				fprintf(stderr, "--interpolation must be none, linear or cubic\n");
+				return 1;
+			}
+			break;
+
+		case 'E':
+			if (strcmp(optarg, "edge") == 0)
+			{
+				estimator = EdgeEstimator;
+			}
+			else if (strcmp(optarg, "spectral") == 0)
+			{
+				estimator = SpectralEstimator;
+			}
+			else if (strcmp(optarg, "fused") == 0)
+			{
+				estimator = FusedEstimator;
+			}
+			else
+			{
+				fprintf(stderr, "--estimator must be edge, spectral or fused\n");
+				return 1;
+			}
+			break;
+
+		case 'T':
+			trackerIntervalMs = std::stod(optarg);
+			break;
+
+		case 'P':
+			if (!preFilterParams.parse(optarg) || std::max(preFilterParams.highPassCutoff, preFilterParams.lowPassCutoff) >= 44100 / 2)
+			{
+				fprintf(stderr, "--prefilter must be a comma separated list of dc[:HZ], highpass:HZ, lowpass:HZ,\n"
+						"bandpass:LOW-HIGH and sections:N (1-4)\n");
+				return 1;
+			}
+			break;
+
+		case 'r':
+			if (strcmp(optarg, "minmax") == 0)
+			{
+				rangeLowPercent = 0;
+				rangeHighPercent = 100;
+			}
+			else if (sscanf(optarg, "%lf-%lf", &rangeLowPercent, &rangeHighPercent) != 2 ||
+					rangeLowPercent < 0 || rangeLowPercent >= rangeHighPercent || rangeHighPercent > 100)
+			{
+				fprintf(stderr, "--range must be minmax or LOW-HIGH percentiles, e.g. 1-99\n");
+				return 1;
+			}
+			break;
+
+		case 'W':
+			rangeWindowPeriods = std::stoi(optarg);
+			if (rangeWindowPeriods == 1 || rangeWindowPeriods < 0)
+			{
+				fprintf(stderr, "--window must be 0 (fixed) or at least 2 periods\n");
+				return 1;
+			}
+			break;
+
+		case 'F':
+			if (!parseRpmFilter(optarg, rpmFilter))
+			{
+				fprintf(stderr, "--rpm_filter must be mean, median, trimmed or hampel\n");
+				return 1;
+			}
+			break;
+
+		case 's':
+			stallParams.maxPeriod = std::stod(optarg);
+			if (stallParams.maxPeriod < 0)
+			{
+				fprintf(stderr, "--max_period must be 0 (never report a stop) or a number of seconds\n");
+				return 1;
+			}
+			break;
+
+		case 'n':
+			numMarks = std::stoi(optarg);
+			if (numMarks < 1)
+			{
+				fprintf(stderr, "--marks must be at least 1\n");
+				return 1;
+			}
+			break;
+
+		case 'O':
+			orderPoints = std::stoi(optarg);
+			if (orderPoints < 8 || (orderPoints & (orderPoints - 1)))
+			{
+				fprintf(stderr, "--orders must be a power of two, at least 8\n");
+				return 1;
+			}
+			break;
+
 		case '?':
 			/* getopt_long already printed an error message. */
 			break;
@@ -535,6 +1025,13 @@ int main (int argc, char *argv[])
 		}
 	}
 
+	if (numMarks)
+	{
+		rpmDivisor = numMarks;
+		// Uneven marks: a stall is a whole revolution without pulses
+		stallParams.deadlineFactor = std::max<double>(stallParams.deadlineFactor, numMarks);
+	}
+
 	if (showHelp_flag)
 	{
 		printf(
@@ -547,6 +1044,30 @@ int main (int argc, char *argv[])
 				"-a, --amplitude Number  minimum input waveform amplitude required before counting revolutions\n"
 				"-h, --help\n"
 				"-f, --file FILENAME.WAV (Analyzing a pre-recorded file)\n"
+				"-H, --http_port PORT     Serve /metrics and /metrics.json on 127.0.0.1:PORT\n"
+				"-U, --unix_socket PATH   Serve /metrics and /metrics.json on a unix domain socket\n"
+				"-S, --shm NAME           Publish rpm and pulses in shared memory /dev/shm/NAME (see rpm_shm.h)\n"
+				"-u, --udp HOST:PORT      Stream pulses as UDP datagrams, unicast or multicast (see rpm_udp.h)\n"
+				"-R, --rig_id N           Rig id sent in UDP datagrams (default 0)\n"
+				"-B, --udp_batch N        Max pulses per UDP datagram, 1-40 (default 16)\n"
+				"-M, --udp_max_delay_ms MS  Max time a pulse waits for its datagram to fill up (default 50)\n"
+				"-I, --interpolation none|linear|cubic  Sub-sample timing of the edges (default linear)\n"
+				"-E, --estimator edge|spectral|fused  Rpm from the edges, from the spectrum (for weak or noisy\n"
+				"                         signals), or from both combined (default edge)\n"
+				"-T, --tracker MS         Also estimate the speed every MS milliseconds, between pulses\n"
+				"-P, --prefilter FILTERS  Filter the samples before the edge detector, e.g. dc,lowpass:2000\n"
+				"                         or dc,bandpass:20-2000 (see README)\n"
+				"-r, --range minmax|LOW-HIGH  Place the threshold between min and max of the signal (default),\n"
+				"                         or between two percentiles, e.g. 1-99, which glitches can not move\n"
+				"-W, --window PERIODS     Track the signal range over PERIODS periods (e.g. 8) instead of 2.6 s\n"
+				"-F, --rpm_filter mean|median|trimmed|hampel  Filter for the filtered rpm, the last 10 pulses\n"
+				"                         averaged, or with missed and extra pulses ignored (default mean)\n"
+				"-s, --max_period SECONDS  Report falling rpm when the pulses stop, and 0 rpm after\n"
+				"                         SECONDS without a pulse (e.g. 3; default 0, disabled)\n"
+				"-n, --marks N            N (possibly uneven) marks per revolution: rpm over whole revolutions,\n"
+				"                         and per segment from the index mark (sets --rpm_divisor N)\n"
+				"-O, --orders POINTS      Order spectrum of the right channel (e.g. an accelerometer), resampled\n"
+				"                         to POINTS (a power of two, e.g. 256) per revolution\n"
 				"\n", argv[0]
 		);
 		return 1;
@@ -554,11 +1075,106 @@ int main (int argc, char *argv[])
 
 	gst_init (&argc, &argv);
 
+	g_period_waveform.reserve(2048);
+
 	data = g_new0 (ProgramData, 1);
-	data->check = new RPMCalculatorFromAudio(44100, rpmDivisor);
+	if (noGUI)
+	{
+		data->blindCheck = new BlindRPMCalculatorFromAudio(44100, rpmDivisor, requiredAmplitude);
+		data->blindCheck->setPulseCallback(onPulse);
+		data->blindCheck->setCrossingInterpolation(interpolation);
+		data->blindCheck->setRangeQuantiles(rangeLowPercent, rangeHighPercent);
+		data->blindCheck->setRangeWindowPeriods(rangeWindowPeriods);
+		data->blindCheck->setRpmFilter(rpmFilter);
+	}
+	else
+	{
+		data->check = new RPMCalculatorFromAudio(44100, rpmDivisor, requiredAmplitude);
+		data->check->setPulseCallback(onPulse);
+		data->check->setWaveformCallback(onWaveform);
+		data->check->setCrossingInterpolation(interpolation);
+		data->check->setRangeQuantiles(rangeLowPercent, rangeHighPercent);
+		data->check->setRangeWindowPeriods(rangeWindowPeriods);
+		data->check->setRpmFilter(rpmFilter);
+	}
 	data->loop = g_main_loop_new (NULL, FALSE);
 
-	std::thread thread1(sdlDisplayThread);
+	if (preFilterParams.isEnabled())
+	{
+		g_preFilter.reset(new PreFilter(44100, preFilterParams));
+	}
+
+	if (trackerIntervalMs > 0)
+	{
+		SpeedTracker::Parameters trackerParams;
+		trackerParams.outputInterval = std::max(1, int(trackerIntervalMs * 44100 / 1000 + 0.5));
+		g_tracker.reset(new SpeedTracker(44100, rpmDivisor, trackerParams));
+		g_tracker->setEstimateCallback(onTrackedSpeed);
+	}
+
+	if (numMarks)
+	{
+		RevolutionTracker::Parameters revolutionParams;
+		revolutionParams.pulsesPerRevolution = numMarks;
+		g_revolutions.reset(new RevolutionTracker(44100, revolutionParams));
+		g_revolutions->setRevolutionCallback(onRevolution);
+	}
+
+	if (orderPoints)
+	{
+		OrderTracker::Parameters orderParams;
+		orderParams.samplesPerRevolution = orderPoints;
+		orderParams.pulsesPerRevolution = numMarks ? 1 : rpmDivisor;
+		g_orders.reset(new AsyncOrderTracker(44100, orderParams));
+		g_orders->setSpectrumCallback(onOrderSpectrum);
+		g_orders->start();
+	}
+
+	if (stallParams.maxPeriod > 0)
+	{
+		g_stall.reset(new StallDetector(44100, rpmDivisor, stallParams));
+		g_stall->setStallCallback(onStall);
+	}
+
+	if (estimator != EdgeEstimator)
+	{
+		g_spectral.reset(new AsyncSpectralRPMEstimator(44100, rpmDivisor));
+		g_spectral->setEstimateCallback(onSpectralEstimate);
+		g_spectral->start();
+	}
+
+	if (shmName && !g_shmPublisher.open(shmName, 44100))
+	{
+		perror(shmName);
+		return 1;
+	}
+
+	if (udpDestination)
+	{
+		std::string error;
+		g_udpSender.reset(new UdpPulseSender(udpParams));
+		if (!g_udpSender->open(udpDestination, error))
+		{
+			fprintf(stderr, "%s: %s\n", udpDestination, error.c_str());
+			return 1;
+		}
+		g_udpSender->start();
+	}
+
+	std::unique_ptr<MetricsServer> metricsServer;
+	if (httpPort || unixSocketPath)
+	{
+		metricsServer.reset(new MetricsServer(g_statsSnapshot, g_metricsRegistry));
+		bool ok = unixSocketPath ? metricsServer->listenUnix(unixSocketPath) : metricsServer->listenTcp(httpPort);
+		if (!ok)
+		{
+			perror(unixSocketPath ? unixSocketPath : "metrics server");
+			return 1;
+		}
+		metricsServer->start();
+	}
+
+	std::thread thread1(sdlDisplayThread, data->check);
 
 	/* setting up source pipeline, we read from a file and convert to our desired
 	 * caps. */
@@ -590,6 +1206,16 @@ int main (int argc, char *argv[])
 	gst_bus_add_watch (bus, (GstBusFunc) on_source_message, data);
 	gst_object_unref (bus);
 
+	/* kill -USR1 dumps internal metrics to stderr */
+	g_unix_signal_add (SIGUSR1, on_sigusr1, NULL);
+
+	/* a file is only advanced by its samples; the mic also by a timer, in
+	 * case the capture stalls, so the stop is still reported in time */
+	if (g_stall && useMicDirectly_flag)
+	{
+		g_timeout_add (StallTimerIntervalMs, on_stall_timer, NULL);
+	}
+
 	/* we use appsink in push mode, it sends us a signal when data is available
 	 * and we pull out the data in the signal callback. If we want the appsink to
 	 * push as fast as it can, we use sync=false */
@@ -618,6 +1244,40 @@ int main (int argc, char *argv[])
 
 	quit = true;
 	thread1.join();
+	if (metricsServer)
+	{
+		metricsServer->stop();
+	}
+	g_shmPublisher.close();
+	if (g_spectral)
+	{
+		g_spectral->stop();
+		if (g_spectral->getNumDropped())
+		{
+			fprintf(stderr, "# spectral: %llu samples dropped (estimator thread fell behind)\n",
+					(unsigned long long)g_spectral->getNumDropped());
+		}
+	}
+	if (g_orders)
+	{
+		g_orders->stop();
+		if (g_orders->getNumDropped())
+		{
+			fprintf(stderr, "# orders: %llu samples dropped (order tracker thread fell behind)\n",
+					(unsigned long long)g_orders->getNumDropped());
+		}
+	}
+	if (g_udpSender)
+	{
+		g_udpSender->stop();
+		if (g_udpSender->getNumDropped())
+		{
+			fprintf(stderr, "# udp: %llu records dropped (sender thread fell behind)\n",
+					(unsigned long long)g_udpSender->getNumDropped());
+		}
+	}
+
+	g_metricsRegistry.dump(stderr);
 
 	return 0;
 }
@@ -0,0 +1,287 @@
+/*
+ * rpm_shm.h
+ *
+ * Layout of, and reader functions for, the shared memory segment published by
+ * RPMRevolutionMeter --shm NAME. Plain C (gcc/clang, Linux), so it can be
+ * copied into other projects. Reading does not need any system calls:
+ *
+ *   struct rpm_shm* shm = rpm_shm_open_reader("rpm");
+ *
+ *   struct rpm_shm_latest latest;
+ *   rpm_shm_read_latest(shm, &latest);               // Newest value, never blocks
+ *
+ *   uint64_t next = rpm_shm_get_write_count(shm);    // Only pulses from now on
+ *   struct rpm_shm_pulse pulses[16];
+ *   while (1)
+ *   {
+ *       rpm_shm_wait(shm, next, 1000);               // Sleeps on a futex
+ *       size_t n = rpm_shm_read_pulses(shm, &next, pulses, 16, NULL);
+ *       ...
+ *   }
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RPM_SHM_MAGIC 0x314d5052u   /* "RPM1" */
+#define RPM_SHM_VERSION 5u         /* 2: period_in_samples is fractional, 3: tracked_*, 4: stall_*, 5: rpm_source */
+#define RPM_SHM_RING_SIZE 256u      /* Power of two */
+
+/* rpm_shm_latest.stall_state */
+#define RPM_SHM_RUNNING 0           /* Pulses are coming, rpm is current */
+#define RPM_SHM_STALLED 1           /* Overdue, the rpm is at most stall_rpm (falling) */
+#define RPM_SHM_STOPPED 2           /* No pulse for --max_period, stall_rpm is 0 */
+
+/* rpm_shm_latest.rpm_source */
+#define RPM_SHM_SOURCE_NONE 0       /* Nothing published yet, or no estimate is good enough */
+#define RPM_SHM_SOURCE_EDGE 1       /* The edge detector (the pulses) */
+#define RPM_SHM_SOURCE_SPECTRAL 2   /* The spectrum (--estimator spectral or fused) */
+
+/** One detected pulse */
+struct rpm_shm_pulse {
+	uint64_t sample_index;      /* Sample completing the rising edge, counted from start of stream */
+	uint64_t timestamp_ns;      /* CLOCK_MONOTONIC when published */
+	double period_in_samples;   /* Between interpolated crossings */
+	double rpm;
+	double filtered_rpm;
+};
+
+/** Latest state of the detector */
+struct rpm_shm_latest {
+	uint64_t num_pulses;        /* Pulses published so far (none with --estimator spectral or fused) */
+	uint64_t sample_index;
+	uint64_t timestamp_ns;      /* CLOCK_MONOTONIC when published */
+	double period_in_samples;
+	double rpm;
+	double filtered_rpm;
+	double threshold;
+	double hysteresis;
+	int32_t signal_min;
+	int32_t signal_max;
+	int32_t threshold_percentage;
+	int32_t sample_rate;
+	/* From the speed tracker (RPMRevolutionMeter --tracker), updated at its output rate */
+	uint64_t tracked_sample_index;  /* 0: not running */
+	double tracked_rpm;
+	int32_t tracked_locked;
+	/* From the stall detector (RPMRevolutionMeter --max_period), back to
+	 * RPM_SHM_RUNNING at the next pulse */
+	int32_t stall_state;
+	uint64_t stall_sample_index;    /* Of the last stall report */
+	double stall_rpm;               /* Highest rpm still possible, 0 when stopped */
+	/* Where sample_index, rpm and filtered_rpm come from (rpm not valid while
+	 * RPM_SHM_SOURCE_NONE). With --estimator spectral or fused, they are
+	 * updated for each spectral estimate, and there are no pulses. */
+	int32_t rpm_source;
+	int32_t reserved;
+};
+
+struct rpm_shm {
+	/* Constant after creation */
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;              /* sizeof(struct rpm_shm) */
+	uint32_t ring_size;
+
+	/* Odd while the writer is updating latest */
+	uint32_t latest_seq;
+	/* Readers blocked in rpm_shm_wait(). The writer only makes a syscall when non zero */
+	uint32_t num_waiters;
+	/* Futex word, incremented for each pulse */
+	uint32_t futex;
+	uint32_t reserved;
+
+	/* Pulses written to ring so far. Pulse i is stored in ring[i % RPM_SHM_RING_SIZE] */
+	uint64_t write_count;
+
+	struct rpm_shm_latest latest;
+	struct rpm_shm_pulse ring[RPM_SHM_RING_SIZE];
+};
+
+
+/**
+ * Maps an existing segment. It is mapped writable, since rpm_shm_wait()
+ * registers itself as a waiter, but readers never modify anything else.
+ * @param name  as given to --shm (without leading slash)
+ * @return NULL (with errno set) on failure, or if the segment has an unexpected layout
+ */
+static inline struct rpm_shm* rpm_shm_open_reader(const char* name)
+{
+	char path[256] = "/";
+	strncat(path, name, sizeof(path) - 2);
+	int fd = shm_open(path, O_RDWR, 0);
+	if (fd < 0)
+	{
+		return NULL;
+	}
+	void* p = mmap(NULL, sizeof(struct rpm_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+	{
+		return NULL;
+	}
+	struct rpm_shm* shm = (struct rpm_shm*)p;
+	if (shm->magic != RPM_SHM_MAGIC || shm->version != RPM_SHM_VERSION || shm->size != sizeof(struct rpm_shm))
+	{
+		munmap(p, sizeof(struct rpm_shm));
+		errno = EPROTO;
+		return NULL;
+	}
+	return shm;
+}
+
+static inline void rpm_shm_close_reader(struct rpm_shm* shm)
+{
+	munmap(shm, sizeof(struct rpm_shm));
+}
+
+/** Consistent copy of the latest values */
+static inline void rpm_shm_read_latest(const struct rpm_shm* shm, struct rpm_shm_latest* out)
+{
+	uint32_t before;
+	uint32_t after;
+	do
+	{
+		before = __atomic_load_n(&shm->latest_seq, __ATOMIC_ACQUIRE);
+		memcpy(out, (const void*)&shm->latest, sizeof(*out));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&shm->latest_seq, __ATOMIC_RELAXED);
+	} while ((before & 1) || before != after);
+}
+
+static inline uint64_t rpm_shm_get_write_count(const struct rpm_shm* shm)
+{
+	return __atomic_load_n(&shm->write_count, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Copies pulses with index *next and onwards (at most max_pulses), and
+ * advances *next past them.
+ *
+ * If the reader fell so far behind that pulses were overwritten, these are
+ * skipped and their number is reported through num_lost (if not NULL).
+ * @return number of pulses copied to out
+ */
+static inline size_t rpm_shm_read_pulses(const struct rpm_shm* shm, uint64_t* next,
+		struct rpm_shm_pulse* out, size_t max_pulses, uint64_t* num_lost)
+{
+	uint64_t lost = 0;
+	uint64_t end = rpm_shm_get_write_count(shm);
+	if (end - *next > RPM_SHM_RING_SIZE)
+	{
+		lost += end - RPM_SHM_RING_SIZE - *next;
+		*next = end - RPM_SHM_RING_SIZE;
+	}
+	if (end - *next > max_pulses)
+	{
+		end = *next + max_pulses;
+	}
+
+	size_t n = 0;
+	for (uint64_t i = *next; i < end; i++)
+	{
+		memcpy(&out[n++], (const void*)&shm->ring[i % RPM_SHM_RING_SIZE], sizeof(*out));
+	}
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	/* The writer is (possibly) writing pulse number write_count, so copies
+	 * of pulses sharing its slot, or older, may be torn. Drop those. */
+	uint64_t writeCount = __atomic_load_n(&shm->write_count, __ATOMIC_RELAXED);
+	uint64_t firstValid = writeCount >= RPM_SHM_RING_SIZE ? writeCount - RPM_SHM_RING_SIZE + 1 : 0;
+	if (*next < firstValid)
+	{
+		uint64_t numTorn = firstValid - *next;
+		if (numTorn > n)
+		{
+			numTorn = n;
+		}
+		memmove(out, out + numTorn, (n - numTorn) * sizeof(*out));
+		n -= numTorn;
+		lost += firstValid - *next;
+		*next = firstValid > end ? firstValid : end;
+	}
+	else
+	{
+		*next = end;
+	}
+
+	if (num_lost)
+	{
+		*num_lost = lost;
+	}
+	return n;
+}
+
+/**
+ * Blocks until pulse number next has been written (write count > next),
+ * or until timeout_ms passed (-1 waits forever).
+ * @return 1 if there are pulses to read, 0 on timeout
+ */
+static inline int rpm_shm_wait(struct rpm_shm* shm, uint64_t next, int timeout_ms)
+{
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	if (timeout_ms > 0)
+	{
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
+
+	while (1)
+	{
+		/* Read the futex word before checking, so a pulse published in
+		 * between makes FUTEX_WAIT return immediately */
+		uint32_t futexValue = __atomic_load_n(&shm->futex, __ATOMIC_ACQUIRE);
+		if (rpm_shm_get_write_count(shm) > next)
+		{
+			return 1;
+		}
+
+		struct timespec timeout;
+		struct timespec* timeoutPtr = NULL;
+		if (timeout_ms >= 0)
+		{
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			int64_t remainingNs = (int64_t)(deadline.tv_sec - now.tv_sec) * 1000000000LL +
+					(deadline.tv_nsec - now.tv_nsec);
+			if (remainingNs <= 0)
+			{
+				return 0;
+			}
+			timeout.tv_sec = remainingNs / 1000000000LL;
+			timeout.tv_nsec = remainingNs % 1000000000LL;
+			timeoutPtr = &timeout;
+		}
+
+		__atomic_add_fetch(&shm->num_waiters, 1, __ATOMIC_SEQ_CST);
+		syscall(SYS_futex, &shm->futex, FUTEX_WAIT, futexValue, timeoutPtr, NULL, 0);
+		__atomic_sub_fetch(&shm->num_waiters, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,373 @@
+/*
+ * rpm_udp.h
+ *
+ * Wire format of the datagrams sent by RPMRevolutionMeter --udp HOST:PORT.
+ * Plain C, so receivers can copy it into other projects.
+ *
+ * A datagram is a header followed by num_records records, all of the type
+ * given in the header. All fields are little endian, with no padding:
+ *
+ *   header (32 bytes)
+ *     u32 magic              RPM_UDP_MAGIC
+ *     u16 version            RPM_UDP_VERSION
+ *     u16 num_records
+ *     u32 rig_id
+ *     u16 channel
+ *     u16 type               RPM_UDP_TYPE_PULSES, RPM_UDP_TYPE_TRACKED, RPM_UDP_TYPE_STALL
+ *                            or RPM_UDP_TYPE_ESTIMATE
+ *     u64 sequence           Datagram number, starting at 0 (gaps = lost datagrams)
+ *     u64 first_record       Number of the first record in this datagram, counted
+ *                            separately for each type, starting at 0
+ *                            (gaps = lost records, either on the network or in the sender)
+ *   pulse (32 bytes each, RPM_UDP_TYPE_PULSES, with --estimator edge)
+ *     u64 sample_index       Sample completing the rising edge, counted from start of stream
+ *     u64 timestamp_ns       Sender CLOCK_MONOTONIC at detection
+ *     f64 period_in_samples
+ *     f64 rpm
+ *   tracked speed (32 bytes each, RPM_UDP_TYPE_TRACKED, with --tracker)
+ *     u64 sample_index       Time of the estimate, in samples from start of stream
+ *     u64 timestamp_ns       Sender CLOCK_MONOTONIC when it was made
+ *     f64 rpm
+ *     u32 flags              RPM_UDP_TRACKED_LOCKED
+ *     u32 reserved
+ *   stall (32 bytes each, RPM_UDP_TYPE_STALL, when the pulses stop, with --max_period)
+ *     u64 sample_index       Time of the report, in samples from start of stream
+ *     u64 timestamp_ns       Sender CLOCK_MONOTONIC when it was made
+ *     f64 rpm                Highest rpm still possible, 0 when stopped
+ *     u32 flags              RPM_UDP_STALL_STOPPED
+ *     u32 reserved
+ *   estimate (32 bytes each, RPM_UDP_TYPE_ESTIMATE, with --estimator spectral
+ *            or fused, in place of the pulses)
+ *     u64 sample_index       End of the analysed frame, in samples from start of stream
+ *     u64 timestamp_ns       Sender CLOCK_MONOTONIC when it was made
+ *     f64 rpm                0 when no estimate is good enough
+ *     u32 source             RPM_UDP_SOURCE_NONE, _EDGE or _SPECTRAL
+ *     u32 reserved
+ *
+ * Version 1 had only pulses, and 0 in place of type. Version 2 had no stall
+ * records, and version 3 no estimates.
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RPM_UDP_MAGIC 0x55504d52u   /* "RPMU" */
+#define RPM_UDP_VERSION 4u
+#define RPM_UDP_HEADER_SIZE 32u
+#define RPM_UDP_RECORD_SIZE 32u
+/* Keeps datagrams below a 1500 byte MTU */
+#define RPM_UDP_MAX_RECORDS 40u
+#define RPM_UDP_MAX_DATAGRAM_SIZE (RPM_UDP_HEADER_SIZE + RPM_UDP_MAX_RECORDS * RPM_UDP_RECORD_SIZE)
+
+#define RPM_UDP_TYPE_PULSES 0u
+#define RPM_UDP_TYPE_TRACKED 1u
+#define RPM_UDP_TYPE_STALL 2u
+#define RPM_UDP_TYPE_ESTIMATE 3u
+#define RPM_UDP_NUM_TYPES 4u
+
+#define RPM_UDP_TRACKED_LOCKED 1u    /* The tracker is locked to the pulses */
+#define RPM_UDP_STALL_STOPPED 1u     /* No pulse for --max_period (rpm is 0) */
+
+/* rpm_udp_estimate.source */
+#define RPM_UDP_SOURCE_NONE 0u       /* No estimate is good enough */
+#define RPM_UDP_SOURCE_EDGE 1u       /* The edge detector's filtered rpm (--estimator fused) */
+#define RPM_UDP_SOURCE_SPECTRAL 2u   /* The spectrum */
+
+struct rpm_udp_header {
+	uint16_t num_records;
+	uint32_t rig_id;
+	uint16_t channel;
+	uint16_t type;
+	uint64_t sequence;
+	uint64_t first_record;
+};
+
+struct rpm_udp_pulse {
+	uint64_t sample_index;
+	uint64_t timestamp_ns;
+	double period_in_samples;
+	double rpm;
+};
+
+struct rpm_udp_tracked {
+	uint64_t sample_index;
+	uint64_t timestamp_ns;
+	double rpm;
+	uint32_t flags;
+};
+
+struct rpm_udp_stall {
+	uint64_t sample_index;
+	uint64_t timestamp_ns;
+	double rpm;
+	uint32_t flags;
+};
+
+struct rpm_udp_estimate {
+	uint64_t sample_index;
+	uint64_t timestamp_ns;
+	double rpm;
+	uint32_t source;
+};
+
+
+static inline void rpm_udp_put_u64(uint8_t* p, uint64_t v)
+{
+	for (int i = 0; i < 8; i++)
+	{
+		p[i] = (uint8_t)(v >> (8 * i));
+	}
+}
+
+static inline uint64_t rpm_udp_get_u64(const uint8_t* p)
+{
+	uint64_t v = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		v |= (uint64_t)p[i] << (8 * i);
+	}
+	return v;
+}
+
+static inline void rpm_udp_put_u32(uint8_t* p, uint32_t v)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		p[i] = (uint8_t)(v >> (8 * i));
+	}
+}
+
+static inline uint32_t rpm_udp_get_u32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void rpm_udp_put_u16(uint8_t* p, uint16_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+static inline uint16_t rpm_udp_get_u16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline void rpm_udp_put_f64(uint8_t* p, double v)
+{
+	uint64_t bits;
+	memcpy(&bits, &v, sizeof(bits));
+	rpm_udp_put_u64(p, bits);
+}
+
+static inline double rpm_udp_get_f64(const uint8_t* p)
+{
+	uint64_t bits = rpm_udp_get_u64(p);
+	double v;
+	memcpy(&v, &bits, sizeof(v));
+	return v;
+}
+
+
+static inline uint8_t* rpm_udp_encode_header(uint8_t* buffer, const struct rpm_udp_header* header)
+{
+	rpm_udp_put_u32(buffer + 0, RPM_UDP_MAGIC);
+	rpm_udp_put_u16(buffer + 4, RPM_UDP_VERSION);
+	rpm_udp_put_u16(buffer + 6, header->num_records);
+	rpm_udp_put_u32(buffer + 8, header->rig_id);
+	rpm_udp_put_u16(buffer + 12, header->channel);
+	rpm_udp_put_u16(buffer + 14, header->type);
+	rpm_udp_put_u64(buffer + 16, header->sequence);
+	rpm_udp_put_u64(buffer + 24, header->first_record);
+	return buffer + RPM_UDP_HEADER_SIZE;
+}
+
+/**
+ * @param buffer  at least RPM_UDP_HEADER_SIZE + header->num_records * RPM_UDP_RECORD_SIZE bytes
+ * @param header  with type RPM_UDP_TYPE_PULSES
+ * @return datagram size in bytes
+ */
+static inline size_t rpm_udp_encode(uint8_t* buffer, const struct rpm_udp_header* header,
+		const struct rpm_udp_pulse* pulses)
+{
+	uint8_t* p = rpm_udp_encode_header(buffer, header);
+	for (unsigned i = 0; i < header->num_records; i++, p += RPM_UDP_RECORD_SIZE)
+	{
+		rpm_udp_put_u64(p + 0, pulses[i].sample_index);
+		rpm_udp_put_u64(p + 8, pulses[i].timestamp_ns);
+		rpm_udp_put_f64(p + 16, pulses[i].period_in_samples);
+		rpm_udp_put_f64(p + 24, pulses[i].rpm);
+	}
+	return p - buffer;
+}
+
+/**
+ * @param buffer  at least RPM_UDP_HEADER_SIZE + header->num_records * RPM_UDP_RECORD_SIZE bytes
+ * @param header  with type RPM_UDP_TYPE_TRACKED
+ * @return datagram size in bytes
+ */
+static inline size_t rpm_udp_encode_tracked(uint8_t* buffer, const struct rpm_udp_header* header,
+		const struct rpm_udp_tracked* tracked)
+{
+	uint8_t* p = rpm_udp_encode_header(buffer, header);
+	for (unsigned i = 0; i < header->num_records; i++, p += RPM_UDP_RECORD_SIZE)
+	{
+		rpm_udp_put_u64(p + 0, tracked[i].sample_index);
+		rpm_udp_put_u64(p + 8, tracked[i].timestamp_ns);
+		rpm_udp_put_f64(p + 16, tracked[i].rpm);
+		rpm_udp_put_u32(p + 24, tracked[i].flags);
+		rpm_udp_put_u32(p + 28, 0);
+	}
+	return p - buffer;
+}
+
+/**
+ * @param buffer  at least RPM_UDP_HEADER_SIZE + header->num_records * RPM_UDP_RECORD_SIZE bytes
+ * @param header  with type RPM_UDP_TYPE_STALL
+ * @return datagram size in bytes
+ */
+static inline size_t rpm_udp_encode_stall(uint8_t* buffer, const struct rpm_udp_header* header,
+		const struct rpm_udp_stall* stall)
+{
+	uint8_t* p = rpm_udp_encode_header(buffer, header);
+	for (unsigned i = 0; i < header->num_records; i++, p += RPM_UDP_RECORD_SIZE)
+	{
+		rpm_udp_put_u64(p + 0, stall[i].sample_index);
+		rpm_udp_put_u64(p + 8, stall[i].timestamp_ns);
+		rpm_udp_put_f64(p + 16, stall[i].rpm);
+		rpm_udp_put_u32(p + 24, stall[i].flags);
+		rpm_udp_put_u32(p + 28, 0);
+	}
+	return p - buffer;
+}
+
+/**
+ * @param buffer  at least RPM_UDP_HEADER_SIZE + header->num_records * RPM_UDP_RECORD_SIZE bytes
+ * @param header  with type RPM_UDP_TYPE_ESTIMATE
+ * @return datagram size in bytes
+ */
+static inline size_t rpm_udp_encode_estimate(uint8_t* buffer, const struct rpm_udp_header* header,
+		const struct rpm_udp_estimate* estimates)
+{
+	uint8_t* p = rpm_udp_encode_header(buffer, header);
+	for (unsigned i = 0; i < header->num_records; i++, p += RPM_UDP_RECORD_SIZE)
+	{
+		rpm_udp_put_u64(p + 0, estimates[i].sample_index);
+		rpm_udp_put_u64(p + 8, estimates[i].timestamp_ns);
+		rpm_udp_put_f64(p + 16, estimates[i].rpm);
+		rpm_udp_put_u32(p + 24, estimates[i].source);
+		rpm_udp_put_u32(p + 28, 0);
+	}
+	return p - buffer;
+}
+
+/**
+ * Checks the datagram and reads its header. The records are then read with
+ * rpm_udp_decode_pulses(), rpm_udp_decode_tracked(), rpm_udp_decode_stall() or
+ * rpm_udp_decode_estimate(), depending on header->type.
+ * @return 0 on success, -1 if the datagram is not a valid datagram of a known type
+ */
+static inline int rpm_udp_decode_header(const uint8_t* buffer, size_t size, struct rpm_udp_header* header)
+{
+	if (size < RPM_UDP_HEADER_SIZE ||
+			rpm_udp_get_u32(buffer) != RPM_UDP_MAGIC ||
+			rpm_udp_get_u16(buffer + 4) != RPM_UDP_VERSION)
+	{
+		return -1;
+	}
+	header->num_records = rpm_udp_get_u16(buffer + 6);
+	header->rig_id = rpm_udp_get_u32(buffer + 8);
+	header->channel = rpm_udp_get_u16(buffer + 12);
+	header->type = rpm_udp_get_u16(buffer + 14);
+	header->sequence = rpm_udp_get_u64(buffer + 16);
+	header->first_record = rpm_udp_get_u64(buffer + 24);
+	if (header->type >= RPM_UDP_NUM_TYPES ||
+			header->num_records > RPM_UDP_MAX_RECORDS ||
+			size != RPM_UDP_HEADER_SIZE + header->num_records * RPM_UDP_RECORD_SIZE)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @param header  from rpm_udp_decode_header(), with type RPM_UDP_TYPE_PULSES
+ * @param pulses  room for header->num_records (at most RPM_UDP_MAX_RECORDS)
+ */
+static inline void rpm_udp_decode_pulses(const uint8_t* buffer, const struct rpm_udp_header* header,
+		struct rpm_udp_pulse* pulses)
+{
+	const uint8_t* p = buffer + RPM_UDP_HEADER_SIZE;
+	for (unsigned i = 0; i < header->num_records; i++, p += RPM_UDP_RECORD_SIZE)
+	{
+		pulses[i].sample_index = rpm_udp_get_u64(p + 0);
+		pulses[i].timestamp_ns = rpm_udp_get_u64(p + 8);
+		pulses[i].period_in_samples = rpm_udp_get_f64(p + 16);
+		pulses[i].rpm = rpm_udp_get_f64(p + 24);
+	}
+}
+
+/**
+ * @param header   from rpm_udp_decode_header(), with type RPM_UDP_TYPE_TRACKED
+ * @param tracked  room for header->num_records (at most RPM_UDP_MAX_RECORDS)
+ */
+static inline void rpm_udp_decode_tracked(const uint8_t* buffer, const struct rpm_udp_header* header,
+		struct rpm_udp_tracked* tracked)
+{
+	const uint8_t* p = buffer + RPM_UDP_HEADER_SIZE;
+	for (unsigned i = 0; i < header->num_records; i++, p += RPM_UDP_RECORD_SIZE)
+	{
+		tracked[i].sample_index = rpm_udp_get_u64(p + 0);
+		tracked[i].timestamp_ns = rpm_udp_get_u64(p + 8);
+		tracked[i].rpm = rpm_udp_get_f64(p + 16);
+		tracked[i].flags = rpm_udp_get_u32(p + 24);
+	}
+}
+
+/**
+ * @param header  from rpm_udp_decode_header(), with type RPM_UDP_TYPE_STALL
+ * @param stall   room for header->num_records (at most RPM_UDP_MAX_RECORDS)
+ */
+static inline void rpm_udp_decode_stall(const uint8_t* buffer, const struct rpm_udp_header* header,
+		struct rpm_udp_stall* stall)
+{
+	const uint8_t* p = buffer + RPM_UDP_HEADER_SIZE;
+	for (unsigned i = 0; i < header->num_records; i++, p += RPM_UDP_RECORD_SIZE)
+	{
+		stall[i].sample_index = rpm_udp_get_u64(p + 0);
+		stall[i].timestamp_ns = rpm_udp_get_u64(p + 8);
+		stall[i].rpm = rpm_udp_get_f64(p + 16);
+		stall[i].flags = rpm_udp_get_u32(p + 24);
+	}
+}
+
+/**
+ * @param header     from rpm_udp_decode_header(), with type RPM_UDP_TYPE_ESTIMATE
+ * @param estimates  room for header->num_records (at most RPM_UDP_MAX_RECORDS)
+ */
+static inline void rpm_udp_decode_estimate(const uint8_t* buffer, const struct rpm_udp_header* header,
+		struct rpm_udp_estimate* estimates)
+{
+	const uint8_t* p = buffer + RPM_UDP_HEADER_SIZE;
+	for (unsigned i = 0; i < header->num_records; i++, p += RPM_UDP_RECORD_SIZE)
+	{
+		estimates[i].sample_index = rpm_udp_get_u64(p + 0);
+		estimates[i].timestamp_ns = rpm_udp_get_u64(p + 8);
+		estimates[i].rpm = rpm_udp_get_f64(p + 16);
+		estimates[i].source = rpm_udp_get_u32(p + 24);
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,88 @@
+/*
+ * BlockKernels_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../StreamProcessors/BlockKernels.hpp"
+
+#include <limits>
+#include <vector>
+
+
+BOOST_AUTO_TEST_SUITE(BlockKernels_Test)
+
+
+BOOST_AUTO_TEST_CASE(findFirstOutside)
+{
+	std::vector<int16_t> samples(100, 5);
+	BOOST_CHECK_EQUAL(100u, BlockKernels::findFirstOutside(&samples[0], samples.size(), 0, 10));
+	BOOST_CHECK_EQUAL(100u, BlockKernels::findFirstOutside(&samples[0], samples.size(), 5, 5));
+	BOOST_CHECK_EQUAL(0u, BlockKernels::findFirstOutside(&samples[0], samples.size(), 6, 10));
+
+	// In the whole chunks, and in the tail
+	samples[37] = 11;
+	BOOST_CHECK_EQUAL(37u, BlockKernels::findFirstOutside(&samples[0], samples.size(), 0, 10));
+	samples[37] = 5;
+	samples[98] = -1;
+	BOOST_CHECK_EQUAL(98u, BlockKernels::findFirstOutside(&samples[0], samples.size(), 0, 10));
+
+	BOOST_CHECK_EQUAL(0u, BlockKernels::findFirstOutside(&samples[0], 0, 0, 10));
+}
+
+BOOST_AUTO_TEST_CASE(findFirstOutsideWithLimitsOutside16Bits)
+{
+	std::vector<int16_t> samples(40, std::numeric_limits<int16_t>::max());
+	samples[0] = std::numeric_limits<int16_t>::min();
+	BOOST_CHECK_EQUAL(40u, BlockKernels::findFirstOutside(&samples[0], samples.size(),
+			std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max()));
+	BOOST_CHECK_EQUAL(1u, BlockKernels::findFirstOutside(&samples[0], samples.size(),
+			std::numeric_limits<int32_t>::min(), 32766));
+	// Empty range
+	BOOST_CHECK_EQUAL(0u, BlockKernels::findFirstOutside(&samples[0], samples.size(), 100000, 99999));
+}
+
+BOOST_AUTO_TEST_CASE(accumulateMinMax)
+{
+	const int16_t samples[] = { 3, -7, 12, 0, 5 };
+	int16_t lo = std::numeric_limits<int16_t>::max();
+	int16_t hi = std::numeric_limits<int16_t>::min();
+	BlockKernels::accumulateMinMax(samples, 5, lo, hi);
+	BOOST_CHECK_EQUAL(-7, lo);
+	BOOST_CHECK_EQUAL(12, hi);
+
+	BlockKernels::accumulateMinMax(samples, 2, lo, hi);
+	BOOST_CHECK_EQUAL(-7, lo);
+	BOOST_CHECK_EQUAL(12, hi);
+}
+
+BOOST_AUTO_TEST_CASE(convertToFloatAndBack)
+{
+	const int16_t samples[] = { 1, 100, -2, 200, 32767, 300, -32768, 400 };
+	float values[4];
+	BlockKernels::convertToFloat(samples, 4, 2, values);
+	BOOST_CHECK_EQUAL(1.0f, values[0]);
+	BOOST_CHECK_EQUAL(-2.0f, values[1]);
+	BOOST_CHECK_EQUAL(32767.0f, values[2]);
+	BOOST_CHECK_EQUAL(-32768.0f, values[3]);
+	BlockKernels::convertToFloat(samples + 1, 2, 1, values);
+	BOOST_CHECK_EQUAL(100.0f, values[0]);
+	BOOST_CHECK_EQUAL(-2.0f, values[1]);
+
+	// Rounded to nearest, and saturated
+	const float toConvert[] = { 1.4f, 1.6f, -1.4f, -1.6f, 40000.0f, -40000.0f };
+	int16_t out[6];
+	BlockKernels::convertToInt16(toConvert, 6, out);
+	BOOST_CHECK_EQUAL(1, out[0]);
+	BOOST_CHECK_EQUAL(2, out[1]);
+	BOOST_CHECK_EQUAL(-1, out[2]);
+	BOOST_CHECK_EQUAL(-2, out[3]);
+	BOOST_CHECK_EQUAL(32767, out[4]);
+	BOOST_CHECK_EQUAL(-32768, out[5]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
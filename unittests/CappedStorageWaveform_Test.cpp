@@ -15,14 +15,17 @@
 #define BRACED_INIT_LIST(...) {__VA_ARGS__}
 /**
  * Usage:
- * std::vector<int16_t> right = ...;
- * CHECK_VECTORS((0, 1, 2), right);
+ * CHECK_BINS((0, 2, 4), (1, 3, 4), w);
+ * (expected min values, expected max values, waveform)
  */
-#define CHECK_VECTORS(L, R) { \
-	std::vector<int16_t> left(BRACED_INIT_LIST L); \
-	BOOST_REQUIRE_EQUAL(left.size(), R.size()); \
-	for (size_t i = 0; i < left.size(); i++) { \
-		BOOST_CHECK_EQUAL(left[i], R[i]); \
+#define CHECK_BINS(MINS, MAXS, W) { \
+	std::vector<int16_t> mins(BRACED_INIT_LIST MINS); \
+	std::vector<int16_t> maxs(BRACED_INIT_LIST MAXS); \
+	BOOST_REQUIRE_EQUAL(mins.size(), maxs.size()); \
+	BOOST_REQUIRE_EQUAL(mins.size(), W.size()); \
+	for (size_t i = 0; i < mins.size(); i++) { \
+		BOOST_CHECK_EQUAL(mins[i], W[i].min); \
+		BOOST_CHECK_EQUAL(maxs[i], W[i].max); \
 	} \
 }
 
@@ -32,161 +35,124 @@ BOOST_AUTO_TEST_SUITE(CappedStorageWaveform_Test)
 BOOST_AUTO_TEST_CASE(construction)
 {
 	CappedStorageWaveform w;
+	BOOST_CHECK_EQUAL(0, w.size());
+	BOOST_CHECK_EQUAL(1, w.getSamplesPerBin());
 }
 
-BOOST_AUTO_TEST_CASE(beforeCompaction)
+BOOST_AUTO_TEST_CASE(beforeMerge)
 {
 	CappedStorageWaveform w(4);
 
 	w.push(0);
-	BOOST_CHECK_EQUAL(1, w.getWaveform().size());
-	CHECK_VECTORS((0), w.getWaveform());
+	CHECK_BINS((0), (0), w);
 	w.push(1);
-	BOOST_CHECK_EQUAL(2, w.getWaveform().size());
-	CHECK_VECTORS((0, 1), w.getWaveform());
+	CHECK_BINS((0, 1), (0, 1), w);
 	w.push(2);
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 1, 2), w.getWaveform());
-	w.push(3);
-	BOOST_CHECK_EQUAL(4, w.getWaveform().size());
-	CHECK_VECTORS((0, 1, 2, 3), w.getWaveform());
+	CHECK_BINS((0, 1, 2), (0, 1, 2), w);
+	BOOST_CHECK_EQUAL(1, w.getSamplesPerBin());
 }
 
-BOOST_AUTO_TEST_CASE(after1Compaction)
+BOOST_AUTO_TEST_CASE(after1Merge)
 {
 	CappedStorageWaveform w(4);
 
 	w.push(0);
-	BOOST_CHECK_EQUAL(1, w.getWaveform().size());
-	CHECK_VECTORS((0), w.getWaveform());
 	w.push(1);
-	BOOST_CHECK_EQUAL(2, w.getWaveform().size());
-	CHECK_VECTORS((0, 1), w.getWaveform());
 	w.push(2);
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 1, 2), w.getWaveform());
-	w.push(3);
-	BOOST_CHECK_EQUAL(4, w.getWaveform().size());
-	CHECK_VECTORS((0, 1, 2, 3), w.getWaveform());
+	w.push(3); // Fills last bin, triggering the first merge
+	BOOST_CHECK_EQUAL(2, w.getSamplesPerBin());
+	CHECK_BINS((0, 2), (1, 3), w);
 
-	w.push(4); // Triggers first compaction
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 2, 4), w.getWaveform());
+	w.push(4); // Partially filled bin
+	CHECK_BINS((0, 2, 4), (1, 3, 4), w);
 
 	w.push(5);
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 2, 4), w.getWaveform());
+	CHECK_BINS((0, 2, 4), (1, 3, 5), w);
 
 	w.push(6);
-	BOOST_CHECK_EQUAL(4, w.getWaveform().size());
-	CHECK_VECTORS((0, 2, 4, 6), w.getWaveform());
+	CHECK_BINS((0, 2, 4, 6), (1, 3, 5, 6), w);
 }
 
-BOOST_AUTO_TEST_CASE(severalCompactions)
+BOOST_AUTO_TEST_CASE(severalMerges)
 {
 	CappedStorageWaveform w(4);
 
-	w.push(0);
-	BOOST_CHECK_EQUAL(1, w.getWaveform().size());
-	CHECK_VECTORS((0), w.getWaveform());
-	w.push(1);
-	BOOST_CHECK_EQUAL(2, w.getWaveform().size());
-	CHECK_VECTORS((0, 1), w.getWaveform());
-	w.push(2);
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 1, 2), w.getWaveform());
-	w.push(3);
-	BOOST_CHECK_EQUAL(4, w.getWaveform().size());
-	CHECK_VECTORS((0, 1, 2, 3), w.getWaveform());
-
-
-	w.push(4); // Triggers first compaction
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 2, 4), w.getWaveform());
-
-	w.push(5);
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 2, 4), w.getWaveform());
+	for (int i = 0; i < 8; i++)
+	{
+		w.push(i);
+	}
+	BOOST_CHECK_EQUAL(4, w.getSamplesPerBin());
+	CHECK_BINS((0, 4), (3, 7), w);
+
+	for (int i = 8; i < 16; i++)
+	{
+		w.push(i);
+	}
+	BOOST_CHECK_EQUAL(8, w.getSamplesPerBin());
+	CHECK_BINS((0, 8), (7, 15), w);
+
+	w.push(16);
+	CHECK_BINS((0, 8, 16), (7, 15, 16), w);
+}
 
-	w.push(6);
-	BOOST_CHECK_EQUAL(4, w.getWaveform().size());
-	CHECK_VECTORS((0, 2, 4, 6), w.getWaveform());
+BOOST_AUTO_TEST_CASE(narrowPulseIsNeverLost)
+{
+	CappedStorageWaveform w(16);
+
+	const int numSamples = 100000;
+	const int pulsePos = 12345;
+	for (int i = 0; i < numSamples; i++)
+	{
+		w.push(i == pulsePos ? 1000 : -5);
+	}
+
+	BOOST_CHECK(w.size() <= 16);
+	int16_t maxSeen = -32768;
+	for (size_t i = 0; i < w.size(); i++)
+	{
+		maxSeen = std::max(maxSeen, w[i].max);
+		BOOST_CHECK_EQUAL(-5, w[i].min);
+	}
+	BOOST_CHECK_EQUAL(1000, maxSeen);
+}
 
+BOOST_AUTO_TEST_CASE(clearWithoutPreTrigger)
+{
+	CappedStorageWaveform w(4);
 
-	w.push(7); // Triggers second compaction
-	BOOST_CHECK_EQUAL(4, w.getWaveform().size());
-	CHECK_VECTORS((0, 2, 4, 6), w.getWaveform());
+	for (int i = 0; i < 10; i++)
+	{
+		w.push(i);
+	}
+	w.clear();
+	BOOST_CHECK_EQUAL(0, w.size());
+	BOOST_CHECK_EQUAL(1, w.getSamplesPerBin());
+	BOOST_CHECK_EQUAL(0, w.getNumPreTriggerSamples());
+
+	w.push(42);
+	CHECK_BINS((42), (42), w);
+}
 
-	w.push(8);
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 4, 8), w.getWaveform());
+BOOST_AUTO_TEST_CASE(clearKeepsPreTriggerSamples)
+{
+	CappedStorageWaveform w(8, 3);
 
-	w.push(9);
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 4, 8), w.getWaveform());
+	w.push(1);
+	w.push(2);
+	w.clear();
+	BOOST_CHECK_EQUAL(2, w.getNumPreTriggerSamples());
+	CHECK_BINS((1, 2), (1, 2), w);
+
+	for (int i = 3; i < 10; i++)
+	{
+		w.push(i);
+	}
+	w.clear();
+	BOOST_CHECK_EQUAL(3, w.getNumPreTriggerSamples());
+	CHECK_BINS((7, 8, 9), (7, 8, 9), w);
 
 	w.push(10);
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 4, 8), w.getWaveform());
-
-	w.push(11);
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 4, 8), w.getWaveform());
-
-	w.push(12);
-	BOOST_CHECK_EQUAL(4, w.getWaveform().size());
-	CHECK_VECTORS((0, 4, 8, 12), w.getWaveform());
-
-
-	w.push(13);
-	BOOST_CHECK_EQUAL(4, w.getWaveform().size());
-	CHECK_VECTORS((0, 4, 8, 12), w.getWaveform());
-
-	w.push(14);
-	BOOST_CHECK_EQUAL(4, w.getWaveform().size());
-	CHECK_VECTORS((0, 4, 8, 12), w.getWaveform());
-
-	w.push(15);
-	BOOST_CHECK_EQUAL(4, w.getWaveform().size());
-	CHECK_VECTORS((0, 4, 8, 12), w.getWaveform());
-
-
-	w.push(16); // Triggers third compaction
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 8, 16), w.getWaveform());
-
-	w.push(17);
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 8, 16), w.getWaveform());
-
-	w.push(18);
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 8, 16), w.getWaveform());
-
-	w.push(19);
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 8, 16), w.getWaveform());
-
-	w.push(20);
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 8, 16), w.getWaveform());
-
-	w.push(21);
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 8, 16), w.getWaveform());
-
-	w.push(22);
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 8, 16), w.getWaveform());
-
-	w.push(23);
-	BOOST_CHECK_EQUAL(3, w.getWaveform().size());
-	CHECK_VECTORS((0, 8, 16), w.getWaveform());
-
-
-	w.push(24);
-	BOOST_CHECK_EQUAL(4, w.getWaveform().size());
-	CHECK_VECTORS((0, 8, 16, 24), w.getWaveform());
+	CHECK_BINS((7, 8, 9, 10), (7, 8, 9, 10), w);
 }
 
 BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,91 @@
+/*
+ * CicDecimator_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../StreamProcessors/CicDecimator.hpp"
+
+#include <math.h>
+
+#include <vector>
+
+
+BOOST_AUTO_TEST_SUITE(CicDecimator_Test)
+
+
+BOOST_AUTO_TEST_CASE(constantKeepsItsValue)
+{
+	// Also through wrap around of the integrators, with full scale input
+	const int16_t values[] = { 1234, -32768, 32767 };
+	for (int16_t value : values)
+	{
+		CicDecimator cic(16, 3);
+		std::vector<int16_t> in(100000, value);
+		std::vector<int16_t> out(in.size() / 16 + 1);
+		size_t n = cic.process(in.data(), in.size(), 1, out.data());
+		BOOST_REQUIRE_EQUAL(in.size() / 16, n);
+		BOOST_CHECK_EQUAL(value, out[n - 1]);
+		BOOST_CHECK_EQUAL(value, out[3]);   // Settled after order outputs
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(orderOneIsBlockAverage)
+{
+	CicDecimator cic(4, 1);
+	const int16_t in[] = { 1, 2, 3, 6, 10, 10, 10, 10, 0, 0 };
+	int16_t out[3];
+	BOOST_REQUIRE_EQUAL(2u, cic.process(in, 10, 1, out));
+	BOOST_CHECK_EQUAL(3, out[0]);
+	BOOST_CHECK_EQUAL(10, out[1]);
+
+	// Continues where the last call ended
+	const int16_t more[] = { 8, 8 };
+	BOOST_REQUIRE_EQUAL(1u, cic.process(more, 2, 1, out));
+	BOOST_CHECK_EQUAL(4, out[0]);
+}
+
+
+BOOST_AUTO_TEST_CASE(strided)
+{
+	CicDecimator a(3, 2);
+	CicDecimator b(3, 2);
+	std::vector<int16_t> mono(300);
+	std::vector<int16_t> stereo(600, -5);
+	for (size_t i = 0; i < mono.size(); i++)
+	{
+		mono[i] = stereo[2 * i] = int16_t(1000 * sin(i * 0.1));
+	}
+	std::vector<int16_t> outA(101);
+	std::vector<int16_t> outB(101);
+	BOOST_REQUIRE_EQUAL(100u, a.process(mono.data(), mono.size(), 1, outA.data()));
+	BOOST_REQUIRE_EQUAL(100u, b.process(stereo.data(), mono.size(), 2, outB.data()));
+	BOOST_CHECK(outA == outB);
+}
+
+
+BOOST_AUTO_TEST_CASE(attenuatesAliases)
+{
+	// A tone at the decimated sample rate aliases to DC; the zeros of the
+	// moving averages are exactly there
+	CicDecimator cic(8, 2);
+	std::vector<int16_t> in(8000);
+	for (size_t i = 0; i < in.size(); i++)
+	{
+		in[i] = int16_t(10000 * cos(2 * M_PI * i / 8));
+	}
+	std::vector<int16_t> out(1001);
+	size_t n = cic.process(in.data(), in.size(), 1, out.data());
+	for (size_t i = 2; i < n; i++)
+	{
+		BOOST_CHECK_SMALL(int(out[i]), 2);
+	}
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
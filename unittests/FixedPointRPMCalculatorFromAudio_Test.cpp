@@ -0,0 +1,271 @@
+/*
+ * FixedPointRPMCalculatorFromAudio_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../FixedPointRPMCalculatorFromAudio.hpp"
+#include "../RPMCalculatorFromAudio.hpp"
+#include "../SignalGenerator/TachometerSignalGenerator.hpp"
+
+#include <stdlib.h>
+
+#include <vector>
+
+namespace {
+
+std::vector<int16_t> makeSignal(const TachometerSignalGenerator::Parameters& params, double seconds)
+{
+	TachometerSignalGenerator gen(params);
+	std::vector<int16_t> signal(seconds * params.sampleRate);
+	for (size_t i = 0; i < signal.size(); i++)
+	{
+		signal[i] = gen.next();
+	}
+	return signal;
+}
+
+template<class Detector>
+std::vector<PulseEvent> runDetector(const std::vector<int16_t>& signal, int sampleRate, size_t blockSize, int divisor = 1)
+{
+	std::vector<PulseEvent> pulses;
+	Detector detector(sampleRate, divisor);
+	detector.setPulseCallback([&](const PulseEvent& event) { pulses.push_back(event); });
+	for (size_t pos = 0; pos < signal.size(); pos += blockSize)
+	{
+		detector.processBlock(&signal[pos], std::min(blockSize, signal.size() - pos));
+	}
+	return pulses;
+}
+
+/**
+ * The tolerances the fixed point detector is validated against:
+ * - at most one pulse more or less than the float reference
+ * - at least 99% of the pulses at exactly the same sample, and the rest at most one sample off
+ * - when a pulse and the one before it are at the same samples as in the
+ *   reference, rpm within 1/256 rpm (the Q8 resolution) plus 0.01%
+ */
+void checkWithinTolerance(const std::vector<PulseEvent>& reference, const std::vector<PulseEvent>& fixed)
+{
+	BOOST_REQUIRE(reference.size() > 50);
+	BOOST_CHECK(labs(long(reference.size()) - long(fixed.size())) <= 1);
+
+	size_t j = 0;
+	size_t numExact = 0;
+	bool previousExact = false;
+	for (size_t i = 0; i < reference.size(); i++)
+	{
+		const PulseEvent& r = reference[i];
+		while (j < fixed.size() && fixed[j].sampleIndex + 1 < r.sampleIndex)
+		{
+			j++;
+		}
+		BOOST_REQUIRE(j < fixed.size());
+		const PulseEvent& f = fixed[j];
+		BOOST_CHECK(labs(long(f.sampleIndex) - long(r.sampleIndex)) <= 1);
+		bool exact = f.sampleIndex == r.sampleIndex;
+		if (exact)
+		{
+			numExact++;
+		}
+		if (exact && previousExact)
+		{
+			BOOST_CHECK_SMALL(f.rpm - r.rpm, 1.0 / 256 + r.rpm * 1e-4);
+		}
+		previousExact = exact;
+	}
+	BOOST_CHECK(numExact >= reference.size() * 99 / 100);
+}
+
+} // namespace
+
+
+BOOST_AUTO_TEST_SUITE(FixedPointRPMCalculatorFromAudio_Test)
+
+
+BOOST_AUTO_TEST_CASE(matchesFloatReference)
+{
+	TachometerSignalGenerator::Parameters constant;
+	constant.rpm = PiecewiseLinearProfile(1500);
+	constant.noise = 100;
+
+	TachometerSignalGenerator::Parameters ramp;
+	ramp.rpm.addPoint(0, 600);
+	ramp.rpm.addPoint(6, 6000);
+	ramp.noise = 300;
+	ramp.jitter = 0.002;
+
+	TachometerSignalGenerator::Parameters fast;
+	fast.rpm = PiecewiseLinearProfile(30000);
+	fast.noise = 50;
+
+	TachometerSignalGenerator::Parameters fading;
+	fading.rpm = PiecewiseLinearProfile(2400);
+	fading.amplitude.addPoint(0, 20000);
+	fading.amplitude.addPoint(6, 400);
+	fading.dcDrift = 2000;
+	fading.dcDriftPeriod = 3;
+
+	const TachometerSignalGenerator::Parameters cases[] = { constant, ramp, fast, fading };
+	for (const TachometerSignalGenerator::Parameters& params : cases)
+	{
+		std::vector<int16_t> signal = makeSignal(params, 6);
+		std::vector<PulseEvent> reference = runDetector<RPMCalculatorFromAudio>(signal, params.sampleRate, 1024);
+		std::vector<PulseEvent> fixed = runDetector<FixedPointRPMCalculatorFromAudio>(signal, params.sampleRate, 1024);
+		checkWithinTolerance(reference, fixed);
+		BOOST_CHECK_CLOSE(reference.back().filteredRpm, fixed.back().filteredRpm, 0.1);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(blockSizeAndStrideDoNotMatter)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm.addPoint(0, 1000);
+	params.rpm.addPoint(3, 9000);
+	params.noise = 200;
+	std::vector<int16_t> signal = makeSignal(params, 3);
+
+	std::vector<PulseEvent> perSample;
+	FixedPointRPMCalculatorFromAudio detector(params.sampleRate, 2);
+	detector.setPulseCallback([&](const PulseEvent& event) { perSample.push_back(event); });
+	for (size_t i = 0; i < signal.size(); i++)
+	{
+		detector.check(signal[i]);
+	}
+
+	// Interleaved with a second channel, which must be ignored
+	std::vector<int16_t> stereo(signal.size() * 2);
+	for (size_t i = 0; i < signal.size(); i++)
+	{
+		stereo[2 * i] = signal[i];
+		stereo[2 * i + 1] = (i & 1) ? 30000 : -30000;
+	}
+	std::vector<PulseEvent> interleaved;
+	FixedPointRPMCalculatorFromAudio stereoDetector(params.sampleRate, 2);
+	stereoDetector.setPulseCallback([&](const PulseEvent& event) { interleaved.push_back(event); });
+	stereoDetector.processBlock(&stereo[0], signal.size(), 2);
+
+	std::vector<PulseEvent> blocks = runDetector<FixedPointRPMCalculatorFromAudio>(signal, params.sampleRate, 4096, 2);
+
+	BOOST_REQUIRE(perSample.size() > 100);
+	BOOST_REQUIRE_EQUAL(perSample.size(), interleaved.size());
+	BOOST_REQUIRE_EQUAL(perSample.size(), blocks.size());
+	for (size_t i = 0; i < perSample.size(); i++)
+	{
+		BOOST_CHECK_EQUAL(perSample[i].sampleIndex, interleaved[i].sampleIndex);
+		BOOST_CHECK_EQUAL(perSample[i].sampleIndex, blocks[i].sampleIndex);
+		BOOST_CHECK_EQUAL(perSample[i].rpm, blocks[i].rpm);
+		BOOST_CHECK_EQUAL(perSample[i].filteredRpm, blocks[i].filteredRpm);
+		BOOST_CHECK_EQUAL(perSample[i].threshold, blocks[i].threshold);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(thresholdPercentage)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm = PiecewiseLinearProfile(3000);
+	std::vector<int16_t> signal = makeSignal(params, 2);
+
+	FixedPointRPMCalculatorFromAudio detector(params.sampleRate, 1);
+	std::vector<PulseEvent> pulses;
+	detector.setPulseCallback([&](const PulseEvent& event) { pulses.push_back(event); });
+	detector.setThresholdPercentage(25);
+	BOOST_CHECK_EQUAL(25, detector.getThresholdPercentage());
+	detector.processBlock(&signal[0], signal.size());
+
+	BOOST_REQUIRE(pulses.size() > 50);
+	const PulseEvent& last = pulses.back();
+	BOOST_CHECK_EQUAL(25, last.thresholdInPercentage);
+	BOOST_CHECK_CLOSE(last.signalMin + 0.25 * (last.signalMax - last.signalMin), last.threshold, 0.1);
+	BOOST_CHECK_EQUAL((last.signalMax - last.signalMin) / 8, last.hysteresis);
+}
+
+BOOST_AUTO_TEST_CASE(rangeQuantilesMatchFloatReference)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm = PiecewiseLinearProfile(2000);
+	params.noise = 200;
+	std::vector<int16_t> signal = makeSignal(params, 3);
+	signal[params.sampleRate] = -32768;
+
+	std::vector<PulseEvent> pulses[2];
+	RPMCalculatorFromAudio reference(params.sampleRate, 1);
+	FixedPointRPMCalculatorFromAudio fixed(params.sampleRate, 1);
+	reference.setRangeQuantiles(2, 98);
+	fixed.setRangeQuantiles(2, 98);
+	reference.setPulseCallback([&](const PulseEvent& event) { pulses[0].push_back(event); });
+	fixed.setPulseCallback([&](const PulseEvent& event) { pulses[1].push_back(event); });
+	reference.processBlock(&signal[0], signal.size());
+	fixed.processBlock(&signal[0], signal.size());
+
+	BOOST_REQUIRE(pulses[0].size() > 90);
+	checkWithinTolerance(pulses[0], pulses[1]);
+	BOOST_CHECK_CLOSE(2000.0, pulses[1].back().rpm, 1.0);
+}
+
+BOOST_AUTO_TEST_CASE(rangeWindowMatchesFloatReference)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm = PiecewiseLinearProfile(9000);
+	params.rpm.addPoint(1.5, 9000);
+	params.rpm.addPoint(1.6, 1200);
+	params.amplitude = PiecewiseLinearProfile(10000);
+	params.amplitude.addPoint(2.5, 10000);
+	params.amplitude.addPoint(2.51, 3000);
+	params.noise = 100;
+	std::vector<int16_t> signal = makeSignal(params, 4);
+
+	std::vector<PulseEvent> pulses[2];
+	RPMCalculatorFromAudio reference(params.sampleRate, 1);
+	FixedPointRPMCalculatorFromAudio fixed(params.sampleRate, 1);
+	reference.setRangeWindowPeriods(6);
+	fixed.setRangeWindowPeriods(6);
+	reference.setPulseCallback([&](const PulseEvent& event) { pulses[0].push_back(event); });
+	fixed.setPulseCallback([&](const PulseEvent& event) { pulses[1].push_back(event); });
+	reference.processBlock(&signal[0], signal.size());
+	fixed.processBlock(&signal[0], signal.size());
+
+	BOOST_REQUIRE(pulses[0].size() > 200);
+	checkWithinTolerance(pulses[0], pulses[1]);
+	BOOST_CHECK_CLOSE(1200.0, pulses[1].back().rpm, 1.0);
+	BOOST_CHECK(pulses[1].back().signalMax < 4000);
+}
+
+
+BOOST_AUTO_TEST_CASE(rpmFilterMatchesFloatReference)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm = PiecewiseLinearProfile(2000);
+	params.rpm.addPoint(2, 6000);
+	params.noise = 300;
+	params.jitter = 0.01;
+	std::vector<int16_t> signal = makeSignal(params, 3);
+
+	for (int filter = MeanFilter; filter <= HampelFilter; filter++)
+	{
+		std::vector<PulseEvent> pulses[2];
+		RPMCalculatorFromAudio reference(params.sampleRate, 1);
+		FixedPointRPMCalculatorFromAudio fixed(params.sampleRate, 1);
+		reference.setRpmFilter(RpmFilter(filter));
+		fixed.setRpmFilter(RpmFilter(filter));
+		reference.setPulseCallback([&](const PulseEvent& event) { pulses[0].push_back(event); });
+		fixed.setPulseCallback([&](const PulseEvent& event) { pulses[1].push_back(event); });
+		reference.processBlock(&signal[0], signal.size());
+		fixed.processBlock(&signal[0], signal.size());
+
+		checkWithinTolerance(pulses[0], pulses[1]);
+		BOOST_REQUIRE_EQUAL(pulses[0].size(), pulses[1].size());
+		for (size_t i = 0; i < pulses[0].size(); i++)
+		{
+			// Within a few Q8 steps, as the fixed point filters see the rounded rpm
+			BOOST_CHECK_SMALL(pulses[1][i].filteredRpm - pulses[0][i].filteredRpm,
+					0.05 + pulses[0][i].filteredRpm * 1e-4);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
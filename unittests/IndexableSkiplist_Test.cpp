@@ -0,0 +1,91 @@
+/*
+ * IndexableSkiplist_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../StreamProcessors/IndexableSkiplist.hpp"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+
+BOOST_AUTO_TEST_SUITE(IndexableSkiplist_Test)
+
+
+BOOST_AUTO_TEST_CASE(matchesSortedVector)
+{
+	srand(1);
+	IndexableSkiplist<int32_t, int64_t> list(100);
+	std::vector<int32_t> sorted;
+	for (int i = 0; i < 20000; i++)
+	{
+		bool insert = sorted.empty() || (sorted.size() < 100 && rand() % 2);
+		if (insert)
+		{
+			int32_t value = rand() % 50 - 25;     // Plenty of duplicates
+			list.insert(value);
+			sorted.insert(std::upper_bound(sorted.begin(), sorted.end(), value), value);
+		}
+		else
+		{
+			size_t rank = rand() % sorted.size();
+			list.erase(sorted[rank]);
+			sorted.erase(sorted.begin() + rank);
+		}
+
+		BOOST_REQUIRE_EQUAL(sorted.size(), list.size());
+		if (i % 7 == 0)
+		{
+			int64_t sum = 0;
+			for (size_t k = 0; k < sorted.size(); k++)
+			{
+				BOOST_REQUIRE_EQUAL(sorted[k], list.at(k));
+				BOOST_REQUIRE_EQUAL(sum, list.sumOfSmallest(k));
+				sum += sorted[k];
+			}
+			BOOST_REQUIRE_EQUAL(sum, list.sumOfSmallest(sorted.size()));
+			int32_t probe = rand() % 60 - 30;
+			BOOST_REQUIRE_EQUAL(size_t(std::lower_bound(sorted.begin(), sorted.end(), probe) - sorted.begin()),
+					list.countBelow(probe));
+			BOOST_REQUIRE_EQUAL(size_t(std::upper_bound(sorted.begin(), sorted.end(), probe) - sorted.begin()),
+					list.countBelow(probe, true));
+		}
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(fillToCapacity)
+{
+	IndexableSkiplist<double, double> list(3);
+	list.insert(2.5);
+	list.insert(-1);
+	list.insert(2.5);
+	BOOST_CHECK_EQUAL(3u, list.size());
+	BOOST_CHECK_EQUAL(-1, list.at(0));
+	BOOST_CHECK_EQUAL(2.5, list.at(2));
+	BOOST_CHECK_EQUAL(4, list.sumOfSmallest(3));
+
+	list.erase(2.5);
+	list.erase(-1);
+	list.insert(7);
+	BOOST_CHECK_EQUAL(2.5, list.at(0));
+	BOOST_CHECK_EQUAL(7, list.at(1));
+
+	list.clear();
+	BOOST_CHECK_EQUAL(0u, list.size());
+	list.insert(1);
+	list.insert(1);
+	list.insert(1);
+	BOOST_CHECK_EQUAL(3, list.sumOfSmallest(3));
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,169 @@
+/*
+ * MetricsServer_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../MetricsServer.hpp"
+
+
+BOOST_AUTO_TEST_SUITE(MetricsServer_Test)
+
+
+static bool contains(const std::string& haystack, const char* needle)
+{
+	return haystack.find(needle) != std::string::npos;
+}
+
+
+static int connectUnix(const char* path)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+
+/// Reads until the server closes the connection
+static std::string receiveAll(int fd)
+{
+	std::string reply;
+	char buff[1024];
+	ssize_t n;
+	while ((n = recv(fd, buff, sizeof(buff), 0)) > 0)
+	{
+		reply.append(buff, n);
+	}
+	return reply;
+}
+
+
+static std::string get(int fd, const char* request)
+{
+	send(fd, request, strlen(request), MSG_NOSIGNAL);
+	return receiveAll(fd);
+}
+
+
+BOOST_AUTO_TEST_CASE(prometheusNames)
+{
+	BOOST_CHECK_EQUAL("rpmmeter_detector_pulses", MetricsFormat::prometheusName("detector.pulses"));
+	BOOST_CHECK_EQUAL("rpmmeter_a_b_c", MetricsFormat::prometheusName("a-b.c"));
+}
+
+
+BOOST_AUTO_TEST_CASE(responses)
+{
+	MetricsRegistry registry;
+	registry.addCounter("detector.pulses").add(42);
+	registry.addHistogram("capture.buffer_processing").record(1000);
+
+	Stats stats;
+	stats.rpm = 1500;
+	stats.trackedRpm = 1499.5;
+	stats.rpmSource = 2;
+	stats.threshold = -17;
+	SeqLockValue<Stats> snapshot(stats);
+
+	MetricsServer server(snapshot, registry);
+
+	std::string prom = server.respond("GET /metrics HTTP/1.1");
+	BOOST_CHECK(contains(prom, "HTTP/1.0 200 OK\r\n"));
+	BOOST_CHECK(contains(prom, "\nrpmmeter_rpm 1500\n"));
+	BOOST_CHECK(contains(prom, "\nrpmmeter_rpm_tracked 1499.5\n"));
+	BOOST_CHECK(contains(prom, "\nrpmmeter_rpm_source 2\n"));
+	BOOST_CHECK(contains(prom, "\nrpmmeter_threshold -17\n"));
+	BOOST_CHECK(contains(prom, "\nrpmmeter_detector_pulses_total 42\n"));
+	BOOST_CHECK(contains(prom, "\nrpmmeter_capture_buffer_processing_ns_count 1\n"));
+
+	std::string json = server.respond("GET /metrics.json?pretty HTTP/1.0");
+	BOOST_CHECK(contains(json, "application/json"));
+	BOOST_CHECK(contains(json, "\"rpm\": 1500,"));
+	BOOST_CHECK(contains(json, "\"rpm_tracked\": 1499.5,"));
+	BOOST_CHECK(contains(json, "\"rpm_source\": 2,"));
+	BOOST_CHECK(contains(json, "\"detector.pulses\": 42"));
+
+	BOOST_CHECK(contains(server.respond("GET / HTTP/1.0"), "404 Not Found"));
+	BOOST_CHECK(contains(server.respond("POST /metrics HTTP/1.0"), "405"));
+	BOOST_CHECK(contains(server.respond(""), "405"));
+}
+
+
+BOOST_AUTO_TEST_CASE(servesOverUnixSocket)
+{
+	MetricsRegistry registry;
+	SeqLockValue<Stats> snapshot;
+	MetricsServer server(snapshot, registry);
+
+	char path[] = "/tmp/MetricsServer_TestXXXXXX";
+	int tmpFd = mkstemp(path);
+	BOOST_REQUIRE(tmpFd >= 0);
+	close(tmpFd);
+	BOOST_REQUIRE(server.listenUnix(path));
+	server.start();
+
+	int fd = connectUnix(path);
+	BOOST_REQUIRE(fd >= 0);
+	std::string reply = get(fd, "GET /metrics HTTP/1.0\r\n\r\n");
+	close(fd);
+	server.stop();
+
+	BOOST_CHECK(contains(reply, "HTTP/1.0 200 OK"));
+	BOOST_CHECK(contains(reply, "rpmmeter_uptime_seconds"));
+	BOOST_CHECK_EQUAL(-1, access(path, F_OK));
+}
+
+
+BOOST_AUTO_TEST_CASE(slowClientsDoNotBlockOthers)
+{
+	MetricsRegistry registry;
+	SeqLockValue<Stats> snapshot;
+	MetricsServer server(snapshot, registry);
+
+	char path[] = "/tmp/MetricsServer_TestXXXXXX";
+	int tmpFd = mkstemp(path);
+	BOOST_REQUIRE(tmpFd >= 0);
+	close(tmpFd);
+	BOOST_REQUIRE(server.listenUnix(path));
+	server.start();
+
+	// One silent, and one with half a request line
+	int silent = connectUnix(path);
+	int partial = connectUnix(path);
+	BOOST_REQUIRE(silent >= 0 && partial >= 0);
+	send(partial, "GET /met", 8, MSG_NOSIGNAL);
+	usleep(50000);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int fd = connectUnix(path);
+	BOOST_REQUIRE(fd >= 0);
+	std::string reply = get(fd, "GET /metrics.json HTTP/1.0\r\n\r\n");
+	close(fd);
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	BOOST_CHECK(contains(reply, "HTTP/1.0 200 OK"));
+	BOOST_CHECK(elapsed < 0.5);
+
+	// Both are closed after the request timeout, without a reply
+	BOOST_CHECK_EQUAL("", receiveAll(silent));
+	BOOST_CHECK_EQUAL("", receiveAll(partial));
+	double timedOut = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	BOOST_CHECK(timedOut > 0.5 && timedOut < 0.5 + 2 * MetricsServer::RequestTimeoutMs / 1000.0);
+	close(silent);
+	close(partial);
+	server.stop();
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,80 @@
+/*
+ * Metrics_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../Metrics.hpp"
+
+
+BOOST_AUTO_TEST_SUITE(Metrics_Test)
+
+
+BOOST_AUTO_TEST_CASE(counter)
+{
+	MetricsCounter c;
+	BOOST_CHECK_EQUAL(0, c.get());
+	c.add();
+	c.add(10);
+	BOOST_CHECK_EQUAL(11, c.get());
+}
+
+
+BOOST_AUTO_TEST_CASE(histogramBuckets)
+{
+	BOOST_CHECK_EQUAL(0, MetricsHistogram::bucketOf(0));
+	BOOST_CHECK_EQUAL(1, MetricsHistogram::bucketOf(1));
+	BOOST_CHECK_EQUAL(2, MetricsHistogram::bucketOf(2));
+	BOOST_CHECK_EQUAL(2, MetricsHistogram::bucketOf(3));
+	BOOST_CHECK_EQUAL(3, MetricsHistogram::bucketOf(4));
+	BOOST_CHECK_EQUAL(64, MetricsHistogram::bucketOf(UINT64_MAX));
+}
+
+
+BOOST_AUTO_TEST_CASE(histogramStatistics)
+{
+	MetricsHistogram h;
+	BOOST_CHECK_EQUAL(0, h.getPercentile(50));
+
+	for (int i = 0; i < 99; i++)
+	{
+		h.record(100);
+	}
+	h.record(5000);
+
+	BOOST_CHECK_EQUAL(100, h.getCount());
+	BOOST_CHECK_EQUAL(99 * 100 + 5000, h.getSum());
+	BOOST_CHECK_EQUAL(5000, h.getMax());
+	BOOST_CHECK_CLOSE(149.0, h.getMean(), 1e-9);
+	// 100 is in bucket [64, 127]
+	BOOST_CHECK_EQUAL(127, h.getPercentile(50));
+	BOOST_CHECK_EQUAL(127, h.getPercentile(99));
+	BOOST_CHECK_EQUAL(5000, h.getPercentile(100));
+}
+
+
+BOOST_AUTO_TEST_CASE(registryReferencesStayValid)
+{
+	MetricsRegistry registry;
+	MetricsCounter& first = registry.addCounter("first");
+	for (int i = 0; i < 100; i++)
+	{
+		registry.addCounter("other");
+	}
+	first.add(3);
+
+	uint64_t seen = 0;
+	registry.forEachCounter([&](const std::string& name, const MetricsCounter& c) {
+		if (name == "first")
+		{
+			seen = c.get();
+		}
+	});
+	BOOST_CHECK_EQUAL(3, seen);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -12,6 +12,11 @@
 
 #include "../StreamProcessors/MinMaxCheck.hpp"
 
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
 
 BOOST_AUTO_TEST_SUITE(MinMaxCheck_Test)
 
@@ -171,4 +176,68 @@ BOOST_AUTO_TEST_CASE(test2SamplesPerSegment_Decreasing)
 	BOOST_CHECK_EQUAL(5, dut.getMax());
 }
 
+
+BOOST_AUTO_TEST_CASE(checkBlockSameAsCheck)
+{
+	MinMaxCheck reference(7, 3);
+	MinMaxCheck dut(7, 3);
+
+	srand(1);
+	std::vector<int16_t> samples(500);
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		samples[i] = rand() % 2001 - 1000;
+	}
+
+	size_t pos = 0;
+	size_t blockSize = 1;
+	while (pos < samples.size())
+	{
+		size_t n = std::min(std::min(blockSize, samples.size() - pos), dut.getSamplesLeftInSegment());
+		dut.checkBlock(&samples[pos], n);
+		for (size_t i = 0; i < n; i++)
+		{
+			reference.check(samples[pos + i]);
+		}
+		pos += n;
+		blockSize = blockSize % 5 + 1;
+
+		BOOST_CHECK_EQUAL(reference.getMin(), dut.getMin());
+		BOOST_CHECK_EQUAL(reference.getMax(), dut.getMax());
+		BOOST_CHECK_EQUAL(reference.getSamplesLeftInSegment(), dut.getSamplesLeftInSegment());
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(shorterSegments)
+{
+	MinMaxCheck dut(100, 4);
+	for (int i = 0; i < 450; i++)
+	{
+		dut.check(i == 200 ? 1000 : 0);
+	}
+	BOOST_CHECK_EQUAL(1000, dut.getMax());
+
+	// 50 samples into a segment: ends it right away
+	dut.setSamplesPerSegment(10);
+	BOOST_CHECK_EQUAL(10u, dut.getSamplesPerSegment());
+	BOOST_CHECK_EQUAL(10u, dut.getSamplesLeftInSegment());
+
+	// The old segments age out as new ones are added (the one holding 1000
+	// is the second oldest now)
+	for (int i = 0; i < 10; i++)
+	{
+		dut.check(0);
+	}
+	BOOST_CHECK_EQUAL(1000, dut.getMax());
+	for (int i = 0; i < 10; i++)
+	{
+		dut.check(0);
+	}
+	BOOST_CHECK_EQUAL(0, dut.getMax());
+
+	dut.setSamplesPerSegment(1000);
+	BOOST_CHECK_EQUAL(1000u, dut.getSamplesLeftInSegment());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
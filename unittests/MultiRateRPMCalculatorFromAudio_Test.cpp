@@ -0,0 +1,164 @@
+/*
+ * MultiRateRPMCalculatorFromAudio_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../MultiRateRPMCalculatorFromAudio.hpp"
+#include "../RPMCalculatorFromAudio.hpp"
+#include "../SignalGenerator/TachometerSignalGenerator.hpp"
+
+#include <math.h>
+
+#include <vector>
+
+namespace {
+
+std::vector<int16_t> makeSignal(int sampleRate, const char* rpm, double seconds)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.sampleRate = sampleRate;
+	params.rpm.parse(rpm);
+	params.noise = 100;
+	params.sensorTimeConstant = 5e-6;
+	TachometerSignalGenerator gen(params);
+	std::vector<int16_t> signal(seconds * sampleRate);
+	gen.generate(signal.data(), signal.size());
+	return signal;
+}
+
+std::vector<PulseEvent> runReference(const std::vector<int16_t>& signal, int sampleRate)
+{
+	std::vector<PulseEvent> pulses;
+	BasicRPMCalculatorFromAudio<false> detector(sampleRate, 1);
+	detector.setPulseCallback([&](const PulseEvent& event) { pulses.push_back(event); });
+	detector.processBlock(signal.data(), signal.size());
+	return pulses;
+}
+
+std::vector<PulseEvent> runMultiRate(const std::vector<int16_t>& signal, int sampleRate, size_t decimation,
+		size_t blockSize)
+{
+	std::vector<PulseEvent> pulses;
+	MultiRateRPMCalculatorFromAudio detector(sampleRate, 1, decimation);
+	detector.setPulseCallback([&](const PulseEvent& event) { pulses.push_back(event); });
+	for (size_t pos = 0; pos < signal.size(); pos += blockSize)
+	{
+		detector.processBlock(&signal[pos], std::min(blockSize, signal.size() - pos));
+	}
+	return pulses;
+}
+
+/// Same pulses after the first 0.2 s, with crossing times differing by at most maxDifference samples
+void checkSameTiming(const std::vector<PulseEvent>& reference, const std::vector<PulseEvent>& pulses,
+		int sampleRate, double maxDifference)
+{
+	BOOST_REQUIRE_GT(reference.size(), 50u);
+	size_t j = 0;
+	double worst = 0;
+	for (const PulseEvent& r : reference)
+	{
+		if (r.sampleIndex < 0.2 * sampleRate)
+		{
+			continue;
+		}
+		while (j < pulses.size() && pulses[j].crossingTime < r.crossingTime - 1)
+		{
+			j++;
+		}
+		BOOST_REQUIRE(j < pulses.size());
+		worst = std::max(worst, fabs(pulses[j].crossingTime - r.crossingTime));
+		BOOST_CHECK_EQUAL(r.sampleIndex, pulses[j].sampleIndex);
+	}
+	BOOST_CHECK_LE(worst, maxDifference);
+}
+
+}
+
+
+BOOST_AUTO_TEST_SUITE(MultiRateRPMCalculatorFromAudio_Test)
+
+
+BOOST_AUTO_TEST_CASE(sameTimingAsFullRate)
+{
+	const int rates[] = { 192000, 384000 };
+	const size_t decimations[] = { 1, 4, 16, 64 };
+	for (int rate : rates)
+	{
+		std::vector<int16_t> signal = makeSignal(rate, "0:1000,2:20000", 2);
+		std::vector<PulseEvent> reference = runReference(signal, rate);
+		for (size_t decimation : decimations)
+		{
+			checkSameTiming(reference, runMultiRate(signal, rate, decimation, 1000), rate, 0.01);
+		}
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(blockSizeDoesNotMatter)
+{
+	std::vector<int16_t> signal = makeSignal(192000, "0:3000,1:6000", 1);
+	std::vector<PulseEvent> a = runMultiRate(signal, 192000, 8, 4096);
+	std::vector<PulseEvent> b = runMultiRate(signal, 192000, 8, 13);
+	BOOST_REQUIRE_EQUAL(a.size(), b.size());
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		BOOST_CHECK_EQUAL(a[i].crossingTime, b[i].crossingTime);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(stridedInput)
+{
+	std::vector<int16_t> signal = makeSignal(192000, "0:3000,1:6000", 1);
+	std::vector<int16_t> stereo(2 * signal.size(), 0);
+	for (size_t i = 0; i < signal.size(); i++)
+	{
+		stereo[2 * i + 1] = signal[i];
+	}
+	std::vector<PulseEvent> expected = runMultiRate(signal, 192000, 8, 1000);
+
+	std::vector<PulseEvent> pulses;
+	MultiRateRPMCalculatorFromAudio detector(192000, 1, 8);
+	detector.setPulseCallback([&](const PulseEvent& event) { pulses.push_back(event); });
+	detector.processBlock(&stereo[1], signal.size(), 2);
+	BOOST_REQUIRE_EQUAL(expected.size(), pulses.size());
+	for (size_t i = 0; i < pulses.size(); i++)
+	{
+		BOOST_CHECK_EQUAL(expected[i].crossingTime, pulses[i].crossingTime);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(decimatedWaveform)
+{
+	const int rate = 192000;
+	std::vector<int16_t> signal = makeSignal(rate, "0:6000", 1);
+	MultiRateRPMCalculatorFromAudio detector(rate, 1, 8);
+	int numWaveforms = 0;
+	detector.setWaveformCallback([&](const CappedStorageWaveform& waveform, const PulseEvent& pulse) {
+		numWaveforms++;
+		if (pulse.sampleIndex > rate / 2)
+		{
+			// Three periods (and the pre-trigger part) at rate / 8, one sample per bin
+			BOOST_CHECK_CLOSE(double(waveform.size()), 3 * 60.0 * rate / 6000 / 8 + rate / 200 / 8, 2);
+			int16_t lo = 0;
+			int16_t hi = 0;
+			for (size_t i = 0; i < waveform.size(); i++)
+			{
+				lo = std::min(lo, waveform[i].min);
+				hi = std::max(hi, waveform[i].max);
+			}
+			BOOST_CHECK_GT(hi - lo, 5000);
+		}
+	});
+	detector.processBlock(signal.data(), signal.size());
+	BOOST_CHECK_GE(numWaveforms, 30);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,364 @@
+/*
+ * OrderTracker_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../OrderTracker.hpp"
+#include "../RevolutionTracker.hpp"
+
+#include <math.h>
+#include <unistd.h>
+
+#include <vector>
+
+namespace {
+
+const int Rate = 44100;
+
+struct Order {
+	int order;
+	double amplitude;
+};
+
+/**
+ * A shaft at rpm0 + slope * t (rpm, t in seconds), with pulsesPerRevolution
+ * pulses per revolution, and a vibration signal of the given orders.
+ */
+struct Machine {
+	std::vector<double> pulses;
+	std::vector<int16_t> vibration;
+
+	Machine(double rpm0, double slope, double seconds, const std::vector<Order>& orders, int pulsesPerRevolution = 1)
+	{
+		double f0 = rpm0 / 60;
+		double a = slope / 60;
+		for (int k = 0; ; k++)
+		{
+			// Revolutions f0 * t + a * t^2 / 2 == pulse angle, from 0.05 revolutions in
+			double angle = double(k) / pulsesPerRevolution + 0.05;
+			double t = a ? (-f0 + sqrt(f0 * f0 + 2 * a * angle)) / a : angle / f0;
+			if (t > seconds)
+			{
+				break;
+			}
+			pulses.push_back(t * Rate);
+		}
+		vibration.resize(size_t(seconds * Rate));
+		for (size_t i = 0; i < vibration.size(); i++)
+		{
+			double t = double(i) / Rate;
+			double angle = f0 * t + a * t * t / 2;
+			double value = 0;
+			for (const Order& o : orders)
+			{
+				value += o.amplitude * sin(2 * M_PI * o.order * angle + o.order);
+			}
+			vibration[i] = int16_t(lrint(value));
+		}
+	}
+};
+
+struct Result {
+	double rpm;
+	std::vector<float> orders;
+	std::vector<float> averaged;
+};
+
+/// Feeds the pulses of each block before its samples, like main does
+template<class Tracker>
+void feed(Tracker& tracker, const Machine& machine, size_t blockSize, bool slow = false)
+{
+	size_t next = 0;
+	for (size_t pos = 0; pos < machine.vibration.size(); pos += blockSize)
+	{
+		size_t n = std::min(blockSize, machine.vibration.size() - pos);
+		while (next < machine.pulses.size() && machine.pulses[next] < pos + n)
+		{
+			tracker.addPulse(machine.pulses[next++]);
+		}
+		tracker.processBlock(&machine.vibration[pos], n);
+		if (slow)
+		{
+			usleep(200);
+		}
+	}
+}
+
+std::vector<Result> track(const Machine& machine, size_t blockSize = 512,
+		OrderTracker::Parameters params = OrderTracker::Parameters())
+{
+	std::vector<Result> results;
+	OrderTracker tracker(Rate, params);
+	tracker.setSpectrumCallback([&](const OrderSpectrum& s) {
+		Result r;
+		r.rpm = s.rpm;
+		r.orders.assign(s.orders, s.orders + s.numOrders);
+		r.averaged.assign(s.averaged, s.averaged + s.numOrders);
+		results.push_back(r);
+	});
+	feed(tracker, machine, blockSize);
+	return results;
+}
+
+/**
+ * Like main with --marks: the RevolutionTracker picks the revolution pulses
+ * for the order tracker, and a restart of it resets the boundary. Pulse
+ * lost is not added (lost index).
+ */
+template<class Tracker>
+void feedThroughRevolutions(Tracker& tracker, const Machine& machine, int marks, size_t lost, bool slow = false)
+{
+	RevolutionTracker::Parameters params;
+	params.pulsesPerRevolution = marks;
+	RevolutionTracker revolutions(Rate, params);
+	RevolutionEvent latest = RevolutionEvent();
+	revolutions.setRevolutionCallback([&](const RevolutionEvent& e) { latest = e; });
+
+	size_t next = 0;
+	for (size_t pos = 0; pos < machine.vibration.size(); pos += 512)
+	{
+		size_t n = std::min<size_t>(512, machine.vibration.size() - pos);
+		for (; next < machine.pulses.size() && machine.pulses[next] < pos + n; next++)
+		{
+			if (next == lost)
+			{
+				continue;
+			}
+			if (!revolutions.addPulse(machine.pulses[next]))
+			{
+				tracker.resetBoundary();
+			}
+			else if (latest.revolution)
+			{
+				tracker.addPulse(machine.pulses[next]);
+			}
+		}
+		tracker.processBlock(&machine.vibration[pos], n);
+		if (slow)
+		{
+			usleep(200);
+		}
+	}
+}
+
+/// Largest amplitude of the orders not in the list
+float leakage(const std::vector<float>& amplitudes, const std::vector<Order>& orders)
+{
+	float largest = 0;
+	for (size_t k = 0; k < amplitudes.size(); k++)
+	{
+		bool listed = false;
+		for (const Order& o : orders)
+		{
+			listed = listed || size_t(o.order) == k;
+		}
+		largest = listed ? largest : std::max(largest, amplitudes[k]);
+	}
+	return largest;
+}
+
+} // namespace
+
+
+BOOST_AUTO_TEST_SUITE(OrderTracker_Test)
+
+BOOST_AUTO_TEST_CASE(constantSpeedGivesOrders)
+{
+	std::vector<Order> orders = { { 3, 1000 }, { 10, 500 }, { 40, 200 } };
+	for (double rpm : { 600, 1500, 12000 })     // 12000 rpm has fewer samples than points
+	{
+		std::vector<Result> results = track(Machine(rpm, 0, 2, orders), 512);
+		BOOST_REQUIRE(results.size() >= size_t(rpm / 30) - 2);
+		for (const Result& r : results)
+		{
+			BOOST_CHECK_CLOSE(rpm, r.rpm, 1e-6);
+			BOOST_CHECK_CLOSE(1000.0, r.orders[3], 0.5);
+			BOOST_CHECK_CLOSE(500.0, r.orders[10], 0.5);
+			BOOST_CHECK_CLOSE(200.0, r.orders[40], 1);
+			BOOST_CHECK_SMALL(leakage(r.orders, orders), 3.0f);
+		}
+		BOOST_CHECK_CLOSE(1000.0, results.back().averaged[3], 0.5);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(rampKeepsOrdersSharp)
+{
+	// 600 to 3000 rpm in 3 s: 10% faster over each of the first revolutions
+	std::vector<Order> orders = { { 5, 1000 }, { 24, 300 } };
+	std::vector<Result> results = track(Machine(600, 800, 3, orders), 512);
+	BOOST_REQUIRE(results.size() > 80);
+	for (size_t i = 1; i < results.size(); i++)
+	{
+		BOOST_CHECK_CLOSE(1000.0, results[i].orders[5], 0.5);
+		BOOST_CHECK_CLOSE(300.0, results[i].orders[24], 1);
+		BOOST_CHECK_SMALL(leakage(results[i].orders, orders), 5.0f);
+	}
+	// The first one has no revolution before it, and is linear in angle
+	BOOST_CHECK(leakage(results[0].orders, orders) > 10);
+}
+
+BOOST_AUTO_TEST_CASE(sameForAnyBlockSizeAndPulsesPerRevolution)
+{
+	std::vector<Order> orders = { { 2, 1000 }, { 7, 400 } };
+	std::vector<Result> reference = track(Machine(1000, 500, 2, orders), 512);
+
+	OrderTracker::Parameters params;
+	params.pulsesPerRevolution = 3;
+	std::vector<Result> a = track(Machine(1000, 500, 2, orders, 3), 64, params);
+	std::vector<Result> b = track(Machine(1000, 500, 2, orders), 8192);
+
+	BOOST_REQUIRE(reference.size() > 20);
+	BOOST_REQUIRE_EQUAL(reference.size(), a.size());
+	BOOST_REQUIRE_EQUAL(reference.size(), b.size());
+	for (size_t i = 0; i < reference.size(); i++)
+	{
+		BOOST_CHECK_CLOSE(reference[i].rpm, a[i].rpm, 1e-6);
+		BOOST_CHECK_CLOSE(reference[i].orders[7], a[i].orders[7], 0.01);
+		BOOST_CHECK_EQUAL(reference[i].orders[7], b[i].orders[7]);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(skipStartsOver)
+{
+	std::vector<Order> orders = { { 4, 1000 } };
+	Machine machine(1200, 0, 2, orders);   // 20 revolutions per second
+
+	std::vector<OrderSpectrum> results;
+	OrderTracker tracker(Rate);
+	tracker.setSpectrumCallback([&](const OrderSpectrum& s) { results.push_back(s); });
+
+	// Samples 0.5 - 0.6 s are lost, with the pulses in them
+	size_t gapStart = Rate / 2;
+	size_t gapEnd = Rate * 6 / 10;
+	size_t next = 0;
+	for (size_t pos = 0; pos < machine.vibration.size(); pos += 441)
+	{
+		while (next < machine.pulses.size() && machine.pulses[next] < pos + 441)
+		{
+			if (machine.pulses[next] < gapStart || machine.pulses[next] >= gapEnd)
+			{
+				tracker.addPulse(machine.pulses[next]);
+			}
+			next++;
+		}
+		if (pos >= gapStart && pos < gapEnd)
+		{
+			tracker.skip(441);
+		}
+		else
+		{
+			tracker.processBlock(&machine.vibration[pos], 441);
+		}
+	}
+
+	// No revolution across the gap, or with its kernel in it (76 samples at 1200 rpm)
+	BOOST_REQUIRE(results.size() > 30);
+	for (const OrderSpectrum& s : results)
+	{
+		BOOST_CHECK(s.endTime + 76 < gapStart || s.startTime - 76 >= gapEnd);
+		BOOST_CHECK_CLOSE(1200.0, s.rpm, 1e-6);
+	}
+	BOOST_CHECK_EQUAL(uint64_t(results.size()), tracker.getNumRevolutions());
+}
+
+BOOST_AUTO_TEST_CASE(noRevolutionAcrossLostIndex)
+{
+	// 4 marks at 1200 rpm; mark 42 (a tenth into revolution 10) is missed
+	std::vector<Order> orders = { { 4, 1000 } };
+	Machine machine(1200, 0, 2, orders, 4);
+	const size_t lost = 42;
+
+	std::vector<OrderSpectrum> results;
+	OrderTracker tracker(Rate);
+	tracker.setSpectrumCallback([&](const OrderSpectrum& s) { results.push_back(s); });
+	feedThroughRevolutions(tracker, machine, 4, lost);
+
+	std::vector<OrderSpectrum> asyncResults;
+	AsyncOrderTracker async(Rate);
+	async.setSpectrumCallback([&](const OrderSpectrum& s) { asyncResults.push_back(s); });
+	async.start();
+	feedThroughRevolutions(async, machine, 4, lost, true);
+	async.stop();
+
+	// Without the reset, the revolution up to the first one after the restart
+	// would span nearly two, at about 690 rpm
+	BOOST_REQUIRE(results.size() > 30);
+	size_t numAfter = 0;
+	for (const OrderSpectrum& s : results)
+	{
+		BOOST_CHECK_CLOSE(1200.0, s.rpm, 1e-6);
+		BOOST_CHECK(s.endTime < machine.pulses[lost] || s.startTime > machine.pulses[lost]);
+		numAfter += s.startTime > machine.pulses[lost];
+	}
+	BOOST_CHECK(numAfter > 20);     // Regained
+	BOOST_CHECK_EQUAL(0u, async.getNumDropped());
+	BOOST_REQUIRE_EQUAL(results.size(), asyncResults.size());
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		BOOST_CHECK_EQUAL(results[i].startTime, asyncResults[i].startTime);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(asyncMatchesSynchronous)
+{
+	std::vector<Order> orders = { { 3, 1000 }, { 12, 250 } };
+	Machine machine(900, 600, 2, orders);
+	std::vector<Result> reference = track(machine, 512);
+
+	std::vector<Result> results;
+	AsyncOrderTracker async(Rate);
+	async.setSpectrumCallback([&](const OrderSpectrum& s) {
+		Result r;
+		r.rpm = s.rpm;
+		r.orders.assign(s.orders, s.orders + s.numOrders);
+		results.push_back(r);
+	});
+	async.start();
+	feed(async, machine, 512, true);   // Slower than the worker, so nothing is dropped
+	async.stop();
+
+	BOOST_CHECK_EQUAL(0u, async.getNumDropped());
+	BOOST_REQUIRE_EQUAL(reference.size(), results.size());
+	for (size_t i = 0; i < reference.size(); i++)
+	{
+		BOOST_CHECK_EQUAL(reference[i].rpm, results[i].rpm);
+		BOOST_CHECK_EQUAL(reference[i].orders[3], results[i].orders[3]);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(asyncDropsWholeBlocks)
+{
+	std::vector<Order> orders = { { 3, 1000 } };
+	Machine machine(1500, 0, 3, orders);
+
+	std::vector<Result> results;
+	AsyncOrderTracker async(Rate);
+	async.setSpectrumCallback([&](const OrderSpectrum& s) {
+		Result r;
+		r.rpm = s.rpm;
+		r.orders.assign(s.orders, s.orders + s.numOrders);
+		results.push_back(r);
+	});
+	// Not started: the rings fill up, and the rest is dropped
+	feed(async, machine, 441);
+	BOOST_CHECK(async.getNumDropped() > 0);
+	BOOST_CHECK_EQUAL(0u, async.getNumDropped() % 441);
+	async.start();
+	async.stop();
+
+	// What was queued is still analysed right
+	BOOST_REQUIRE(results.size() > 5);
+	for (const Result& r : results)
+	{
+		BOOST_CHECK_CLOSE(1500.0, r.rpm, 1e-6);
+		BOOST_CHECK_CLOSE(1000.0, r.orders[3], 0.5);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
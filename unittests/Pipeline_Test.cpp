@@ -0,0 +1,135 @@
+/*
+ * Pipeline_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../RPMCalculatorFromAudio.hpp"
+#include "../SignalGenerator/TachometerSignalGenerator.hpp"
+#include "../StreamProcessors/Pipeline.hpp"
+
+#include <vector>
+
+namespace {
+
+struct Doubler : PipelineStage {
+	void process(PipelineContext& ctx) { ctx.sample *= 2; }
+};
+
+struct Recorder : PipelineStage {
+	enum { PerSample = 1, PerBlock = 1 };
+	Recorder() : numBlocks(0) { }
+	void beginBlock(PipelineContext&) { numBlocks++; }
+	void process(PipelineContext& ctx)
+	{
+		samples.push_back(ctx.sample);
+		indices.push_back(ctx.sampleIndex);
+	}
+	int numBlocks;
+	std::vector<int32_t> samples;
+	std::vector<uint64_t> indices;
+};
+
+struct BlockCounter : PipelineStage {
+	enum { PerSample = 0, PerBlock = 1 };
+	BlockCounter() : numBlocks(0) { }
+	void beginBlock(PipelineContext&) { numBlocks++; }
+	int numBlocks;
+};
+
+template<class Detector>
+std::vector<PulseEvent> runDetector(const std::vector<int16_t>& signal, size_t blockSize)
+{
+	std::vector<PulseEvent> pulses;
+	Detector detector(44100, 1);
+	detector.setPulseCallback([&](const PulseEvent& event) { pulses.push_back(event); });
+	for (size_t pos = 0; pos < signal.size(); pos += blockSize)
+	{
+		detector.processBlock(&signal[pos], std::min(blockSize, signal.size() - pos));
+	}
+	return pulses;
+}
+
+void checkSamePulses(const std::vector<PulseEvent>& a, const std::vector<PulseEvent>& b)
+{
+	BOOST_REQUIRE_EQUAL(a.size(), b.size());
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		BOOST_CHECK_EQUAL(a[i].sampleIndex, b[i].sampleIndex);
+		BOOST_CHECK_EQUAL(a[i].periodInSamples, b[i].periodInSamples);
+		BOOST_CHECK_EQUAL(a[i].rpm, b[i].rpm);
+		BOOST_CHECK_EQUAL(a[i].filteredRpm, b[i].filteredRpm);
+		BOOST_CHECK_EQUAL(a[i].threshold, b[i].threshold);
+	}
+}
+
+} // namespace
+
+
+BOOST_AUTO_TEST_SUITE(Pipeline_Test)
+
+
+BOOST_AUTO_TEST_CASE(stagesRunInOrder)
+{
+	Pipeline<Recorder, Doubler, Recorder> pipeline;
+	const int16_t samples[] = { 1, 2, 3 };
+	pipeline.processBlock(samples, 3);
+
+	BOOST_CHECK_EQUAL(pipeline.get<0>().samples.size(), 3u);
+	BOOST_CHECK_EQUAL(pipeline.get<0>().samples[2], 3);
+	BOOST_CHECK_EQUAL(pipeline.get<2>().samples[2], 6);
+	BOOST_CHECK_EQUAL(pipeline.get<2>().indices[2], 2u);
+	BOOST_CHECK_EQUAL(pipeline.context().sampleIndex, 3u);
+	// stage<>() finds the first stage of a type
+	BOOST_CHECK_EQUAL(&pipeline.stage<Recorder>(), &pipeline.get<0>());
+}
+
+BOOST_AUTO_TEST_CASE(blockHooksOncePerBlock)
+{
+	Pipeline<BlockCounter, Recorder> pipeline;
+	const int16_t samples[] = { 1, 2, 3, 4, 5, 6 };
+	pipeline.processBlock(samples, 3, 2);
+	pipeline.push(7);
+
+	BOOST_CHECK_EQUAL(pipeline.get<0>().numBlocks, 2);
+	BOOST_CHECK_EQUAL(pipeline.get<1>().numBlocks, 2);
+	const std::vector<int32_t>& seen = pipeline.get<1>().samples;
+	BOOST_REQUIRE_EQUAL(seen.size(), 4u);
+	BOOST_CHECK_EQUAL(seen[0], 1);
+	BOOST_CHECK_EQUAL(seen[1], 3);
+	BOOST_CHECK_EQUAL(seen[2], 5);
+	BOOST_CHECK_EQUAL(seen[3], 7);
+}
+
+BOOST_AUTO_TEST_CASE(blindDetectorFindsSamePulses)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm.addPoint(0, 1000);
+	params.rpm.addPoint(3, 5000);
+	params.noise = 200;
+	TachometerSignalGenerator gen(params);
+	std::vector<int16_t> signal(3 * params.sampleRate);
+	for (size_t i = 0; i < signal.size(); i++)
+	{
+		signal[i] = gen.next();
+	}
+
+	std::vector<PulseEvent> reference;
+	RPMCalculatorFromAudio detector(44100, 1);
+	detector.setPulseCallback([&](const PulseEvent& event) { reference.push_back(event); });
+	for (size_t i = 0; i < signal.size(); i++)
+	{
+		detector.check(signal[i]);
+	}
+	BOOST_REQUIRE(reference.size() > 100);
+
+	checkSamePulses(reference, runDetector<RPMCalculatorFromAudio>(signal, 1024));
+	checkSamePulses(reference, runDetector<BasicRPMCalculatorFromAudio<false> >(signal, 1));
+	checkSamePulses(reference, runDetector<BasicRPMCalculatorFromAudio<false> >(signal, 4096));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,203 @@
+/*
+ * PreFilter_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../RPMCalculatorFromAudio.hpp"
+#include "../SignalGenerator/TachometerSignalGenerator.hpp"
+#include "../StreamProcessors/PreFilter.hpp"
+
+#include <math.h>
+
+#include <vector>
+
+namespace {
+
+const int Rate = 44100;
+
+/// Amplitude of the output for a sine at frequency, after it has settled
+double gainAt(const PreFilter::Parameters& params, double frequency)
+{
+	PreFilter filter(Rate, params);
+	std::vector<int16_t> signal(Rate);
+	for (size_t i = 0; i < signal.size(); i++)
+	{
+		signal[i] = int16_t(10000 * sin(2 * M_PI * frequency * i / Rate));
+	}
+	double peak = 0;
+	size_t pos = 0;
+	filter.processBlock(signal.data(), signal.size(), 1, [&](const int16_t* filtered, size_t count) {
+		for (size_t i = 0; i < count; i++, pos++)
+		{
+			if (pos > signal.size() / 2)
+			{
+				peak = std::max(peak, fabs(filtered[i]));
+			}
+		}
+	});
+	BOOST_CHECK_EQUAL(signal.size(), pos);
+	return peak / 10000;
+}
+
+/// Pulses reported by the detector after the first 0.1 s (when the range is known), optionally with the samples filtered first
+size_t countPulses(const std::vector<int16_t>& signal, const PreFilter::Parameters& params)
+{
+	BlindRPMCalculatorFromAudio detector(Rate, 1);
+	size_t numPulses = 0;
+	detector.setPulseCallback([&](const PulseEvent& e) { numPulses += e.sampleIndex > Rate / 10; });
+	if (params.isEnabled())
+	{
+		PreFilter filter(Rate, params);
+		filter.processBlock(signal.data(), signal.size(), 1, [&](const int16_t* filtered, size_t count) {
+			detector.processBlock(filtered, count);
+		});
+	}
+	else
+	{
+		detector.processBlock(signal.data(), signal.size());
+	}
+	return numPulses;
+}
+
+}
+
+
+BOOST_AUTO_TEST_SUITE(PreFilter_Test)
+
+
+BOOST_AUTO_TEST_CASE(lowPass)
+{
+	PreFilter::Parameters params;
+	params.lowPassCutoff = 1000;
+	BOOST_CHECK_CLOSE(1.0, gainAt(params, 50), 1);
+	BOOST_CHECK_CLOSE(sqrt(0.5), gainAt(params, 1000), 2);
+	BOOST_CHECK_LT(gainAt(params, 10000), 0.015);   // 12 dB/octave
+
+	params.numSections = 2;
+	BOOST_CHECK_CLOSE(sqrt(0.5), gainAt(params, 1000), 2);
+	BOOST_CHECK_LT(gainAt(params, 10000), 0.0003);
+}
+
+
+BOOST_AUTO_TEST_CASE(bandPass)
+{
+	PreFilter::Parameters params;
+	params.highPassCutoff = 100;
+	params.lowPassCutoff = 2000;
+	BOOST_CHECK_CLOSE(1.0, gainAt(params, 450), 2);
+	BOOST_CHECK_LT(gainAt(params, 10), 0.015);
+	BOOST_CHECK_LT(gainAt(params, 20000), 0.015);
+}
+
+
+BOOST_AUTO_TEST_CASE(dcBlocker)
+{
+	PreFilter::Parameters params;
+	params.dcBlockerCutoff = 2;
+	PreFilter filter(Rate, params);
+	std::vector<int16_t> signal(2 * Rate, 5000);
+	std::vector<int16_t> out;
+	filter.processBlock(signal.data(), signal.size(), 1, [&](const int16_t* filtered, size_t count) {
+		out.insert(out.end(), filtered, filtered + count);
+	});
+	BOOST_REQUIRE_EQUAL(signal.size(), out.size());
+	BOOST_CHECK_EQUAL(5000, out[0]);
+	BOOST_CHECK_EQUAL(0, out.back());
+	BOOST_CHECK_CLOSE(1.0, gainAt(params, 100), 1);
+}
+
+
+BOOST_AUTO_TEST_CASE(stridedAndInParts)
+{
+	// Same output whatever the block boundaries, and for one channel of interleaved stereo
+	PreFilter::Parameters params;
+	params.dcBlockerCutoff = 2;
+	params.lowPassCutoff = 3000;
+	std::vector<int16_t> mono(5000);
+	std::vector<int16_t> stereo(2 * mono.size());
+	for (size_t i = 0; i < mono.size(); i++)
+	{
+		mono[i] = int16_t(8000 * sin(i * 0.05) + 3000 * ((i * 7919) % 13 - 6) / 6);
+		stereo[2 * i] = mono[i];
+		stereo[2 * i + 1] = 12345;
+	}
+
+	std::vector<int16_t> whole;
+	PreFilter a(Rate, params);
+	a.processBlock(mono.data(), mono.size(), 1, [&](const int16_t* filtered, size_t count) {
+		BOOST_CHECK_LE(count, size_t(PreFilter::MaxBlockSize));
+		whole.insert(whole.end(), filtered, filtered + count);
+	});
+
+	std::vector<int16_t> parts;
+	PreFilter b(Rate, params);
+	for (size_t pos = 0; pos < mono.size(); pos += 333)
+	{
+		size_t n = std::min<size_t>(333, mono.size() - pos);
+		b.processBlock(&stereo[2 * pos], n, 2, [&](const int16_t* filtered, size_t count) {
+			parts.insert(parts.end(), filtered, filtered + count);
+		});
+	}
+	BOOST_CHECK(whole == parts);
+}
+
+
+BOOST_AUTO_TEST_CASE(parse)
+{
+	PreFilter::Parameters params;
+	BOOST_CHECK(params.parse("dc"));
+	BOOST_CHECK_EQUAL(2, params.dcBlockerCutoff);
+	BOOST_CHECK_EQUAL(0, params.lowPassCutoff);
+
+	BOOST_CHECK(params.parse("dc:5,bandpass:20-2000,sections:2"));
+	BOOST_CHECK_EQUAL(5, params.dcBlockerCutoff);
+	BOOST_CHECK_EQUAL(20, params.highPassCutoff);
+	BOOST_CHECK_EQUAL(2000, params.lowPassCutoff);
+	BOOST_CHECK_EQUAL(2, params.numSections);
+
+	BOOST_CHECK(params.parse("lowpass:1500"));
+	BOOST_CHECK_EQUAL(0, params.dcBlockerCutoff);
+	BOOST_CHECK_EQUAL(1500, params.lowPassCutoff);
+	BOOST_CHECK(params.parse("highpass:50"));
+	BOOST_CHECK_EQUAL(50, params.highPassCutoff);
+
+	BOOST_CHECK(!params.parse(""));
+	BOOST_CHECK(!params.parse("sections:2"));
+	BOOST_CHECK(!params.parse("lowpass"));
+	BOOST_CHECK(!params.parse("lowpass:x"));
+	BOOST_CHECK(!params.parse("bandpass:2000-20"));
+	BOOST_CHECK(!params.parse("bandpass:20"));
+	BOOST_CHECK(!params.parse("dc,notch:50"));
+	BOOST_CHECK(!params.parse("dc,sections:1.5"));
+}
+
+
+BOOST_AUTO_TEST_CASE(removesFalseTriggers)
+{
+	// Broadband noise strong enough to cross the hysteresis between edges (about 300
+	// pulses instead of 98 without filtering)
+	TachometerSignalGenerator::Parameters gen;
+	gen.rpm = PiecewiseLinearProfile(1200);
+	gen.noise = 2000;
+	gen.dcDrift = 3000;
+	gen.dcDriftPeriod = 2;
+	std::vector<int16_t> signal(5 * Rate);
+	TachometerSignalGenerator(gen).generate(signal.data(), signal.size());
+	const size_t expected = (5 - 0.1) * 1200 / 60;
+
+	size_t unfiltered = countPulses(signal, PreFilter::Parameters());
+	PreFilter::Parameters params;
+	params.parse("dc,lowpass:2000");
+	size_t filtered = countPulses(signal, params);
+	BOOST_CHECK_GT(unfiltered, expected + 10);
+	BOOST_CHECK_LE(filtered, expected + 1);
+	BOOST_CHECK_GE(filtered, expected - 1);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,133 @@
+/*
+ * QuantileTracker_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../StreamProcessors/QuantileTracker.hpp"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+namespace {
+
+/// Sample of the given rank among the values, like QuantileTracker picks it
+int16_t quantile(const std::deque<int16_t>& values, double percent)
+{
+	std::vector<int16_t> sorted(values.begin(), values.end());
+	std::sort(sorted.begin(), sorted.end());
+	return sorted[size_t((sorted.size() - 1) * (percent / 100))];
+}
+
+}
+
+
+BOOST_AUTO_TEST_SUITE(QuantileTracker_Test)
+
+
+BOOST_AUTO_TEST_CASE(matchesSortedWindow)
+{
+	// Clusters far apart (like the low and high level of pulses), with the
+	// share of each changing, so the cursors have to cross the gap
+	srand(1);
+	QuantileTracker tracker(500, 5, 90);
+	std::deque<int16_t> window;
+	for (int i = 0; i < 20000; i++)
+	{
+		int highShare = (i / 2000) % 4 * 10;   // 0, 10, 20, 30 %
+		int16_t sample = (rand() % 100 < highShare) ? 20000 + rand() % 50 : -15000 + rand() % 50;
+		if (i % 997 == 0)
+		{
+			sample = i % 2 ? 32767 : -32768;
+		}
+		tracker.push(sample);
+		window.push_back(sample);
+		if (window.size() > 500)
+		{
+			window.pop_front();
+		}
+		if (i % 37 == 0 || i < 10)
+		{
+			BOOST_REQUIRE_EQUAL(quantile(window, 5), tracker.getLow());
+			BOOST_REQUIRE_EQUAL(quantile(window, 90), tracker.getHigh());
+		}
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(ignoresGlitches)
+{
+	QuantileTracker tracker(1000, 1, 99);
+	for (int i = 0; i < 5000; i++)
+	{
+		int16_t sample = (i % 10 == 0) ? 8000 : -2000;   // Pulses with 10% duty cycle
+		if (i == 3000 || i == 3001)
+		{
+			sample = 32767;
+		}
+		if (i == 3500)
+		{
+			sample = -32768;
+		}
+		tracker.push(sample);
+		if (i >= 1000)
+		{
+			BOOST_CHECK_EQUAL(-2000, tracker.getLow());
+			BOOST_CHECK_EQUAL(8000, tracker.getHigh());
+		}
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(extremesAreMinAndMax)
+{
+	QuantileTracker tracker(10, 0, 100);
+	const int16_t samples[] = { 5, -3, 7, 2, 100, -50, 0, 1, 1, 1, 1, 1, 1, 1, 1 };
+	for (int16_t s : samples)
+	{
+		tracker.push(s);
+	}
+	// Window is the last 10: -50 .. 1
+	BOOST_CHECK_EQUAL(-50, tracker.getLow());
+	BOOST_CHECK_EQUAL(1, tracker.getHigh());
+	BOOST_CHECK(tracker.isEnabled());
+	BOOST_CHECK(!QuantileTracker().isEnabled());
+}
+
+
+BOOST_AUTO_TEST_CASE(resizedWindowMatchesSortedWindow)
+{
+	srand(2);
+	QuantileTracker tracker(400, 10, 90);
+	BOOST_CHECK_EQUAL(400u, tracker.getCapacity());
+	std::deque<int16_t> window;
+	size_t windowSize = 400;
+	for (int i = 0; i < 6000; i++)
+	{
+		if (i % 1000 == 0)
+		{
+			windowSize = i % 2000 ? 400 : 50;
+			tracker.setWindowSize(windowSize);
+		}
+		int16_t sample = rand() % 2000 - (i / 100) % 2 * 5000;
+		tracker.push(sample);
+		window.push_back(sample);
+		// Shrinks by dropping two per sample
+		for (int k = 0; k < 2 && window.size() > windowSize; k++)
+		{
+			window.pop_front();
+		}
+		BOOST_REQUIRE_EQUAL(quantile(window, 10), tracker.getLow());
+		BOOST_REQUIRE_EQUAL(quantile(window, 90), tracker.getHigh());
+	}
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
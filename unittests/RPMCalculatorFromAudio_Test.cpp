@@ -0,0 +1,437 @@
+/*
+ * RPMCalculatorFromAudio_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../RPMCalculatorFromAudio.hpp"
+#include "../SignalGenerator/TachometerSignalGenerator.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+std::vector<PulseEvent> runDetector(const TachometerSignalGenerator::Parameters& params,
+		double seconds, int divisor = 1)
+{
+	std::vector<PulseEvent> pulses;
+	RPMCalculatorFromAudio detector(params.sampleRate, divisor);
+	detector.setPulseCallback([&](const PulseEvent& event) { pulses.push_back(event); });
+
+	TachometerSignalGenerator gen(params);
+	for (int i = 0; i < seconds * params.sampleRate; i++)
+	{
+		detector.check(gen.next());
+	}
+	return pulses;
+}
+
+} // namespace
+
+
+BOOST_AUTO_TEST_SUITE(RPMCalculatorFromAudio_Test)
+
+
+BOOST_AUTO_TEST_CASE(constantRpm)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm = PiecewiseLinearProfile(1500);
+	params.noise = 100;
+
+	std::vector<PulseEvent> pulses = runDetector(params, 4);
+
+	BOOST_REQUIRE(pulses.size() > 90);
+	for (size_t i = 1; i < pulses.size(); i++)
+	{
+		// Noise before the first pulse is counted, until min/max tracking
+		// has seen the real signal
+		if (pulses[i].sampleIndex < uint64_t(params.sampleRate / 2))
+		{
+			continue;
+		}
+		BOOST_CHECK_CLOSE(1500.0, pulses[i].rpm, 1.0);
+		BOOST_CHECK_SMALL(pulses[i].crossingTime - pulses[i-1].crossingTime - pulses[i].periodInSamples, 1e-6);
+		BOOST_CHECK(pulses[i].crossingTime <= pulses[i].sampleIndex);
+		BOOST_CHECK(pulses[i].crossingTime >= pulses[i].sampleIndex - 1.0);
+	}
+	BOOST_CHECK_CLOSE(1500.0, pulses.back().filteredRpm, 0.2);
+}
+
+
+BOOST_AUTO_TEST_CASE(rpmDivisor)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm = PiecewiseLinearProfile(1000);
+	params.pulsesPerRevolution = 4;
+
+	std::vector<PulseEvent> pulses = runDetector(params, 2, 4);
+
+	BOOST_REQUIRE(pulses.size() > 100);
+	BOOST_CHECK_CLOSE(1000.0, pulses.back().rpm, 1.0);
+}
+
+
+BOOST_AUTO_TEST_CASE(followsRamp)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm.addPoint(0, 600);
+	params.rpm.addPoint(1, 600);
+	params.rpm.addPoint(3, 3000);
+	params.rpm.addPoint(4, 3000);
+	params.jitter = 0.002;
+	params.noise = 50;
+
+	std::vector<PulseEvent> pulses = runDetector(params, 4);
+
+	BOOST_REQUIRE(!pulses.empty());
+	BOOST_CHECK_CLOSE(3000.0, pulses.back().rpm, 2.0);
+}
+
+
+BOOST_AUTO_TEST_CASE(noPulsesWhenAmplitudeTooLow)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.amplitude = PiecewiseLinearProfile(2);
+
+	std::vector<PulseEvent> pulses = runDetector(params, 2);
+
+	BOOST_CHECK(pulses.empty());
+}
+
+
+BOOST_AUTO_TEST_CASE(waveformDeliveredEveryThirdPulse)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm = PiecewiseLinearProfile(3000);
+
+	RPMCalculatorFromAudio detector(params.sampleRate, 1);
+	int numPulses = 0;
+	int numWaveforms = 0;
+	detector.setPulseCallback([&](const PulseEvent&) { numPulses++; });
+	detector.setWaveformCallback([&](const CappedStorageWaveform& w, const PulseEvent&) {
+		numWaveforms++;
+		BOOST_CHECK(w.size() > 0);
+	});
+
+	TachometerSignalGenerator gen(params);
+	for (int i = 0; i < params.sampleRate; i++)
+	{
+		detector.check(gen.next());
+	}
+
+	BOOST_CHECK(numPulses > 40);
+	BOOST_CHECK_EQUAL(numPulses / 3, numWaveforms);
+}
+
+
+
+namespace {
+
+struct RpmErrors {
+	double max;     // In percent
+	double rms;
+};
+
+/// Error of the per pulse rpm after the first second (when min/max tracking has settled)
+RpmErrors measureRpmErrors(const TachometerSignalGenerator::Parameters& params, double rpm,
+		CrossingInterpolation interpolation)
+{
+	BasicRPMCalculatorFromAudio<false> detector(params.sampleRate, 1);
+	detector.setCrossingInterpolation(interpolation);
+	RpmErrors errors = { 0, 0 };
+	int n = 0;
+	detector.setPulseCallback([&](const PulseEvent& event) {
+		if (event.sampleIndex < uint64_t(params.sampleRate))
+		{
+			return;
+		}
+		double error = 100 * (event.rpm - rpm) / rpm;
+		errors.max = std::max(errors.max, fabs(error));
+		errors.rms += error * error;
+		n++;
+	});
+
+	TachometerSignalGenerator gen(params);
+	std::vector<int16_t> block(1024);
+	for (int i = 0; i < 4 * params.sampleRate / 1024; i++)
+	{
+		gen.generate(&block[0], block.size());
+		detector.processBlock(&block[0], block.size());
+	}
+	BOOST_REQUIRE(n > 0);
+	errors.rms = sqrt(errors.rms / n);
+	return errors;
+}
+
+} // namespace
+
+
+BOOST_AUTO_TEST_CASE(interpolatedCrossingsAtHighRpm)
+{
+	// 88.2 samples per period, so whole sample periods alternate between 88 and 89
+	TachometerSignalGenerator::Parameters params;
+	params.rpm = PiecewiseLinearProfile(30000);
+	params.noise = 30;
+
+	RpmErrors none = measureRpmErrors(params, 30000, NoInterpolation);
+	RpmErrors linear = measureRpmErrors(params, 30000, LinearInterpolation);
+	BOOST_CHECK(none.rms > 0.4);
+	BOOST_CHECK(linear.rms < 0.1);
+	BOOST_CHECK(linear.max < 0.3);
+
+	// Slower edges (a few samples long) is where cubic helps
+	params.noise = 0;
+	params.sensorTimeConstant = 100e-6;
+	RpmErrors linearSlow = measureRpmErrors(params, 30000, LinearInterpolation);
+	RpmErrors cubicSlow = measureRpmErrors(params, 30000, CubicInterpolation);
+	BOOST_CHECK(linearSlow.rms < 0.03);
+	BOOST_CHECK(cubicSlow.rms < linearSlow.rms);
+}
+
+
+BOOST_AUTO_TEST_CASE(crossingTimesFollowGeneratedEdges)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm.addPoint(0, 6000);
+	params.rpm.addPoint(3, 24000);
+	params.noise = 10;
+
+	TachometerSignalGenerator gen(params);
+	gen.setRecordPulseTimes(true);
+	std::vector<PulseEvent> pulses;
+	RPMCalculatorFromAudio detector(params.sampleRate, 1);
+	detector.setPulseCallback([&](const PulseEvent& event) { pulses.push_back(event); });
+	for (int i = 0; i < 3 * params.sampleRate; i++)
+	{
+		detector.check(gen.next());
+	}
+
+	// The crossing trails the generated edge by a (nearly) constant delay, so
+	// periods between crossings match periods between edges
+	const std::vector<double>& edges = gen.getPulseTimes();
+	size_t numChecked = 0;
+	double sumSquaredError = 0;
+	for (size_t i = 1; i < pulses.size(); i++)
+	{
+		if (pulses[i].sampleIndex < uint64_t(params.sampleRate))
+		{
+			continue;
+		}
+		// Generated edge just before the crossing
+		std::vector<double>::const_iterator it = std::upper_bound(edges.begin(), edges.end(), pulses[i].crossingTime);
+		BOOST_REQUIRE(it - edges.begin() >= 2);
+		double edgePeriod = *(it - 1) - *(it - 2);
+		BOOST_CHECK_SMALL(pulses[i].periodInSamples - edgePeriod, 0.25);
+		sumSquaredError += (pulses[i].periodInSamples - edgePeriod) * (pulses[i].periodInSamples - edgePeriod);
+		numChecked++;
+	}
+	BOOST_REQUIRE(numChecked > 500);
+	BOOST_CHECK(sqrt(sumSquaredError / numChecked) < 0.1);   // Whole samples would give about 0.4
+}
+
+
+BOOST_AUTO_TEST_CASE(thresholdPercentageChangeTakesEffect)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm = PiecewiseLinearProfile(3000);
+
+	BlindRPMCalculatorFromAudio detector(params.sampleRate, 1);
+	std::vector<PulseEvent> pulses;
+	detector.setPulseCallback([&](const PulseEvent& event) { pulses.push_back(event); });
+
+	TachometerSignalGenerator gen(params);
+	std::vector<int16_t> block(441);
+	for (int n = 0; n < 200; n++)
+	{
+		if (n == 100)
+		{
+			detector.setThresholdPercentage(30);
+			BOOST_CHECK_EQUAL(30, detector.getThresholdPercentage());
+		}
+		for (size_t i = 0; i < block.size(); i++)
+		{
+			block[i] = gen.next();
+		}
+		detector.processBlock(&block[0], block.size());
+	}
+
+	BOOST_REQUIRE(pulses.size() > 80);
+	const PulseEvent& before = pulses[pulses.size() / 2 - 5];
+	const PulseEvent& after = pulses.back();
+	BOOST_CHECK_EQUAL(50, before.thresholdInPercentage);
+	BOOST_CHECK_EQUAL(30, after.thresholdInPercentage);
+	BOOST_CHECK_CLOSE(before.signalMin + 0.5 * (before.signalMax - before.signalMin), before.threshold, 0.1);
+	BOOST_CHECK_CLOSE(after.signalMin + 0.3 * (after.signalMax - after.signalMin), after.threshold, 0.1);
+	BOOST_CHECK_CLOSE(3000.0, after.rpm, 1.0);
+}
+
+
+BOOST_AUTO_TEST_CASE(rangeQuantilesIgnoreGlitch)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm = PiecewiseLinearProfile(3000);
+	params.noise = 100;
+	TachometerSignalGenerator gen(params);
+	std::vector<int16_t> signal(3 * params.sampleRate);
+	for (size_t i = 0; i < signal.size(); i++)
+	{
+		signal[i] = gen.next();
+	}
+	signal[params.sampleRate] = 32767;      // A click at 1 s
+
+	size_t counted[2];
+	for (int useQuantiles = 0; useQuantiles < 2; useQuantiles++)
+	{
+		RPMCalculatorFromAudio detector(params.sampleRate, 1);
+		if (useQuantiles)
+		{
+			detector.setRangeQuantiles(1, 99);
+		}
+		counted[useQuantiles] = 0;
+		detector.setPulseCallback([&](const PulseEvent& event) {
+			if (event.sampleIndex > uint64_t(params.sampleRate * 1.1))   // The click is a pulse too
+			{
+				counted[useQuantiles]++;
+				BOOST_CHECK_CLOSE(3000.0, event.rpm, 1.0);
+			}
+		});
+		detector.processBlock(&signal[0], signal.size());
+	}
+
+	// The click holds max for the rest of the signal, above the pulses
+	BOOST_CHECK_EQUAL(0u, counted[0]);
+	BOOST_CHECK(counted[1] >= 94 && counted[1] <= 96);
+}
+
+
+BOOST_AUTO_TEST_CASE(rangeWindowFollowsAmplitudeDrop)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm = PiecewiseLinearProfile(6000);
+	params.amplitude = PiecewiseLinearProfile(10000);
+	params.amplitude.addPoint(1.0, 10000);
+	params.amplitude.addPoint(1.001, 2000);
+	params.noise = 50;
+
+	size_t counted[2];
+	for (int adaptive = 0; adaptive < 2; adaptive++)
+	{
+		RPMCalculatorFromAudio detector(params.sampleRate, 1);
+		detector.setRangeWindowPeriods(adaptive ? 8 : 0);
+		counted[adaptive] = 0;
+		detector.setPulseCallback([&](const PulseEvent& event) {
+			if (event.sampleIndex > uint64_t(params.sampleRate * 1.2))
+			{
+				counted[adaptive]++;
+				BOOST_CHECK_CLOSE(6000.0, event.rpm, 1.0);
+			}
+		});
+		TachometerSignalGenerator gen(params);
+		for (int i = 0; i < 2 * params.sampleRate; i++)
+		{
+			detector.check(gen.next());
+		}
+	}
+
+	// The 2.6 s window still holds the old max, above the new pulses, while
+	// 8 periods (80 ms) have passed long ago
+	BOOST_CHECK_EQUAL(0u, counted[0]);
+	BOOST_CHECK(counted[1] >= 79 && counted[1] <= 81);
+}
+
+
+BOOST_AUTO_TEST_CASE(rangeWindowFollowsSpeedDrop)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm = PiecewiseLinearProfile(12000);
+	params.rpm.addPoint(1.0, 12000);
+	params.rpm.addPoint(1.01, 600);
+	params.noise = 50;
+
+	RPMCalculatorFromAudio detector(params.sampleRate, 1);
+	detector.setRangeWindowPeriods(4);
+	std::vector<PulseEvent> pulses;
+	detector.setPulseCallback([&](const PulseEvent& event) { pulses.push_back(event); });
+	TachometerSignalGenerator gen(params);
+	for (int i = 0; i < 4 * params.sampleRate; i++)
+	{
+		detector.check(gen.next());
+	}
+
+	// A 4 period window at 12000 rpm is 20 ms, but the range must not be
+	// lost in the 100 ms between the pulses at 600 rpm
+	size_t counted = 0;
+	for (const PulseEvent& pulse : pulses)
+	{
+		if (pulse.sampleIndex > uint64_t(params.sampleRate * 1.2))
+		{
+			counted++;
+			BOOST_CHECK_CLOSE(600.0, pulse.rpm, 1.0);
+		}
+	}
+	BOOST_CHECK(counted >= 27 && counted <= 29);
+}
+
+
+BOOST_AUTO_TEST_CASE(rpmFiltersIgnoreExtraPulse)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm = PiecewiseLinearProfile(3000);
+	params.noise = 100;
+	TachometerSignalGenerator gen(params);
+	std::vector<int16_t> signal(3 * params.sampleRate);
+	for (size_t i = 0; i < signal.size(); i++)
+	{
+		signal[i] = gen.next();
+	}
+
+	// A copy of the pulse after 1 s, halfway to the next one
+	size_t edge = 0;
+	{
+		RPMCalculatorFromAudio detector(params.sampleRate, 1);
+		detector.setPulseCallback([&](const PulseEvent& event) {
+			if (!edge && event.sampleIndex > uint64_t(params.sampleRate))
+			{
+				edge = event.sampleIndex;
+			}
+		});
+		detector.processBlock(&signal[0], signal.size());
+	}
+	BOOST_REQUIRE(edge);
+	std::copy(&signal[edge - 20], &signal[edge + 100], &signal[edge + 400]);
+
+	for (int filter = MeanFilter; filter <= HampelFilter; filter++)
+	{
+		RPMCalculatorFromAudio detector(params.sampleRate, 1);
+		detector.setRpmFilter(RpmFilter(filter));
+		double maxError = 0;
+		int numPulses = 0;
+		detector.setPulseCallback([&](const PulseEvent& event) {
+			if (event.sampleIndex > uint64_t(params.sampleRate / 2))
+			{
+				maxError = std::max(maxError, fabs(event.filteredRpm - 3000));
+				numPulses++;
+			}
+		});
+		detector.processBlock(&signal[0], signal.size());
+
+		BOOST_CHECK(numPulses >= 125 && numPulses <= 127);     // Including the extra one
+		if (filter == MeanFilter)
+		{
+			BOOST_CHECK(maxError > 300);
+		}
+		else
+		{
+			BOOST_CHECK_SMALL(maxError, 30.0);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
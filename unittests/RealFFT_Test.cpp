@@ -0,0 +1,77 @@
+/*
+ * RealFFT_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../StreamProcessors/RealFFT.hpp"
+
+#include <math.h>
+
+#include <complex>
+#include <random>
+#include <vector>
+
+
+BOOST_AUTO_TEST_SUITE(RealFFT_Test)
+
+
+BOOST_AUTO_TEST_CASE(matchesDirectDft)
+{
+	std::mt19937 rng(1);
+	for (size_t n : { 4, 8, 64, 1024 })
+	{
+		std::vector<float> in(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			in[i] = int(rng() % 2001) - 1000;
+		}
+
+		RealFFT fft(n);
+		BOOST_CHECK_EQUAL(n / 2 + 1, fft.getNumBins());
+		std::vector<RealFFT::Complex> out(fft.getNumBins());
+		fft.forward(in.data(), out.data());
+
+		double maxError = 0;
+		for (size_t k = 0; k < out.size(); k++)
+		{
+			std::complex<double> expected = 0;
+			for (size_t i = 0; i < n; i++)
+			{
+				expected += double(in[i]) * std::polar(1.0, -2 * M_PI * double(k * i % n) / n);
+			}
+			maxError = std::max(maxError, std::abs(expected - std::complex<double>(out[k])));
+		}
+		// Relative to the size of the bins (about 1000 * sqrt(n))
+		BOOST_CHECK_SMALL(maxError / (1000 * sqrt(n)), 1e-5);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(reusedForManyFrames)
+{
+	const size_t n = 256;
+	RealFFT fft(n);
+	std::vector<float> in(n);
+	std::vector<RealFFT::Complex> out(fft.getNumBins());
+	for (size_t bin : { 3, 17, 128 })
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			in[i] = cos(2 * M_PI * bin * i / n);
+		}
+		fft.forward(in.data(), out.data());
+		for (size_t k = 0; k < out.size(); k++)
+		{
+			double expected = k != bin ? 0 : bin == n / 2 ? n : n / 2.0;
+			BOOST_CHECK_SMALL(std::abs(out[k]) - expected, 1e-3);
+		}
+	}
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,201 @@
+/*
+ * RevolutionTracker_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../RevolutionTracker.hpp"
+
+#include <math.h>
+
+#include <vector>
+
+namespace {
+
+const int Rate = 44100;
+
+/**
+ * Crossing times of marks at the given angles (in revolutions, 0 .. 1,
+ * increasing), at rpm0 + slope * t (rpm, t in seconds).
+ */
+std::vector<double> markPulses(const std::vector<double>& marks, double rpm0, double slope, double seconds)
+{
+	std::vector<double> times;
+	double f0 = rpm0 / 60;
+	double a = slope / 60;
+	for (int rev = 0; ; rev++)
+	{
+		for (double mark : marks)
+		{
+			// Revolutions f0 * t + a * t^2 / 2 == rev + mark, from 0.05 revolutions in
+			double k = rev + mark + 0.05;
+			double t = a ? (-f0 + sqrt(f0 * f0 + 2 * a * k)) / a : k / f0;
+			if (t > seconds)
+			{
+				return times;
+			}
+			times.push_back(t * Rate);
+		}
+	}
+}
+
+std::vector<RevolutionEvent> track(const std::vector<double>& pulses, int marks)
+{
+	std::vector<RevolutionEvent> events;
+	RevolutionTracker::Parameters params;
+	params.pulsesPerRevolution = marks;
+	RevolutionTracker tracker(Rate, params);
+	tracker.setRevolutionCallback([&](const RevolutionEvent& e) { events.push_back(e); });
+	for (double t : pulses)
+	{
+		tracker.addPulse(t);
+	}
+	return events;
+}
+
+/// A 12 tooth wheel with one tooth missing: 11 marks, the last gap twice as long
+std::vector<double> missingToothWheel()
+{
+	std::vector<double> marks;
+	for (int k = 0; k < 11; k++)
+	{
+		marks.push_back(k / 12.0);
+	}
+	return marks;
+}
+
+} // namespace
+
+
+BOOST_AUTO_TEST_SUITE(RevolutionTracker_Test)
+
+BOOST_AUTO_TEST_CASE(unevenMarksGiveConstantRpm)
+{
+	std::vector<double> marks;
+	marks.push_back(0);
+	marks.push_back(0.2);
+	marks.push_back(0.45);
+	marks.push_back(0.8);
+	std::vector<RevolutionEvent> events = track(markPulses(marks, 1200, 0, 5), 4);
+
+	BOOST_REQUIRE(events.size() > 350);
+	for (size_t i = 3; i < events.size(); i++)
+	{
+		BOOST_CHECK_CLOSE(1200.0, events[i].rpm, 0.01);
+	}
+	// Segment rpm is right once the angles are learned (after the first revolution)
+	for (size_t i = 8; i < events.size(); i++)
+	{
+		BOOST_CHECK_CLOSE(1200.0, events[i].segmentRpm, 0.01);
+	}
+	// Dividing the pulse rate instead gives a ripple: the 0.2 revolutions from
+	// the last mark to the first one give 1.25 * rpm
+	BOOST_CHECK_CLOSE(1200.0 * 0.25 / 0.2, 60.0 * Rate / (events[3].crossingTime - events[2].crossingTime) / 4, 0.01);
+}
+
+BOOST_AUTO_TEST_CASE(findsIndexFromGap)
+{
+	std::vector<double> pulses = markPulses(missingToothWheel(), 3000, 0, 2);
+	std::vector<RevolutionEvent> events = track(pulses, 11);
+
+	BOOST_REQUIRE(events.size() > 500);
+	int numRevolutions = 0;
+	for (size_t i = 11; i < events.size(); i++)
+	{
+		const RevolutionEvent& e = events[i];
+		BOOST_CHECK(e.indexLocked);
+		// The index pulse is the first mark, after the gap. Event i is for
+		// pulse i + 1, and mark 0 is pulse 0, 11, 22, ...
+		BOOST_CHECK_EQUAL(int(i % 11), e.segment);
+		BOOST_CHECK_EQUAL(e.segment == 10, e.revolution);
+		numRevolutions += e.revolution;
+		BOOST_CHECK_CLOSE(3000.0, e.rpm, 0.01);
+		BOOST_CHECK_CLOSE(3000.0, e.segmentRpm, 0.01);
+	}
+	BOOST_CHECK(numRevolutions >= 97 && numRevolutions <= 99);
+}
+
+BOOST_AUTO_TEST_CASE(evenMarksDoNotLock)
+{
+	std::vector<double> marks;
+	for (int k = 0; k < 6; k++)
+	{
+		marks.push_back(k / 6.0);
+	}
+	std::vector<RevolutionEvent> events = track(markPulses(marks, 600, 0, 3), 6);
+	BOOST_REQUIRE(!events.empty());
+	for (const RevolutionEvent& e : events)
+	{
+		BOOST_CHECK(!e.indexLocked);
+	}
+	BOOST_CHECK_CLOSE(600.0, events.back().rpm, 0.01);
+}
+
+BOOST_AUTO_TEST_CASE(followsRampWithoutRipple)
+{
+	std::vector<double> pulses = markPulses(missingToothWheel(), 1000, 1000, 3);  // 1000 to 4000 rpm
+	std::vector<RevolutionEvent> events = track(pulses, 11);
+
+	BOOST_REQUIRE(events.size() > 500);
+	for (size_t i = 30; i < events.size(); i++)
+	{
+		// The rpm over the last revolution is the true rpm half a revolution back
+		double t = events[i].crossingTime / Rate;
+		double revolutionTime = 60.0 / (1000 + 1000 * t);
+		double expected = 1000 + 1000 * (t - revolutionTime / 2);
+		BOOST_CHECK_CLOSE(expected, events[i].rpm, 0.5);
+		// The segment rpm is the true rpm half a segment back
+		double segmentExpected = 1000 + 1000 * (t - revolutionTime / 24);
+		BOOST_CHECK_CLOSE(segmentExpected, events[i].segmentRpm, 0.5);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(restartsAfterMissedPulse)
+{
+	std::vector<double> pulses = markPulses(missingToothWheel(), 3000, 0, 2);
+	pulses.erase(pulses.begin() + 200);
+	std::vector<RevolutionEvent> events = track(pulses, 11);
+
+	// Locked again within three revolutions, to the right index
+	int numChecked = 0;
+	for (const RevolutionEvent& e : events)
+	{
+		if (e.crossingTime > pulses[200] + 3 * Rate / 50)
+		{
+			double revolutions = e.crossingTime / Rate * 50 - 0.05;     // 3000 rpm
+			BOOST_CHECK(e.indexLocked);
+			BOOST_CHECK_EQUAL(fabs(revolutions - floor(revolutions + 0.5)) < 1e-6, e.revolution);
+			BOOST_CHECK_CLOSE(3000.0, e.rpm, 0.01);
+			numChecked++;
+		}
+	}
+	BOOST_CHECK(numChecked > 500);
+}
+
+BOOST_AUTO_TEST_CASE(noEventForFirstPulseOrRestart)
+{
+	std::vector<double> pulses = markPulses(missingToothWheel(), 3000, 0, 1);
+	pulses.erase(pulses.begin() + 200);
+
+	RevolutionTracker::Parameters params;
+	params.pulsesPerRevolution = 11;
+	RevolutionTracker tracker(Rate, params);
+	size_t numEvents = 0;
+	tracker.setRevolutionCallback([&](const RevolutionEvent&) { numEvents++; });
+
+	// The pulse after the missing one starts over, like the very first one
+	for (size_t i = 0; i < pulses.size(); i++)
+	{
+		size_t before = numEvents;
+		bool reported = tracker.addPulse(pulses[i]);
+		BOOST_CHECK_EQUAL(numEvents == before + 1, reported);
+		BOOST_CHECK_EQUAL(i != 0 && i != 200, reported);
+	}
+	BOOST_CHECK_EQUAL(pulses.size() - 2, numEvents);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,89 @@
+/*
+ * RpmFusion_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../RpmFusion.hpp"
+
+namespace {
+
+PulseEvent makePulse(uint64_t sampleIndex, double rpm)
+{
+	PulseEvent pulse = PulseEvent();
+	pulse.sampleIndex = sampleIndex;
+	pulse.periodInSamples = 44100 * 60 / rpm;
+	pulse.rpm = rpm;
+	pulse.filteredRpm = rpm;
+	return pulse;
+}
+
+SpectralEstimate makeEstimate(uint64_t sampleIndex, double rpm, double confidence)
+{
+	SpectralEstimate estimate;
+	estimate.sampleIndex = sampleIndex;
+	estimate.frequency = rpm / 60;
+	estimate.rpm = rpm;
+	estimate.confidence = confidence;
+	return estimate;
+}
+
+}
+
+
+BOOST_AUTO_TEST_SUITE(RpmFusion_Test)
+
+
+BOOST_AUTO_TEST_CASE(agreeingUsesEdge)
+{
+	RpmFusion fusion;
+	PulseEvent pulse = makePulse(100000, 1510);
+	RpmFusion::Result r = fusion.fuse(&pulse, makeEstimate(100500, 1500, 0.9));
+	BOOST_CHECK_EQUAL(RpmFusion::Edge, r.source);
+	BOOST_CHECK_EQUAL(1510, r.rpm);
+
+	// Pulses newer than the estimate (the estimate lags behind)
+	pulse.sampleIndex = 200000;
+	BOOST_CHECK_EQUAL(RpmFusion::Edge, fusion.fuse(&pulse, makeEstimate(100500, 1500, 0.9)).source);
+}
+
+
+BOOST_AUTO_TEST_CASE(disagreeingUsesSpectral)
+{
+	// E.g. noise triggering the edge detector twice per pulse
+	RpmFusion fusion;
+	PulseEvent pulse = makePulse(100000, 3000);
+	RpmFusion::Result r = fusion.fuse(&pulse, makeEstimate(100500, 1500, 0.9));
+	BOOST_CHECK_EQUAL(RpmFusion::Spectral, r.source);
+	BOOST_CHECK_EQUAL(1500, r.rpm);
+}
+
+
+BOOST_AUTO_TEST_CASE(onlyOneAvailable)
+{
+	RpmFusion fusion;
+
+	// No pulses (yet), or the last one too long ago (amplitude too low)
+	BOOST_CHECK_EQUAL(RpmFusion::Spectral, fusion.fuse(NULL, makeEstimate(100500, 1500, 0.9)).source);
+	PulseEvent pulse = makePulse(100000, 1500);
+	BOOST_CHECK_EQUAL(RpmFusion::Edge, fusion.fuse(&pulse, makeEstimate(100000 + 4 * 1764, 1500, 0.9)).source);
+	BOOST_CHECK_EQUAL(RpmFusion::Spectral, fusion.fuse(&pulse, makeEstimate(100000 + 4 * 1764 + 1, 1500, 0.9)).source);
+
+	// Spectral estimate not trusted
+	pulse = makePulse(100000, 3000);
+	RpmFusion::Result r = fusion.fuse(&pulse, makeEstimate(100500, 1500, 0.3));
+	BOOST_CHECK_EQUAL(RpmFusion::Edge, r.source);
+	BOOST_CHECK_EQUAL(3000, r.rpm);
+
+	r = fusion.fuse(NULL, makeEstimate(100500, 1500, 0.3));
+	BOOST_CHECK_EQUAL(RpmFusion::None, r.source);
+	BOOST_CHECK_EQUAL(0, r.rpm);
+	BOOST_CHECK_EQUAL("none", RpmFusion::getSourceName(r.source));
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,76 @@
+/*
+ * SeqLock_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../SeqLock.hpp"
+
+#include <atomic>
+#include <thread>
+
+
+BOOST_AUTO_TEST_SUITE(SeqLock_Test)
+
+
+struct Triple {
+	int64_t a;
+	int64_t b;
+	int16_t c; // Size not a multiple of 4
+};
+
+
+BOOST_AUTO_TEST_CASE(storeAndLoad)
+{
+	Triple initial = { 1, 2, 3 };
+	SeqLockValue<Triple> value(initial);
+	BOOST_CHECK_EQUAL(0, value.getVersion());
+	BOOST_CHECK_EQUAL(1, value.load().a);
+	BOOST_CHECK_EQUAL(3, value.load().c);
+
+	Triple t = { -5, 7, -9 };
+	value.store(t);
+	Triple loaded = value.load();
+	BOOST_CHECK_EQUAL(-5, loaded.a);
+	BOOST_CHECK_EQUAL(7, loaded.b);
+	BOOST_CHECK_EQUAL(-9, loaded.c);
+	BOOST_CHECK_EQUAL(1, value.getVersion());
+}
+
+
+BOOST_AUTO_TEST_CASE(readersNeverSeeTornValues)
+{
+	Triple initial = { 0, 0, 0 };
+	SeqLockValue<Triple> value(initial);
+	std::atomic<bool> done(false);
+	std::atomic<int> numTorn(0);
+
+	std::thread reader([&]() {
+		while (!done)
+		{
+			Triple t = value.load();
+			if (t.b != -t.a || t.c != int16_t(t.a))
+			{
+				numTorn++;
+			}
+		}
+	});
+
+	for (int64_t i = 1; i <= 200000; i++)
+	{
+		Triple t = { i, -i, int16_t(i) };
+		value.store(t);
+	}
+	done = true;
+	reader.join();
+
+	BOOST_CHECK_EQUAL(0, numTorn);
+	BOOST_CHECK_EQUAL(200000, value.load().a);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,234 @@
+/*
+ * ShmPublisher_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../ShmPublisher.hpp"
+
+#include <stdio.h>
+
+#include <thread>
+
+
+BOOST_AUTO_TEST_SUITE(ShmPublisher_Test)
+
+
+static std::string uniqueName()
+{
+	char name[64];
+	snprintf(name, sizeof(name), "ShmPublisher_Test.%d", int(getpid()));
+	return name;
+}
+
+static PulseEvent makeEvent(uint64_t sampleIndex)
+{
+	PulseEvent e = PulseEvent();
+	e.sampleIndex = sampleIndex;
+	e.periodInSamples = 100;
+	e.rpm = double(sampleIndex);
+	e.filteredRpm = 2.0 * sampleIndex;
+	e.signalMin = -7;
+	e.signalMax = 9;
+	return e;
+}
+
+
+BOOST_AUTO_TEST_CASE(latestValue)
+{
+	const std::string name = uniqueName();
+	ShmPublisher publisher;
+	BOOST_REQUIRE(publisher.open(name.c_str(), 44100));
+
+	struct rpm_shm* shm = rpm_shm_open_reader(name.c_str());
+	BOOST_REQUIRE(shm);
+
+	struct rpm_shm_latest latest;
+	rpm_shm_read_latest(shm, &latest);
+	BOOST_CHECK_EQUAL(0, latest.num_pulses);
+	BOOST_CHECK_EQUAL(44100, latest.sample_rate);
+
+	publisher.publish(makeEvent(1000));
+	publisher.publish(makeEvent(1100));
+	rpm_shm_read_latest(shm, &latest);
+	BOOST_CHECK_EQUAL(2, latest.num_pulses);
+	BOOST_CHECK_EQUAL(1100, latest.sample_index);
+	BOOST_CHECK_EQUAL(1100, latest.rpm);
+	BOOST_CHECK_EQUAL(2200, latest.filtered_rpm);
+	BOOST_CHECK_EQUAL(-7, latest.signal_min);
+	BOOST_CHECK_EQUAL(9, latest.signal_max);
+	BOOST_CHECK_EQUAL(0, latest.tracked_sample_index);
+
+	SpeedEstimate estimate;
+	estimate.sampleIndex = 1144;
+	estimate.frequency = 25;
+	estimate.rpm = 1500;
+	estimate.locked = true;
+	publisher.publishTracked(estimate);
+	publisher.publish(makeEvent(1200));
+	rpm_shm_read_latest(shm, &latest);
+	BOOST_CHECK_EQUAL(1200, latest.rpm);
+	BOOST_CHECK_EQUAL(1144, latest.tracked_sample_index);
+	BOOST_CHECK_EQUAL(1500, latest.tracked_rpm);
+	BOOST_CHECK_EQUAL(1, latest.tracked_locked);
+	BOOST_CHECK_EQUAL(RPM_SHM_RUNNING, latest.stall_state);
+	BOOST_CHECK_EQUAL(RPM_SHM_SOURCE_EDGE, latest.rpm_source);
+
+	rpm_shm_close_reader(shm);
+	publisher.close();
+	BOOST_CHECK(rpm_shm_open_reader(name.c_str()) == NULL);
+}
+
+
+BOOST_AUTO_TEST_CASE(spectralEstimates)
+{
+	const std::string name = uniqueName();
+	ShmPublisher publisher;
+	BOOST_REQUIRE(publisher.open(name.c_str(), 44100));
+	struct rpm_shm* shm = rpm_shm_open_reader(name.c_str());
+	BOOST_REQUIRE(shm);
+
+	struct rpm_shm_latest latest;
+	rpm_shm_read_latest(shm, &latest);
+	BOOST_CHECK_EQUAL(RPM_SHM_SOURCE_NONE, latest.rpm_source);
+
+	SpectralEstimate estimate = { 22050, 25.0, 1500.5, 0.9 };
+	RpmFusion::Result result = { 1500.5, RpmFusion::Spectral };
+	publisher.publishEstimate(estimate, result);
+	rpm_shm_read_latest(shm, &latest);
+	BOOST_CHECK_EQUAL(RPM_SHM_SOURCE_SPECTRAL, latest.rpm_source);
+	BOOST_CHECK_EQUAL(22050, latest.sample_index);
+	BOOST_CHECK_EQUAL(1500.5, latest.rpm);
+	BOOST_CHECK_EQUAL(1500.5, latest.filtered_rpm);
+	BOOST_CHECK_EQUAL(0, latest.num_pulses);     // Not a pulse
+	BOOST_CHECK_EQUAL(0, rpm_shm_get_write_count(shm));
+
+	estimate.sampleIndex = 44100;
+	result.rpm = 1499.75;
+	result.source = RpmFusion::Edge;
+	publisher.publishEstimate(estimate, result);
+	rpm_shm_read_latest(shm, &latest);
+	BOOST_CHECK_EQUAL(RPM_SHM_SOURCE_EDGE, latest.rpm_source);
+	BOOST_CHECK_EQUAL(1499.75, latest.rpm);
+
+	result.source = RpmFusion::None;
+	publisher.publishEstimate(estimate, result);
+	rpm_shm_read_latest(shm, &latest);
+	BOOST_CHECK_EQUAL(RPM_SHM_SOURCE_NONE, latest.rpm_source);
+
+	rpm_shm_close_reader(shm);
+}
+
+
+BOOST_AUTO_TEST_CASE(stallUntilNextPulse)
+{
+	const std::string name = uniqueName();
+	ShmPublisher publisher;
+	BOOST_REQUIRE(publisher.open(name.c_str(), 44100));
+	struct rpm_shm* shm = rpm_shm_open_reader(name.c_str());
+	BOOST_REQUIRE(shm);
+
+	publisher.publish(makeEvent(1000));
+	StallEvent event;
+	event.sampleIndex = 5000;
+	event.rpm = 661.5;
+	event.stopped = false;
+	publisher.publishStall(event);
+
+	struct rpm_shm_latest latest;
+	rpm_shm_read_latest(shm, &latest);
+	BOOST_CHECK_EQUAL(RPM_SHM_STALLED, latest.stall_state);
+	BOOST_CHECK_EQUAL(5000, latest.stall_sample_index);
+	BOOST_CHECK_EQUAL(661.5, latest.stall_rpm);
+	BOOST_CHECK_EQUAL(1000, latest.rpm);     // The last measured one is kept
+	BOOST_CHECK_EQUAL(1, latest.num_pulses);
+
+	event.sampleIndex = 9000;
+	event.rpm = 0;
+	event.stopped = true;
+	publisher.publishStall(event);
+	rpm_shm_read_latest(shm, &latest);
+	BOOST_CHECK_EQUAL(RPM_SHM_STOPPED, latest.stall_state);
+	BOOST_CHECK_EQUAL(0, latest.stall_rpm);
+
+	publisher.publish(makeEvent(9100));
+	rpm_shm_read_latest(shm, &latest);
+	BOOST_CHECK_EQUAL(RPM_SHM_RUNNING, latest.stall_state);
+	BOOST_CHECK_EQUAL(9100, latest.rpm);
+
+	rpm_shm_close_reader(shm);
+}
+
+
+BOOST_AUTO_TEST_CASE(ringReportsLostPulses)
+{
+	const std::string name = uniqueName();
+	ShmPublisher publisher;
+	BOOST_REQUIRE(publisher.open(name.c_str(), 44100));
+	struct rpm_shm* shm = rpm_shm_open_reader(name.c_str());
+	BOOST_REQUIRE(shm);
+
+	uint64_t next = 0;
+	struct rpm_shm_pulse pulses[16];
+	uint64_t numLost = 1;
+	BOOST_CHECK_EQUAL(0, rpm_shm_read_pulses(shm, &next, pulses, 16, &numLost));
+	BOOST_CHECK_EQUAL(0, numLost);
+
+	for (uint64_t i = 0; i < 10; i++)
+	{
+		publisher.publish(makeEvent(i));
+	}
+	BOOST_CHECK_EQUAL(4, rpm_shm_read_pulses(shm, &next, pulses, 4, &numLost));
+	BOOST_CHECK_EQUAL(0, numLost);
+	BOOST_CHECK_EQUAL(3, pulses[3].sample_index);
+	BOOST_CHECK_EQUAL(4, next);
+
+	// Overwrite everything, only the last RING_SIZE - 1 can be trusted
+	for (uint64_t i = 10; i < 10 + 2 * RPM_SHM_RING_SIZE; i++)
+	{
+		publisher.publish(makeEvent(i));
+	}
+	const uint64_t end = 10 + 2 * RPM_SHM_RING_SIZE;
+	std::vector<struct rpm_shm_pulse> all(RPM_SHM_RING_SIZE);
+	size_t n = rpm_shm_read_pulses(shm, &next, all.data(), all.size(), &numLost);
+	BOOST_CHECK_EQUAL(RPM_SHM_RING_SIZE - 1, n);
+	BOOST_CHECK_EQUAL(end - (RPM_SHM_RING_SIZE - 1) - 4, numLost);
+	BOOST_CHECK_EQUAL(end, next);
+	BOOST_CHECK_EQUAL(end - 1, all[n - 1].sample_index);
+	for (size_t i = 1; i < n; i++)
+	{
+		BOOST_CHECK_EQUAL(all[i - 1].sample_index + 1, all[i].sample_index);
+	}
+
+	rpm_shm_close_reader(shm);
+}
+
+
+BOOST_AUTO_TEST_CASE(waitWakesOnPulse)
+{
+	const std::string name = uniqueName();
+	ShmPublisher publisher;
+	BOOST_REQUIRE(publisher.open(name.c_str(), 44100));
+	struct rpm_shm* shm = rpm_shm_open_reader(name.c_str());
+	BOOST_REQUIRE(shm);
+
+	BOOST_CHECK_EQUAL(0, rpm_shm_wait(shm, 0, 10));
+
+	std::thread writer([&]() {
+		usleep(20000);
+		publisher.publish(makeEvent(5));
+	});
+	uint64_t start = nowNs();
+	BOOST_CHECK_EQUAL(1, rpm_shm_wait(shm, 0, 5000));
+	BOOST_CHECK_LT(nowNs() - start, 2000000000ULL);
+	writer.join();
+
+	rpm_shm_close_reader(shm);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,181 @@
+/*
+ * SlidingRpmFilter_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../StreamProcessors/SlidingRpmFilter.hpp"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace {
+
+/// Straightforward versions of the filters, on a sorted copy of the window
+double reference(const std::deque<double>& window, const SlidingRpmFilter::Parameters& params)
+{
+	std::vector<double> v(window.begin(), window.end());
+	std::sort(v.begin(), v.end());
+	size_t n = v.size();
+	double sum = 0;
+	switch(params.filter)
+	{
+	case MeanFilter:
+		for (double x : v) { sum += x; }
+		return sum / n;
+
+	case MedianFilter:
+		return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+
+	case TrimmedMeanFilter:
+	{
+		size_t trim = size_t(n * params.trimFraction);
+		for (size_t i = trim; i < n - trim; i++) { sum += v[i]; }
+		return sum / (n - 2 * trim);
+	}
+
+	case HampelFilter:
+	{
+		double median = v[(n - 1) / 2];
+		std::vector<double> distances;
+		for (double x : v) { distances.push_back(fabs(x - median)); }
+		std::sort(distances.begin(), distances.end());
+		double band = distances[(n - 1) / 2] * params.hampelThreshold * 1.4826;
+		for (double x : v) { sum += fabs(x - median) <= band ? x : median; }
+		return sum / n;
+	}
+	}
+	return 0;
+}
+
+}
+
+
+BOOST_AUTO_TEST_SUITE(SlidingRpmFilter_Test)
+
+
+BOOST_AUTO_TEST_CASE(matchesReference)
+{
+	const RpmFilter filters[] = { MeanFilter, MedianFilter, TrimmedMeanFilter, HampelFilter };
+	const size_t windowSizes[] = { 1, 2, 5, 10, 31 };
+	for (RpmFilter filter : filters)
+	{
+		for (size_t windowSize : windowSizes)
+		{
+			srand(windowSize);
+			SlidingRpmFilter::Parameters params;
+			params.filter = filter;
+			params.windowSize = windowSize;
+			SlidingRpmFilter dut(params);
+			std::deque<double> window;
+			for (int i = 0; i < 2000; i++)
+			{
+				double value = 3000 + rand() % 100 * 0.5;
+				if (rand() % 10 == 0)
+				{
+					value *= (rand() % 2) ? 2 : 0.5;    // Doubled or missed pulse
+				}
+				dut.push(value);
+				window.push_back(value);
+				if (window.size() > windowSize)
+				{
+					window.pop_front();
+				}
+				BOOST_REQUIRE_CLOSE(reference(window, params), dut.getValue(), 1e-9);
+			}
+		}
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(rejectsSingleOutlier)
+{
+	const RpmFilter filters[] = { MedianFilter, TrimmedMeanFilter, HampelFilter };
+	for (RpmFilter filter : filters)
+	{
+		SlidingRpmFilter::Parameters params;
+		params.filter = filter;
+		SlidingRpmFilter dut(params);
+		for (int i = 0; i < 30; i++)
+		{
+			double rpm = 1500 + (i % 3 - 1) * 2;
+			dut.push(i == 20 ? 750 : rpm);   // A missed pulse
+			if (i > 3)
+			{
+				BOOST_CHECK_CLOSE(1500.0, dut.getValue(), 0.2);
+			}
+		}
+	}
+
+	// The mean is off by 75 rpm for the next 10 pulses
+	SlidingRpmFilter mean;
+	for (int i = 0; i < 10; i++)
+	{
+		mean.push(i == 5 ? 750 : 1500);
+	}
+	BOOST_CHECK_CLOSE(1425.0, mean.getValue(), 1e-9);
+}
+
+
+BOOST_AUTO_TEST_CASE(integerFractions)
+{
+	BasicSlidingRpmFilter<uint32_t, uint64_t>::Parameters params;
+	params.filter = MedianFilter;
+	params.windowSize = 4;
+	BasicSlidingRpmFilter<uint32_t, uint64_t> dut(params);
+	dut.push(100);
+	dut.push(4000000000u);
+	dut.push(103);
+	dut.push(1);
+	BOOST_CHECK_EQUAL(203u, dut.getNumerator());
+	BOOST_CHECK_EQUAL(2u, dut.getDenominator());
+
+	params.filter = HampelFilter;
+	BasicSlidingRpmFilter<uint32_t, uint64_t> hampel(params);
+	hampel.push(100);
+	hampel.push(4000000000u);
+	hampel.push(102);
+	hampel.push(98);
+	// Median 100, MAD 2: 4000000000 counts as 100
+	BOOST_CHECK_EQUAL(400u, hampel.getNumerator());
+	BOOST_CHECK_EQUAL(4u, hampel.getDenominator());
+}
+
+
+BOOST_AUTO_TEST_CASE(changeFilter)
+{
+	SlidingRpmFilter dut;
+	dut.push(1000);
+	dut.push(1000);
+	dut.push(4000);
+	BOOST_CHECK_CLOSE(2000.0, dut.getValue(), 1e-9);
+	dut.setFilter(MedianFilter);
+	BOOST_CHECK_CLOSE(1000.0, dut.getValue(), 1e-9);
+	dut.push(1600);
+	BOOST_CHECK_CLOSE(1300.0, dut.getValue(), 1e-9);
+}
+
+
+BOOST_AUTO_TEST_CASE(parse)
+{
+	RpmFilter filter = MeanFilter;
+	BOOST_CHECK(parseRpmFilter("hampel", filter));
+	BOOST_CHECK_EQUAL(HampelFilter, filter);
+	BOOST_CHECK(parseRpmFilter("trimmed", filter));
+	BOOST_CHECK_EQUAL(TrimmedMeanFilter, filter);
+	BOOST_CHECK(!parseRpmFilter("average", filter));
+	BOOST_CHECK_EQUAL(std::string("median"), getRpmFilterName(MedianFilter));
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,173 @@
+/*
+ * SpectralRPMEstimator_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../SpectralRPMEstimator.hpp"
+#include "../SignalGenerator/TachometerSignalGenerator.hpp"
+
+#include <math.h>
+
+#include <vector>
+
+namespace {
+
+std::vector<int16_t> makeSignal(int sampleRate, double rpm, double amplitude, double noise, double seconds)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.sampleRate = sampleRate;
+	params.rpm = PiecewiseLinearProfile(rpm);
+	params.amplitude = PiecewiseLinearProfile(amplitude);
+	params.noise = noise;
+	TachometerSignalGenerator gen(params);
+	std::vector<int16_t> signal(size_t(seconds * sampleRate));
+	gen.generate(signal.data(), signal.size());
+	return signal;
+}
+
+std::vector<SpectralEstimate> runEstimator(const std::vector<int16_t>& signal, int sampleRate,
+		int divisor = 1, size_t blockSize = 1000)
+{
+	std::vector<SpectralEstimate> estimates;
+	SpectralRPMEstimator estimator(sampleRate, divisor);
+	estimator.setEstimateCallback([&](const SpectralEstimate& e) { estimates.push_back(e); });
+	for (size_t pos = 0; pos < signal.size(); pos += blockSize)
+	{
+		estimator.processBlock(&signal[pos], std::min(blockSize, signal.size() - pos));
+	}
+	return estimates;
+}
+
+}
+
+
+BOOST_AUTO_TEST_SUITE(SpectralRPMEstimator_Test)
+
+
+BOOST_AUTO_TEST_CASE(constantRpm)
+{
+	for (int rate : { 44100, 192000 })
+	{
+		for (double rpm : { 600, 1500, 6000, 30000 })
+		{
+			std::vector<int16_t> signal = makeSignal(rate, rpm, 10000, 100, 1.5);
+			std::vector<SpectralEstimate> estimates = runEstimator(signal, rate);
+
+			SpectralRPMEstimator estimator(rate, 1);
+			size_t expected = (signal.size() - estimator.getFrameSize()) / estimator.getHopSize() + 1;
+			BOOST_REQUIRE_EQUAL(expected, estimates.size());
+			for (size_t i = 0; i < estimates.size(); i++)
+			{
+				BOOST_CHECK_EQUAL(estimator.getFrameSize() + i * estimator.getHopSize(), estimates[i].sampleIndex);
+				BOOST_CHECK_CLOSE(rpm, estimates[i].rpm, 0.05);
+				BOOST_CHECK_GT(estimates[i].confidence, 0.9);
+			}
+		}
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(divisor)
+{
+	std::vector<int16_t> signal = makeSignal(44100, 6000, 10000, 0, 1);
+	std::vector<SpectralEstimate> estimates = runEstimator(signal, 44100, 4);
+	BOOST_REQUIRE(!estimates.empty());
+	BOOST_CHECK_CLOSE(1500.0, estimates.back().rpm, 0.05);
+	BOOST_CHECK_CLOSE(100.0, estimates.back().frequency, 0.05);
+}
+
+
+BOOST_AUTO_TEST_CASE(weakSignalInNoise)
+{
+	// Peak to peak amplitude as large as the noise std dev, where the edge
+	// detector triggers on the noise
+	std::vector<int16_t> signal = makeSignal(44100, 6000, 100, 100, 2);
+	for (const SpectralEstimate& e : runEstimator(signal, 44100))
+	{
+		BOOST_CHECK_CLOSE(6000.0, e.rpm, 0.5);
+		BOOST_CHECK_GT(e.confidence, 0.5);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(noiseOnlyHasLowConfidence)
+{
+	std::vector<int16_t> signal = makeSignal(44100, 6000, 0, 100, 2);
+	std::vector<SpectralEstimate> estimates = runEstimator(signal, 44100);
+	BOOST_REQUIRE(!estimates.empty());
+	for (const SpectralEstimate& e : estimates)
+	{
+		BOOST_CHECK_LT(e.confidence, 0.2);
+	}
+
+	std::vector<int16_t> silence(44100);
+	for (const SpectralEstimate& e : runEstimator(silence, 44100))
+	{
+		BOOST_CHECK_EQUAL(0, e.confidence);
+		BOOST_CHECK_EQUAL(0, e.rpm);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(blockSizeAndStrideDoNotMatter)
+{
+	std::vector<int16_t> signal = makeSignal(44100, 1500, 10000, 100, 1);
+	std::vector<int16_t> stereo(2 * signal.size());
+	for (size_t i = 0; i < signal.size(); i++)
+	{
+		stereo[2 * i] = signal[i];
+		stereo[2 * i + 1] = -12345;
+	}
+
+	std::vector<SpectralEstimate> reference = runEstimator(signal, 44100, 1, signal.size());
+	std::vector<SpectralEstimate> small = runEstimator(signal, 44100, 1, 7);
+
+	std::vector<SpectralEstimate> strided;
+	SpectralRPMEstimator estimator(44100, 1);
+	estimator.setEstimateCallback([&](const SpectralEstimate& e) { strided.push_back(e); });
+	estimator.processBlock(stereo.data(), signal.size(), 2);
+
+	BOOST_REQUIRE_EQUAL(reference.size(), small.size());
+	BOOST_REQUIRE_EQUAL(reference.size(), strided.size());
+	for (size_t i = 0; i < reference.size(); i++)
+	{
+		BOOST_CHECK_EQUAL(reference[i].rpm, small[i].rpm);
+		BOOST_CHECK_EQUAL(reference[i].rpm, strided[i].rpm);
+		BOOST_CHECK_EQUAL(reference[i].confidence, strided[i].confidence);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(workerThreadGivesSameEstimates)
+{
+	std::vector<int16_t> signal = makeSignal(44100, 1500, 10000, 100, 1);
+	std::vector<SpectralEstimate> reference = runEstimator(signal, 44100);
+
+	std::vector<SpectralEstimate> estimates;
+	AsyncSpectralRPMEstimator async(44100, 1);
+	async.setEstimateCallback([&](const SpectralEstimate& e) { estimates.push_back(e); });
+	async.start();
+	for (size_t pos = 0; pos < signal.size(); pos += 512)
+	{
+		async.processBlock(&signal[pos], std::min<size_t>(512, signal.size() - pos));
+		usleep(500); // Slower than the worker, so nothing is dropped
+	}
+	async.stop();
+
+	BOOST_CHECK_EQUAL(0u, async.getNumDropped());
+	BOOST_REQUIRE_EQUAL(reference.size(), estimates.size());
+	for (size_t i = 0; i < reference.size(); i++)
+	{
+		BOOST_CHECK_EQUAL(reference[i].sampleIndex, estimates[i].sampleIndex);
+		BOOST_CHECK_EQUAL(reference[i].rpm, estimates[i].rpm);
+	}
+	BOOST_CHECK_EQUAL(reference.back().rpm, async.getLatest().rpm);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,182 @@
+/*
+ * SpeedTracker_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../RPMCalculatorFromAudio.hpp"
+#include "../SpeedTracker.hpp"
+#include "../SignalGenerator/TachometerSignalGenerator.hpp"
+
+#include <math.h>
+
+#include <vector>
+
+namespace {
+
+const int Rate = 44100;
+
+/// Crossing times of pulses at frequency f0 + slope * t (Hz, t in seconds)
+std::vector<double> rampPulses(double f0, double slope, double seconds)
+{
+	std::vector<double> times;
+	for (int k = 1; ; k++)
+	{
+		// Phase f0 * t + slope * t^2 / 2 == k
+		double t = slope ? (-f0 + sqrt(f0 * f0 + 2 * slope * k)) / slope : k / f0;
+		if (t > seconds)
+		{
+			break;
+		}
+		times.push_back(t * Rate);
+	}
+	return times;
+}
+
+/// Feeds the pulses in blocks of blockSize samples, like main does
+std::vector<SpeedEstimate> track(const std::vector<double>& pulses, double seconds,
+		size_t blockSize = 512, SpeedTracker::Parameters params = SpeedTracker::Parameters())
+{
+	std::vector<SpeedEstimate> estimates;
+	SpeedTracker tracker(Rate, 1, params);
+	tracker.setEstimateCallback([&](const SpeedEstimate& e) { estimates.push_back(e); });
+	size_t next = 0;
+	for (size_t pos = 0; pos < seconds * Rate; pos += blockSize)
+	{
+		while (next < pulses.size() && pulses[next] < pos + blockSize)
+		{
+			tracker.addPulse(pulses[next++]);
+		}
+		tracker.advance(blockSize);
+	}
+	return estimates;
+}
+
+}
+
+
+BOOST_AUTO_TEST_SUITE(SpeedTracker_Test)
+
+
+BOOST_AUTO_TEST_CASE(constantSpeed)
+{
+	std::vector<SpeedEstimate> estimates = track(rampPulses(25, 0, 2), 2);
+	BOOST_REQUIRE_EQUAL(size_t(173 * 512 / 44), estimates.size());  // 173 blocks of 512 samples
+	for (size_t i = 0; i < estimates.size(); i++)
+	{
+		BOOST_CHECK_EQUAL((i + 1) * 44, estimates[i].sampleIndex);
+		if (estimates[i].sampleIndex > 0.2 * Rate)
+		{
+			BOOST_CHECK(estimates[i].locked);
+			BOOST_CHECK_CLOSE(1500.0, estimates[i].rpm, 1e-6);
+		}
+	}
+	BOOST_CHECK_EQUAL(0, estimates[0].rpm);
+	BOOST_CHECK(!estimates[0].locked);
+}
+
+
+BOOST_AUTO_TEST_CASE(followsRampBetweenPulses)
+{
+	// 10 Hz (600 rpm) accelerating by 20 Hz per second: the period based rpm
+	// is up to 2 Hz behind
+	const double f0 = 10;
+	const double slope = 20;
+	std::vector<SpeedEstimate> estimates = track(rampPulses(f0, slope, 3), 3);
+	double maxError = 0;
+	for (const SpeedEstimate& e : estimates)
+	{
+		double t = double(e.sampleIndex) / Rate;
+		if (t > 1)  // About 20 pulses to settle to the acceleration
+		{
+			BOOST_CHECK(e.locked);
+			maxError = std::max(maxError, fabs(e.frequency - (f0 + slope * t)));
+		}
+	}
+	BOOST_CHECK_LT(maxError, 0.01);
+}
+
+
+BOOST_AUTO_TEST_CASE(missedAndExtraPulses)
+{
+	std::vector<double> pulses = rampPulses(50, 0, 2);
+	pulses.erase(pulses.begin() + 40);                              // Missed
+	pulses.insert(pulses.begin() + 60, pulses[59] + 0.5 * Rate / 50);  // Noise in between
+	for (const SpeedEstimate& e : track(pulses, 2))
+	{
+		if (e.sampleIndex > 0.2 * Rate)
+		{
+			BOOST_CHECK(e.locked);
+			BOOST_CHECK_CLOSE(3000.0, e.rpm, 1e-6);
+		}
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(unlocksWhenPulsesStop)
+{
+	std::vector<double> pulses = rampPulses(20, 0, 1);
+	std::vector<SpeedEstimate> estimates = track(pulses, 2);
+	for (const SpeedEstimate& e : estimates)
+	{
+		double periodsSinceLast = (e.sampleIndex - pulses.back()) * 20.0 / Rate;
+		if (e.sampleIndex > 0.3 * Rate)
+		{
+			BOOST_CHECK_EQUAL(periodsSinceLast <= 3, e.locked);
+		}
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(restartsOnNewSpeed)
+{
+	// Pulses at 20 Hz, then at 35 Hz: outliers until it starts over
+	std::vector<double> pulses = rampPulses(20, 0, 1);
+	for (int i = 0; i < 35; i++)
+	{
+		pulses.push_back(pulses.back() + Rate / 35.0);
+	}
+	std::vector<SpeedEstimate> estimates = track(pulses, 2);
+	BOOST_CHECK(estimates.back().locked);
+	BOOST_CHECK_CLOSE(2100.0, estimates.back().rpm, 1e-6);
+}
+
+
+BOOST_AUTO_TEST_CASE(withDetector)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.rpm.parse("0:600,4:6000");
+	params.noise = 100;
+	TachometerSignalGenerator gen(params);
+	std::vector<int16_t> signal(4 * Rate);
+	gen.generate(signal.data(), signal.size());
+
+	BlindRPMCalculatorFromAudio detector(Rate, 1);
+	SpeedTracker tracker(Rate, 1);
+	detector.setPulseCallback([&](const PulseEvent& e) { tracker.addPulse(e.crossingTime); });
+	double sumSquares = 0;
+	int n = 0;
+	tracker.setEstimateCallback([&](const SpeedEstimate& e) {
+		double t = double(e.sampleIndex) / Rate;
+		if (t > 1)  // After the first pulses, and settling to the acceleration
+		{
+			double error = e.rpm / params.rpm.valueAt(t) - 1;
+			sumSquares += error * error;
+			n++;
+		}
+	});
+	for (size_t pos = 0; pos < signal.size(); pos += 1024)
+	{
+		size_t count = std::min<size_t>(1024, signal.size() - pos);
+		detector.processBlock(&signal[pos], count);
+		tracker.advance(count);
+	}
+	BOOST_CHECK_LT(sqrt(sumSquares / n), 0.002);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
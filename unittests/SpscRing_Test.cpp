@@ -0,0 +1,99 @@
+/*
+ * SpscRing_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../SpscRing.hpp"
+
+#include <stdint.h>
+
+#include <thread>
+
+
+BOOST_AUTO_TEST_SUITE(SpscRing_Test)
+
+
+BOOST_AUTO_TEST_CASE(fillAndDrain)
+{
+	SpscRing<int> ring(4);
+	int v = 0;
+	BOOST_CHECK(!ring.tryPop(v));
+
+	BOOST_CHECK(ring.tryPush(1));
+	BOOST_CHECK(ring.tryPush(2));
+	BOOST_CHECK(ring.tryPush(3));
+	BOOST_CHECK(ring.tryPush(4));
+	BOOST_CHECK(!ring.tryPush(5));
+	BOOST_CHECK_EQUAL(4, ring.size());
+
+	BOOST_CHECK(ring.tryPop(v));
+	BOOST_CHECK_EQUAL(1, v);
+	BOOST_CHECK(ring.tryPush(6));
+
+	for (int expected : { 2, 3, 4, 6 })
+	{
+		BOOST_CHECK(ring.tryPop(v));
+		BOOST_CHECK_EQUAL(expected, v);
+	}
+	BOOST_CHECK(!ring.tryPop(v));
+	BOOST_CHECK_EQUAL(0, ring.size());
+}
+
+
+BOOST_AUTO_TEST_CASE(blocks)
+{
+	SpscRing<int16_t> ring(8);
+	const int16_t interleaved[] = { 1, -1, 2, -2, 3, -3, 4, -4, 5, -5, 6, -6, 7, -7, 8, -8, 9, -9, 10, -10 };
+	BOOST_CHECK_EQUAL(6, ring.tryPushBlock(interleaved, 6, 2));
+	BOOST_CHECK_EQUAL(2, ring.tryPushBlock(interleaved + 12, 4, 2));
+	BOOST_CHECK_EQUAL(0, ring.tryPushBlock(interleaved, 1));
+
+	int16_t out[10];
+	BOOST_CHECK_EQUAL(5, ring.tryPopBlock(out, 5));
+	BOOST_CHECK_EQUAL(2, ring.tryPushBlock(interleaved + 16, 2, 2)); // Wraps around
+	BOOST_CHECK_EQUAL(5, ring.tryPopBlock(out + 5, 10));
+	for (int i = 0; i < 10; i++)
+	{
+		BOOST_CHECK_EQUAL(i + 1, out[i]);
+	}
+	BOOST_CHECK_EQUAL(0, ring.tryPopBlock(out, 10));
+}
+
+
+BOOST_AUTO_TEST_CASE(twoThreads)
+{
+	SpscRing<uint64_t> ring(64);
+	const uint64_t n = 200000;
+
+	std::thread producer([&]() {
+		for (uint64_t i = 0; i < n; i++)
+		{
+			while (!ring.tryPush(i))
+			{
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	uint64_t expected = 0;
+	uint64_t numOutOfOrder = 0;
+	while (expected < n)
+	{
+		uint64_t v;
+		if (ring.tryPop(v))
+		{
+			numOutOfOrder += v != expected;
+			expected++;
+		}
+	}
+	producer.join();
+	BOOST_CHECK_EQUAL(0, numOutOfOrder);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
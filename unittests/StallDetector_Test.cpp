@@ -0,0 +1,165 @@
+/*
+ * StallDetector_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../StallDetector.hpp"
+
+#include <vector>
+
+namespace {
+
+const int Rate = 44100;
+
+/// Feeds the pulses in blocks of blockSize samples, like main does
+std::vector<StallEvent> run(const std::vector<double>& pulses, double seconds,
+		size_t blockSize = 512, StallDetector::Parameters params = StallDetector::Parameters())
+{
+	std::vector<StallEvent> events;
+	StallDetector stall(Rate, 1, params);
+	stall.setStallCallback([&](const StallEvent& e) { events.push_back(e); });
+	size_t next = 0;
+	for (size_t pos = 0; pos < seconds * Rate; pos += blockSize)
+	{
+		while (next < pulses.size() && pulses[next] < pos + blockSize)
+		{
+			stall.addPulse(pulses[next++]);
+		}
+		stall.advance(blockSize);
+	}
+	return events;
+}
+
+/// Pulses at rpm (one per revolution) from 0.1 s until the given time
+std::vector<double> pulsesUntil(double rpm, double seconds)
+{
+	std::vector<double> times;
+	for (double t = 0.1 * Rate; t < seconds * Rate; t += 60.0 * Rate / rpm)
+	{
+		times.push_back(t);
+	}
+	return times;
+}
+
+} // namespace
+
+
+BOOST_AUTO_TEST_SUITE(StallDetector_Test)
+
+BOOST_AUTO_TEST_CASE(nothingWhileRunning)
+{
+	BOOST_CHECK(run(pulsesUntil(600, 10), 10).empty());
+	BOOST_CHECK(run(std::vector<double>(), 10).empty());
+}
+
+BOOST_AUTO_TEST_CASE(decaysThenStops)
+{
+	std::vector<double> pulses = pulsesUntil(600, 2);   // 0.1 s periods
+	double last = pulses.back();
+	std::vector<StallEvent> events = run(pulses, 6);
+
+	BOOST_REQUIRE(events.size() > 10);
+	// First report at the deadline (2.5 periods), below the last rpm
+	BOOST_CHECK(events[0].sampleIndex >= last + 0.25 * Rate);
+	BOOST_CHECK(events[0].sampleIndex < last + 0.25 * Rate + 512);
+	BOOST_CHECK(!events[0].stopped);
+	for (size_t i = 0; i + 1 < events.size(); i++)
+	{
+		const StallEvent& e = events[i];
+		BOOST_CHECK(!e.stopped);
+		BOOST_CHECK(e.rpm < 600 / 2.5 + 0.1);
+		// An upper bound: a pulse would have come by now at that rpm
+		BOOST_CHECK_CLOSE(60.0 * Rate / (e.sampleIndex - last), e.rpm, 0.1);
+		BOOST_CHECK(events[i + 1].rpm < e.rpm || events[i + 1].stopped);
+	}
+
+	// A stop, once, 3 s after the last pulse
+	const StallEvent& stop = events.back();
+	BOOST_CHECK(stop.stopped);
+	BOOST_CHECK_EQUAL(0, stop.rpm);
+	BOOST_CHECK_EQUAL(uint64_t(ceil(last + 3 * Rate)), stop.sampleIndex);
+}
+
+BOOST_AUTO_TEST_CASE(stopTimeDoesNotDependOnBlockSize)
+{
+	std::vector<double> pulses = pulsesUntil(1500, 1.5);
+	std::vector<StallEvent> a = run(pulses, 6, 64);
+	std::vector<StallEvent> b = run(pulses, 6, 8192);      // Longer than updateInterval
+	BOOST_REQUIRE(!a.empty() && !b.empty());
+	BOOST_CHECK(a.back().stopped && b.back().stopped);
+	BOOST_CHECK_EQUAL(a.back().sampleIndex, b.back().sampleIndex);
+	// Every report is on the same grid, large blocks just skip some
+	BOOST_CHECK(b.size() < a.size());
+	for (const StallEvent& e : b)
+	{
+		bool found = false;
+		for (const StallEvent& f : a)
+		{
+			found = found || (f.sampleIndex == e.sampleIndex && f.rpm == e.rpm);
+		}
+		BOOST_CHECK(found);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(singleMissedPulseIsNotAStall)
+{
+	std::vector<double> pulses = pulsesUntil(600, 5);
+	pulses.erase(pulses.begin() + 20);
+	std::vector<StallEvent> events = run(pulses, 5);
+	BOOST_CHECK(events.empty());
+}
+
+BOOST_AUTO_TEST_CASE(restartsWithPulses)
+{
+	std::vector<double> pulses = pulsesUntil(600, 1);
+	for (double t = 6 * Rate; t < 8 * Rate; t += 0.1 * Rate)
+	{
+		pulses.push_back(t);
+	}
+	std::vector<StallEvent> events = run(pulses, 12);
+
+	// Stopped once after 1 s, and once more after 8 s
+	int numStops = 0;
+	for (const StallEvent& e : events)
+	{
+		BOOST_CHECK(e.sampleIndex < 4 * Rate || e.sampleIndex > 8 * Rate);
+		numStops += e.stopped;
+	}
+	BOOST_CHECK_EQUAL(2, numStops);
+}
+
+BOOST_AUTO_TEST_CASE(timerReportsStopWithoutSamples)
+{
+	StallDetector::Parameters params;
+	params.maxPeriod = 0.5;
+	StallDetector stall(Rate, 1, params);
+	std::vector<StallEvent> events;
+	stall.setStallCallback([&](const StallEvent& e) { events.push_back(e); });
+
+	stall.addPulse(1000);
+	stall.addPulse(1000 + Rate / 20);
+	stall.advance(Rate / 10);
+	BOOST_CHECK(events.empty());
+
+	// The samples stop coming; a timer checks where they should be
+	stall.checkAt(Rate / 5);                // Past the deadline (2.5 periods)
+	BOOST_REQUIRE_EQUAL(1u, events.size());
+	BOOST_CHECK(!events[0].stopped);
+	stall.checkAt(Rate);
+	BOOST_CHECK_EQUAL(uint64_t(Rate / 10), stall.getSampleIndex());
+	BOOST_REQUIRE_EQUAL(2u, events.size());
+	BOOST_CHECK(events[1].stopped);
+	BOOST_CHECK(stall.isStopped());
+	BOOST_CHECK_EQUAL(uint64_t(1000 + Rate / 20 + Rate / 2), events[1].sampleIndex);
+
+	// Nothing more when the samples come back
+	stall.advance(Rate);
+	BOOST_CHECK_EQUAL(2u, events.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,103 @@
+/*
+ * TachometerSignalGenerator_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../SignalGenerator/TachometerSignalGenerator.hpp"
+
+#include <vector>
+
+
+BOOST_AUTO_TEST_SUITE(TachometerSignalGenerator_Test)
+
+
+BOOST_AUTO_TEST_CASE(profileInterpolation)
+{
+	PiecewiseLinearProfile p;
+	BOOST_REQUIRE(p.parse("0:100,1:200,1:500,2:500"));
+
+	BOOST_CHECK_CLOSE(100.0, p.valueAt(-1), 1e-9);
+	BOOST_CHECK_CLOSE(100.0, p.valueAt(0), 1e-9);
+	BOOST_CHECK_CLOSE(150.0, p.valueAt(0.5), 1e-9);
+	BOOST_CHECK_CLOSE(500.0, p.valueAt(1), 1e-9); // Step
+	BOOST_CHECK_CLOSE(500.0, p.valueAt(10), 1e-9);
+	BOOST_CHECK_CLOSE(2.0, p.getEndTime(), 1e-9);
+
+	BOOST_CHECK(!p.parse("0:100,x"));
+	BOOST_CHECK(!p.parse("1:100,0:200")); // Time going backwards
+}
+
+
+BOOST_AUTO_TEST_CASE(sameSeedGivesSameSignal)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.noise = 200;
+	params.jitter = 0.01;
+	params.seed = 42;
+
+	TachometerSignalGenerator a(params);
+	TachometerSignalGenerator b(params);
+	params.seed = 43;
+	TachometerSignalGenerator c(params);
+
+	bool differsFromOtherSeed = false;
+	for (int i = 0; i < 10000; i++)
+	{
+		int16_t sa = a.next();
+		BOOST_REQUIRE_EQUAL(sa, b.next());
+		differsFromOtherSeed |= (sa != c.next());
+	}
+	BOOST_CHECK(differsFromOtherSeed);
+}
+
+
+BOOST_AUTO_TEST_CASE(pulseTimesFollowRpm)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.sampleRate = 48000;
+	params.rpm = PiecewiseLinearProfile(600); // 10 pulses/s
+	params.pulsesPerRevolution = 2;
+
+	TachometerSignalGenerator gen(params);
+	gen.setRecordPulseTimes(true);
+	for (int i = 0; i < params.sampleRate; i++)
+	{
+		gen.next();
+	}
+
+	const std::vector<double>& times = gen.getPulseTimes();
+	BOOST_REQUIRE_EQUAL(20, times.size());
+	for (size_t i = 1; i < times.size(); i++)
+	{
+		BOOST_CHECK_CLOSE(2400.0, times[i] - times[i-1], 1e-6);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(acCouplingRemovesDc)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.dutyCycle = 0.5;
+	params.dcOffset = 0;
+
+	TachometerSignalGenerator gen(params);
+	double sum = 0;
+	const int n = 10 * params.sampleRate;
+	for (int i = 0; i < n; i++)
+	{
+		int16_t s = gen.next();
+		if (i >= n - params.sampleRate)
+		{
+			sum += s;
+		}
+	}
+	// Pulse train alone has a mean of amplitude * dutyCycle = 5000
+	BOOST_CHECK_SMALL(sum / params.sampleRate, 100.0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,443 @@
+/*
+ * UdpPulseSender_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../UdpPulseSender.hpp"
+
+#include <poll.h>
+#include <stdio.h>
+
+#include <vector>
+
+
+BOOST_AUTO_TEST_SUITE(UdpPulseSender_Test)
+
+
+BOOST_AUTO_TEST_CASE(encodeDecode)
+{
+	struct rpm_udp_header header;
+	header.num_records = 2;
+	header.rig_id = 0xdeadbeef;
+	header.channel = 3;
+	header.type = RPM_UDP_TYPE_PULSES;
+	header.sequence = 0x0102030405060708ULL;
+	header.first_record = 77;
+	struct rpm_udp_pulse pulses[2] = {
+			{ 1000, 123456789, 2646, 1000.0 },
+			{ 3646, 123556789, 2646.5, 999.81 } };
+
+	uint8_t buffer[RPM_UDP_MAX_DATAGRAM_SIZE];
+	size_t size = rpm_udp_encode(buffer, &header, pulses);
+	BOOST_CHECK_EQUAL(RPM_UDP_HEADER_SIZE + 2 * RPM_UDP_RECORD_SIZE, size);
+	BOOST_CHECK_EQUAL(0x52, buffer[0]); // Little endian magic
+	BOOST_CHECK_EQUAL(0x08, buffer[16]);
+
+	struct rpm_udp_header h;
+	struct rpm_udp_pulse p[RPM_UDP_MAX_RECORDS];
+	BOOST_REQUIRE_EQUAL(0, rpm_udp_decode_header(buffer, size, &h));
+	rpm_udp_decode_pulses(buffer, &h, p);
+	BOOST_CHECK_EQUAL(2, h.num_records);
+	BOOST_CHECK_EQUAL(0xdeadbeef, h.rig_id);
+	BOOST_CHECK_EQUAL(3, h.channel);
+	BOOST_CHECK_EQUAL(RPM_UDP_TYPE_PULSES, h.type);
+	BOOST_CHECK_EQUAL(0x0102030405060708ULL, h.sequence);
+	BOOST_CHECK_EQUAL(77, h.first_record);
+	BOOST_CHECK_EQUAL(3646, p[1].sample_index);
+	BOOST_CHECK_EQUAL(123556789, p[1].timestamp_ns);
+	BOOST_CHECK_EQUAL(2646.5, p[1].period_in_samples);
+	BOOST_CHECK_EQUAL(999.81, p[1].rpm);
+
+	BOOST_CHECK_EQUAL(-1, rpm_udp_decode_header(buffer, size - 1, &h));
+	buffer[14] = RPM_UDP_NUM_TYPES;
+	BOOST_CHECK_EQUAL(-1, rpm_udp_decode_header(buffer, size, &h));
+	buffer[14] = RPM_UDP_TYPE_PULSES;
+	buffer[4] = 1;  // Version 1
+	BOOST_CHECK_EQUAL(-1, rpm_udp_decode_header(buffer, size, &h));
+	buffer[4] = RPM_UDP_VERSION;
+	buffer[0] ^= 1;
+	BOOST_CHECK_EQUAL(-1, rpm_udp_decode_header(buffer, size, &h));
+}
+
+
+BOOST_AUTO_TEST_CASE(encodeDecodeTracked)
+{
+	struct rpm_udp_header header;
+	header.num_records = 2;
+	header.rig_id = 5;
+	header.channel = 0;
+	header.type = RPM_UDP_TYPE_TRACKED;
+	header.sequence = 9;
+	header.first_record = 100;
+	struct rpm_udp_tracked tracked[2] = {
+			{ 44100, 123456789, 1499.75, RPM_UDP_TRACKED_LOCKED },
+			{ 44541, 123466789, 1500.25, 0 } };
+
+	uint8_t buffer[RPM_UDP_MAX_DATAGRAM_SIZE];
+	size_t size = rpm_udp_encode_tracked(buffer, &header, tracked);
+	BOOST_CHECK_EQUAL(RPM_UDP_HEADER_SIZE + 2 * RPM_UDP_RECORD_SIZE, size);
+	BOOST_CHECK_EQUAL(RPM_UDP_TYPE_TRACKED, buffer[14]);
+
+	struct rpm_udp_header h;
+	struct rpm_udp_tracked t[RPM_UDP_MAX_RECORDS];
+	BOOST_REQUIRE_EQUAL(0, rpm_udp_decode_header(buffer, size, &h));
+	BOOST_REQUIRE_EQUAL(RPM_UDP_TYPE_TRACKED, h.type);
+	rpm_udp_decode_tracked(buffer, &h, t);
+	BOOST_CHECK_EQUAL(100, h.first_record);
+	BOOST_CHECK_EQUAL(44100, t[0].sample_index);
+	BOOST_CHECK_EQUAL(123456789, t[0].timestamp_ns);
+	BOOST_CHECK_EQUAL(1499.75, t[0].rpm);
+	BOOST_CHECK_EQUAL(RPM_UDP_TRACKED_LOCKED, t[0].flags);
+	BOOST_CHECK_EQUAL(1500.25, t[1].rpm);
+	BOOST_CHECK_EQUAL(0, t[1].flags);
+}
+
+
+BOOST_AUTO_TEST_CASE(encodeDecodeStall)
+{
+	struct rpm_udp_header header;
+	header.num_records = 2;
+	header.rig_id = 5;
+	header.channel = 1;
+	header.type = RPM_UDP_TYPE_STALL;
+	header.sequence = 10;
+	header.first_record = 4;
+	struct rpm_udp_stall stall[2] = {
+			{ 88200, 223456789, 352.75, 0 },
+			{ 176400, 323456789, 0, RPM_UDP_STALL_STOPPED } };
+
+	uint8_t buffer[RPM_UDP_MAX_DATAGRAM_SIZE];
+	size_t size = rpm_udp_encode_stall(buffer, &header, stall);
+	BOOST_CHECK_EQUAL(RPM_UDP_HEADER_SIZE + 2 * RPM_UDP_RECORD_SIZE, size);
+	BOOST_CHECK_EQUAL(RPM_UDP_TYPE_STALL, buffer[14]);
+
+	struct rpm_udp_header h;
+	struct rpm_udp_stall t[RPM_UDP_MAX_RECORDS];
+	BOOST_REQUIRE_EQUAL(0, rpm_udp_decode_header(buffer, size, &h));
+	BOOST_REQUIRE_EQUAL(RPM_UDP_TYPE_STALL, h.type);
+	rpm_udp_decode_stall(buffer, &h, t);
+	BOOST_CHECK_EQUAL(4, h.first_record);
+	BOOST_CHECK_EQUAL(88200, t[0].sample_index);
+	BOOST_CHECK_EQUAL(223456789, t[0].timestamp_ns);
+	BOOST_CHECK_EQUAL(352.75, t[0].rpm);
+	BOOST_CHECK_EQUAL(0, t[0].flags);
+	BOOST_CHECK_EQUAL(176400, t[1].sample_index);
+	BOOST_CHECK_EQUAL(0, t[1].rpm);
+	BOOST_CHECK_EQUAL(RPM_UDP_STALL_STOPPED, t[1].flags);
+
+	buffer[4] = 2;  // Version 2 had no stall records
+	BOOST_CHECK_EQUAL(-1, rpm_udp_decode_header(buffer, size, &h));
+}
+
+
+BOOST_AUTO_TEST_CASE(encodeDecodeEstimate)
+{
+	struct rpm_udp_header header;
+	header.num_records = 2;
+	header.rig_id = 5;
+	header.channel = 0;
+	header.type = RPM_UDP_TYPE_ESTIMATE;
+	header.sequence = 11;
+	header.first_record = 20;
+	struct rpm_udp_estimate estimates[2] = {
+			{ 22050, 423456789, 1500.5, RPM_UDP_SOURCE_SPECTRAL },
+			{ 44100, 523456789, 1499.75, RPM_UDP_SOURCE_EDGE } };
+
+	uint8_t buffer[RPM_UDP_MAX_DATAGRAM_SIZE];
+	size_t size = rpm_udp_encode_estimate(buffer, &header, estimates);
+	BOOST_CHECK_EQUAL(RPM_UDP_HEADER_SIZE + 2 * RPM_UDP_RECORD_SIZE, size);
+	BOOST_CHECK_EQUAL(RPM_UDP_TYPE_ESTIMATE, buffer[14]);
+
+	struct rpm_udp_header h;
+	struct rpm_udp_estimate e[RPM_UDP_MAX_RECORDS];
+	BOOST_REQUIRE_EQUAL(0, rpm_udp_decode_header(buffer, size, &h));
+	BOOST_REQUIRE_EQUAL(RPM_UDP_TYPE_ESTIMATE, h.type);
+	rpm_udp_decode_estimate(buffer, &h, e);
+	BOOST_CHECK_EQUAL(20, h.first_record);
+	BOOST_CHECK_EQUAL(22050, e[0].sample_index);
+	BOOST_CHECK_EQUAL(423456789, e[0].timestamp_ns);
+	BOOST_CHECK_EQUAL(1500.5, e[0].rpm);
+	BOOST_CHECK_EQUAL(RPM_UDP_SOURCE_SPECTRAL, e[0].source);
+	BOOST_CHECK_EQUAL(1499.75, e[1].rpm);
+	BOOST_CHECK_EQUAL(RPM_UDP_SOURCE_EDGE, e[1].source);
+
+	buffer[4] = 3;  // Version 3 had no estimates
+	BOOST_CHECK_EQUAL(-1, rpm_udp_decode_header(buffer, size, &h));
+}
+
+
+struct LoopbackReceiver {
+	LoopbackReceiver() : port(0)
+	{
+		fd = socket(AF_INET, SOCK_DGRAM, 0);
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+		socklen_t len = sizeof(addr);
+		getsockname(fd, (struct sockaddr*)&addr, &len);
+		port = ntohs(addr.sin_port);
+	}
+
+	~LoopbackReceiver() { close(fd); }
+
+	/// @return false on timeout. Fills pulses, tracked, stall or estimates, depending on header.type.
+	bool receive(struct rpm_udp_header& header, std::vector<struct rpm_udp_pulse>& pulses, int timeoutMs,
+			std::vector<struct rpm_udp_tracked>* tracked = NULL, std::vector<struct rpm_udp_stall>* stall = NULL,
+			std::vector<struct rpm_udp_estimate>* estimates = NULL)
+	{
+		struct pollfd pfd = { fd, POLLIN, 0 };
+		if (poll(&pfd, 1, timeoutMs) <= 0)
+		{
+			return false;
+		}
+		uint8_t buffer[RPM_UDP_MAX_DATAGRAM_SIZE];
+		ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+		if (n < 0 || rpm_udp_decode_header(buffer, n, &header) != 0)
+		{
+			return false;
+		}
+		pulses.clear();
+		if (header.type == RPM_UDP_TYPE_PULSES)
+		{
+			pulses.resize(header.num_records);
+			rpm_udp_decode_pulses(buffer, &header, pulses.data());
+		}
+		else if (header.type == RPM_UDP_TYPE_TRACKED && tracked)
+		{
+			tracked->resize(header.num_records);
+			rpm_udp_decode_tracked(buffer, &header, tracked->data());
+		}
+		else if (header.type == RPM_UDP_TYPE_STALL && stall)
+		{
+			stall->resize(header.num_records);
+			rpm_udp_decode_stall(buffer, &header, stall->data());
+		}
+		else if (header.type == RPM_UDP_TYPE_ESTIMATE && estimates)
+		{
+			estimates->resize(header.num_records);
+			rpm_udp_decode_estimate(buffer, &header, estimates->data());
+		}
+		return true;
+	}
+
+	int fd;
+	int port;
+};
+
+static PulseEvent makeEvent(uint64_t sampleIndex)
+{
+	PulseEvent e = PulseEvent();
+	e.sampleIndex = sampleIndex;
+	e.periodInSamples = 441;
+	e.rpm = 6000;
+	return e;
+}
+
+
+BOOST_AUTO_TEST_CASE(batchesByCountAndTime)
+{
+	LoopbackReceiver receiver;
+	UdpPulseSender::Parameters params;
+	params.rigId = 7;
+	params.channel = 1;
+	params.maxPulsesPerDatagram = 4;
+	params.maxDelayMs = 20;
+	UdpPulseSender sender(params);
+
+	char destination[64];
+	snprintf(destination, sizeof(destination), "127.0.0.1:%d", receiver.port);
+	std::string error;
+	BOOST_REQUIRE_MESSAGE(sender.open(destination, error), error);
+	sender.start();
+
+	// 4 pulses fill a datagram, the 5th is sent after maxDelayMs
+	for (uint64_t i = 0; i < 5; i++)
+	{
+		sender.push(makeEvent(1000 + 441 * i));
+	}
+
+	struct rpm_udp_header header;
+	std::vector<struct rpm_udp_pulse> pulses;
+	BOOST_REQUIRE(receiver.receive(header, pulses, 2000));
+	BOOST_CHECK_EQUAL(7, header.rig_id);
+	BOOST_CHECK_EQUAL(1, header.channel);
+	BOOST_CHECK_EQUAL(RPM_UDP_TYPE_PULSES, header.type);
+	BOOST_CHECK_EQUAL(0, header.sequence);
+	BOOST_CHECK_EQUAL(0, header.first_record);
+	BOOST_REQUIRE_EQUAL(4, pulses.size());
+	BOOST_CHECK_EQUAL(1000 + 441 * 3, pulses[3].sample_index);
+	BOOST_CHECK_EQUAL(441, pulses[3].period_in_samples);
+	BOOST_CHECK_EQUAL(6000, pulses[3].rpm);
+
+	uint64_t start = nowNs();
+	BOOST_REQUIRE(receiver.receive(header, pulses, 2000));
+	BOOST_CHECK_EQUAL(1, header.sequence);
+	BOOST_CHECK_EQUAL(4, header.first_record);
+	BOOST_CHECK_EQUAL(1, pulses.size());
+	BOOST_CHECK_LT(nowNs() - start, 1000000000ULL);
+
+	sender.stop();
+	BOOST_CHECK_EQUAL(2, sender.getNumDatagrams());
+	BOOST_CHECK_EQUAL(0, sender.getNumDropped());
+}
+
+
+BOOST_AUTO_TEST_CASE(sendsTrackedSpeedsInTheirOwnDatagrams)
+{
+	LoopbackReceiver receiver;
+	UdpPulseSender::Parameters params;
+	params.maxPulsesPerDatagram = 3;
+	params.maxDelayMs = 1000;
+	UdpPulseSender sender(params);
+
+	char destination[64];
+	snprintf(destination, sizeof(destination), "127.0.0.1:%d", receiver.port);
+	std::string error;
+	BOOST_REQUIRE_MESSAGE(sender.open(destination, error), error);
+	sender.start();
+
+	// Interleaved, as from onPulse() and onTrackedSpeed()
+	for (uint64_t i = 0; i < 3; i++)
+	{
+		sender.push(makeEvent(1000 + 441 * i));
+		SpeedEstimate estimate;
+		estimate.sampleIndex = 1000 + 441 * i + 100;
+		estimate.frequency = 100;
+		estimate.rpm = 6000 + i;
+		estimate.locked = i > 0;
+		sender.pushTracked(estimate);
+	}
+
+	struct rpm_udp_header header;
+	std::vector<struct rpm_udp_pulse> pulses;
+	std::vector<struct rpm_udp_tracked> tracked;
+	BOOST_REQUIRE(receiver.receive(header, pulses, 2000, &tracked));
+	BOOST_CHECK_EQUAL(RPM_UDP_TYPE_PULSES, header.type);
+	BOOST_CHECK_EQUAL(0, header.sequence);
+	BOOST_CHECK_EQUAL(3, pulses.size());
+
+	BOOST_REQUIRE(receiver.receive(header, pulses, 2000, &tracked));
+	BOOST_CHECK_EQUAL(RPM_UDP_TYPE_TRACKED, header.type);
+	BOOST_CHECK_EQUAL(1, header.sequence);
+	BOOST_CHECK_EQUAL(0, header.first_record);
+	BOOST_REQUIRE_EQUAL(3, tracked.size());
+	BOOST_CHECK_EQUAL(1100, tracked[0].sample_index);
+	BOOST_CHECK_EQUAL(6000, tracked[0].rpm);
+	BOOST_CHECK_EQUAL(0, tracked[0].flags);
+	BOOST_CHECK_EQUAL(6002, tracked[2].rpm);
+	BOOST_CHECK_EQUAL(RPM_UDP_TRACKED_LOCKED, tracked[2].flags);
+
+	sender.stop();
+	BOOST_CHECK_EQUAL(2, sender.getNumDatagrams());
+	BOOST_CHECK_EQUAL(0, sender.getNumDropped());
+}
+
+
+BOOST_AUTO_TEST_CASE(sendsStallsInTheirOwnDatagrams)
+{
+	LoopbackReceiver receiver;
+	UdpPulseSender::Parameters params;
+	params.maxPulsesPerDatagram = 2;
+	params.maxDelayMs = 1000;
+	UdpPulseSender sender(params);
+
+	char destination[64];
+	snprintf(destination, sizeof(destination), "127.0.0.1:%d", receiver.port);
+	std::string error;
+	BOOST_REQUIRE_MESSAGE(sender.open(destination, error), error);
+	sender.start();
+
+	// The last pulse, a falling upper bound, and the stop
+	sender.push(makeEvent(1000));
+	StallEvent falling = { 12000, 300, false };
+	StallEvent stopped = { 133300, 0, true };
+	sender.pushStall(falling);
+	sender.pushStall(stopped);
+
+	struct rpm_udp_header header;
+	std::vector<struct rpm_udp_pulse> pulses;
+	std::vector<struct rpm_udp_stall> stall;
+	BOOST_REQUIRE(receiver.receive(header, pulses, 2000, NULL, &stall));
+	BOOST_CHECK_EQUAL(RPM_UDP_TYPE_STALL, header.type);
+	BOOST_CHECK_EQUAL(0, header.sequence);
+	BOOST_CHECK_EQUAL(0, header.first_record);
+	BOOST_REQUIRE_EQUAL(2, stall.size());
+	BOOST_CHECK_EQUAL(12000, stall[0].sample_index);
+	BOOST_CHECK_EQUAL(300, stall[0].rpm);
+	BOOST_CHECK_EQUAL(0, stall[0].flags);
+	BOOST_CHECK_EQUAL(133300, stall[1].sample_index);
+	BOOST_CHECK_EQUAL(0, stall[1].rpm);
+	BOOST_CHECK_EQUAL(RPM_UDP_STALL_STOPPED, stall[1].flags);
+
+	// The lone pulse goes out when its time is up
+	BOOST_REQUIRE(receiver.receive(header, pulses, 3000));
+	BOOST_CHECK_EQUAL(RPM_UDP_TYPE_PULSES, header.type);
+	BOOST_CHECK_EQUAL(1, header.sequence);
+	BOOST_CHECK_EQUAL(1, pulses.size());
+
+	sender.stop();
+	BOOST_CHECK_EQUAL(2, sender.getNumDatagrams());
+	BOOST_CHECK_EQUAL(0, sender.getNumDropped());
+}
+
+
+BOOST_AUTO_TEST_CASE(sendsEstimates)
+{
+	LoopbackReceiver receiver;
+	UdpPulseSender::Parameters params;
+	params.maxPulsesPerDatagram = 3;
+	params.maxDelayMs = 1000;
+	UdpPulseSender sender(params);
+
+	char destination[64];
+	snprintf(destination, sizeof(destination), "127.0.0.1:%d", receiver.port);
+	std::string error;
+	BOOST_REQUIRE_MESSAGE(sender.open(destination, error), error);
+	sender.start();
+
+	// As from onSpectralEstimate() with --estimator fused
+	const RpmFusion::Source sources[3] = { RpmFusion::None, RpmFusion::Spectral, RpmFusion::Edge };
+	for (int i = 0; i < 3; i++)
+	{
+		SpectralEstimate estimate = { uint64_t(22050 * (i + 1)), 25.0, 1500.0 + i, 0.9 };
+		RpmFusion::Result result = { i ? 1500.0 + i : 0, sources[i] };
+		sender.pushEstimate(estimate, result);
+	}
+
+	struct rpm_udp_header header;
+	std::vector<struct rpm_udp_pulse> pulses;
+	std::vector<struct rpm_udp_estimate> estimates;
+	BOOST_REQUIRE(receiver.receive(header, pulses, 2000, NULL, NULL, &estimates));
+	BOOST_CHECK_EQUAL(RPM_UDP_TYPE_ESTIMATE, header.type);
+	BOOST_CHECK_EQUAL(0, header.first_record);
+	BOOST_REQUIRE_EQUAL(3, estimates.size());
+	BOOST_CHECK_EQUAL(22050, estimates[0].sample_index);
+	BOOST_CHECK_EQUAL(0, estimates[0].rpm);
+	BOOST_CHECK_EQUAL(RPM_UDP_SOURCE_NONE, estimates[0].source);
+	BOOST_CHECK_EQUAL(1501, estimates[1].rpm);
+	BOOST_CHECK_EQUAL(RPM_UDP_SOURCE_SPECTRAL, estimates[1].source);
+	BOOST_CHECK_EQUAL(66150, estimates[2].sample_index);
+	BOOST_CHECK_EQUAL(RPM_UDP_SOURCE_EDGE, estimates[2].source);
+
+	sender.stop();
+	BOOST_CHECK_EQUAL(1, sender.getNumDatagrams());
+}
+
+
+BOOST_AUTO_TEST_CASE(badDestination)
+{
+	UdpPulseSender sender;
+	std::string error;
+	BOOST_CHECK(!sender.open("localhost", error));
+	BOOST_CHECK(!error.empty());
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,252 @@
+/*
+ * rpmcore_Test.cpp
+ *
+ *  Copyright (c) 2016 Simon Gustafsson (www.optisimon.com)
+ *  Do whatever you like with this code, but please refer to me as the original author.
+ */
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../Library/rpmcore.h"
+#include "../RPMCalculatorFromAudio.hpp"
+#include "../SignalGenerator/TachometerSignalGenerator.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace {
+
+std::vector<int16_t> makeSignal(double rpm, double seconds, int sampleRate = 44100)
+{
+	TachometerSignalGenerator::Parameters params;
+	params.sampleRate = sampleRate;
+	params.rpm = PiecewiseLinearProfile(rpm);
+	params.noise = 50;
+	TachometerSignalGenerator gen(params);
+	std::vector<int16_t> signal(size_t(seconds * sampleRate));
+	gen.generate(signal.data(), signal.size());
+	return signal;
+}
+
+std::vector<rpmcore_pulse> pollAll(rpmcore* rpm)
+{
+	std::vector<rpmcore_pulse> pulses;
+	rpmcore_pulse buffer[7];
+	size_t n;
+	while ((n = rpmcore_poll(rpm, buffer, 7)) > 0)
+	{
+		pulses.insert(pulses.end(), buffer, buffer + n);
+	}
+	return pulses;
+}
+
+void onPulse(void* userData, const rpmcore_pulse* pulse)
+{
+	static_cast<std::vector<rpmcore_pulse>*>(userData)->push_back(*pulse);
+}
+
+} // namespace
+
+
+BOOST_AUTO_TEST_SUITE(rpmcore_Test)
+
+
+BOOST_AUTO_TEST_CASE(invalidConfig)
+{
+	rpmcore_config config;
+	rpmcore_config_init(&config);
+	config.divisor = 0;
+	BOOST_CHECK(rpmcore_create(&config) == NULL);
+
+	rpmcore_config_init(&config);
+	config.threshold_percentage = 100;
+	BOOST_CHECK(rpmcore_create(&config) == NULL);
+	BOOST_CHECK(rpmcore_create(NULL) == NULL);
+
+	// Too large for a std::vector (length_error), or for memory (bad_alloc)
+	rpmcore_config_init(&config);
+	config.event_queue_size = SIZE_MAX;
+	BOOST_CHECK(rpmcore_create(&config) == NULL);
+	config.event_queue_size = SIZE_MAX / 2 / sizeof(rpmcore_pulse);
+	BOOST_CHECK(rpmcore_create(&config) == NULL);
+
+	BOOST_CHECK_EQUAL(RPMCORE_API_VERSION, rpmcore_api_version());
+}
+
+
+BOOST_AUTO_TEST_CASE(configLayoutIsFrozen)
+{
+	// Programs built against librpmcore.so.1 allocate the config themselves
+	BOOST_CHECK_EQUAL(16u, offsetof(rpmcore_config, event_queue_size));
+	BOOST_CHECK_EQUAL(16u + sizeof(size_t), sizeof(rpmcore_config));
+}
+
+
+BOOST_AUTO_TEST_CASE(invalidDecimation)
+{
+	rpmcore_config config;
+	rpmcore_config_init(&config);
+	rpmcore* rpm = rpmcore_create(&config);
+	BOOST_REQUIRE(rpm);
+	BOOST_CHECK_EQUAL(-1, rpmcore_set_decimation(rpm, 0));
+	BOOST_CHECK_EQUAL(0, rpmcore_set_decimation(rpm, 4));
+
+	int16_t samples[64] = { 0 };
+	rpmcore_process(rpm, samples, 64, 1);
+	BOOST_CHECK_EQUAL(-1, rpmcore_set_decimation(rpm, 8));
+	rpmcore_destroy(rpm);
+}
+
+
+BOOST_AUTO_TEST_CASE(sameResultAsDetector)
+{
+	std::vector<int16_t> signal = makeSignal(3000, 2);
+
+	std::vector<PulseEvent> expected;
+	BlindRPMCalculatorFromAudio detector(44100, 1);
+	detector.setPulseCallback([&](const PulseEvent& e) { expected.push_back(e); });
+	for (int16_t s : signal)
+	{
+		detector.check(s);
+	}
+
+	// Interleave with a silent channel, and feed in odd sized blocks
+	std::vector<int16_t> stereo(signal.size() * 2, 0);
+	for (size_t i = 0; i < signal.size(); i++)
+	{
+		stereo[2 * i + 1] = signal[i];
+	}
+
+	rpmcore_config config;
+	rpmcore_config_init(&config);
+	config.event_queue_size = 1000;
+	rpmcore* rpm = rpmcore_create(&config);
+	BOOST_REQUIRE(rpm);
+
+	std::vector<rpmcore_pulse> actual;
+	size_t numReported = 0;
+	for (size_t pos = 0; pos < signal.size(); pos += 333)
+	{
+		size_t n = std::min<size_t>(333, signal.size() - pos);
+		numReported += rpmcore_process(rpm, stereo.data() + 2 * pos + 1, n, 2);
+		std::vector<rpmcore_pulse> polled = pollAll(rpm);
+		actual.insert(actual.end(), polled.begin(), polled.end());
+	}
+	BOOST_CHECK_EQUAL(signal.size(), rpmcore_get_num_samples(rpm));
+	BOOST_CHECK_EQUAL(0, rpmcore_get_num_lost(rpm));
+
+	BOOST_REQUIRE(expected.size() > 50);
+	BOOST_REQUIRE_EQUAL(expected.size(), actual.size());
+	BOOST_CHECK_EQUAL(expected.size(), numReported);
+	for (size_t i = 0; i < expected.size(); i++)
+	{
+		BOOST_CHECK_EQUAL(expected[i].sampleIndex, actual[i].sample_index);
+		BOOST_CHECK_EQUAL(expected[i].rpm, actual[i].rpm);
+		BOOST_CHECK_EQUAL(expected[i].filteredRpm, actual[i].filtered_rpm);
+		BOOST_CHECK_EQUAL(expected[i].signalMax, actual[i].signal_max);
+	}
+
+	rpmcore_pulse latest;
+	BOOST_CHECK_EQUAL(1, rpmcore_get_latest(rpm, &latest));
+	BOOST_CHECK_EQUAL(expected.back().sampleIndex, latest.sample_index);
+	rpmcore_destroy(rpm);
+}
+
+
+BOOST_AUTO_TEST_CASE(queueOverflowKeepsNewest)
+{
+	std::vector<int16_t> signal = makeSignal(6000, 1);
+
+	rpmcore_config config;
+	rpmcore_config_init(&config);
+	config.event_queue_size = 8;
+	rpmcore* rpm = rpmcore_create(&config);
+	BOOST_REQUIRE(rpm);
+	rpmcore_pulse latest;
+	BOOST_CHECK_EQUAL(0, rpmcore_get_latest(rpm, &latest));
+
+	size_t numPulses = rpmcore_process(rpm, signal.data(), signal.size(), 1);
+	std::vector<rpmcore_pulse> pulses = pollAll(rpm);
+
+	BOOST_REQUIRE(numPulses > 8);
+	BOOST_CHECK_EQUAL(8, pulses.size());
+	BOOST_CHECK_EQUAL(numPulses - 8, rpmcore_get_num_lost(rpm));
+	BOOST_CHECK_EQUAL(1, rpmcore_get_latest(rpm, &latest));
+	BOOST_CHECK_EQUAL(latest.sample_index, pulses.back().sample_index);
+	rpmcore_destroy(rpm);
+}
+
+
+BOOST_AUTO_TEST_CASE(decimation)
+{
+	// Edges are still timed at the full rate
+	const int rate = 192000;
+	std::vector<int16_t> signal = makeSignal(12000, 1, rate);
+	std::vector<rpmcore_pulse> pulses[2];
+	for (int k = 0; k < 2; k++)
+	{
+		rpmcore_config config;
+		rpmcore_config_init(&config);
+		config.sample_rate = rate;
+		config.threshold_percentage = 40;
+		rpmcore* rpm = rpmcore_create(&config);
+		BOOST_REQUIRE(rpm);
+		rpmcore_set_pulse_callback(rpm, onPulse, &pulses[k]);
+		// Settings made before the decimation are kept
+		BOOST_CHECK_EQUAL(0, rpmcore_set_crossing_interpolation(rpm, RPMCORE_INTERPOLATION_NONE));
+		BOOST_CHECK_EQUAL(0, rpmcore_set_decimation(rpm, k ? 8 : 1));
+		rpmcore_process(rpm, signal.data(), signal.size(), 1);
+		rpmcore_destroy(rpm);
+	}
+	// The same, once the signal range is known
+	BOOST_REQUIRE_GT(pulses[0].size(), 150u);
+	BOOST_REQUIRE_GE(pulses[1].size(), 150u);
+	for (size_t i = 1; i <= 150; i++)
+	{
+		const rpmcore_pulse& a = pulses[0][pulses[0].size() - i];
+		const rpmcore_pulse& b = pulses[1][pulses[1].size() - i];
+		BOOST_CHECK_EQUAL(a.sample_index, b.sample_index);
+		BOOST_CHECK_EQUAL(a.period_in_samples, b.period_in_samples);
+		BOOST_CHECK_EQUAL(40, b.threshold_percentage);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(callbackAndIndependentInstances)
+{
+	std::vector<int16_t> slow = makeSignal(1200, 2);
+	std::vector<int16_t> fast = makeSignal(4800, 2);
+
+	rpmcore_config config;
+	rpmcore_config_init(&config);
+	rpmcore* a = rpmcore_create(&config);
+	config.divisor = 2;
+	rpmcore* b = rpmcore_create(&config);
+	BOOST_REQUIRE(a && b);
+
+	std::vector<rpmcore_pulse> pulsesA;
+	std::vector<rpmcore_pulse> pulsesB;
+	rpmcore_set_pulse_callback(a, onPulse, &pulsesA);
+	rpmcore_set_pulse_callback(b, onPulse, &pulsesB);
+
+	for (size_t pos = 0; pos < slow.size(); pos += 1024)
+	{
+		size_t n = std::min<size_t>(1024, slow.size() - pos);
+		rpmcore_process(a, slow.data() + pos, n, 1);
+		rpmcore_process(b, fast.data() + pos, n, 1);
+	}
+	BOOST_CHECK(pollAll(a).empty());
+
+	BOOST_REQUIRE(!pulsesA.empty() && !pulsesB.empty());
+	BOOST_CHECK_CLOSE(1200.0, pulsesA.back().filtered_rpm, 0.5);
+	BOOST_CHECK_CLOSE(2400.0, pulsesB.back().filtered_rpm, 0.5);
+
+	rpmcore_destroy(a);
+	rpmcore_destroy(b);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END()